@@ -0,0 +1,21 @@
+# - Try to find BLAS
+# Variables used by this module:
+#  BLAS_ROOT_DIR     - BLAS root directory
+# Variables defined by this module:
+#  BLAS_FOUND        - system has BLAS
+#  BLAS_LIBRARY      - the BLAS library (cached)
+#  BLAS_LIBRARIES    - the BLAS libraries
+
+if(NOT BLAS_FOUND)
+
+  find_library(BLAS_LIBRARY NAMES openblas blas
+    HINTS ${BLAS_ROOT_DIR} PATH_SUFFIXES lib)
+  mark_as_advanced(BLAS_INCLUDE_DIR BLAS_LIBRARY)
+
+  include(FindPackageHandleStandardArgs)
+  find_package_handle_standard_args(BLAS DEFAULT_MSG
+    BLAS_LIBRARY)
+
+  set(BLAS_LIBRARIES ${BLAS_LIBRARY})
+
+endif(NOT BLAS_FOUND)
@@ -6,6 +6,7 @@
 # It sets the following variables:
 #   FFTW_FOUND               ... true if fftw is found on the system
 #   FFTW_LIBRARIES           ... full path to fftw library
+#   FFTW_THREADS_FOUND       ... true if the multi-threaded fftw library is found
 #   FFTW_INCLUDES            ... fftw include directory
 #
 # The following variables will be checked by the function
@@ -65,6 +66,14 @@ if( FFTW_ROOT )
     NO_DEFAULT_PATH
   )
 
+  find_library(
+    FFTW_THREADS_LIB
+    NAMES "fftw3_threads"
+    PATHS ${FFTW_ROOT}
+    PATH_SUFFIXES "lib" "lib64"
+    NO_DEFAULT_PATH
+  )
+
   #find includes
   find_path(
     FFTW_INCLUDES
@@ -95,6 +104,12 @@ else()
     PATHS ${PKG_FFTW_LIBRARY_DIRS} ${LIB_INSTALL_DIR}
   )
 
+  find_library(
+    FFTW_THREADS_LIB
+    NAMES "fftw3_threads"
+    PATHS ${PKG_FFTW_LIBRARY_DIRS} ${LIB_INSTALL_DIR}
+  )
+
   find_path(
     FFTW_INCLUDES
     NAMES "fftw3.h"
@@ -109,11 +124,18 @@ if(FFTWL_LIB)
   set(FFTW_LIBRARIES ${FFTW_LIBRARIES} ${FFTWL_LIB})
 endif()
 
+if(FFTW_THREADS_LIB)
+  set(FFTW_LIBRARIES ${FFTW_THREADS_LIB} ${FFTW_LIBRARIES})
+  set(FFTW_THREADS_FOUND TRUE)
+else()
+  set(FFTW_THREADS_FOUND FALSE)
+endif()
+
 set( CMAKE_FIND_LIBRARY_SUFFIXES ${CMAKE_FIND_LIBRARY_SUFFIXES_SAV} )
 
 include(FindPackageHandleStandardArgs)
 find_package_handle_standard_args(FFTW DEFAULT_MSG
                                   FFTW_INCLUDES FFTW_LIBRARIES)
 
-mark_as_advanced(FFTW_INCLUDES FFTW_LIBRARIES FFTW_LIB FFTWF_LIB FFTWL_LIB)
+mark_as_advanced(FFTW_INCLUDES FFTW_LIBRARIES FFTW_LIB FFTWF_LIB FFTWL_LIB FFTW_THREADS_LIB)
 
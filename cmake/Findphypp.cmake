@@ -102,6 +102,9 @@ if(NOT PHYPP_FOUND)
     if (NOT NO_LAPACK)
         find_package(LAPACK)
     endif()
+    if (NOT NO_BLAS)
+        find_package(BLAS)
+    endif()
     if (NOT NO_GSL AND NOT NO_LAPACK)
         find_package(GSL)
     endif()
@@ -121,6 +124,13 @@ if(NOT PHYPP_FOUND)
         set(PHYPP_LIBRARIES ${PHYPP_LIBRARIES} ${LAPACK_LIBRARIES})
     endif()
 
+    # handle conditional BLAS support
+    if (NOT BLAS_FOUND OR NO_BLAS)
+        add_definitions(-DNO_BLAS)
+    else()
+        set(PHYPP_LIBRARIES ${PHYPP_LIBRARIES} ${BLAS_LIBRARIES})
+    endif()
+
     # handle conditional GSL support
     if (NOT GSL_FOUND OR NO_GSL OR NO_LAPACK OR NOT LAPACK_FOUND)
         add_definitions(-DNO_GSL)
@@ -143,6 +153,9 @@ if(NOT PHYPP_FOUND)
     else()
         set(PHYPP_INCLUDE_DIRS ${PHYPP_INCLUDE_DIRS} ${FFTW_INCLUDES})
         set(PHYPP_LIBRARIES ${PHYPP_LIBRARIES} ${FFTW_LIBRARIES})
+        if (NOT FFTW_THREADS_FOUND)
+            add_definitions(-DNO_FFTW_THREADS)
+        endif()
     endif()
 
     # handle conditional LibUnwind support
@@ -163,6 +176,11 @@ if(NOT PHYPP_FOUND)
         set(PHYPP_LIBRARIES ${PHYPP_LIBRARIES} ${LIBDWARF_LIBRARIES} ${LIBELF_LIBRARIES})
     endif()
 
+    # handle conditional SIMD support
+    if (NO_SIMD)
+        add_definitions(-DNO_SIMD)
+    endif()
+
     # handle conditional Google perftools support
     if (TCMALLOC_LIBRARY)
         set(PHYPP_LIBRARIES ${PHYPP_LIBRARIES} ${TCMALLOC_LIBRARY})
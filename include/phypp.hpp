@@ -3,6 +3,7 @@
 #include "phypp/core/range.hpp"
 #include "phypp/core/print.hpp"
 #include "phypp/core/error.hpp"
+#include "phypp/core/parallel.hpp"
 
 // New entry point of the program, necessary to get stack trace in case of errors
 #include "phypp/core/main.hpp"
@@ -30,6 +31,7 @@
 #include "phypp/math/histogram.hpp"
 #include "phypp/math/random.hpp"
 #include "phypp/math/matrix.hpp"
+#include "phypp/math/sparse.hpp"
 #include "phypp/math/linfit.hpp"
 #include "phypp/math/convex_hull.hpp"
 #include "phypp/math/complex.hpp"
@@ -2,6 +2,9 @@
 #define PHYPP_ASTRO_ASTRO_HPP
 
 #include <map>
+#include <memory>
+#include <numeric>
+#include <tuple>
 #include "phypp/core/vec.hpp"
 #include "phypp/core/error.hpp"
 #include "phypp/utility/thread.hpp"
@@ -11,6 +14,7 @@
 #include "phypp/math/histogram.hpp"
 #include "phypp/math/reduce.hpp"
 #include "phypp/math/random.hpp"
+#include "phypp/math/simd.hpp"
 #include "phypp/io/fits.hpp"
 #include "phypp/io/ascii.hpp"
 #include "phypp/astro/image.hpp"
@@ -459,7 +463,8 @@ namespace astro {
     // Absolute luminosity [Lsun] to absolute magnitude [AB] using rest-frame wavelength
     // 'lam' [um]
     template<typename T, typename U>
-    auto lsun2mag(const T& lam, const U& lum, double zp = 23.9) -> decltype(1.0*lam*lum) {
+    auto lsun2mag(const T& lam, const U& lum, double zp = 23.9)
+        -> meta::concrete_t<decltype(1.0*lam*lum)> {
         const double Mpc = 3.0856e22; // [m/Mpc]
         const double Lsol = 3.839e26; // [W/Lsol]
         const double uJy = 1.0e32;    // [uJy/(W.m-2.Hz-1)]
@@ -472,7 +477,8 @@ namespace astro {
     // Absolute magnitude [AB] to absolute luminosity [Lsun] using rest-frame wavelength
     // 'lam' [um]
     template<typename T, typename U>
-    auto mag2lsun(const T& lam, const T& mag, double zp = 23.9) -> decltype(e10(mag)/lam) {
+    auto mag2lsun(const T& lam, const T& mag, double zp = 23.9)
+        -> meta::concrete_t<decltype(e10(mag)/lam)> {
         const double Mpc = 3.0856e22; // [m/Mpc]
         const double Lsol = 3.839e26; // [W/Lsol]
         const double uJy = 1.0e32;    // [uJy/(W.m-2.Hz-1)]
@@ -484,7 +490,8 @@ namespace astro {
 
     // Flux in uJy to AB magnitude
     template<typename T>
-    auto uJy2mag(const T& x, double zp = 23.9) -> decltype(-2.5*log10(x) + zp) {
+    auto uJy2mag(const T& x, double zp = 23.9)
+        -> meta::concrete_t<decltype(-2.5*log10(x) + zp)> {
         return -2.5*log10(x) + zp;
     }
 
@@ -496,7 +503,7 @@ namespace astro {
 
     // Flux in uJy to erg/s/cm2/A (cgs), lambda in [um]
     template<typename T, typename U>
-    auto uJy2cgs(const T& lam, const U& flx) -> decltype(1.0*lam*flx) {
+    auto uJy2cgs(const T& lam, const U& flx) -> meta::concrete_t<decltype(1.0*lam*flx)> {
         const double toerg = 1.0e-29;   // 1 uJy in erg/s/cm2/Hz
         const double c = 2.9979e8;      // speed of light in m/s
         const double tometer = 1e-6;    // 1 um in meter
@@ -507,7 +514,7 @@ namespace astro {
 
     // Flux in erg/s/cm2/A (cgs) to uJy, lambda in [A]
     template<typename T, typename U>
-    auto cgs2uJy(const T& lam, const U& flx) -> decltype(1.0*lam*flx) {
+    auto cgs2uJy(const T& lam, const U& flx) -> meta::concrete_t<decltype(1.0*lam*flx)> {
         const double toerg = 1.0e-29; // 1 uJy in erg/s/cm2/Hz
         const double c = 2.9979e8;    // speed of light in m/s
         const double tometer = 1e-10; // 1 Angstrom in meter
@@ -529,8 +536,8 @@ namespace astro {
         double area = 0;
 
         auto d2r = dpi/180.0;
-        auto hx = hull.x*d2r;
-        auto hy = hull.y*d2r;
+        vec1d hx = hull.x*d2r;
+        vec1d hy = hull.y*d2r;
         for (uint_t i : range(2, hull.size())) {
             double e1 = angdistr(hx.safe[0],   hy.safe[0],   hx.safe[i-1], hy.safe[i-1]);
             double e2 = angdistr(hx.safe[i-1], hy.safe[i-1], hx.safe[i],   hy.safe[i]);
@@ -598,8 +605,8 @@ namespace astro {
 
             // Compute the average distance between sources
             const double d2r = dpi/180.0;
-            auto dra  = ra[ids]*d2r;
-            auto ddec = dec[ids]*d2r;
+            vec1d dra  = ra[ids]*d2r;
+            vec1d ddec = dec[ids]*d2r;
             auto dcdec = cos(ddec);
 
             const uint_t n = ra.size();
@@ -661,43 +668,431 @@ namespace astro {
         return field_area_h2d(ra, dec);
     }
 
+}
+
+namespace impl {
+    namespace astro_impl {
+        // Tree of positions on the sphere, used for pair counting and cross matching.
+        // Positions are stored as 3D unit vectors, for which the euclidean (chord) distance
+        // is a monotonic function of the angular distance. The tree is a kd-tree: each node
+        // holds the bounding box of its points, and is split in two along the longest axis of
+        // this box. Points are reordered so that each node covers a contiguous range, and
+        // 'id' gives the original index of each point.
+        struct sky_tree {
+            struct node {
+                double lo[3], hi[3];
+                uint_t i0, i1;               // range of points in this node
+                uint_t left = npos, right = npos;
+
+                uint_t size() const { return i1 - i0; }
+                bool leaf() const { return left == npos; }
+            };
+
+            static const uint_t leaf_size = 32;
+
+            std::vector<double> x, y, z;
+            std::vector<uint_t> id;
+            std::vector<node> nodes;
+
+            sky_tree() = default;
+
+            template<typename TR, typename TD>
+            sky_tree(const TR& ra, const TD& dec, const vec1u& ids) {
+                const double d2r = dpi/180.0;
+                x.resize(ids.size()); y.resize(ids.size()); z.resize(ids.size());
+                id = ids.data;
+                for (uint_t i : range(ids)) {
+                    double tra = d2r*ra.safe[ids.safe[i]], tdec = d2r*dec.safe[ids.safe[i]];
+                    x[i] = cos(tdec)*cos(tra);
+                    y[i] = cos(tdec)*sin(tra);
+                    z[i] = sin(tdec);
+                }
+
+                if (!ids.empty()) {
+                    nodes.reserve(2*(ids.size()/leaf_size + 1));
+                    build_(0, ids.size());
+                }
+            }
+
+            uint_t build_(uint_t i0, uint_t i1) {
+                uint_t inode = nodes.size();
+                nodes.emplace_back();
+                node& n = nodes.back();
+                n.i0 = i0; n.i1 = i1;
+
+                std::vector<double>* c[3] = {&x, &y, &z};
+                for (uint_t k : range(3)) {
+                    auto mm = std::minmax_element(c[k]->begin() + i0, c[k]->begin() + i1);
+                    n.lo[k] = *mm.first;
+                    n.hi[k] = *mm.second;
+                }
+
+                if (i1 - i0 <= leaf_size) return inode;
+
+                uint_t axis = 0;
+                for (uint_t k : range(1, 3)) {
+                    if (n.hi[k] - n.lo[k] > n.hi[axis] - n.lo[axis]) axis = k;
+                }
+
+                // Partition the points around the median along this axis
+                std::vector<uint_t> p(i1 - i0);
+                std::iota(p.begin(), p.end(), i0);
+                uint_t im = (i1 - i0)/2;
+                const std::vector<double>& v = *c[axis];
+                std::nth_element(p.begin(), p.begin() + im, p.end(), [&v](uint_t i, uint_t j) {
+                    return v[i] < v[j];
+                });
+
+                for (auto* t : c) {
+                    std::vector<double> tmp(i1 - i0);
+                    for (uint_t i : range(p)) {
+                        tmp[i] = (*t)[p[i]];
+                    }
+
+                    std::copy(tmp.begin(), tmp.end(), t->begin() + i0);
+                }
+
+                std::vector<uint_t> tid(i1 - i0);
+                for (uint_t i : range(p)) {
+                    tid[i] = id[p[i]];
+                }
+
+                std::copy(tid.begin(), tid.end(), id.begin() + i0);
+
+                // Note: 'n' may be invalidated by the recursive calls
+                uint_t l = build_(i0, i0 + im);
+                uint_t r = build_(i0 + im, i1);
+                nodes[inode].left = l;
+                nodes[inode].right = r;
+
+                return inode;
+            }
+        };
+
+        // Angular bins converted into intervals of squared chord distance
+        struct pair_bins : impl::bin_impl::bin_finder<double> {
+            template<typename TB>
+            static vec2d chord2_bins_(const vec<2,TB>& bins) {
+                phypp_check(bins.dims[0] == 2, "can only be called with a bin vector (expected "
+                    "dims=[2,...], got dims=[", bins.dims, "])");
+
+                const double a2r = dpi/180.0/3600.0;
+                auto chord2 = [a2r](double d) {
+                    d = std::min(std::max(d*a2r, 0.0), dpi);
+                    double c = 2.0*sin(0.5*d);
+                    return c*c;
+                };
+
+                vec2d cb(2, bins.dims[1]);
+                for (uint_t b : range(bins.dims[1])) {
+                    phypp_check(bins.safe(0,b) <= bins.safe(1,b), "bins must have increasing "
+                        "bounds (got [", bins.safe(0,b), ", ", bins.safe(1,b), "] for bin ", b, ")");
+                    phypp_check(b == 0 || bins.safe(0,b) >= bins.safe(1,b-1), "bins must be sorted "
+                        "and must not overlap");
+
+                    cb.safe(0,b) = chord2(bins.safe(0,b));
+                    cb.safe(1,b) = chord2(bins.safe(1,b));
+                }
+
+                return cb;
+            }
+
+            template<typename TB>
+            explicit pair_bins(const vec<2,TB>& bins) :
+                impl::bin_impl::bin_finder<double>(chord2_bins_(bins)) {}
+        };
+
+        // Count the pairs between two nodes of two trees. If 'same' is true, the two nodes
+        // are the same, and each pair is counted once.
+        struct pair_counter {
+            const sky_tree& t1;
+            const sky_tree& t2;
+            const pair_bins& bins;
+
+            // Squared minimum and maximum distances between the bounding boxes of two nodes
+            void bounds_(const sky_tree::node& a, const sky_tree::node& b,
+                double& dmin, double& dmax) const {
+                dmin = 0.0; dmax = 0.0;
+                for (uint_t k : range(3)) {
+                    double gap = std::max(0.0, std::max(a.lo[k] - b.hi[k], b.lo[k] - a.hi[k]));
+                    double ext = std::max(a.hi[k] - b.lo[k], b.hi[k] - a.lo[k]);
+                    dmin += gap*gap;
+                    dmax += ext*ext;
+                }
+            }
+
+            // Returns true if all the pairs of these nodes are in the same interval, in which
+            // case they are directly added to the counts
+            bool try_bulk_(const sky_tree::node& a, const sky_tree::node& b, bool same,
+                uint_t* counts) const {
+                double dmin, dmax;
+                bounds_(a, b, dmin, dmax);
+                uint_t k = bins.interval(dmin);
+                if (k != bins.interval(dmax)) return false;
+
+                uint_t bin = bins.bin_of(k);
+                if (bin != npos) {
+                    counts[bin] += (same ? a.size()*(a.size() - 1)/2 : a.size()*b.size());
+                }
+
+                return true;
+            }
+
+            void leaf_(const sky_tree::node& a, const sky_tree::node& b, bool same,
+                uint_t* counts) const {
+                const double dlast = bins.edges.back();
+                for (uint_t i : range(a.i0, a.i1))
+                for (uint_t j : range(same ? i+1 : b.i0, b.i1)) {
+                    double dx = t1.x[i] - t2.x[j];
+                    double dy = t1.y[i] - t2.y[j];
+                    double dz = t1.z[i] - t2.z[j];
+                    double d2 = dx*dx + dy*dy + dz*dz;
+                    if (d2 >= dlast) continue;
+
+                    uint_t bin = bins.bin_of(bins.interval(d2));
+                    if (bin != npos) ++counts[bin];
+                }
+            }
+
+            // Child node pairs to visit, or nothing if the pairs were counted already
+            void split_(uint_t ia, uint_t ib, bool same, uint_t* counts,
+                std::vector<std::tuple<uint_t,uint_t,bool>>& next) const {
+                const sky_tree::node& a = t1.nodes[ia];
+                const sky_tree::node& b = t2.nodes[ib];
+                if (try_bulk_(a, b, same, counts)) return;
+
+                if (same) {
+                    if (a.leaf()) {
+                        leaf_(a, b, true, counts);
+                    } else {
+                        next.emplace_back(a.left, a.left, true);
+                        next.emplace_back(a.left, a.right, false);
+                        next.emplace_back(a.right, a.right, true);
+                    }
+                } else if (a.leaf() && b.leaf()) {
+                    leaf_(a, b, false, counts);
+                } else if (b.leaf() || (!a.leaf() && a.size() >= b.size())) {
+                    next.emplace_back(a.left, ib, false);
+                    next.emplace_back(a.right, ib, false);
+                } else {
+                    next.emplace_back(ia, b.left, false);
+                    next.emplace_back(ia, b.right, false);
+                }
+            }
+
+            void count(uint_t ia, uint_t ib, bool same, uint_t* counts) const {
+                std::vector<std::tuple<uint_t,uint_t,bool>> stack;
+                stack.emplace_back(ia, ib, same);
+                while (!stack.empty()) {
+                    auto p = stack.back();
+                    stack.pop_back();
+                    split_(std::get<0>(p), std::get<1>(p), std::get<2>(p), counts, stack);
+                }
+            }
+        };
+
+        // Build one tree per region
+        template<typename TR, typename TD>
+        std::vector<std::unique_ptr<sky_tree>> make_sky_trees(const TR& ra, const TD& dec,
+            const vec1u& reg, uint_t nreg) {
+
+            std::vector<vec1u> ids(nreg);
+            for (uint_t i : range(reg)) {
+                ids[reg.safe[i]].push_back(i);
+            }
+
+            std::vector<std::unique_ptr<sky_tree>> trees(nreg);
+            parallel::run(nreg, [&](uint_t r) {
+                trees[r].reset(new sky_tree(ra, dec, ids[r]));
+            });
+
+            return trees;
+        }
+
+        // Count pairs between all the regions of two sets of positions. The regions of each
+        // position are given in 'reg1' and 'reg2'. If 'self' is true, the two sets are the
+        // same and each pair is counted once, with the first region <= the second region.
+        // Returns counts(r1,r2,bin). The work is spread over the thread pool.
+        template<typename TR1, typename TD1, typename TR2, typename TD2, typename TB>
+        vec3u pair_count_regions(const TR1& ra1, const TD1& dec1, const vec1u& reg1,
+            const TR2& ra2, const TD2& dec2, const vec1u& reg2, uint_t nreg,
+            const vec<2,TB>& tbins, bool self) {
+
+            pair_bins bins(tbins);
+            vec3u counts(nreg, nreg, bins.nbin);
+            if (bins.edges.empty()) return counts;
+
+            auto trees1 = make_sky_trees(ra1, dec1, reg1, nreg);
+            decltype(trees1) trees2;
+            if (!self) trees2 = make_sky_trees(ra2, dec2, reg2, nreg);
+            const auto& t2 = (self ? trees1 : trees2);
+
+            // Expand the top of the trees until there are enough node pairs to keep
+            // all the threads busy, then count each node pair in a separate job
+            struct job_t {
+                uint_t r1, r2, n1, n2;
+                bool same;
+            };
+
+            std::vector<job_t> jobs;
+            for (uint_t r1 : range(nreg))
+            for (uint_t r2 : range(self ? r1 : 0, nreg)) {
+                if (trees1[r1]->nodes.empty() || t2[r2]->nodes.empty()) continue;
+                jobs.push_back({r1, r2, 0, 0, self && r1 == r2});
+            }
+
+            const uint_t njob = 16*parallel::threads();
+            std::vector<std::tuple<uint_t,uint_t,bool>> next;
+            while (jobs.size() < njob) {
+                std::vector<job_t> tjobs;
+                bool split = false;
+                for (auto& j : jobs) {
+                    pair_counter c{*trees1[j.r1], *t2[j.r2], bins};
+                    const auto& a = c.t1.nodes[j.n1];
+                    const auto& b = c.t2.nodes[j.n2];
+                    if (a.leaf() && b.leaf()) {
+                        tjobs.push_back(j);
+                        continue;
+                    }
+
+                    next.clear();
+                    c.split_(j.n1, j.n2, j.same, &counts.safe(j.r1, j.r2, 0), next);
+                    for (auto& n : next) {
+                        tjobs.push_back({j.r1, j.r2, std::get<0>(n), std::get<1>(n), std::get<2>(n)});
+                    }
+
+                    split = true;
+                }
+
+                std::swap(jobs, tjobs);
+                if (!split) break;
+            }
+
+            std::vector<vec1u> jcounts(jobs.size());
+            parallel::run(jobs.size(), [&](uint_t i) {
+                const job_t& j = jobs[i];
+                jcounts[i].resize(bins.nbin);
+                pair_counter c{*trees1[j.r1], *t2[j.r2], bins};
+                c.count(j.n1, j.n2, j.same, jcounts[i].data.data());
+            });
+
+            for (uint_t i : range(jobs)) {
+                counts(jobs[i].r1, jobs[i].r2, _) += jcounts[i];
+            }
+
+            return counts;
+        }
+
+        template<typename TR, typename TD>
+        void check_positions(const TR& ra, const TD& dec, const vec1u& reg,
+            const std::string& what) {
+            phypp_check(ra.dims == dec.dims, "RA and Dec dimensions do not match for the ",
+                what, " (", ra.dims, " vs ", dec.dims, ")");
+            phypp_check(reg.size() == ra.size(), "region and RA dimensions do not match for the ",
+                what, " (", reg.dims, " vs ", ra.dims, ")");
+        }
+    }
+}
+
+namespace astro {
+    // Count the pairs of positions whose angular separation (in arcseconds) falls in each
+    // bin. Each pair is counted once, and a position is not paired with itself.
+    // Coordinates are assumed to be given in degrees. The pairs are counted with a tree,
+    // and the work is spread over the thread pool (see parallel::set_threads()).
+    template<std::size_t N, typename TR, typename TD, typename TB>
+    vec1u pair_count(const vec<N,TR>& ra, const vec<N,TD>& dec, const vec<2,TB>& bins) {
+        phypp_check(ra.dims == dec.dims, "RA and Dec dimensions do not match (",
+            ra.dims, " vs ", dec.dims, ")");
+
+        vec1u reg(ra.size());
+        return flatten(impl::astro_impl::pair_count_regions(
+            ra, dec, reg, ra, dec, reg, 1, bins, true));
+    }
+
+    // Count the pairs between two sets of positions whose angular separation (in arcseconds)
+    // falls in each bin.
+    template<std::size_t N1, typename TR1, typename TD1,
+        std::size_t N2, typename TR2, typename TD2, typename TB>
+    vec1u pair_count(const vec<N1,TR1>& ra1, const vec<N1,TD1>& dec1,
+        const vec<N2,TR2>& ra2, const vec<N2,TD2>& dec2, const vec<2,TB>& bins) {
+        phypp_check(ra1.dims == dec1.dims, "RA and Dec dimensions do not match for the "
+            "first set (", ra1.dims, " vs ", dec1.dims, ")");
+        phypp_check(ra2.dims == dec2.dims, "RA and Dec dimensions do not match for the "
+            "second set (", ra2.dims, " vs ", dec2.dims, ")");
+
+        vec1u reg1(ra1.size()), reg2(ra2.size());
+        return flatten(impl::astro_impl::pair_count_regions(
+            ra1, dec1, reg1, ra2, dec2, reg2, 1, bins, false));
+    }
+
     // Compute 2 point angular correlation function of a data set with positions 'ra' and 'dec'
     // against a set of random positions uniformly drawn in the same region of space 'rra' and
     // 'rdec'. For good results, there must be at least as many random positions as there are
     // input positions, and results get better the more random positions are given.
     // Compute the correlation in given bins of angular separation (in arcseconds).
-    // Uses the Landy-Szalay estimator, computed with a brute force approach.
+    // Uses the Landy-Szalay estimator, with pairs counted using pair_count().
+    // The jackknife version splits the positions in sub-regions, given by the region index of
+    // each input position 'reg' and random position 'rreg'. It returns in 'wjk(k,_)' the
+    // correlation function computed without the positions of region 'k'. The uncertainty on
+    // the correlation function is then sqrt((K-1)/K*total(sqr(wjk(k,_) - <wjk>))) for K
+    // regions.
     template<std::size_t N1, typename TR1, typename TD1,
         std::size_t N2, typename TR2, typename TD2, typename TB>
     vec1d angcorrel(const vec<N1,TR1>& ra, const vec<N1,TD1>& dec,
-        const vec<N2,TR2>& rra, const vec<N2,TD2>& rdec, const vec<2,TB>& bins) {
-        phypp_check(ra.dims == dec.dims, "RA and Dec dimensions do not match for the "
-            "input catalog (", ra.dims, " vs ", dec.dims, ")");
-        phypp_check(rra.dims == rdec.dims, "RA and Dec dimensions do not match for the "
-            "random catalog (", rra.dims, " vs ", rdec.dims, ")");
+        const vec<N2,TR2>& rra, const vec<N2,TD2>& rdec, const vec<2,TB>& bins,
+        const vec1u& reg, const vec1u& rreg, vec2d& wjk) {
+        impl::astro_impl::check_positions(ra, dec, reg, "input catalog");
+        impl::astro_impl::check_positions(rra, rdec, rreg, "random catalog");
 
         uint_t nbin = bins.dims[1];
+        uint_t nreg = 1 + std::max(reg.empty() ? 0 : max(reg), rreg.empty() ? 0 : max(rreg));
+
+        vec3u dd = impl::astro_impl::pair_count_regions(ra, dec, reg, ra, dec, reg,
+            nreg, bins, true);
+        vec3u dr = impl::astro_impl::pair_count_regions(ra, dec, reg, rra, rdec, rreg,
+            nreg, bins, false);
+        vec3u rr = impl::astro_impl::pair_count_regions(rra, rdec, rreg, rra, rdec, rreg,
+            nreg, bins, true);
+
+        vec1u nd = histogram(reg, make_bins(-0.5, nreg-0.5, nreg));
+        vec1u nr = histogram(rreg, make_bins(-0.5, nreg-0.5, nreg));
+
+        // Landy-Szalay estimator, with ordered pairs (i.e., twice the number of DD and RR pairs)
+        auto estimator = [](const vec1d& tdd, const vec1d& tdr, const vec1d& trr,
+            double tnd, double tnr) {
+            double norm1 = tnr/tnd;
+            double norm2 = norm1*((tnr - 1.0)/(tnd - 1.0));
+            return vec1d(((2*tdd*norm2 - tdr*norm1) + (2*trr - tdr*norm1))/(2*trr));
+        };
 
-        vec1d dd(nbin);
-        vec1d dr(nbin);
-        vec1d rr(nbin);
+        vec1d tdd = partial_total(0, partial_total(0, dd));
+        vec1d tdr = partial_total(0, partial_total(0, dr));
+        vec1d trr = partial_total(0, partial_total(0, rr));
+
+        wjk.resize(nreg, nbin);
+        for (uint_t k : range(nreg)) {
+            // Remove all the pairs involving region k
+            vec1d kdd = tdd, kdr = tdr, krr = trr;
+            for (uint_t r : range(nreg)) {
+                kdd -= dd(std::min(k,r),std::max(k,r),_);
+                krr -= rr(std::min(k,r),std::max(k,r),_);
+                kdr -= dr(k,r,_) + dr(r,k,_);
+            }
 
-        for (uint_t i : range(ra)) {
-            vec1d d = angdist(ra, dec, ra[i], dec[i]);
-            dd += histogram(d, bins);
+            kdr += dr(k,k,_);
 
-            d = angdist(rra, rdec, ra[i], dec[i]);
-            dr += histogram(d, bins);
+            wjk(k,_) = estimator(kdd, kdr, krr, ra.size() - nd[k], rra.size() - nr[k]);
         }
 
-        for (uint_t i : range(rra)) {
-            vec1d d = angdist(rra, rdec, rra[i], rdec[i]);
-            rr += histogram(d, bins);
-        }
+        return estimator(tdd, tdr, trr, ra.size(), rra.size());
+    }
 
-        double norm1 = rra.size()/double(ra.size());
-        double norm2 = norm1*((rra.size() - 1.0)/(ra.size() - 1.0));
-        return ((dd*norm2 - dr*norm1) + (rr - dr*norm1))/rr;
+    template<std::size_t N1, typename TR1, typename TD1,
+        std::size_t N2, typename TR2, typename TD2, typename TB>
+    vec1d angcorrel(const vec<N1,TR1>& ra, const vec<N1,TD1>& dec,
+        const vec<N2,TR2>& rra, const vec<N2,TD2>& rdec, const vec<2,TB>& bins) {
+        vec2d wjk;
+        return angcorrel(ra, dec, rra, rdec, bins, vec1u(ra.size()), vec1u(rra.size()), wjk);
     }
 
     struct randpos_status {
@@ -1292,7 +1687,9 @@ namespace astro {
         vec1d nlam; nlam.reserve(nflam + bnd[1] - bnd[0] + 1);
         vec1d nrs;  nrs.reserve( nflam + bnd[1] - bnd[0] + 1);
 
-        uint_t j = bnd[0];
+        // Note: bnd[0] is the last SED point before the start of the filter, so each filter
+        // point is interpolated from the SED values at j-1 and j, with lam[j-1] <= x < lam[j]
+        uint_t j = bnd[0] + 1;
         for (uint_t i : range(filter.lam)) {
             nlam.push_back(filter.lam.safe[i]);
             nrs.push_back(filter.res.safe[i]*interpolate(
@@ -1320,12 +1717,211 @@ namespace astro {
         r.reserve(nsed);
 
         for (uint_t s : range(nsed)) {
-            r.push_back(sed2flux(filter, lam.safe(s,_).concretise(), sed.safe(s,_).concretise()));
+            r.push_back(sed2flux(filter, lam.safe(s,_), sed.safe(s,_)));
         }
 
         return r;
     }
 
+    // Precomputed convolution of SEDs sampled on a common wavelength grid with a set of
+    // filters, optionally moved to the observer frame at a grid of redshifts. Since sed2flux()
+    // is linear in the SED, the flux in each filter (and at each redshift) is a weighted sum of
+    // the SED over a contiguous range of wavelengths, so the weights only need to be computed
+    // once and the fluxes of a whole library are obtained with a sparse matrix product.
+    struct filter_operator {
+        vec1d lam;   // wavelength grid of the SEDs (rest-frame if 'z' is not empty) [um]
+        vec1d z, d;  // redshifts and luminosity distances [Mpc] (empty: observer frame)
+        uint_t nfilter = 0;
+
+        // One row per redshift and filter (in this order)
+        vec1u first;  // first wavelength index of each row (npos: filter not covered)
+        vec1u offset; // position of each row in 'weight' (one more element than rows)
+        vec1d weight; // weights of all the rows, concatenated
+
+        uint_t nz() const {
+            return z.empty() ? 1 : z.size();
+        }
+    };
+}
+
+namespace impl {
+    namespace astro_impl {
+        // Weights of sed2flux() for the SED sampled on the grid 'lam', with each SED value
+        // multiplied by 'scale'. Returns the first wavelength index, or npos if the filter is
+        // not covered by the grid.
+        template<typename TL>
+        uint_t filter_weights_(const astro::filter_t& filter, const vec<1,TL>& lam,
+            const vec1d& scale, vec1d& w) {
+
+            const uint_t nflam = filter.lam.size();
+            w.clear();
+
+            auto bnd = bounds(filter.lam.safe[0], filter.lam.safe[nflam-1], lam);
+            if (bnd[0] == npos || bnd[1] == npos) {
+                return npos;
+            }
+
+            const uint_t j0 = bnd[0];
+            w.resize(bnd[1] - j0 + 1);
+
+            // Same sampling as sed2flux(): each point is a linear combination of (at most) two
+            // consecutive SED values
+            double px0 = 0.0, pa0 = 0.0, pb0 = 0.0;
+            uint_t pj0 = 0;
+            bool start = true;
+            auto add_point = [&](double x, uint_t j, double a, double b) {
+                // Trapezoidal integration: 0.5*(x1 - x0)*(y0 + y1)
+                if (!start) {
+                    double h = 0.5*(x - px0);
+                    w.safe[pj0-1-j0] += h*pa0;
+                    w.safe[pj0-j0]   += h*pb0;
+                    w.safe[j-1-j0]   += h*a;
+                    w.safe[j-j0]     += h*b;
+                }
+
+                start = false;
+                px0 = x; pj0 = j; pa0 = a; pb0 = b;
+            };
+
+            uint_t j = j0 + 1;
+            for (uint_t i : range(nflam)) {
+                double fl = filter.lam.safe[i];
+                double t = (fl - lam.safe[j-1])/(lam.safe[j] - lam.safe[j-1]);
+                add_point(fl, j, filter.res.safe[i]*(1.0 - t), filter.res.safe[i]*t);
+
+                if (i != nflam - 1) {
+                    while (lam.safe[j] < filter.lam.safe[i+1]) {
+                        add_point(lam.safe[j], j, 0.0, interpolate(
+                            filter.res.safe[i], filter.res.safe[i+1],
+                            filter.lam.safe[i], filter.lam.safe[i+1], lam.safe[j]
+                        ));
+                        ++j;
+                    }
+                }
+            }
+
+            for (uint_t k : range(w)) {
+                w.safe[k] *= scale.safe[j0+k];
+            }
+
+            return j0;
+        }
+
+        inline void filter_operator_apply_(const astro::filter_operator& op, const double* sed,
+            uint_t iz, double* flux) {
+
+            for (uint_t f : range(op.nfilter)) {
+                uint_t row = iz*op.nfilter + f;
+                uint_t j0 = op.first.safe[row];
+                if (j0 == npos) {
+                    flux[f] = dnan;
+                } else {
+                    uint_t i0 = op.offset.safe[row];
+                    simd::gemv(1, op.offset.safe[row+1] - i0, op.weight.data.data() + i0,
+                        sed + j0, flux + f);
+                }
+            }
+        }
+    }
+}
+
+namespace astro {
+    // Build the filter operator for rest-frame SEDs [Lsun] sampled on the grid 'lam' [um], for
+    // sources at each redshift 'z' and luminosity distance 'd' [Mpc]. The resulting fluxes are
+    // in [uJy], as with lsun2uJy().
+    template<typename TFi, typename TL, typename TZ, typename TD>
+    filter_operator make_filter_operator(const vec<1,TFi>& filters, const vec<1,TL>& lam,
+        const vec<1,TZ>& z, const vec<1,TD>& d) {
+
+        phypp_check(z.size() == d.size(), "incompatible redshift and distance variables (",
+            z.dims, " vs ", d.dims, ")");
+
+        filter_operator op;
+        op.lam = lam;
+        op.z = z;
+        op.d = d;
+        op.nfilter = filters.size();
+
+        const uint_t nz = op.nz();
+        op.first.resize(nz*op.nfilter);
+        op.offset.resize(nz*op.nfilter + 1);
+
+        vec1d olam = op.lam;
+        vec1d scale = replicate(1.0, op.lam.size());
+        vec1d w;
+        for (uint_t iz : range(nz)) {
+            if (!op.z.empty()) {
+                olam = op.lam*(1.0 + op.z.safe[iz]);
+                scale = lsun2uJy(op.z.safe[iz], op.d.safe[iz], op.lam, 1.0);
+            }
+
+            for (uint_t f : range(op.nfilter)) {
+                uint_t row = iz*op.nfilter + f;
+                op.first.safe[row] = impl::astro_impl::filter_weights_(filters[f], olam, scale, w);
+                op.offset.safe[row] = op.weight.size();
+                append(op.weight, w);
+            }
+        }
+
+        op.offset.safe[nz*op.nfilter] = op.weight.size();
+
+        return op;
+    }
+
+    // Build the filter operator for SEDs in the observer frame, sampled on the grid 'lam' [um]
+    template<typename TFi, typename TL>
+    filter_operator make_filter_operator(const vec<1,TFi>& filters, const vec<1,TL>& lam) {
+        return make_filter_operator(filters, lam, vec1d{}, vec1d{});
+    }
+
+    // Fluxes of the SEDs 'sed' (one per row, sampled on the wavelength grid of the operator)
+    // in each filter, for the redshift 'iz' of the operator. Equivalent to calling sed2flux()
+    // for each filter.
+    inline vec2d sed2flux(const filter_operator& op, const vec2d& sed, uint_t iz = 0) {
+        phypp_check(sed.dims[1] == op.lam.size(), "incompatible SED and operator wavelength "
+            "grid (", sed.dims[1], " vs ", op.lam.size(), ")");
+        phypp_check(iz < op.nz(), "redshift index out of bounds (", iz, " vs ", op.nz(), ")");
+
+        const uint_t nsed = sed.dims[0];
+        const uint_t nlam = sed.dims[1];
+        vec2d flux(nsed, op.nfilter);
+        for (uint_t s : range(nsed)) {
+            impl::astro_impl::filter_operator_apply_(op, sed.data.data() + s*nlam, iz,
+                flux.data.data() + s*op.nfilter);
+        }
+
+        return flux;
+    }
+
+    template<typename TS>
+    vec2d sed2flux(const filter_operator& op, const vec<2,TS>& sed, uint_t iz = 0) {
+        vec2d tsed = sed;
+        return sed2flux(op, tsed, iz);
+    }
+
+    template<typename TS>
+    vec1d sed2flux(const filter_operator& op, const vec<1,TS>& sed, uint_t iz = 0) {
+        return flatten(sed2flux(op, reform(sed, 1, sed.size()), iz));
+    }
+
+    inline void filter_operator_save(const std::string& file, const filter_operator& op) {
+        fits::write_table(file, ftable(op.lam, op.z, op.d, op.nfilter, op.first, op.offset,
+            op.weight));
+    }
+
+    inline filter_operator filter_operator_restore(const std::string& file) {
+        filter_operator op;
+        fits::read_table(file, ftable(op.lam, op.z, op.d, op.nfilter, op.first, op.offset,
+            op.weight));
+
+        phypp_check(op.z.size() == op.d.size() && op.first.size() == op.nz()*op.nfilter &&
+            op.offset.size() == op.first.size() + 1 &&
+            (op.offset.empty() || op.offset.back() == op.weight.size()),
+            "corrupted filter operator in '", file, "'");
+
+        return op;
+    }
+
     template<typename TypeL, typename TypeS>
     double sed_convert(const filter_t& from, const filter_t& to, double z, double d,
         const vec<1,TypeL>& lam, const vec<1,TypeS>& sed) {
@@ -291,45 +291,113 @@ namespace astro {
         return r;
     }
 
-    // Perform the convolution of two 2D arrays, assuming the second one is the kernel.
+    // Convolution of many images by the same kernel.
+    // The kernel is Fourier transformed only once for all images of the same dimensions, and
+    // the FFT plans and work buffers are reused from one image to the next. Calling this object
+    // from several threads at the same time is not safe: use one convolver per thread.
     // Note: If the FFTW library is not used, falls back to convolve2d_naive().
-    template<typename TypeY1, typename TypeY2>
-    auto convolve2d(const vec<2,TypeY1>& map, const vec<2,TypeY2>& kernel) ->
-        vec<2,decltype(map[0]*kernel[0])> {
-    #ifdef NO_FFTW
-        return convolve2d_naive(map, kernel);
-    #else
-        phypp_check(kernel.dims[0]%2 == 1 && kernel.dims[1]%2 == 1,
-            "kernel must have odd dimensions (", kernel.dims, ")");
+    class convolver {
+        vec2d kernel_;
+
+    #ifndef NO_FFTW
+        uint_t hsx_, hsy_;
+        std::vector<uint_t> dims_; // dimensions of the padded image
+        impl::fftw_impl::buffer_t<double> real_;
+        impl::fftw_impl::buffer_t<fftw_complex> spec_, kspec_;
+
+        void prepare_(const std::array<uint_t,2>& mdims) {
+            std::vector<uint_t> d = {mdims[0] + 2*hsx_, mdims[1] + 2*hsy_};
+            if (d == dims_) return;
+
+            dims_ = d;
+            const uint_t n = d[0]*d[1];
+            const uint_t nh = impl::fftw_impl::half_size(d);
+            real_.resize(n);
+            spec_.resize(nh);
+            kspec_.resize(nh);
+
+            // Resize kernel to padded image size, with kernel center at (0,0)
+            std::fill(real_.data(), real_.data() + n, 0.0);
+            for (uint_t kx : range(kernel_.dims[0]))
+            for (uint_t ky : range(kernel_.dims[1])) {
+                uint_t x = (kx + d[0] - hsx_) % d[0];
+                uint_t y = (ky + d[1] - hsy_) % d[1];
+                real_.data()[x*d[1] + y] = kernel_.safe(kx,ky);
+            }
 
-        uint_t hsx = kernel.dims[0]/2, hsy = kernel.dims[1]/2;
+            // Transform the kernel, including the normalization of the inverse FFT
+            impl::fftw_impl::execute_r2c(d, real_.data(), kspec_.data());
+            for (uint_t i : range(nh)) {
+                kspec_.data()[i][0] /= n;
+                kspec_.data()[i][1] /= n;
+            }
+        }
+    #endif
 
-        // Pad image to prevent issues with cyclic borders
-        vec2d tmap = enlarge(map, {{hsx, hsy, hsx, hsy}});
+    public :
+        template<typename TypeK>
+        explicit convolver(const vec<2,TypeK>& kernel) : kernel_(kernel) {
+            phypp_check(kernel.dims[0]%2 == 1 && kernel.dims[1]%2 == 1,
+                "kernel must have odd dimensions (", kernel.dims, ")");
 
-        // Resize kernel to map size, with kernel center at (0,0)
-        vec2d tkernel(tmap.dims);
+        #ifndef NO_FFTW
+            hsx_ = kernel.dims[0]/2;
+            hsy_ = kernel.dims[1]/2;
+        #endif
+        }
 
-        vec1u px1 = hsx + uindgen(hsx);
-        vec1u py1 = hsy + uindgen(hsy);
-        vec1u px2 = hsx - 1 - uindgen(hsx);
-        vec1u py2 = hsy - 1 - uindgen(hsy);
+        template<typename TypeM>
+        vec2d operator() (const vec<2,TypeM>& map) {
+        #ifdef NO_FFTW
+            return convolve2d_naive(map, kernel_);
+        #else
+            vec2d r(map.dims);
+            if (map.empty()) return r;
+
+            prepare_(map.dims);
+
+            // Pad image with zeros to prevent issues with cyclic borders
+            const uint_t ny = dims_[1];
+            double* p = real_.data();
+            std::fill(p, p + real_.size(), 0.0);
+            for (uint_t x : range(map.dims[0]))
+            for (uint_t y : range(map.dims[1])) {
+                p[(x + hsx_)*ny + y + hsy_] = map.safe(x,y);
+            }
 
-        vec1u ix1 = uindgen(hsx);
-        vec1u iy1 = uindgen(hsy);
-        vec1u ix2 = tmap.dims[0] - 1 - uindgen(hsx);
-        vec1u iy2 = tmap.dims[1] - 1 - uindgen(hsy);
+            // Perform the convolution in Fourier space
+            fftw_complex* c = spec_.data();
+            fftw_complex* k = kspec_.data();
+            impl::fftw_impl::execute_r2c(dims_, p, c);
+            for (uint_t i : range(spec_.size())) {
+                double re = c[i][0]*k[i][0] - c[i][1]*k[i][1];
+                double im = c[i][0]*k[i][1] + c[i][1]*k[i][0];
+                c[i][0] = re;
+                c[i][1] = im;
+            }
 
-        tkernel(ix1,iy1) = kernel(px1, py1);
-        tkernel(ix2,iy1) = kernel(px2, py1);
-        tkernel(ix1,iy2) = kernel(px1, py2);
-        tkernel(ix2,iy2) = kernel(px2, py2);
+            // Go back to real space and shrink map back to original dimensions
+            impl::fftw_impl::execute_c2r(dims_, c, p);
+            for (uint_t x : range(map.dims[0]))
+            for (uint_t y : range(map.dims[1])) {
+                r.safe(x,y) = p[(x + hsx_)*ny + y + hsy_];
+            }
 
-        // Perform the convolution in Fourrier space
-        auto cimg = fft(tmap)*fft(tkernel);
+            return r;
+        #endif
+        }
+    };
 
-        // Go back to real space and shrink map back to original dimensions
-        return shrink(ifft(cimg), {{hsx, hsy, hsx, hsy}})/cimg.size();
+    // Perform the convolution of two 2D arrays, assuming the second one is the kernel.
+    // To convolve many images with the same kernel, prefer using a convolver.
+    // Note: If the FFTW library is not used, falls back to convolve2d_naive().
+    template<typename TypeY1, typename TypeY2>
+    auto convolve2d(const vec<2,TypeY1>& map, const vec<2,TypeY2>& kernel) ->
+        vec<2,decltype(map[0]*kernel[0])> {
+    #ifdef NO_FFTW
+        return convolve2d_naive(map, kernel);
+    #else
+        return convolver(kernel)(map);
     #endif
     }
 
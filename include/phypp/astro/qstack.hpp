@@ -8,6 +8,7 @@ namespace phypp {
 namespace impl {
     namespace qstack_impl {
         struct image_workspace {
+            std::string file;
             int status = 0;
             fitsfile* fptr = nullptr;
             long width, height;
@@ -16,7 +17,8 @@ namespace impl {
 
             image_workspace() = default;
 
-            explicit image_workspace(const std::string& file, const vec1d& ra, const vec1d& dec) {
+            explicit image_workspace(const std::string& f, const vec1d& ra, const vec1d& dec) :
+                file(f) {
                 fits_open_image(&fptr, file.c_str(), READONLY, &status);
                 fits::phypp_check_cfitsio(status, "cannot open file '"+file+"'");
 
@@ -59,7 +61,7 @@ namespace impl {
             image_workspace(const image_workspace&) = delete;
             image_workspace& operator=(const image_workspace&) = delete;
 
-            image_workspace(image_workspace&& i) : status(i.status), fptr(i.fptr),
+            image_workspace(image_workspace&& i) : file(std::move(i.file)), status(i.status), fptr(i.fptr),
                 width(i.width), height(i.height), astro(std::move(i.astro)),
                 x(std::move(x)), y(std::move(y)) {
                 i.fptr = nullptr;
@@ -72,6 +74,195 @@ namespace impl {
                 fptr = nullptr;
             }
         };
+
+        // Maximum number of pixels read at once by each thread
+        static const uint_t band_pixels = 4*1024*1024;
+
+        // Cutout to extract, with the (1-based) FITS pixel coordinates of its first pixel.
+        // The cutout may extend beyond the edges of the image.
+        struct cutout_t {
+            uint_t id;
+            long x0, y0;
+        };
+
+        // Region of the image read at once, covering the cutouts [i0,i1) of the sorted list
+        struct band_t {
+            long x0, x1, y0, y1;
+            uint_t i0, i1;
+            bool whole = true; // false: read each cutout separately
+        };
+
+        template<typename Type>
+        void read_region(fitsfile* fptr, const std::string& file, long x0, long y0,
+            long x1, long y1, Type* data) {
+            long p0[2] = {x0, y0};
+            long p1[2] = {x1, y1};
+            long inc[2] = {1, 1};
+            Type null = fnan;
+            int anynul = 0;
+            int status = 0;
+            fits_read_subset(fptr, impl::fits_impl::traits<Type>::ttype, p0, p1, inc, &null,
+                data, &anynul, &status);
+            fits::phypp_check_cfitsio(status, "cannot read cutout from '"+file+"'");
+        }
+
+        // Copy a cutout from the region 'b' held in 'data', and set the pixels that fall
+        // outside of the image to NaN
+        template<typename Type>
+        void copy_cutout(const band_t& b, const Type* data, const cutout_t& c, long csize,
+            long width, long height, Type* cut) {
+            const long bw = b.x1 - b.x0 + 1;
+            const long xa = std::max(1l, c.x0), xb = std::min(width, c.x0 + csize - 1);
+            for (long cy = 0; cy < csize; ++cy) {
+                Type* row = cut + cy*csize;
+                const long y = c.y0 + cy;
+                if (y < 1 || y > height || xa > xb) {
+                    std::fill(row, row + csize, Type(fnan));
+                    continue;
+                }
+
+                std::fill(row, row + (xa - c.x0), Type(fnan));
+                const Type* src = data + (y - b.y0)*bw + (xa - b.x0);
+                std::copy(src, src + (xb - xa + 1), row + (xa - c.x0));
+                std::fill(row + (xb - c.x0 + 1), row + csize, Type(fnan));
+            }
+        }
+
+        // Extract cutouts of (2*hsize+1)^2 pixels from one or more images of identical
+        // dimensions. Cutouts are sorted by row, and grouped into bands of rows that are read
+        // at once with a single call to cfitsio, unless a band would be mostly empty. Bands
+        // are processed by 'nthread' tasks, each with its own handles to the files.
+        // dest(id, f) must return a pointer to the memory where the cutout 'id' of the file
+        // 'f' is written, and finish(id) is called once all the files have been extracted.
+        // Each cutout is processed by a single thread.
+        template<typename Type, typename D, typename F>
+        void extract_cutouts(const vec1s& files, long width, long height, uint_t hsize,
+            std::vector<cutout_t> cuts, uint_t nthread, bool verbose, D&& dest, F&& finish) {
+
+            if (cuts.empty()) return;
+
+            const long csize = 2*hsize+1;
+            const uint_t npix = csize*csize;
+
+            std::sort(cuts.begin(), cuts.end(), [](const cutout_t& c1, const cutout_t& c2) {
+                return c1.y0 < c2.y0 || (c1.y0 == c2.y0 && c1.x0 < c2.x0);
+            });
+
+            // Group cutouts into bands of rows
+            const long max_rows = std::max(csize, long(band_pixels/uint_t(width)));
+            std::vector<band_t> bands;
+            for (uint_t i = 0; i < cuts.size();) {
+                band_t b;
+                b.i0 = i;
+                b.y0 = std::max(1l, cuts[i].y0);
+                b.y1 = b.y0;
+                b.x0 = width;
+                b.x1 = 1;
+
+                while (i < cuts.size()) {
+                    const long y1 = std::min(height, cuts[i].y0 + csize - 1);
+                    if (y1 - b.y0 + 1 > max_rows) break;
+
+                    b.y1 = std::max(b.y1, y1);
+                    b.x0 = std::min(b.x0, std::max(1l, cuts[i].x0));
+                    b.x1 = std::max(b.x1, std::min(width, cuts[i].x0 + csize - 1));
+                    ++i;
+                }
+
+                b.i1 = i;
+
+                // Do not read the whole band if the cutouts only cover a small part of it
+                b.whole = uint_t((b.x1 - b.x0 + 1)*(b.y1 - b.y0 + 1)) <= 4*npix*(b.i1 - b.i0);
+                bands.push_back(b);
+            }
+
+            std::atomic<uint_t> iter(0);
+            std::atomic<uint_t> ndone(0);
+            auto pg = progress_start(cuts.size());
+
+            auto runner = [&]() {
+                // Each thread has its own handles
+                std::vector<fitsfile*> fptr(files.size(), nullptr);
+                auto close = [&]() {
+                    int status = 0;
+                    for (auto* f : fptr) {
+                        if (f) fits_close_file(f, &status);
+                    }
+                };
+
+                try {
+                    for (uint_t f : range(files)) {
+                        int status = 0;
+                        fits_open_image(&fptr[f], files[f].c_str(), READONLY, &status);
+                        fits::phypp_check_cfitsio(status, "cannot open file '"+files[f]+"'");
+                    }
+
+                    std::vector<Type> buffer;
+                    uint_t ib;
+                    while ((ib = iter++) < bands.size()) {
+                        const band_t& b = bands[ib];
+                        if (b.whole) {
+                            const uint_t bsize = (b.x1 - b.x0 + 1)*(b.y1 - b.y0 + 1);
+                            buffer.resize(files.size()*bsize);
+                            for (uint_t f : range(files)) {
+                                read_region(fptr[f], files[f], b.x0, b.y0, b.x1, b.y1,
+                                    buffer.data() + f*bsize);
+                            }
+
+                            for (uint_t i = b.i0; i < b.i1; ++i) {
+                                for (uint_t f : range(files)) {
+                                    copy_cutout(b, buffer.data() + f*bsize, cuts[i], csize,
+                                        width, height, dest(cuts[i].id, f));
+                                }
+
+                                finish(cuts[i].id);
+                            }
+                        } else {
+                            for (uint_t i = b.i0; i < b.i1; ++i) {
+                                const cutout_t& c = cuts[i];
+                                band_t cb;
+                                cb.x0 = std::max(1l, c.x0); cb.x1 = std::min(width,  c.x0 + csize - 1);
+                                cb.y0 = std::max(1l, c.y0); cb.y1 = std::min(height, c.y0 + csize - 1);
+                                buffer.resize((cb.x1 - cb.x0 + 1)*(cb.y1 - cb.y0 + 1));
+                                for (uint_t f : range(files)) {
+                                    read_region(fptr[f], files[f], cb.x0, cb.y0, cb.x1, cb.y1,
+                                        buffer.data());
+                                    copy_cutout(cb, buffer.data(), c, csize, width, height,
+                                        dest(c.id, f));
+                                }
+
+                                finish(c.id);
+                            }
+                        }
+
+                        ndone += b.i1 - b.i0;
+                        if (verbose && nthread <= 1) print_progress(pg, ndone.load());
+                    }
+                } catch (...) {
+                    close();
+                    iter = bands.size();
+                    throw;
+                }
+
+                close();
+            };
+
+            if (nthread <= 1) {
+                runner();
+                return;
+            }
+
+            parallel::task_group tasks;
+            for (uint_t t = 0; t < nthread; ++t) {
+                tasks.run(runner);
+            }
+
+            while (!tasks.wait_for(0.2)) {
+                if (verbose) print_progress(pg, ndone.load());
+            }
+
+            if (verbose) print_progress(pg, cuts.size());
+        }
     }
 }
 
@@ -81,6 +272,8 @@ namespace astro {
         bool save_offsets = false;
         bool save_section = false;
         bool verbose = false;
+        // Number of concurrent threads extracting cutouts
+        uint_t thread = 1u;
     };
 
     struct qstack_output {
@@ -113,10 +306,12 @@ namespace astro {
             cube.dims[1] = cube.dims[2] = 2*hsize+1;
         }
 
-        cube.reserve(cube.size() + (2*hsize+1)*(2*hsize+1)*ra.size());
+        const uint_t npix = (2*hsize+1)*(2*hsize+1);
+        cube.reserve(cube.size() + npix*ra.size());
         ids.reserve(ids.size() + ra.size());
 
-        vec1b found(ra.size());
+        // Position in the cube of the sources found so far
+        std::vector<uint_t> slot(ra.size(), npos);
 
         qstack_output out;
         if (params.save_offsets) {
@@ -129,14 +324,16 @@ namespace astro {
         }
 
         // Loop over all images
-        auto pg = progress_start(ra.size()*imgs.size());
         for (uint_t iimg : range(imgs.size())) {
             auto& img = imgs[iimg];
 
-            // Loop over all sources
+            // Find which sources are covered by this image. New sources are written directly
+            // at the end of the cube, in order, while sources already found in a previous
+            // image go into a temporary buffer.
+            std::vector<impl::qstack_impl::cutout_t> cuts;
+            std::vector<uint_t> pos(ra.size(), npos);
+            uint_t nnew = 0, nold = 0;
             for (uint_t i : range(ra)) {
-                if (params.verbose) progress(pg);
-
                 long p0[2] = {long(round(img.x[i]-hsize)), long(round(img.y[i]-hsize))};
                 long p1[2] = {long(round(img.x[i]+hsize)), long(round(img.y[i]+hsize))};
 
@@ -145,65 +342,73 @@ namespace astro {
                     continue;
                 }
 
-                vec<2,Type> cut(2*hsize+1, 2*hsize+1);
-
-                if (p0[0] < 1 || p1[0] >= img.width || p0[1] < 1 || p1[1] >= img.height) {
-                    // The source is overlapping with the edges of the map
-                    // Extract what we can
-                    cut[_] = fnan;
-
-                    long p0b[2] = {max(1, p0[0]),         max(1, p0[1])};
-                    long p1b[2] = {min(img.width, p1[0]), min(img.height, p1[1])};
+                cuts.push_back({i, p0[0], p0[1]});
+                pos[i] = (slot[i] == npos ? nnew++ : nold++);
+            }
 
-                    vec<2,Type> subcut(p1b[0]-p0b[0]+1, p1b[1]-p0b[1]+1);
+            const uint_t nbase = cube.dims[0];
+            cube.dims[0] += nnew;
+            cube.resize();
+            std::vector<Type> tmp(nold*npix);
+            std::vector<char> valid(ra.size(), false);
+
+            impl::qstack_impl::extract_cutouts<Type>(vec1s{img.file}, img.width, img.height,
+                hsize, std::move(cuts), params.thread, params.verbose,
+                [&](uint_t i, uint_t) {
+                    return slot[i] == npos ?
+                        cube.data.data() + (nbase + pos[i])*npix : tmp.data() + pos[i]*npix;
+                },
+                [&](uint_t i) {
+                    const Type* cut = (slot[i] == npos ?
+                        cube.data.data() + (nbase + pos[i])*npix : tmp.data() + pos[i]*npix);
+
+                    // Discard any source that contains a bad pixel (either infinite or NaN)
+                    if (!params.keep_nan) {
+                        for (uint_t k = 0; k < npix; ++k) {
+                            if (!is_finite(cut[k])) return;
+                        }
+                    }
 
-                    Type null = fnan;
-                    int anynul = 0;
-                    long inc[2] = {1, 1};
-                    fits_read_subset(img.fptr, impl::fits_impl::traits<Type>::ttype, p0b, p1b, inc, &null,
-                        subcut.data.data(), &anynul, &img.status);
+                    valid[i] = true;
 
-                    long x0 = p0b[0]-p0[0];
-                    long x1 = p1b[0]-p0[0];
-                    long y0 = p0b[1]-p0[1];
-                    long y1 = p1b[1]-p0[1];
-                    cut(y0-_-y1,x0-_-x1) = subcut;
-                } else {
-                    // The source is fully covered, easy
-                    Type null = fnan;
-                    int anynul = 0;
-                    long inc[2] = {1, 1};
-                    fits_read_subset(img.fptr, impl::fits_impl::traits<Type>::ttype, p0, p1, inc, &null,
-                        cut.data.data(), &anynul, &img.status);
+                    if (slot[i] != npos) {
+                        // We already found this source in another image, combine the two
+                        Type* old = cube.data.data() + slot[i]*npix;
+                        for (uint_t k = 0; k < npix; ++k) {
+                            if (!is_finite(old[k])) old[k] = cut[k];
+                        }
+                    }
                 }
+            );
 
-                // Discard any source that contains a bad pixel (either infinite or NaN)
-                if (!params.keep_nan && count(!is_finite(cut)) != 0) {
-                    continue;
+            // Remove the new sources that were rejected, keeping the others in order
+            uint_t nkept = nbase;
+            for (uint_t i : range(ra)) {
+                if (pos[i] == npos || slot[i] != npos || !valid[i]) continue;
+
+                // First time we find this source, add it to the output values
+                const Type* src = cube.data.data() + (nbase + pos[i])*npix;
+                if (nkept != nbase + pos[i]) {
+                    std::copy(src, src + npix, cube.data.data() + nkept*npix);
                 }
 
-                if (!found[i]) {
-                    // First time we find this source, add it to the output values
-                    found[i] = true;
+                slot[i] = nkept;
+                ++nkept;
 
-                    ids.push_back(i);
-                    cube.push_back(cut);
+                ids.push_back(i);
 
-                    if (params.save_offsets) {
-                        out.dx.push_back(img.x[i] - round(img.x[i]));
-                        out.dy.push_back(img.y[i] - round(img.y[i]));
-                    }
+                if (params.save_offsets) {
+                    out.dx.push_back(img.x[i] - round(img.x[i]));
+                    out.dy.push_back(img.y[i] - round(img.y[i]));
+                }
 
-                    if (params.save_section) {
-                        out.sect.push_back(iimg);
-                    }
-                } else {
-                    // We already found this source in another image, combine the two
-                    uint_t id = where_last(ids == i);
-                    vec1u idb = where(!is_finite(cube(id,_,_)));
-                    cube(id,_,_)[idb] = cut[idb];
+                if (params.save_section) {
+                    out.sect.push_back(iimg);
                 }
             }
+
+            cube.dims[0] = nkept;
+            cube.resize();
         }
 
         return out;
@@ -303,11 +508,14 @@ namespace astro {
             wcube.dims[1] = wcube.dims[2] = 2*hsize+1;
         }
 
-        cube.reserve(cube.size() + (2*hsize+1)*(2*hsize+1)*ra.size());
-        wcube.reserve(wcube.size() + (2*hsize+1)*(2*hsize+1)*ra.size());
+        const uint_t npix = (2*hsize+1)*(2*hsize+1);
+        cube.reserve(cube.size() + npix*ra.size());
+        wcube.reserve(wcube.size() + npix*ra.size());
         ids.reserve(ids.size() + ra.size());
 
-        // Loop over all sources
+        // Find which sources are covered, and write their cutouts at the end of the cubes
+        std::vector<impl::qstack_impl::cutout_t> cuts;
+        std::vector<uint_t> pos(ra.size(), npos);
         for (uint_t i = 0; i < ra.size(); ++i) {
             long p0[2] = {long(round(x[i]-hsize)), long(round(y[i]-hsize))};
             long p1[2] = {long(round(x[i]+hsize)), long(round(y[i]+hsize))};
@@ -317,26 +525,53 @@ namespace astro {
                 continue;
             }
 
-            vec<2,Type> cut(2*hsize+1, 2*hsize+1);
-            vec<2,Type> wcut(2*hsize+1, 2*hsize+1);
+            pos[i] = cuts.size();
+            cuts.push_back({i, p0[0], p0[1]});
+        }
 
-            Type null = fnan;
-            int anynul = 0;
-            long inc[2] = {1, 1};
+        const uint_t nbase = cube.dims[0];
+        const uint_t wnbase = wcube.dims[0];
+        cube.dims[0] += cuts.size();
+        cube.resize();
+        wcube.dims[0] += cuts.size();
+        wcube.resize();
+        std::vector<char> valid(ra.size(), false);
+
+        impl::qstack_impl::extract_cutouts<Type>(vec1s{ffile, wfile}, width, height, hsize,
+            std::move(cuts), params.thread, params.verbose,
+            [&](uint_t i, uint_t f) {
+                return f == 0 ? cube.data.data() + (nbase + pos[i])*npix :
+                    wcube.data.data() + (wnbase + pos[i])*npix;
+            },
+            [&](uint_t i) {
+                // Discard any source that contains a bad pixel (either infinite or NaN)
+                if (!params.keep_nan) {
+                    const Type* cut = cube.data.data() + (nbase + pos[i])*npix;
+                    const Type* wcut = wcube.data.data() + (wnbase + pos[i])*npix;
+                    for (uint_t k = 0; k < npix; ++k) {
+                        if (!is_finite(cut[k]) || !is_finite(wcut[k])) return;
+                    }
+                }
 
-            fits_read_subset(fptr,  impl::fits_impl::traits<Type>::ttype, p0, p1, inc, &null,
-                cut.data.data(),  &anynul, &status);
-            fits_read_subset(wfptr, impl::fits_impl::traits<Type>::ttype, p0, p1, inc, &null,
-                wcut.data.data(), &anynul, &status);
+                valid[i] = true;
+            }
+        );
 
-            // Discard any source that contains a bad pixel (either infinite or NaN)
-            if (!params.keep_nan && count(!is_finite(cut) || !is_finite(wcut)) != 0) {
-                continue;
+        // Remove the sources that were rejected, keeping the others in order
+        uint_t nkept = 0;
+        for (uint_t i = 0; i < ra.size(); ++i) {
+            if (pos[i] == npos || !valid[i]) continue;
+
+            if (nkept != pos[i]) {
+                const Type* src = cube.data.data() + (nbase + pos[i])*npix;
+                std::copy(src, src + npix, cube.data.data() + (nbase + nkept)*npix);
+                src = wcube.data.data() + (wnbase + pos[i])*npix;
+                std::copy(src, src + npix, wcube.data.data() + (wnbase + nkept)*npix);
             }
 
+            ++nkept;
+
             ids.push_back(i);
-            cube.push_back(cut);
-            wcube.push_back(wcut);
 
             if (params.save_offsets) {
                 out.dx.push_back(x[i] - round(x[i]));
@@ -348,12 +583,167 @@ namespace astro {
             }
         }
 
+        cube.dims[0] = nbase + nkept;
+        cube.resize();
+        wcube.dims[0] = wnbase + nkept;
+        wcube.resize();
+
         fits_close_file(fptr, &status);
         fits_close_file(wfptr, &status);
 
         return out;
     }
 
+    // Cutout of a source, as given by qstack_stream()
+    template<typename Type>
+    struct qstack_cutout {
+        // Index of the source in the input catalog
+        uint_t id = npos;
+        // Section of the image in which the source was found
+        uint_t sect = 0;
+        // Offset of the source from the center of the central pixel
+        double dx = dnan, dy = dnan;
+        // Pixels of the image, and of the weight map (empty if there is none)
+        vec<2,Type> flux, weight;
+    };
+}
+
+namespace impl {
+    namespace qstack_impl {
+        template<typename Type>
+        std::vector<Type>& stream_buffer() {
+            static thread_local std::vector<Type> buffer;
+            return buffer;
+        }
+
+        template<typename Type, typename F>
+        void qstack_stream(const vec1d& ra, const vec1d& dec, const std::string& ffile,
+            const std::string& wfile, uint_t hsize, F&& func, const astro::qstack_params& params) {
+
+            phypp_check(file::exists(ffile), "cannot stack on inexistant file '"+ffile+"'");
+            phypp_check(wfile.empty() || file::exists(wfile),
+                "cannot stack on inexistant file '"+wfile+"'");
+            phypp_check(ra.size() == dec.size(), "need ra.size() == dec.size()");
+
+            vec1s fsects, wsects;
+            if (end_with(ffile, ".sectfits")) {
+                fsects = fits::read_sectfits(ffile);
+            } else {
+                fsects.push_back(ffile);
+            }
+
+            if (!wfile.empty()) {
+                if (end_with(wfile, ".sectfits")) {
+                    wsects = fits::read_sectfits(wfile);
+                } else {
+                    wsects.push_back(wfile);
+                }
+
+                phypp_check(fsects.size() == wsects.size(), "'", ffile, "' and '", wfile,
+                    "' do not have the same number of sections (", fsects.size(), " vs. ",
+                    wsects.size(), ")");
+            }
+
+            const uint_t csize = 2*hsize+1;
+            const uint_t npix = csize*csize;
+            const bool weighted = !wfile.empty();
+            std::vector<char> found(ra.size(), false);
+            std::mutex mutex;
+
+            for (uint_t isect : range(fsects)) {
+                image_workspace img(fsects[isect], ra, dec);
+
+                vec1s files = {img.file};
+                if (weighted) {
+                    vec1u wdims = fits::input_image(wsects[isect]).image_dims();
+                    phypp_check(wdims.size() == 2 && wdims[0] == uint_t(img.height) &&
+                        wdims[1] == uint_t(img.width), "image and weight map do not match");
+                    files.push_back(wsects[isect]);
+                }
+
+                std::vector<cutout_t> cuts;
+                for (uint_t i : range(ra)) {
+                    if (found[i]) continue;
+
+                    long p0[2] = {long(round(img.x[i]-hsize)), long(round(img.y[i]-hsize))};
+                    long p1[2] = {long(round(img.x[i]+hsize)), long(round(img.y[i]+hsize))};
+
+                    // Discard any source that falls out of the boundaries of the image.
+                    // With a weight map, sources must be fully covered.
+                    if (weighted) {
+                        if (p0[0] < 1 || p1[0] >= img.width || p0[1] < 1 || p1[1] >= img.height) {
+                            continue;
+                        }
+                    } else {
+                        if (p1[0] < 1 || p0[0] >= img.width || p1[1] < 1 || p0[1] >= img.height) {
+                            continue;
+                        }
+                    }
+
+                    cuts.push_back({i, p0[0], p0[1]});
+                }
+
+                extract_cutouts<Type>(files, img.width, img.height, hsize, std::move(cuts),
+                    params.thread, params.verbose,
+                    [&](uint_t, uint_t f) {
+                        auto& buffer = stream_buffer<Type>();
+                        buffer.resize(2*npix);
+                        return buffer.data() + f*npix;
+                    },
+                    [&](uint_t i) {
+                        const Type* cut = stream_buffer<Type>().data();
+
+                        // Discard any source that contains a bad pixel (either infinite or NaN)
+                        if (!params.keep_nan) {
+                            for (uint_t k = 0; k < files.size()*npix; ++k) {
+                                if (!is_finite(cut[k])) return;
+                            }
+                        }
+
+                        astro::qstack_cutout<Type> c;
+                        c.id = i;
+                        c.sect = isect;
+                        c.dx = img.x[i] - round(img.x[i]);
+                        c.dy = img.y[i] - round(img.y[i]);
+                        c.flux.resize(csize, csize);
+                        std::copy(cut, cut + npix, c.flux.data.begin());
+                        if (weighted) {
+                            c.weight.resize(csize, csize);
+                            std::copy(cut + npix, cut + 2*npix, c.weight.data.begin());
+                        }
+
+                        std::lock_guard<std::mutex> l(mutex);
+                        found[i] = true;
+                        func(c);
+                    }
+                );
+            }
+        }
+    }
+}
+
+namespace astro {
+    // Same as qstack(), but the cutouts are not stored: f(c) is called for each accepted
+    // cutout 'c' (see qstack_cutout). f() is never called by two threads at the same time.
+    // The order of the calls is unspecified when using more than one thread.
+    // Note: a source covered by several sections is only given once, from the first section
+    // in which it is accepted; cutouts are not merged across sections.
+    template<typename Type, typename F>
+    void qstack_stream(const vec1d& ra, const vec1d& dec, const std::string& filename,
+        uint_t hsize, F&& func, qstack_params params = qstack_params()) {
+        impl::qstack_impl::qstack_stream<Type>(ra, dec, filename, "", hsize,
+            std::forward<F>(func), params);
+    }
+
+    // Same as above, with a weight map. The weight map can be a sectfits with the same
+    // sections as the image.
+    template<typename Type, typename F>
+    void qstack_stream(const vec1d& ra, const vec1d& dec, const std::string& ffile,
+        const std::string& wfile, uint_t hsize, F&& func, qstack_params params = qstack_params()) {
+        impl::qstack_impl::qstack_stream<Type>(ra, dec, ffile, wfile, hsize,
+            std::forward<F>(func), params);
+    }
+
     template<typename Type>
     vec<2,meta::rtype_t<Type>> qstack_mean(const vec<3,Type>& fcube) {
         return partial_mean(0, fcube);
@@ -459,6 +849,355 @@ namespace astro {
         return bs;
     }
 }
+
+namespace impl {
+    namespace qstack_impl {
+        // Estimate of one quantile of a stream of values, for many pixels at once, using the
+        // P^2 algorithm (Jain & Chlamtac 1985). Each pixel only stores five markers, whatever
+        // the number of values. The first five values are kept exactly. Non-finite values are
+        // ignored.
+        class p2_sketch {
+            double p_ = 0.5;
+            std::vector<double> q_; // marker heights (5 per pixel)
+            std::vector<double> n_; // marker positions, starting at 1 (5 per pixel)
+            std::vector<uint_t> count_;
+
+        public :
+            p2_sketch() = default;
+
+            p2_sketch(uint_t npix, double p) : p_(p), q_(5*npix), n_(5*npix), count_(npix) {
+                phypp_check(p >= 0.0 && p <= 1.0, "quantile must be within [0,1] (got ", p, ")");
+            }
+
+            double quantile() const {
+                return p_;
+            }
+
+            void add(uint_t i, double x) {
+                if (!is_finite(x)) return;
+
+                double* q = q_.data() + 5*i;
+                double* n = n_.data() + 5*i;
+                uint_t& c = count_[i];
+
+                if (c < 5) {
+                    // Keep the first values sorted
+                    uint_t k = c;
+                    while (k > 0 && q[k-1] > x) {
+                        q[k] = q[k-1];
+                        --k;
+                    }
+
+                    q[k] = x;
+                    ++c;
+
+                    if (c == 5) {
+                        for (uint_t j = 0; j < 5; ++j) {
+                            n[j] = j + 1;
+                        }
+                    }
+
+                    return;
+                }
+
+                // Find the cell containing the new value, and move the markers above it
+                uint_t k = 0;
+                if (x < q[0]) {
+                    q[0] = x;
+                } else if (x >= q[4]) {
+                    q[4] = x;
+                    k = 3;
+                } else {
+                    while (x >= q[k+1]) ++k;
+                }
+
+                for (uint_t j = k+1; j < 5; ++j) {
+                    n[j] += 1.0;
+                }
+
+                ++c;
+
+                // Adjust the heights of the middle markers, if they are off their desired
+                // positions, with a parabolic (or else linear) interpolation
+                const double dn[5] = {0.0, 0.5*p_, p_, 0.5*(1.0 + p_), 1.0};
+                for (uint_t j = 1; j < 4; ++j) {
+                    const double d = 1.0 + (c - 1)*dn[j] - n[j];
+                    if ((d >= 1.0 && n[j+1] - n[j] > 1.0) || (d <= -1.0 && n[j-1] - n[j] < -1.0)) {
+                        const double s = (d > 0.0 ? 1.0 : -1.0);
+                        const double qp = q[j] + s/(n[j+1] - n[j-1])*(
+                            (n[j] - n[j-1] + s)*(q[j+1] - q[j])/(n[j+1] - n[j]) +
+                            (n[j+1] - n[j] - s)*(q[j] - q[j-1])/(n[j] - n[j-1]));
+
+                        if (q[j-1] < qp && qp < q[j+1]) {
+                            q[j] = qp;
+                        } else {
+                            const uint_t o = (s > 0.0 ? j+1 : j-1);
+                            q[j] += s*(q[o] - q[j])/(n[o] - n[j]);
+                        }
+
+                        n[j] += s;
+                    }
+                }
+            }
+
+            double get(uint_t i) const {
+                const uint_t c = count_[i];
+                if (c == 0) return dnan;
+
+                const double* q = q_.data() + 5*i;
+                if (c < 5) {
+                    return q[std::min(uint_t(c*p_), c-1)];
+                }
+
+                return q[2];
+            }
+        };
+    }
+}
+
+namespace astro {
+    // Stack of cutouts computed on the fly, without keeping the cutouts in memory. For each
+    // pixel, it accumulates the mean (weighted or not) and the variance, using West's
+    // (1979) update, and optionally approximate quantiles (e.g., the median). The memory
+    // does not depend on the number of cutouts.
+    class qstack_accumulator {
+    public :
+        qstack_accumulator() = default;
+
+        explicit qstack_accumulator(uint_t hsize, const vec1d& quantiles = vec1d()) :
+            hsize_(hsize), npix_((2*hsize+1)*(2*hsize+1)),
+            wsum_(npix_), mean_(npix_), m2_(npix_) {
+            for (double p : quantiles) {
+                sketches_.emplace_back(npix_, p);
+            }
+        }
+
+        // Add a cutout, with a weight of one for all pixels
+        template<typename Type>
+        void add(const vec<2,Type>& cut) {
+            check_dims_(cut);
+            add_(cut.concretise().data.data(), static_cast<const double*>(nullptr), 1);
+        }
+
+        // Add a cutout, with a weight for each pixel
+        template<typename TypeF, typename TypeW>
+        void add(const vec<2,TypeF>& cut, const vec<2,TypeW>& wcut) {
+            check_dims_(cut);
+            check_dims_(wcut);
+            add_(cut.concretise().data.data(), wcut.concretise().data.data(), 1);
+        }
+
+        // Number of cutouts in the stack
+        uint_t count() const {
+            return count_;
+        }
+
+        // (Weighted) mean of the stack
+        vec2d mean() const {
+            vec2d r = make_image_();
+            for (uint_t i : range(npix_)) {
+                r.safe[i] = (wsum_[i] > 0.0 ? mean_[i] : dnan);
+            }
+
+            return r;
+        }
+
+        // (Weighted) variance of the stack
+        vec2d variance() const {
+            vec2d r = make_image_();
+            for (uint_t i : range(npix_)) {
+                r.safe[i] = (wsum_[i] > 0.0 ? m2_[i]/wsum_[i] : dnan);
+            }
+
+            return r;
+        }
+
+        // Sum of the weights
+        vec2d total_weight() const {
+            vec2d r = make_image_();
+            std::copy(wsum_.begin(), wsum_.end(), r.data.begin());
+            return r;
+        }
+
+        // Approximate value of the i-th quantile given to the constructor. Weights are ignored.
+        vec2d quantile(uint_t i) const {
+            phypp_check(i < sketches_.size(), "quantile index out of bounds (", i, " vs. ",
+                sketches_.size(), ")");
+
+            vec2d r = make_image_();
+            for (uint_t k : range(npix_)) {
+                r.safe[k] = sketches_[i].get(k);
+            }
+
+            return r;
+        }
+
+        // Approximate median of the stack (0.5 must be one of the quantiles)
+        vec2d median() const {
+            for (uint_t i : range(sketches_)) {
+                if (sketches_[i].quantile() == 0.5) return quantile(i);
+            }
+
+            phypp_check(false, "the median was not requested when building this accumulator");
+            return vec2d();
+        }
+
+    private :
+        template<typename TypeS>
+        friend class qstack_bootstrap_accumulator;
+
+        uint_t hsize_ = 0;
+        uint_t npix_ = 0;
+        uint_t count_ = 0;
+        std::vector<double> wsum_, mean_, m2_;
+        std::vector<impl::qstack_impl::p2_sketch> sketches_;
+
+        template<typename Type>
+        void check_dims_(const vec<2,Type>& cut) const {
+            phypp_check(cut.dims[0] == 2*hsize_+1 && cut.dims[1] == 2*hsize_+1,
+                "cutout has wrong dimensions (expected ", 2*hsize_+1, "x", 2*hsize_+1,
+                ", got ", cut.dims, ")");
+        }
+
+        vec2d make_image_() const {
+            return vec2d(2*hsize_+1, 2*hsize_+1);
+        }
+
+        // Add a cutout 'mult' times (w: weights, or null for uniform weights).
+        // Pixels with a non-finite value or weight are ignored.
+        template<typename TypeF, typename TypeW>
+        void add_(const TypeF* f, const TypeW* w, uint_t mult) {
+            if (mult == 0) return;
+
+            count_ += mult;
+            for (uint_t i = 0; i < npix_; ++i) {
+                const double x = f[i];
+                const double tw = mult*(w ? double(w[i]) : 1.0);
+                if (tw == 0.0 || !is_finite(x) || !is_finite(tw)) continue;
+
+                wsum_[i] += tw;
+                const double d = x - mean_[i];
+                mean_[i] += d*tw/wsum_[i];
+                m2_[i] += tw*d*(x - mean_[i]);
+            }
+
+            for (auto& s : sketches_) {
+                for (uint_t i = 0; i < npix_; ++i) {
+                    if (!is_finite(f[i]) || (w && !is_finite(w[i]))) continue;
+
+                    for (uint_t m = 0; m < mult; ++m) {
+                        s.add(i, f[i]);
+                    }
+                }
+            }
+        }
+    };
+
+    // Bootstrap of a stack computed on the fly. Each of the 'nbstrap' realizations has its own
+    // qstack_accumulator. Since the number of sources is not known in advance, each cutout
+    // enters each realization a random number of times, drawn from a Poisson distribution
+    // of mean 'fraction' ("Poisson bootstrap"). On average, a realization therefore contains
+    // a fraction 'fraction' of the sources, drawn with replacement.
+    // The draws of each source come from their own random sequence, seeded from 'seed' and
+    // the ID of the source, so that the realizations do not depend on the order in which the
+    // cutouts are added (e.g., from qstack_stream() with several threads). Without an ID, the
+    // cutouts are numbered in the order they are added.
+    template<typename TypeS = seed_t>
+    class qstack_bootstrap_accumulator {
+    public :
+        qstack_bootstrap_accumulator(uint_t hsize, uint_t nbstrap, double fraction,
+            TypeS& seed, const vec1d& quantiles = vec1d()) :
+            base_(seed()), poisson_(fraction),
+            acc_(nbstrap, qstack_accumulator(hsize, quantiles)) {
+            phypp_check(fraction > 0.0, "the bootstrap fraction must be positive (got ",
+                fraction, ")");
+        }
+
+        template<typename Type>
+        void add(const vec<2,Type>& cut) {
+            add(nadd_, cut);
+        }
+
+        template<typename TypeF, typename TypeW>
+        void add(const vec<2,TypeF>& cut, const vec<2,TypeW>& wcut) {
+            add(nadd_, cut, wcut);
+        }
+
+        // Add the cutout of the source 'id'
+        template<typename Type>
+        void add(uint_t id, const vec<2,Type>& cut) {
+            ++nadd_;
+            if (acc_.empty()) return;
+
+            acc_[0].check_dims_(cut);
+            const auto& c = cut.concretise();
+            auto seed = source_seed_(id);
+            for (auto& a : acc_) {
+                a.add_(c.data.data(), static_cast<const double*>(nullptr), poisson_(seed));
+            }
+        }
+
+        template<typename TypeF, typename TypeW>
+        void add(uint_t id, const vec<2,TypeF>& cut, const vec<2,TypeW>& wcut) {
+            ++nadd_;
+            if (acc_.empty()) return;
+
+            acc_[0].check_dims_(cut);
+            acc_[0].check_dims_(wcut);
+            const auto& c = cut.concretise();
+            const auto& w = wcut.concretise();
+            auto seed = source_seed_(id);
+            for (auto& a : acc_) {
+                a.add_(c.data.data(), w.data.data(), poisson_(seed));
+            }
+        }
+
+        // Accumulator of the i-th realization
+        const qstack_accumulator& realization(uint_t i) const {
+            return acc_[i];
+        }
+
+        // Mean of all the realizations, as a cube (like qstack_mean_bootstrap)
+        vec3d mean() const {
+            return gather_([](const qstack_accumulator& a) { return a.mean(); });
+        }
+
+        vec3d median() const {
+            return gather_([](const qstack_accumulator& a) { return a.median(); });
+        }
+
+        vec3d quantile(uint_t i) const {
+            return gather_([i](const qstack_accumulator& a) { return a.quantile(i); });
+        }
+
+    private :
+        std::uint32_t base_ = 0;
+        uint_t nadd_ = 0;
+        std::poisson_distribution<uint_t> poisson_;
+        std::vector<qstack_accumulator> acc_;
+
+        seed_t source_seed_(uint_t id) {
+            // Each draw must not depend on the previous ones
+            poisson_.reset();
+            std::seed_seq seq{base_, std::uint32_t(id), std::uint32_t(id >> 32)};
+            return seed_t(seq);
+        }
+
+        template<typename F>
+        vec3d gather_(F&& f) const {
+            vec3d r;
+            if (acc_.empty()) return r;
+
+            r.dims[1] = r.dims[2] = 2*acc_[0].hsize_+1;
+            r.reserve(acc_.size()*r.dims[1]*r.dims[2]);
+            for (auto& a : acc_) {
+                r.push_back(f(a));
+            }
+
+            return r;
+        }
+    };
+}
 }
 
 #endif
@@ -38,95 +38,368 @@ namespace astro {
 
 namespace impl {
     namespace qxmatch_impl {
-        struct depth_cache {
-            struct depth_t {
-                vec1i bx, by;
-                double max_dist;
-            };
+        using astro_impl::sky_tree;
+
+        inline void unit_vector(double ra, double dec, double& x, double& y, double& z) {
+            const double d2r = dpi/180.0;
+            ra *= d2r; dec *= d2r;
+            x = cos(dec)*cos(ra);
+            y = cos(dec)*sin(ra);
+            z = sin(dec);
+        }
 
-            std::vector<depth_t> depths;
-            vec2b                visited;
-            double               csize;
-            std::size_t          max_depth;
+        // Convert a squared chord distance between two unit vectors into arcseconds
+        inline double chord2_to_arcsec(double d2) {
+            return 3600.0*(180.0/dpi)*2*asin(std::min(1.0, sqrt(0.25*d2)));
+        }
 
-            depth_cache(uint_t nx, uint_t ny, double cs) : csize(cs),
-                max_depth(std::max(nx, ny)) {
+        inline double arcsec_to_chord2(double d) {
+            d = std::min(std::max(d/(3600.0*(180.0/dpi)), 0.0), dpi);
+            return sqr(2.0*sin(0.5*d));
+        }
 
-                visited = vec2b(nx, ny);
-                depths.reserve(20);
+        // Squared distance between a point and the bounding box of a node, or the farthest
+        // point of this box
+        inline double min_dist2(const sky_tree::node& n, const double* p) {
+            double d2 = 0.0;
+            for (uint_t k : range(3)) {
+                double gap = std::max(0.0, std::max(n.lo[k] - p[k], p[k] - n.hi[k]));
+                d2 += gap*gap;
+            }
 
-                // First depth is trivial
-                depths.push_back(depth_t{});
-                auto& depth = depths.back();
-                depth.max_dist = csize/2.0;
-                depth.bx = {0};
-                depth.by = {0};
-                visited(0,0) = true;
+            return d2;
+        }
 
-                // Generate a few in advance
-                for (uint_t d : range(std::min(uint_t{9}, std::max(nx, ny)-1))) {
-                    grow();
-                }
+        inline double max_dist2(const sky_tree::node& n, const double* p) {
+            double d2 = 0.0;
+            for (uint_t k : range(3)) {
+                double ext = std::max(p[k] - n.lo[k], n.hi[k] - p[k]);
+                d2 += ext*ext;
             }
 
-            const depth_t& operator[] (uint_t i) {
-                if (i >= depths.size()) {
-                    for (uint_t d : range(i+1 - depths.size())) {
-                        grow();
+            return d2;
+        }
+
+        // Find the 'nth' nearest neighbors of a point in the tree, skipping the point with
+        // original index 'exclude'. The arrays 'id' and 'd2' (squared chord distances) must
+        // be initialized to npos and infinity, and are kept sorted by increasing distance.
+        inline void nearest(const sky_tree& t, const double* p, uint_t nth, uint_t exclude,
+            uint_t* id, double* d2, std::vector<std::pair<uint_t,double>>& stack) {
+
+            if (t.nodes.empty()) return;
+
+            stack.clear();
+            stack.emplace_back(0, 0.0);
+            while (!stack.empty()) {
+                auto e = stack.back();
+                stack.pop_back();
+                if (e.second >= d2[nth-1]) continue;
+
+                const sky_tree::node& n = t.nodes[e.first];
+                if (n.leaf()) {
+                    for (uint_t i : range(n.i0, n.i1)) {
+                        double dx = t.x[i] - p[0], dy = t.y[i] - p[1], dz = t.z[i] - p[2];
+                        double td = dx*dx + dy*dy + dz*dz;
+                        if (td >= d2[nth-1] || t.id[i] == exclude) continue;
+
+                        // Insert in the list, keeping it sorted
+                        uint_t k = nth-1;
+                        while (k > 0 && d2[k-1] > td) {
+                            d2[k] = d2[k-1];
+                            id[k] = id[k-1];
+                            --k;
+                        }
+
+                        d2[k] = td;
+                        id[k] = t.id[i];
+                    }
+                } else {
+                    // Visit the nearest child first
+                    double dl = min_dist2(t.nodes[n.left], p);
+                    double dr = min_dist2(t.nodes[n.right], p);
+                    if (dl < dr) {
+                        stack.emplace_back(n.right, dr);
+                        stack.emplace_back(n.left, dl);
+                    } else {
+                        stack.emplace_back(n.left, dl);
+                        stack.emplace_back(n.right, dr);
                     }
                 }
-
-                return depths[i];
             }
+        }
 
-            std::size_t size() const {
-                return max_depth;
+        // Find all the points of the tree within a squared distance 'r2' of a point
+        inline void within(const sky_tree& t, const double* p, double r2, std::vector<uint_t>& ids) {
+            if (t.nodes.empty()) return;
+
+            std::vector<uint_t> stack = {0};
+            while (!stack.empty()) {
+                const sky_tree::node& n = t.nodes[stack.back()];
+                stack.pop_back();
+                if (min_dist2(n, p) > r2) continue;
+
+                if (max_dist2(n, p) <= r2) {
+                    ids.insert(ids.end(), t.id.begin() + n.i0, t.id.begin() + n.i1);
+                } else if (n.leaf()) {
+                    for (uint_t i : range(n.i0, n.i1)) {
+                        double dx = t.x[i] - p[0], dy = t.y[i] - p[1], dz = t.z[i] - p[2];
+                        if (dx*dx + dy*dy + dz*dz <= r2) ids.push_back(t.id[i]);
+                    }
+                } else {
+                    stack.push_back(n.left);
+                    stack.push_back(n.right);
+                }
             }
+        }
 
-            void grow() {
-                phypp_check(depths.size() < visited.dims[0] ||
-                    depths.size() < visited.dims[1], "cannot grow past the size of the "
-                    "bucket field (", visited.dims, "; trying to reach ", depths.size(), ")");
-
-                depths.push_back(depth_t{});
-                auto& depth = depths.back();
-                uint_t d = depths.size();
-
-                // Look further by one cell size
-                depth.max_dist = csize*(d + 0.5);
-
-                // See which new buckets are reached.
-                // We only need to do the maths for one quadrant, the other 3
-                // can be deduced by symmetry.
-                for (uint_t x : range(std::min(d+1, visited.dims[0])))
-                for (uint_t y : range(std::min(d+1, visited.dims[1]))) {
-                    double dist2 = sqr(csize)*min(vec1d{
-                        sqr(x-0.5) + sqr(y-0.5), sqr(x+0.5) + sqr(y-0.5),
-                        sqr(x+0.5) + sqr(y+0.5), sqr(x-0.5) + sqr(y+0.5)
-                    });
-
-                    if (dist2 <= sqr(depth.max_dist) && !visited(x, y)) {
-                        depth.bx.push_back(x);
-                        depth.by.push_back(y);
-                        visited(x, y) = true;
+        // Call f(i) for all i in [0,n) using 'nthread' tasks of the thread pool, and show
+        // the progress if requested
+        template<typename F>
+        void run_jobs(uint_t n, uint_t nthread, bool verbose, F&& f) {
+            std::atomic<uint_t> iter(0);
+            const uint_t chunk = 256;
+            auto runner = [&]() {
+                uint_t i0;
+                while ((i0 = chunk*(iter++)) < n) {
+                    for (uint_t i = i0; i < std::min(n, i0 + chunk); ++i) {
+                        f(i);
                     }
                 }
+            };
 
-                // We have (+x,+y), fill the other 3 quadrants:
-                // (-x,+y), (-x,-y), (-x,+y)
-                vec1u idnew = uindgen(depth.bx.size());
-                append(depth.bx, -depth.bx[idnew]);
-                append(depth.by, depth.by[idnew]);
-                append(depth.bx, -depth.bx[idnew]);
-                append(depth.by, -depth.by[idnew]);
-                append(depth.bx, depth.bx[idnew]);
-                append(depth.by, -depth.by[idnew]);
+            if (nthread <= 1) {
+                runner();
+                return;
             }
-        };
+
+            parallel::task_group tasks;
+            for (uint_t t = 0; t < nthread; ++t) {
+                tasks.run(runner);
+            }
+
+            // Wait for the computation to finish, and once in a while update the progress
+            // bar if any
+            auto p = progress_start(n);
+            while (!tasks.wait_for(0.2)) {
+                if (verbose) print_progress(p, std::min(n, chunk*iter.load()));
+            }
+
+            if (verbose) print_progress(p, n);
+        }
     }
 }
 
 namespace astro {
+    // Spatial index of a set of positions on the sky, to search for nearest neighbors or
+    // neighbors within a given radius. Building the index is the most expensive step, so
+    // the same index should be used to match many catalogs against the same positions. It
+    // can also be saved to disk with sky_index_save() and loaded back with
+    // sky_index_restore(). Queries do not modify the index, and can be run concurrently.
+    // Note: all distances are given in arcseconds, and coordinates in degrees.
+    struct sky_index {
+        impl::astro_impl::sky_tree tree;
+
+        sky_index() = default;
+
+        template<typename TypeR, typename TypeD>
+        sky_index(const vec<1,TypeR>& ra, const vec<1,TypeD>& dec) {
+            phypp_check(ra.dims == dec.dims, "RA and Dec dimensions do not match (",
+                ra.dims, " vs ", dec.dims, ")");
+            phypp_check(count(!is_finite(ra) || !is_finite(dec)) == 0,
+                "RA and Dec coordinates contain invalid values (infinite or NaN)");
+
+            tree = impl::astro_impl::sky_tree(ra, dec, uindgen(ra.size()));
+        }
+
+        uint_t size() const {
+            return tree.id.size();
+        }
+
+        bool empty() const {
+            return tree.id.empty();
+        }
+
+        // Find the 'nth' nearest neighbors of a position, sorted by increasing distance.
+        // If there are less than 'nth' positions, the missing neighbors have id = npos and
+        // d = infinity. The position of index 'exclude' is skipped.
+        void nearest(double ra, double dec, uint_t nth, vec1u& id, vec1d& d,
+            uint_t exclude = npos) const {
+            id = replicate(npos, nth);
+            d = replicate(dinf, nth);
+            if (nth == 0) return;
+
+            double p[3];
+            impl::qxmatch_impl::unit_vector(ra, dec, p[0], p[1], p[2]);
+            std::vector<std::pair<uint_t,double>> stack;
+            impl::qxmatch_impl::nearest(tree, p, nth, exclude, id.data.data(), d.data.data(),
+                stack);
+
+            for (auto& td : d) {
+                if (td != dinf) td = impl::qxmatch_impl::chord2_to_arcsec(td);
+            }
+        }
+
+        // Find all the positions within 'radius' of a position, in increasing order
+        vec1u within(double ra, double dec, double radius) const {
+            double p[3];
+            impl::qxmatch_impl::unit_vector(ra, dec, p[0], p[1], p[2]);
+
+            vec1u ids;
+            impl::qxmatch_impl::within(tree, p,
+                impl::qxmatch_impl::arcsec_to_chord2(radius), ids.data);
+            ids.dims[0] = ids.data.size();
+            inplace_sort(ids);
+
+            return ids;
+        }
+    };
+
+    inline void sky_index_save(const std::string& file, const sky_index& idx) {
+        const auto& t = idx.tree;
+        vec1d x, y, z;
+        vec1u id;
+        x.data = t.x; x.dims[0] = t.x.size();
+        y.data = t.y; y.dims[0] = t.y.size();
+        z.data = t.z; z.dims[0] = t.z.size();
+        id.data = t.id; id.dims[0] = t.id.size();
+
+        const uint_t n = t.nodes.size();
+        vec2d lo(n, 3), hi(n, 3);
+        vec1u i0(n), i1(n), left(n), right(n);
+        for (uint_t i : range(n)) {
+            const auto& nd = t.nodes[i];
+            for (uint_t k : range(3)) {
+                lo.safe(i,k) = nd.lo[k];
+                hi.safe(i,k) = nd.hi[k];
+            }
+
+            i0.safe[i] = nd.i0;     i1.safe[i] = nd.i1;
+            left.safe[i] = nd.left; right.safe[i] = nd.right;
+        }
+
+        fits::write_table(file, ftable(x, y, z, id, lo, hi, i0, i1, left, right));
+    }
+
+    inline sky_index sky_index_restore(const std::string& file) {
+        vec1d x, y, z;
+        vec1u id;
+        vec2d lo, hi;
+        vec1u i0, i1, left, right;
+        fits::read_table(file, ftable(x, y, z, id, lo, hi, i0, i1, left, right));
+
+        phypp_check(x.size() == id.size() && y.size() == id.size() && z.size() == id.size(),
+            "corrupted sky index in '", file, "' (inconsistent number of positions)");
+        phypp_check(lo.dims[0] == i0.size() && hi.dims == lo.dims && i1.dims == i0.dims &&
+            left.dims == i0.dims && right.dims == i0.dims && (i0.empty() || lo.dims[1] == 3),
+            "corrupted sky index in '", file, "' (inconsistent number of nodes)");
+
+        sky_index idx;
+        auto& t = idx.tree;
+        t.x = x.data; t.y = y.data; t.z = z.data; t.id = id.data;
+        t.nodes.resize(i0.size());
+        for (uint_t i : range(i0)) {
+            auto& nd = t.nodes[i];
+            for (uint_t k : range(3)) {
+                nd.lo[k] = lo.safe(i,k);
+                nd.hi[k] = hi.safe(i,k);
+            }
+
+            nd.i0 = i0.safe[i];     nd.i1 = i1.safe[i];
+            nd.left = left.safe[i]; nd.right = right.safe[i];
+        }
+
+        return idx;
+    }
+
+    // Find the 'nth' nearest neighbors of each position in the index. If 'params.no_mirror'
+    // is false, also find the nearest neighbor of each position of the index among the
+    // input positions (this requires building a temporary index of the input positions).
+    // If 'params.self' is true, the index must have been built from the input positions,
+    // and each position is not matched to itself.
+    template<typename TypeR1, typename TypeD1>
+    qxmatch_res qxmatch(const vec<1,TypeR1>& ra1, const vec<1,TypeD1>& dec1,
+        const sky_index& idx, qxmatch_params params = qxmatch_params{}) {
+
+        qxmatch_res res;
+
+        phypp_check(ra1.dims == dec1.dims, "first RA and Dec dimensions do not match (",
+            ra1.dims, " vs ", dec1.dims, ")");
+        phypp_check(count(!is_finite(ra1) || !is_finite(dec1)) == 0,
+            "first RA and Dec coordinates contain invalid values (infinite or NaN)");
+        phypp_check(!params.self || idx.size() == ra1.size(), "self matching requires an "
+            "index of the input positions");
+
+        uint_t nth = clamp(params.nth, 1u, npos);
+
+        const uint_t n1 = ra1.size();
+        const uint_t n2 = idx.size();
+
+        res.id = replicate(npos, nth, n1);
+        res.d  = replicate(dinf, nth, n1);
+
+        bool mirror = !params.no_mirror && !params.self;
+        if (!params.no_mirror) {
+            res.rid = replicate(npos, n2);
+            res.rd  = replicate(dinf, n2);
+        }
+
+        if (n1 == 0 || n2 == 0) {
+            return res;
+        }
+
+        // Unit vectors of the input positions
+        vec2d p1(n1, 3);
+        for (uint_t i : range(n1)) {
+            impl::qxmatch_impl::unit_vector(ra1.safe[i], dec1.safe[i],
+                p1.safe(i,0), p1.safe(i,1), p1.safe(i,2));
+        }
+
+        // Note: the results are stored as (nth,n1), so each thread works on a copy of
+        // the neighbor list and writes it back in place
+        impl::qxmatch_impl::run_jobs(n1, params.thread, params.verbose, [&](uint_t i) {
+            thread_local std::vector<std::pair<uint_t,double>> stack;
+            thread_local std::vector<uint_t> id;
+            thread_local std::vector<double> d2;
+            id.assign(nth, npos);
+            d2.assign(nth, dinf);
+
+            impl::qxmatch_impl::nearest(idx.tree, &p1.safe(i,0), nth, params.self ? i : npos,
+                id.data(), d2.data(), stack);
+
+            for (uint_t k : range(nth)) {
+                res.id.safe(k,i) = id[k];
+                res.d.safe(k,i) = d2[k];
+            }
+        });
+
+        if (mirror) {
+            impl::astro_impl::sky_tree tree1(ra1, dec1, uindgen(n1));
+            const auto& t2 = idx.tree;
+            impl::qxmatch_impl::run_jobs(n2, params.thread, params.verbose, [&](uint_t j) {
+                thread_local std::vector<std::pair<uint_t,double>> stack;
+                double p[3] = {t2.x[j], t2.y[j], t2.z[j]};
+                uint_t id = npos;
+                double d2 = dinf;
+                impl::qxmatch_impl::nearest(tree1, p, 1, npos, &id, &d2, stack);
+                res.rid.safe[t2.id[j]] = id;
+                res.rd.safe[t2.id[j]] = d2;
+            });
+        }
+
+        // Convert the squared chord distances to real distances
+        for (auto& d : res.d) {
+            if (d != dinf) d = impl::qxmatch_impl::chord2_to_arcsec(d);
+        }
+
+        if (mirror) {
+            for (auto& d : res.rd) {
+                if (d != dinf) d = impl::qxmatch_impl::chord2_to_arcsec(d);
+            }
+        }
+
+        return res;
+    }
+
     template<typename TypeR1, typename TypeD1, typename TypeR2, typename TypeD2>
     qxmatch_res qxmatch(const vec<1,TypeR1>& ra1, const vec<1,TypeD1>& dec1,
         const vec<1,TypeR2>& ra2, const vec<1,TypeD2>& dec2,
@@ -163,12 +436,23 @@ namespace astro {
             return res;
         }
 
+        if (!params.brute_force && ra2.size() < 10) {
+            // The index was requested, but there are too few objects to cross match to.
+            // The brute force algorithm is likely to be the fastest.
+            params.brute_force = true;
+        }
+
+        if (!params.brute_force) {
+            // Build an index of the second catalog, and use it to find the neighbors
+            return qxmatch(ra1, dec1, sky_index(ra2, dec2), params);
+        }
+
         const double d2r = dpi/180.0;
-        auto dra1  = ra1*d2r;
-        auto ddec1 = dec1*d2r;
+        vec1d dra1  = ra1*d2r;
+        vec1d ddec1 = dec1*d2r;
         auto dcdec1 = cos(ddec1);
-        auto dra2  = ra2*d2r;
-        auto ddec2 = dec2*d2r;
+        vec1d dra2  = ra2*d2r;
+        vec1d ddec2 = dec2*d2r;
         auto dcdec2 = cos(ddec2);
 
         auto distance_proxy = [&](uint_t i, uint_t j) {
@@ -181,381 +465,111 @@ namespace astro {
             return sde*sde + sra*sra*dcdec2.safe[j]*dcdec1.safe[i];
         };
 
-        if (!params.brute_force && ra2.size() < 10) {
-            // The bucket algorithm was requested, but there are too few objects to
-            // cross match to. The brute force algorithm is likely to be the fastest.
-            params.brute_force = false;
-        }
-
-        if (!params.brute_force) {
-            // Get bounds of the fields
-            vec1d rra1  = {min(ra1),  max(ra1)};
-            vec1d rra2  = {min(ra2),  max(ra2)};
-            vec1d rdec1 = {min(dec1), max(dec1)};
-            vec1d rdec2 = {min(dec2), max(dec2)};
-
-            vec1d rra  = {std::min(rra1[0],  rra2[0]),  std::max(rra1[1],  rra2[1])};
-            vec1d rdec = {std::min(rdec1[0], rdec2[0]), std::max(rdec1[1], rdec2[1])};
-
-            // Choose a bucket size (arcsec)
-            const double overgrowth = 10.0;
-            uint_t nc2 = ceil(0.5*sqrt(dpi*ra2.size()/nth/overgrowth));
-            vec1d hx = vec1d{rra2[0],  rra2[0],  rra2[1],  rra2[1]};
-            vec1d hy = vec1d{rdec2[0], rdec2[1], rdec2[0], rdec2[1]};
-            double area2 = field_area_hull(hx, hy);
-            double cell_size = std::max(3600.0*sqrt(area2)/nc2, 1.0);
-
-            // Be careful that RA and Dec are spherical coordinates
-            double dra = cell_size/abs(cos(mean(rdec2)*dpi/180.0))/3600.0;
-            double ddec = cell_size/3600.0;
-
-            // Add some padding to prevent border issues
-            rra[0]  -= dra;
-            rra[1]  += dra;
-            rdec[0] -= ddec;
-            rdec[1] += ddec;
-
-            // Final number of buckets
-            uint_t nra  = (rra[1]  - rra[0])/dra;
-            uint_t ndec = (rdec[1] - rdec[0])/ddec;
-
-            // Build the buckets
-            struct bucket_t {
-                std::vector<uint_t> ids1;
-                std::vector<uint_t> ids2;
-            };
-
-            vec<2,bucket_t> buckets(nra, ndec);
-
-            // Fill the buckets
-            vec1u idx1 = floor((ra1 - rra[0])/dra);
-            vec1u idy1 = floor((dec1 - rdec[0])/ddec);
-            for (uint_t i : range(ra1)) {
-                buckets(idx1[i],idy1[i]).ids1.push_back(i);
+        auto work = [&, nth] (uint_t i, uint_t j, qxmatch_res& tres) {
+            double sd = distance_proxy(i, j);
+
+            // We compare this new distance to the largest one that is in the Nth
+            // nearest neighbor list. If it is lower than that, we insert it in the list,
+            // removing the old one, and sort the whole thing so that the largest distance
+            // goes as the end of the list.
+            if (sd < tres.d.safe(nth-1,i)) {
+                tres.id.safe(nth-1,i) = j;
+                tres.d.safe(nth-1,i) = sd;
+                uint_t k = nth-2;
+                while (k != npos && tres.d.safe(k,i) > tres.d.safe(k+1,i)) {
+                    std::swap(tres.d.safe(k,i), tres.d.safe(k+1,i));
+                    std::swap(tres.id.safe(k,i), tres.id.safe(k+1,i));
+                    --k;
+                }
             }
 
-            vec1u idx2 = floor((ra2 - rra[0])/dra);
-            vec1u idy2 = floor((dec2 - rdec[0])/ddec);
-            for (uint_t j : range(ra2)) {
-                buckets(idx2[j],idy2[j]).ids2.push_back(j);
+            // Take care of reverse search
+            if (!params.no_mirror && sd < tres.rd.safe[j]) {
+                tres.rid.safe[j] = i;
+                tres.rd.safe[j] = sd;
             }
+        };
 
-            // Precompute generic bucket geometry
-            impl::qxmatch_impl::depth_cache depths(nra, ndec, cell_size);
-
-            auto dist_proj = [] (double dist) {
-                return sqr(sin(dist/(3600.0*(180.0/dpi)*2)));
-            };
-
-            auto work1 = [&] (uint_t i, impl::qxmatch_impl::depth_cache& tdepths, qxmatch_res& tres) {
-                int_t x0 = idx1[i];
-                int_t y0 = idy1[i];
-
-                // Compute the distance of this source from the bucket center
-                double cell_dist = angdist(ra1[i], dec1[i],
-                    rra[0] + (x0+0.5)*dra, rdec[0] + (y0+0.5)*ddec);
-
-                // Scan the buckets around this source until all neighbors are found
-                uint_t d = 0;
-                double reached_distance = 0.0;
-
-                do {
-                    auto& depth = tdepths[d];
-                    for (uint_t b : range(depth.bx)) {
-                        int_t x = x0+depth.bx.safe[b];
-                        int_t y = y0+depth.by.safe[b];
-                        if (x < 0 || uint_t(x) >= nra || y < 0 || uint_t(y) >= ndec) continue;
-
-                        auto& bucket = buckets(uint_t(x),uint_t(y));
-                        for (uint_t j : bucket.ids2) {
-                            if (params.self && i == j) continue;
-
-                            auto sd = distance_proxy(i, j);
-
-                            // Compare this new distance to the largest one that is in the
-                            // Nth nearest neighbor list. If it is lower than that, we
-                            // insert it in the list, removing the old one, and sort the
-                            // whole thing so that the largest distance goes as the end of
-                            // the list.
-                            if (sd < tres.d.safe(nth-1,i)) {
-                                tres.id.safe(nth-1,i) = j;
-                                tres.d.safe(nth-1,i) = sd;
-                                uint_t k = nth-2;
-                                while (k != npos && tres.d.safe(k,i) > tres.d.safe(k+1,i)) {
-                                    std::swap(tres.d.safe(k,i), tres.d.safe(k+1,i));
-                                    std::swap(tres.id.safe(k,i), tres.id.safe(k+1,i));
-                                    --k;
-                                }
-                            }
-                        }
-                    }
-
-                    reached_distance = dist_proj(
-                        std::max(0.0, tdepths[d].max_dist - 1.1*cell_dist - 0.1*cell_size));
-
-                    ++d;
-                } while (tres.d.safe(nth-1,i) > reached_distance && d < tdepths.size());
-            };
-
-            auto work2 = [&] (uint_t j, impl::qxmatch_impl::depth_cache& tdepths, qxmatch_res& tres) {
-                int_t x0 = idx2[j];
-                int_t y0 = idy2[j];
-
-                // Compute the distance of this source from the bucket center
-                double cell_dist = angdist(ra2[j], dec2[j],
-                    rra[0] + (x0+0.5)*dra, rdec[0] + (y0+0.5)*ddec);
-
-                // Scan the buckets around this source until all neighbors are found
-                uint_t d = 0;
-                double reached_distance = 0.0;
-
-                do {
-                    auto& depth = tdepths[d];
-                    for (uint_t b : range(depth.bx)) {
-                        int_t x = x0+depth.bx[b];
-                        int_t y = y0+depth.by[b];
-
-                        if (x < 0 || uint_t(x) >= nra || y < 0 || uint_t(y) >= ndec) continue;
-
-                        auto& bucket = buckets(uint_t(x),uint_t(y));
-                        for (uint_t i : bucket.ids1) {
-                            double sd = distance_proxy(i, j);
-
-                            // Just keep the nearest match
-                            if (sd < tres.rd.safe[j]) {
-                                tres.rd.safe[j] = sd;
-                                tres.rid.safe[j] = i;
-                            }
-                        }
-                    }
-
-                    reached_distance = dist_proj(
-                        std::max(0.0, tdepths[d].max_dist - 1.1*cell_dist - 0.1*cell_size));
-
-                    ++d;
-                } while (tres.rd[j] > reached_distance && d < tdepths.size());
-            };
-
-            if (params.thread <= 1) {
-                if (n2 < nth) {
-                    // We asked more neighbors than there are sources in the second catalog...
-                    // Lower 'nth' to prevent this from blocking the algorithm.
-                    nth = n2;
-                }
-
-                // When using a single thread, all the work is done in the main thread
-                auto p = progress_start(n1+(params.self ? 0 : n2));
-                for (uint_t i : range(ra1)) {
-                    work1(i, depths, res);
-                    if (params.verbose) progress(p, 31);
-                }
-                if (!params.self && !params.no_mirror) {
-                    for (uint_t j : range(ra2)) {
-                        work2(j, depths, res);
-                        if (params.verbose) progress(p, 31);
-                    }
-                }
-            } else {
-                // When using more than one thread, the work load is evenly separated between
-                // all the available threads, such that they should more or less all end at
-                // the same time.
-                std::atomic<uint_t> iter(0);
-
-                // Create the thread pool and launch the threads
-                std::vector<qxmatch_res> vres(params.thread);
-                for (auto& r : vres) {
-                    r.id = replicate(npos, nth, n1);
-                    r.d  = dblarr(nth, n1)+dinf;
-                    r.rid = replicate(npos, n2);
-                    r.rd  = dblarr(n2)+dinf;
-                }
-
-                if (n2 < nth) {
-                    // We asked more neighbors than there are sources in the second catalog...
-                    // Lower 'nth' to prevent this from blocking the algorithm.
-                    nth = n2;
-                }
-
-                vec1u tbeg1(params.thread);
-                vec1u tend1(params.thread);
-                vec1u tbeg2(params.thread);
-                vec1u tend2(params.thread);
-                auto pool = thread::pool(params.thread);
-                uint_t total1 = 0;
-                uint_t total2 = 0;
-                uint_t assigned1 = floor(n1/float(params.thread));
-                uint_t assigned2 = floor(n2/float(params.thread));
-                for (uint_t t = 0; t < params.thread; ++t) {
-                    if (t == params.thread-1) {
-                        assigned1 = n1 - total1;
-                        assigned2 = n2 - total2;
-                    }
-
-                    tbeg1[t] = total1;
-                    tend1[t] = total1+assigned1;
-                    tbeg2[t] = total2;
-                    tend2[t] = total2+assigned2;
-
-                    pool[t].start([&iter, &work1, &work2, &vres,
-                        t, tbeg1, tbeg2, tend1, tend2, depths, params]() mutable {
-                        for (uint_t i = tbeg1[t]; i < tend1[t]; ++i) {
-                            work1(i, depths, vres[t]);
-                            ++iter;
-                        }
-
-                        if (!params.self && !params.no_mirror) {
-                            for (uint_t j = tbeg2[t]; j < tend2[t]; ++j) {
-                                work2(j, depths, vres[t]);
-                                ++iter;
-                            }
-                        }
-                    });
-
-                    total1 += assigned1;
-                    total2 += assigned2;
-                }
-
-                // Wait for the computation to finish.
-                // Here the main thread does nothing except sleeping, occasionally waking
-                // up once in a while to update the progress bar if any.
-                uint_t niter = n1+(params.self ? 0 : n2);
-                auto p = progress_start(niter);
-                while (iter < niter) {
-                    thread::sleep_for(0.2);
-                    if (params.verbose) print_progress(p, iter);
-                }
-
-                // By now, all threads should have ended their tasks.
-                // We must ask them to terminate nicely.
-                for (auto& t : pool) {
-                    t.join();
+        if (params.thread <= 1) {
+            // When using a single thread, all the work is done in the main thread
+            auto p = progress_start(n1);
+            for (uint_t i = 0; i < n1; ++i) {
+                for (uint_t j = 0; j < n2; ++j) {
+                    if (params.self && i == j) continue;
+                    work(i,j,res);
                 }
 
-                // Merge back the results of each thread
-                for (uint_t t = 0; t < params.thread; ++t) {
-                    auto ids = tbeg1[t]-_-(tend1[t]-1);
-                    res.id.safe(_,ids) = vres[t].id.safe(_,ids);
-                    res.d.safe(_,ids) = vres[t].d.safe(_,ids);
-
-                    if (!params.no_mirror) {
-                        ids = tbeg2[t]-_-(tend2[t]-1);
-                        res.rid.safe[ids] = vres[t].rid.safe[ids];
-                        res.rd.safe[ids] = vres[t].rd.safe[ids];
-                    }
-                }
+                if (params.verbose) progress(p);
             }
         } else {
-            auto work = [&, nth] (uint_t i, uint_t j, qxmatch_res& tres) {
-                double sd = distance_proxy(i, j);
-
-                // We compare this new distance to the largest one that is in the Nth
-                // nearest neighbor list. If it is lower than that, we insert it in the list,
-                // removing the old one, and sort the whole thing so that the largest distance
-                // goes as the end of the list.
-                if (sd < tres.d.safe(nth-1,i)) {
-                    tres.id.safe(nth-1,i) = j;
-                    tres.d.safe(nth-1,i) = sd;
-                    uint_t k = nth-2;
-                    while (k != npos && tres.d.safe(k,i) > tres.d.safe(k+1,i)) {
-                        std::swap(tres.d.safe(k,i), tres.d.safe(k+1,i));
-                        std::swap(tres.id.safe(k,i), tres.id.safe(k+1,i));
-                        --k;
-                    }
-                }
-
-                // Take care of reverse search
-                if (!params.no_mirror && sd < tres.rd.safe[j]) {
-                    tres.rid.safe[j] = i;
-                    tres.rd.safe[j] = sd;
+            // When using more than one thread, the work load is evenly separated between
+            // all the available threads, such that they should more or less all end at
+            // the same time.
+            std::atomic<uint_t> iter(0);
+
+            // Prepare one task per thread, run by the shared thread pool
+            std::vector<qxmatch_res> vres(params.thread);
+            for (auto& r : vres) {
+                r.id = replicate(npos, nth, n1);
+                r.d  = replicate(dinf, nth, n1);
+                if (!params.no_mirror) {
+                    r.rid = replicate(npos, n2);
+                    r.rd  = replicate(dinf, n2);
                 }
-            };
-
-            if (params.thread <= 1) {
-                // When using a single thread, all the work is done in the main thread
-                auto p = progress_start(n1);
-                for (uint_t i = 0; i < n1; ++i) {
-                    for (uint_t j = 0; j < n2; ++j) {
-                        if (params.self && i == j) continue;
-                        work(i,j,res);
-                    }
+            }
 
-                    if (params.verbose) progress(p);
-                }
-            } else {
-                // When using more than one thread, the work load is evenly separated between
-                // all the available threads, such that they should more or less all end at
-                // the same time.
-                std::atomic<uint_t> iter(0);
-
-                // Create the thread pool and launch the threads
-                std::vector<qxmatch_res> vres(params.thread);
-                for (auto& r : vres) {
-                    r.id = replicate(npos, nth, n1);
-                    r.d  = replicate(dinf, nth, n1);
-                    if (!params.no_mirror) {
-                        r.rid = replicate(npos, n2);
-                        r.rd  = replicate(dinf, n2);
-                    }
+            vec1u tbeg(params.thread);
+            vec1u tend(params.thread);
+            parallel::task_group tasks;
+            uint_t total = 0;
+            uint_t assigned = floor(n1/float(params.thread));
+            for (uint_t t = 0; t < params.thread; ++t) {
+                if (t == params.thread-1) {
+                    assigned = n1 - total;
                 }
 
-                vec1u tbeg(params.thread);
-                vec1u tend(params.thread);
-                auto pool = thread::pool(params.thread);
-                uint_t total = 0;
-                uint_t assigned = floor(n1/float(params.thread));
-                for (uint_t t = 0; t < params.thread; ++t) {
-                    if (t == params.thread-1) {
-                        assigned = n1 - total;
-                    }
-
-                    tbeg[t] = total;
-                    tend[t] = total+assigned;
-
-                    pool[t].start([&iter, &work, &vres, t, tbeg, tend, params, n2]() {
-                        for (uint_t i = tbeg[t]; i < tend[t]; ++i) {
-                            for (uint_t j = 0; j < n2; ++j) {
-                                if (params.self && i == j) continue;
-                                work(i,j,vres[t]);
-                            }
+                tbeg[t] = total;
+                tend[t] = total+assigned;
 
-                            ++iter;
+                tasks.run([&iter, &work, &vres, t, tbeg, tend, params, n2]() {
+                    for (uint_t i = tbeg[t]; i < tend[t]; ++i) {
+                        for (uint_t j = 0; j < n2; ++j) {
+                            if (params.self && i == j) continue;
+                            work(i,j,vres[t]);
                         }
-                    });
 
-                    total += assigned;
-                }
+                        ++iter;
+                    }
+                });
 
-                // Wait for the computation to finish.
-                // Here the main thread does nothing except sleeping, occasionally waking up
-                // once in a while to update the progress bar if any.
-                auto p = progress_start(n1);
-                while (iter < n1) {
-                    thread::sleep_for(0.2);
-                    if (params.verbose) print_progress(p, iter);
-                }
+                total += assigned;
+            }
 
-                // By now, all threads should have ended their tasks.
-                // We must ask them to terminate nicely.
-                for (auto& t : pool) {
-                    t.join();
-                }
+            // Wait for the computation to finish.
+            // Here the main thread takes part in the work, and once in a while updates
+            // the progress bar if any.
+            auto p = progress_start(n1);
+            while (!tasks.wait_for(0.2)) {
+                if (params.verbose) print_progress(p, iter);
+            }
 
-                // Merge back the results of each thread
-                for (uint_t t = 0; t < params.thread; ++t) {
-                    auto ids = tbeg[t]-_-(tend[t]-1);
-                    res.id.safe(_,ids) = vres[t].id.safe(_,ids);
-                    res.d.safe(_,ids) = vres[t].d.safe(_,ids);
-
-                    if (!params.no_mirror) {
-                        if (t == 0) {
-                            res.rid = vres[t].rid;
-                            res.rd = vres[t].rd;
-                        } else {
-                            for (uint_t j = 0; j < n2; ++j) {
-                                if (res.rd.safe[j] >= vres[t].rd.safe[j]) {
-                                    res.rid.safe[j] = vres[t].rid.safe[j];
-                                    res.rd.safe[j] = vres[t].rd.safe[j];
-                                }
+            if (params.verbose) print_progress(p, iter);
+
+            // Merge back the results of each thread
+            for (uint_t t = 0; t < params.thread; ++t) {
+                auto ids = tbeg[t]-_-(tend[t]-1);
+                res.id.safe(_,ids) = vres[t].id.safe(_,ids);
+                res.d.safe(_,ids) = vres[t].d.safe(_,ids);
+
+                if (!params.no_mirror) {
+                    if (t == 0) {
+                        res.rid = vres[t].rid;
+                        res.rd = vres[t].rd;
+                    } else {
+                        for (uint_t j = 0; j < n2; ++j) {
+                            if (res.rd.safe[j] >= vres[t].rd.safe[j]) {
+                                res.rid.safe[j] = vres[t].rid.safe[j];
+                                res.rd.safe[j] = vres[t].rd.safe[j];
                             }
                         }
                     }
@@ -645,8 +659,8 @@ namespace astro {
             ra.dims, " vs ", dec.dims, ")");
 
         const double d2r = dpi/180.0;
-        auto dra  = ra*d2r;
-        auto ddec = dec*d2r;
+        vec1d dra  = ra*d2r;
+        vec1d ddec = dec*d2r;
         auto dcdec = cos(ddec);
 
         const uint_t n = ra.size();
@@ -0,0 +1,478 @@
+#ifndef PHYPP_ASTRO_REGRID_HPP
+#define PHYPP_ASTRO_REGRID_HPP
+
+#include <atomic>
+#include "phypp/core/vec.hpp"
+#include "phypp/core/error.hpp"
+#include "phypp/core/range.hpp"
+#include "phypp/core/parallel.hpp"
+#include "phypp/utility/time.hpp"
+#include "phypp/utility/generic.hpp"
+#include "phypp/math/base.hpp"
+#include "phypp/math/reduce.hpp"
+#include "phypp/io/fits.hpp"
+#include "phypp/astro/wcs.hpp"
+
+namespace phypp {
+namespace astro {
+    enum class regrid_method : char {
+        // Each output pixel receives the flux of the input pixels it overlaps, weighted by
+        // the exact area of the overlap (flux conserving)
+        exact,
+        // The surface brightness is interpolated at the center of each output pixel, and
+        // multiplied by its area in input pixels (approximately flux conserving)
+        bilinear,
+        lanczos
+    };
+
+    struct regrid_params {
+        regrid_method method = regrid_method::exact;
+        // Size of the Lanczos kernel (in input pixels)
+        uint_t lanczos_order = 3u;
+        // Number of concurrent threads
+        uint_t thread = 1u;
+        // Number of output rows computed at once by a thread
+        uint_t stripe = 16u;
+        // Approximate number of output pixels in memory when regridding a file
+        uint_t max_pixels = 16u*1024u*1024u;
+        bool verbose = false;
+    };
+}
+
+namespace impl {
+    namespace regrid_impl {
+        // Polygon with a bounded number of vertices, to avoid allocations
+        struct polygon {
+            // Clipping a quadrilateral by four lines can at most double its number of
+            // vertices each time
+            static const uint_t max_vertices = 64;
+            uint_t n = 0;
+            double x[max_vertices], y[max_vertices];
+        };
+
+        // Clip a polygon by a vertical (X = true) or horizontal (X = false) line at 'c',
+        // keeping the side where the coordinate is lower (Lower = true) or larger than 'c'
+        template<bool X, bool Lower>
+        void clip(const polygon& in, polygon& out, double c) {
+            out.n = 0;
+            if (in.n == 0) return;
+
+            uint_t j = in.n - 1;
+            for (uint_t i = 0; i < in.n; ++i) {
+                const double vi = (X ? in.x[i] : in.y[i]);
+                const double vj = (X ? in.x[j] : in.y[j]);
+                const bool ini = (Lower ? vi <= c : vi >= c);
+                const bool inj = (Lower ? vj <= c : vj >= c);
+
+                if (ini != inj) {
+                    // This edge crosses the line, add the intersection point
+                    const double t = (c - vj)/(vi - vj);
+                    out.x[out.n] = in.x[j] + t*(in.x[i] - in.x[j]);
+                    out.y[out.n] = in.y[j] + t*(in.y[i] - in.y[j]);
+                    ++out.n;
+                }
+
+                if (ini) {
+                    out.x[out.n] = in.x[i];
+                    out.y[out.n] = in.y[i];
+                    ++out.n;
+                }
+
+                j = i;
+            }
+        }
+
+        inline double area(const polygon& p) {
+            if (p.n < 3) return 0.0;
+
+            double a = 0.0;
+            uint_t j = p.n - 1;
+            for (uint_t i = 0; i < p.n; ++i) {
+                a += p.x[j]*p.y[i] - p.x[i]*p.y[j];
+                j = i;
+            }
+
+            return 0.5*std::abs(a);
+        }
+
+        // Area of the intersection of a polygon with the square [x0,x0+1]x[y0,y0+1]
+        // (Sutherland-Hodgman algorithm)
+        inline double overlap(const polygon& p, double x0, double y0) {
+            polygon t1, t2;
+            clip<true,false>(p, t1, x0);
+            clip<true,true>(t1, t2, x0 + 1.0);
+            clip<false,false>(t2, t1, y0);
+            clip<false,true>(t1, t2, y0 + 1.0);
+            return area(t2);
+        }
+
+        inline double lanczos(double x, double a) {
+            if (x == 0.0) return 1.0;
+            if (std::abs(x) >= a) return 0.0;
+
+            const double px = dpi*x;
+            return a*sin(px)*sin(px/a)/(px*px);
+        }
+
+        // Astrometry of the input and output grids. WCSLib structures must not be used by
+        // several threads at once, so each thread builds its own.
+        struct projector {
+            astro::wcs src, dst;
+
+            projector(const fits::header& shdr, const fits::header& dhdr) : src(shdr), dst(dhdr) {
+                phypp_check(src.is_valid(), "invalid WCS data for the input grid");
+                phypp_check(dst.is_valid(), "invalid WCS data for the output grid");
+            }
+
+            // Position on the input grid (0-based pixels) of the corners of the output
+            // pixels in [y0,y1]x[x0,x1] (0-based, inclusive). The corners are stored in
+            // row-major order, with x1-x0+2 corners per row.
+            void corners(uint_t y0, uint_t y1, uint_t x0, uint_t x1, vec1d& cx, vec1d& cy) {
+                const uint_t nx = x1 - x0 + 2, ny = y1 - y0 + 2;
+                vec1d px(nx*ny), py(nx*ny);
+                for (uint_t iy = 0; iy < ny; ++iy)
+                for (uint_t ix = 0; ix < nx; ++ix) {
+                    px.safe[iy*nx + ix] = x0 + ix + 0.5;
+                    py.safe[iy*nx + ix] = y0 + iy + 0.5;
+                }
+
+                vec1d ra, dec;
+                astro::xy2ad(dst, px, py, ra, dec);
+                astro::ad2xy(src, ra, dec, cx, cy);
+                cx -= 1.0;
+                cy -= 1.0;
+            }
+        };
+
+        // Range of input pixels [i0,i1] covering the coordinates [v0,v1], extended by
+        // 'margin' and clipped to [0,n-1]. Returns false if the range is empty.
+        inline bool pixel_range(double v0, double v1, uint_t margin, uint_t n,
+            long& i0, long& i1) {
+            i0 = long(floor(v0 + 0.5)) - long(margin);
+            i1 = long(floor(v1 + 0.5)) + long(margin);
+            if (i1 < 0 || i0 >= long(n)) return false;
+
+            i0 = std::max(i0, 0l);
+            i1 = std::min(i1, long(n) - 1);
+            return true;
+        }
+    }
+}
+
+namespace astro {
+    // Projection of images from one WCS grid onto another. The output pixels are computed
+    // by stripes of rows, in parallel, projecting all the pixel corners of a stripe at once.
+    // It can work on the whole image, or on regions of the output image with only the input
+    // pixels they need (see source_region()), for images that do not fit in memory.
+    class regridder {
+    public :
+        regridder(const fits::header& src_hdr, const vec1u& src_dims,
+            const fits::header& dst_hdr, const vec1u& dst_dims,
+            const regrid_params& p = regrid_params()) :
+            src_hdr_(src_hdr), dst_hdr_(dst_hdr), src_dims_(src_dims), dst_dims_(dst_dims),
+            params_(p) {
+
+            phypp_check(src_dims.size() == 2, "regridding needs 2D images (got ",
+                src_dims.size(), " dimensions for the input image)");
+            phypp_check(dst_dims.size() == 2, "regridding needs 2D images (got ",
+                dst_dims.size(), " dimensions for the output image)");
+            phypp_check(params_.stripe > 0, "'stripe' must be positive");
+            phypp_check(params_.method != regrid_method::lanczos ||
+                (params_.lanczos_order > 0 && params_.lanczos_order <= max_lanczos),
+                "'lanczos_order' must be within [1,", uint_t(max_lanczos), "] (got ",
+                params_.lanczos_order, ")");
+
+            // Check the astrometry now
+            impl::regrid_impl::projector pj(src_hdr_, dst_hdr_);
+        }
+
+        // Dimensions of the input image
+        const vec1u& source_dims() const {
+            return src_dims_;
+        }
+
+        // Dimensions of the output image
+        const vec1u& dims() const {
+            return dst_dims_;
+        }
+
+        const regrid_params& params() const {
+            return params_;
+        }
+
+        // Region [s0,s1] of the input image (0-based, inclusive) needed to compute the output
+        // pixels in [p0,p1]. Returns false if these pixels do not overlap the input image.
+        bool source_region(const vec1u& p0, const vec1u& p1, vec1u& s0, vec1u& s1) const {
+            phypp_check(p0.size() == 2 && p1.size() == 2, "regions must be 2D");
+            phypp_check(p0[0] <= p1[0] && p0[1] <= p1[1] && p1[0] < dst_dims_[0] &&
+                p1[1] < dst_dims_[1], "invalid region of the output image (", p0, " to ", p1,
+                " in ", dst_dims_, ")");
+
+            impl::regrid_impl::projector pj(src_hdr_, dst_hdr_);
+
+            // Project the border of the region
+            vec1d cx, cy, tx, ty;
+            pj.corners(p0[0], p0[0], p0[1], p1[1], cx, cy);
+            pj.corners(p1[0], p1[0], p0[1], p1[1], tx, ty);
+            append(cx, tx); append(cy, ty);
+            pj.corners(p0[0], p1[0], p0[1], p0[1], tx, ty);
+            append(cx, tx); append(cy, ty);
+            pj.corners(p0[0], p1[0], p1[1], p1[1], tx, ty);
+            append(cx, tx); append(cy, ty);
+
+            const uint_t m = margin_();
+            long x0, x1, y0, y1;
+            if (!impl::regrid_impl::pixel_range(min(cx), max(cx), m, src_dims_[1], x0, x1) ||
+                !impl::regrid_impl::pixel_range(min(cy), max(cy), m, src_dims_[0], y0, y1)) {
+                return false;
+            }
+
+            s0 = {uint_t(y0), uint_t(x0)};
+            s1 = {uint_t(y1), uint_t(x1)};
+            return true;
+        }
+
+        // Compute the output pixels starting at 'p0', in a region of the size of 'out', from
+        // the input pixels 'src', which start at 's0' in the input image. Input pixels that
+        // are not in 'src' are considered empty.
+        template<typename TI, typename TO>
+        void regrid(const vec<2,TI>& src, const vec1u& s0, const vec1u& p0,
+            vec<2,TO>& out) const {
+
+            phypp_check(s0.size() == 2 && p0.size() == 2, "regions must be 2D");
+            phypp_check(p0[0] + out.dims[0] <= dst_dims_[0] && p0[1] + out.dims[1] <= dst_dims_[1],
+                "output region is out of the output image (", p0, " + ", out.dims, " vs. ",
+                dst_dims_, ")");
+
+            if (out.empty()) return;
+
+            const uint_t nstripe = (out.dims[0] + params_.stripe - 1)/params_.stripe;
+            const uint_t nthread = std::max(uint_t(1), std::min(params_.thread, nstripe));
+            const auto& csrc = src.concretise();
+
+            std::atomic<uint_t> iter(0);
+            std::atomic<uint_t> ndone(0);
+            auto pg = progress_start(out.dims[0]);
+
+            auto runner = [&]() {
+                impl::regrid_impl::projector pj(src_hdr_, dst_hdr_);
+                vec1d cx, cy;
+
+                uint_t is;
+                while ((is = iter++) < nstripe) {
+                    const uint_t r0 = is*params_.stripe;
+                    const uint_t r1 = std::min(r0 + params_.stripe, out.dims[0]) - 1;
+
+                    pj.corners(p0[0] + r0, p0[0] + r1, p0[1], p0[1] + out.dims[1] - 1, cx, cy);
+                    cx -= s0[1];
+                    cy -= s0[0];
+
+                    for (uint_t r = r0; r <= r1; ++r) {
+                        regrid_row_(csrc, cx, cy, r - r0, r, out);
+                    }
+
+                    ndone += r1 - r0 + 1;
+                    if (params_.verbose && nthread <= 1) print_progress(pg, ndone.load());
+                }
+            };
+
+            if (nthread <= 1) {
+                runner();
+                return;
+            }
+
+            parallel::task_group tasks;
+            for (uint_t t = 0; t < nthread; ++t) {
+                tasks.run(runner);
+            }
+
+            while (!tasks.wait_for(0.2)) {
+                if (params_.verbose) print_progress(pg, ndone.load());
+            }
+
+            if (params_.verbose) print_progress(pg, out.dims[0]);
+        }
+
+        // Regrid a whole image held in memory
+        template<typename T>
+        vec2d regrid(const vec<2,T>& src) const {
+            phypp_check(src.dims[0] == src_dims_[0] && src.dims[1] == src_dims_[1],
+                "input image does not match the input grid (", src.dims, " vs. ", src_dims_, ")");
+
+            vec2d out(dst_dims_[0], dst_dims_[1]);
+            regrid(src, vec1u{0, 0}, vec1u{0, 0}, out);
+            return out;
+        }
+
+    private :
+        static const uint_t max_lanczos = 8;
+
+        fits::header src_hdr_, dst_hdr_;
+        vec1u src_dims_, dst_dims_;
+        regrid_params params_;
+
+        uint_t margin_() const {
+            switch (params_.method) {
+                case regrid_method::exact    : return 0;
+                case regrid_method::bilinear : return 1;
+                case regrid_method::lanczos  : return params_.lanczos_order;
+            }
+
+            return 0;
+        }
+
+        // Compute the output row 'r' from the corners of row 'cr' in (cx,cy)
+        template<typename TI, typename TO>
+        void regrid_row_(const vec<2,TI>& src, const vec1d& cx, const vec1d& cy, uint_t cr,
+            uint_t r, vec<2,TO>& out) const {
+
+            const uint_t nx = out.dims[1];
+            const uint_t nc = nx + 1;
+            const uint_t sh = src.dims[0], sw = src.dims[1];
+
+            impl::regrid_impl::polygon q;
+            q.n = 4;
+
+            for (uint_t ix = 0; ix < nx; ++ix) {
+                const uint_t c0 = cr*nc + ix;
+                const uint_t ic[4] = {c0, c0 + 1, c0 + nc + 1, c0 + nc};
+                for (uint_t k = 0; k < 4; ++k) {
+                    q.x[k] = cx.safe[ic[k]];
+                    q.y[k] = cy.safe[ic[k]];
+                }
+
+                double flx = 0.0;
+                if (sh != 0 && sw != 0) {
+                    if (params_.method == regrid_method::exact) {
+                        flx = exact_(src, q);
+                    } else {
+                        flx = interpolate_(src, q)*impl::regrid_impl::area(q);
+                    }
+                }
+
+                out.safe(r,ix) = flx;
+            }
+        }
+
+        template<typename TI>
+        double exact_(const vec<2,TI>& src, const impl::regrid_impl::polygon& q) const {
+            double xmin = q.x[0], xmax = q.x[0], ymin = q.y[0], ymax = q.y[0];
+            for (uint_t k = 1; k < 4; ++k) {
+                xmin = std::min(xmin, q.x[k]); xmax = std::max(xmax, q.x[k]);
+                ymin = std::min(ymin, q.y[k]); ymax = std::max(ymax, q.y[k]);
+            }
+
+            long x0, x1, y0, y1;
+            if (!impl::regrid_impl::pixel_range(xmin, xmax, 0, src.dims[1], x0, x1) ||
+                !impl::regrid_impl::pixel_range(ymin, ymax, 0, src.dims[0], y0, y1)) {
+                return 0.0;
+            }
+
+            double flx = 0.0;
+            for (long py = y0; py <= y1; ++py)
+            for (long px = x0; px <= x1; ++px) {
+                const double a = impl::regrid_impl::overlap(q, px - 0.5, py - 0.5);
+                if (a > 0.0) {
+                    flx += src.safe(uint_t(py),uint_t(px))*a;
+                }
+            }
+
+            return flx;
+        }
+
+        template<typename TI>
+        double interpolate_(const vec<2,TI>& src, const impl::regrid_impl::polygon& q) const {
+            const long sh = src.dims[0], sw = src.dims[1];
+
+            // Center of the output pixel
+            const double x = 0.25*(q.x[0] + q.x[1] + q.x[2] + q.x[3]);
+            const double y = 0.25*(q.y[0] + q.y[1] + q.y[2] + q.y[3]);
+            if (x < -0.5 || x > sw - 0.5 || y < -0.5 || y > sh - 0.5) return 0.0;
+
+            if (params_.method == regrid_method::bilinear) {
+                const double tx = std::min(std::max(x, 0.0), double(sw - 1));
+                const double ty = std::min(std::max(y, 0.0), double(sh - 1));
+                const long x0 = long(tx), y0 = long(ty);
+                const long x1 = std::min(x0 + 1, sw - 1), y1 = std::min(y0 + 1, sh - 1);
+                const double fx = tx - x0, fy = ty - y0;
+
+                return (1.0 - fy)*((1.0 - fx)*src.safe(uint_t(y0),uint_t(x0)) +
+                        fx*src.safe(uint_t(y0),uint_t(x1))) +
+                    fy*((1.0 - fx)*src.safe(uint_t(y1),uint_t(x0)) +
+                        fx*src.safe(uint_t(y1),uint_t(x1)));
+            } else {
+                const long a = params_.lanczos_order;
+                const long bx = long(floor(x)) - a + 1, by = long(floor(y)) - a + 1;
+
+                double wx[2*max_lanczos], wy[2*max_lanczos];
+                for (long k = 0; k < 2*a; ++k) {
+                    wx[k] = (bx + k >= 0 && bx + k < sw ?
+                        impl::regrid_impl::lanczos(x - (bx + k), a) : 0.0);
+                    wy[k] = (by + k >= 0 && by + k < sh ?
+                        impl::regrid_impl::lanczos(y - (by + k), a) : 0.0);
+                }
+
+                double sum = 0.0, wsum = 0.0;
+                for (long ky = 0; ky < 2*a; ++ky) {
+                    if (wy[ky] == 0.0) continue;
+                    for (long kx = 0; kx < 2*a; ++kx) {
+                        if (wx[kx] == 0.0) continue;
+                        const double w = wx[kx]*wy[ky];
+                        sum += w*src.safe(uint_t(by + ky),uint_t(bx + kx));
+                        wsum += w;
+                    }
+                }
+
+                return (wsum != 0.0 ? sum/wsum : 0.0);
+            }
+        }
+    };
+
+    // Regrid the image in 'src_file' (with astrometry 'src_hdr') onto the grid described by
+    // 'dst_hdr' and 'dst_dims', and save it in 'dst_file'. The output image is computed by
+    // bands of rows, and only the input pixels needed for the current band are read, so that
+    // images larger than the memory can be regridded.
+    inline void regrid(const std::string& src_file, const fits::header& src_hdr,
+        const std::string& dst_file, const fits::header& dst_hdr, const vec1u& dst_dims,
+        const regrid_params& p = regrid_params()) {
+
+        fits::input_image in(src_file);
+
+        regrid_params tp = p;
+        tp.verbose = false;
+        regridder rg(src_hdr, in.image_dims(), dst_hdr, dst_dims, tp);
+
+        fits::tile_writer<double> out(dst_file, dst_dims);
+        out.write_header(dst_hdr);
+
+        const uint_t ny = dst_dims[0], nx = dst_dims[1];
+        const uint_t nrow = std::max(uint_t(1), p.max_pixels/std::max(nx, uint_t(1)));
+        auto pg = progress_start(ny);
+        for (uint_t y0 = 0; y0 < ny; y0 += nrow) {
+            const uint_t y1 = std::min(y0 + nrow, ny) - 1;
+            vec2d res(y1 - y0 + 1, nx);
+
+            vec1u s0, s1;
+            if (nx != 0 && rg.source_region({y0, 0}, {y1, nx - 1}, s0, s1)) {
+                vec2d buffer;
+                in.read_subset(s0, s1, buffer);
+                rg.regrid(buffer, s0, vec1u{y0, 0}, res);
+            }
+
+            out.write(vec1u{y0, 0}, res);
+
+            if (p.verbose) print_progress(pg, y1 + 1);
+        }
+    }
+
+    // Same as above, using the astrometry of the input file
+    inline void regrid(const std::string& src_file, const std::string& dst_file,
+        const fits::header& dst_hdr, const vec1u& dst_dims,
+        const regrid_params& p = regrid_params()) {
+        fits::input_image in(src_file);
+        regrid(src_file, in.read_header(), dst_file, dst_hdr, dst_dims, p);
+    }
+}
+}
+
+#endif
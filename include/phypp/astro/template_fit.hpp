@@ -5,10 +5,32 @@
 #include "phypp/math/mpfit.hpp"
 
 namespace phypp {
+namespace impl {
+namespace template_fit_impl {
+    // Check if all the SEDs of a library are sampled on the same wavelength grid, in which
+    // case their fluxes can be computed with a single filter operator
+    template<typename T>
+    bool shared_lam_grid(const vec<2,T>& lam) {
+        const uint_t nsed = lam.dims[0];
+        const uint_t nlam = lam.dims[1];
+        for (uint_t s = 1; s < nsed; ++s)
+        for (uint_t l = 0; l < nlam; ++l) {
+            if (lam.safe(s,l) != lam.safe(0,l)) return false;
+        }
+
+        return nsed != 0;
+    }
+}
+}
+
 namespace astro {
     // Convolve each SED with the response curve of the filters
     template<typename TLib, typename TFi>
     vec2d template_observed(const TLib& lib, const vec<1,TFi>& filters) {
+        if (impl::template_fit_impl::shared_lam_grid(lib.lam)) {
+            return sed2flux(make_filter_operator(filters, lib.lam.safe(0,_)), lib.sed);
+        }
+
         const uint_t nsed = lib.sed.dims[0];
         const uint_t nfilter = filters.size();
 
@@ -21,13 +43,19 @@ namespace astro {
     }
 
     template<typename TLib, typename TFi>
-    vec2d template_observed(TLib lib, double z, double d, const vec<1,TFi>& filters) {
+    vec2d template_observed(const TLib& lib, double z, double d, const vec<1,TFi>& filters) {
+        if (impl::template_fit_impl::shared_lam_grid(lib.lam)) {
+            return sed2flux(make_filter_operator(filters, lib.lam.safe(0,_), vec1d{z}, vec1d{d}),
+                lib.sed);
+        }
+
         // Move each SED to the observed frame
-        lib.sed = lsun2uJy(z, d, lib.lam, lib.sed);
-        lib.lam *= (1.0 + z);
+        TLib tlib = lib;
+        tlib.sed = lsun2uJy(z, d, tlib.lam, tlib.sed);
+        tlib.lam *= (1.0 + z);
 
         // Convolve each SED with the response curve of the filters
-        return template_observed(lib, filters);
+        return template_observed(tlib, filters);
     }
 
     template<typename TLib, typename TFi, typename TZ, typename TD>
@@ -83,6 +111,11 @@ namespace astro {
         return d;
     }
 
+    template<std::size_t Dim, typename E>
+    vec<Dim,typename E::value_type> limweight(vec<Dim,impl::vec_expr<E>> d) {
+        return limweight(std::move(d).concretise());
+    }
+
     struct template_fit_res_t {
         uint_t bfit; // index of the best fit template in the library
         vec1d chi2;  // chi^2 of each template
@@ -100,7 +133,279 @@ namespace astro {
         bool ulim = false;   // if true, use upper limits to constrain the fit (negative errors)
         bool lib_obs = false; // if true, the input library is assumed to be in observer frame
     };
+}
+
+namespace impl {
+namespace template_fit_impl {
+    using astro::template_fit_res_t;
+    using astro::template_fit_params;
+    using astro::limweight;
+
+    // Derivative of sqrt(limweight(d)) with respect to d, given w = limweight(d)
+    inline double sqrt_limweight_deriv(double d, double w) {
+        if (w <= 0.0) return 0.0;
+        double dw = d < -3.0 ? 2.0*d + 2.0/d :
+            -2.0*sqrt(2.0/dpi)*exp(-0.5*d*d)/(1.0 + erf(d/sqrt(2.0)));
+        return dw/(2.0*sqrt(w));
+    }
+
+    // Fit the amplitudes of the templates 'tpl' (one per row) to the fluxes 'flux', where the
+    // measurements flagged in 'ulim' are upper limits. Fluxes and templates must already be
+    // divided by the errors. The derivatives are computed analytically, and the buffers of 'ws'
+    // are reused from one call to the next.
+    template<typename TF, typename TT>
+    mpfit_result fit_ulim_amp(mpfit_workspace& ws, const vec<1,TF>& flux, const vec<2,TT>& tpl,
+        const vec1b& ulim, const vec1d& p0) {
+
+        const uint_t nflux = flux.size();
+        const uint_t ntpl = tpl.dims[0];
+
+        auto residual = [&](const vec1d& p, uint_t k) {
+            double d = flux.safe[k];
+            for (uint_t l = 0; l < ntpl; ++l) {
+                d -= p.safe[l]*tpl.safe(l,k);
+            }
+
+            return d;
+        };
+
+        ws.resize(nflux, ntpl);
+        return mpfit(ws, [&](const vec1d& p, vec1d& deviate) {
+            for (uint_t k = 0; k < nflux; ++k) {
+                double d = residual(p, k);
+                deviate.safe[k] = ulim.safe[k] ? sqrt(limweight(d)) : d;
+            }
+        }, [&](const vec1d& p, vec2d& jac) {
+            for (uint_t k = 0; k < nflux; ++k) {
+                double s = 1.0;
+                if (ulim.safe[k]) {
+                    double d = residual(p, k);
+                    s = sqrt_limweight_deriv(d, limweight(d));
+                }
+
+                for (uint_t l = 0; l < ntpl; ++l) {
+                    jac.safe(l,k) = -s*tpl.safe(l,k);
+                }
+            }
+        }, p0);
+    }
+
+    // Fit with upper limits, with templates already in the observed frame (in 'res.flux'),
+    // using a numerical solver for each template
+    template<typename TypeSeed>
+    void fit_ulim(template_fit_res_t& res, TypeSeed& seed, vec1d flux, vec1d err,
+        const template_fit_params& params) {
+
+        const uint_t nsed = res.flux.dims[0];
+
+        using ttype = decltype(err[0]*flux[0]*res.flux[0]);
+
+        vec1b isu = err < 0;
+        vec1u idu = where(isu);
+        vec1u idm = where(err > 0);
+        err[idu] *= -1.0;
+        flux /= err;
+
+        for (uint_t i = 0; i < nsed; ++i) {
+            res.flux(i,_) /= err;
+        }
+
+        const uint_t nflux = flux.size();
+        mpfit_workspace ws(nflux, 1);
+
+        if (params.renorm) {
+            // Fit each template, compute chi2 and pick the best one
+            res.chi2.resize(nsed);
+            res.amp.resize(nsed);
+
+            for (uint_t i = 0; i < nsed; ++i) {
+                vec1d model = res.flux(i,_);
+
+                auto lres = linfit(flux[idm], 1.0, model[idm]);
+                auto fres = fit_ulim_amp(ws, flux, reform(model, 1, nflux), isu, lres.params);
+
+                res.chi2[i] = fres.chi2;
+                res.amp[i] = fres.params[0];
+            }
+
+            // Find the best chi2 among all the SEDs
+            res.bfit = min_id(res.chi2);
+
+            // Compute the error with MC simulation
+            res.amp_bfit_sim.resize(params.nsim);
+            res.amp_sim.resize(params.nsim);
+            res.sed_sim.resize(params.nsim);
+
+            for (uint_t i = 0; i < params.nsim; ++i) {
+                auto fsim = flux;
+                fsim[idm] += randomn(seed, idm.size());
+
+                vec<1,ttype> amp(nsed), chi2(nsed);
+                for (uint_t i = 0; i < nsed; ++i) {
+                    vec1d model = res.flux(i,_);
+                    auto lres = linfit(fsim[idm], 1.0, model[idm]);
+                    auto fres = fit_ulim_amp(ws, fsim, reform(model, 1, nflux), isu,
+                        lres.params);
+
+                    chi2[i] = fres.chi2;
+                    amp[i] = fres.params[0];
+                }
+
+                auto ised = min_id(chi2);
+                res.sed_sim[i] = ised;
+                res.amp_sim[i] = amp[ised];
+                res.amp_bfit_sim[i] = amp[res.bfit];
+            }
+        } else {
+            // Just compute chi2 and pick the best one
+            res.chi2.resize(nsed);
+
+            for (uint_t i = 0; i < nsed; ++i) {
+                vec<1,ttype> deviate = flux - res.flux(i,_);
+                res.chi2[i] = total(sqr(deviate[idm])) + total(limweight(deviate[idu]));
+            }
+
+            // Find the best chi2 among all the SEDs
+            res.bfit = min_id(res.chi2);
+
+            // Then normalize the templates to fit the observation
+            res.amp.resize(nsed);
+            for (uint_t i = 0; i < nsed; ++i) {
+                vec1d model = res.flux(i,_);
+
+                auto lres = linfit(flux[idm], 1.0, model[idm]);
+                auto fres = fit_ulim_amp(ws, flux, reform(model, 1, nflux), isu, lres.params);
+
+                res.amp[i] = fres.params[0];
+            }
+
+            // Compute the error with MC simulation
+            res.amp_bfit_sim.resize(params.nsim);
+            res.amp_sim.resize(params.nsim);
+            res.sed_sim.resize(params.nsim);
+
+            for (uint_t i = 0; i < params.nsim; ++i) {
+                auto fsim = flux;
+                fsim[idm] += randomn(seed, idm.size());
+
+                vec<1,ttype> chi2(nsed);
+                for (uint_t i = 0; i < nsed; ++i) {
+                    vec<1,ttype> deviate = fsim - res.flux(i,_);
+                    chi2[i] = total(sqr(deviate[idm])) + total(limweight(deviate[idu]));
+                }
+
+                auto ised = min_id(chi2);
+                res.sed_sim[i] = ised;
+
+                vec1d model = res.flux(ised,_);
+                auto lres = linfit(fsim[idm], 1.0, model[idm]);
+                auto fres = fit_ulim_amp(ws, fsim, reform(model, 1, nflux), isu, lres.params);
+
+                res.amp_sim[i] = fres.params[0];
+
+                model = res.flux(res.bfit,_);
+                lres = linfit(fsim[idm], 1.0, model[idm]);
+                fres = fit_ulim_amp(ws, fsim, reform(model, 1, nflux), isu, lres.params);
+
+                res.amp_bfit_sim[i] = fres.params[0];
+            }
+        }
+
+        for (uint_t i = 0; i < nsed; ++i) {
+            res.flux(i,_) *= err;
+        }
+    }
+
+    // Linear fit, with templates already in the observed frame (in 'res.flux'). The templates
+    // and the fluxes are whitened (divided by the errors), and the fluxes of the observation
+    // and of all the random realizations are fitted at once as a single matrix product.
+    template<typename TypeSeed>
+    void fit_linear(template_fit_res_t& res, TypeSeed& seed, const vec1d& flux,
+        const vec1d& err, const template_fit_params& params) {
+
+        const uint_t nsed = res.flux.dims[0];
+        const uint_t nflux = flux.size();
+        const uint_t nsim = params.nsim;
+
+        vec2d tw(nsed, nflux);
+        for (uint_t t : range(nsed))
+        for (uint_t f : range(nflux)) {
+            tw.safe(t,f) = res.flux.safe(t,f)/err.safe[f];
+        }
+
+        // Row 0: observed fluxes, other rows: random realizations
+        vec2d fw(nsim+1, nflux);
+        for (uint_t f : range(nflux)) {
+            fw.safe(0,f) = flux.safe[f]/err.safe[f];
+        }
+
+        // Draw one realization at a time: randomn() keeps the unused half of the last pair
+        // of Gaussian variates within a single call, so drawing all the realizations at once
+        // would give a different sequence when 'nflux' is odd
+        for (uint_t i : range(nsim)) {
+            vec1d rnd = randomn(seed, nflux);
+            for (uint_t f : range(nflux)) {
+                fw.safe(i+1,f) = fw.safe(0,f) + rnd.safe[f];
+            }
+        }
+
+        // Cross products of each realization with each template, and of each template
+        // with itself
+        vec2d tmp1 = matrix::product_transpose(fw, tw);
+        vec1d tmp2(nsed);
+        for (uint_t t : range(nsed)) {
+            double s = 0.0;
+            for (uint_t f : range(nflux)) {
+                s += sqr(tw.safe(t,f));
+            }
+
+            tmp2.safe[t] = s;
+        }
+
+        // Chi2 and amplitude of each template for realization 'i'
+        vec1d amp(nsed), chi2(nsed);
+        auto fit = [&](uint_t i) {
+            double ff = 0.0;
+            for (uint_t f : range(nflux)) {
+                ff += sqr(fw.safe(i,f));
+            }
+
+            for (uint_t t : range(nsed)) {
+                double t1 = tmp1.safe(i,t);
+                amp.safe[t] = t1/tmp2.safe[t];
+                if (params.renorm) {
+                    chi2.safe[t] = ff - t1*amp.safe[t];
+                } else {
+                    chi2.safe[t] = ff - 2.0*t1 + tmp2.safe[t];
+                }
+            }
+        };
+
+        fit(0);
+        res.amp = amp;
+        res.chi2 = chi2;
 
+        // Find the best chi2 among all the SEDs
+        res.bfit = min_id(res.chi2);
+
+        // Compute the error with MC simulation
+        res.amp_bfit_sim.resize(nsim);
+        res.amp_sim.resize(nsim);
+        res.sed_sim.resize(nsim);
+
+        for (uint_t i : range(nsim)) {
+            fit(i+1);
+
+            auto ised = min_id(chi2);
+            res.amp_bfit_sim.safe[i] = amp.safe[res.bfit];
+            res.amp_sim.safe[i] = amp.safe[ised];
+            res.sed_sim.safe[i] = ised;
+        }
+    }
+}
+}
+
+namespace astro {
     // Note: Errors on the fit are computed by adding a random offset to the measured photometry (upper
     // limits are not touched) according to the provided error. The fit is performed on each of these
     // random realizations and the error on the parameters are computed as the standard deviation of the
@@ -140,197 +445,119 @@ namespace astro {
             res.flux = template_observed(lib, z, d, filters);
         }
 
-        const uint_t nsed = res.flux.dims[0];
-        const uint_t nfilter = filters.size();
-
-        using ttype = decltype(err[0]*flux[0]*res.flux[0]);
-
         if (params.ulim) {
-            vec1u idu = where(err < 0);
-            vec1u idm = where(err > 0);
-            err[idu] *= -1.0;
-            flux /= err;
-
-            for (uint_t i = 0; i < nsed; ++i) {
-                res.flux(i,_) /= err;
-            }
-
-            if (params.renorm) {
-                // Fit each template, compute chi2 and pick the best one
-                res.chi2.resize(nsed);
-                res.amp.resize(nsed);
-
-                for (uint_t i = 0; i < nsed; ++i) {
-                    vec1d model = res.flux(i,_);
-
-                    auto lres = linfit(flux[idm], 1.0, model[idm]);
-                    auto fres = mpfit([&](const vec1d& p) {
-                        auto deviate = flux - p[0]*model;
-                        deviate[idu] = sqrt(limweight(deviate[idu]));
-                        return deviate;
-                    }, lres.params);
-
-                    res.chi2[i] = fres.chi2;
-                    res.amp[i] = fres.params[0];
-                }
-
-                // Find the best chi2 among all the SEDs
-                res.bfit = min_id(res.chi2);
-
-                // Compute the error with MC simulation
-                res.amp_bfit_sim.resize(params.nsim);
-                res.amp_sim.resize(params.nsim);
-                res.sed_sim.resize(params.nsim);
-
-                const uint_t nflux = flux.size();
-                for (uint_t i = 0; i < params.nsim; ++i) {
-                    auto fsim = flux;
-                    fsim[idm] += randomn(seed, idm.size());
-
-                    vec<1,ttype> amp(nsed), chi2(nsed);
-                    for (uint_t i = 0; i < nsed; ++i) {
-                        vec1d model = res.flux(i,_);
-                        auto lres = linfit(fsim[idm], 1.0, model[idm]);
-                        auto fres = mpfit([&](const vec1d& p) {
-                            auto deviate = fsim - p[0]*model;
-                            deviate[idu] = sqrt(limweight(deviate[idu]));
-                            return deviate;
-                        }, lres.params);
-
-                        chi2[i] = fres.chi2;
-                        amp[i] = fres.params[0];
-                    }
+            impl::template_fit_impl::fit_ulim(res, seed, flux, err, params);
+        } else {
+            impl::template_fit_impl::fit_linear(res, seed, flux, err, params);
+        }
 
-                    auto ised = min_id(chi2);
-                    res.sed_sim[i] = ised;
-                    res.amp_sim[i] = amp[ised];
-                    res.amp_bfit_sim[i] = amp[res.bfit];
-                }
-            } else {
-                // Just compute chi2 and pick the best one
-                res.chi2.resize(nsed);
+        for (uint_t f : range(res.flux.dims[1])) {
+            res.flux(_,f) *= res.amp;
+        }
 
-                for (uint_t i = 0; i < nsed; ++i) {
-                    auto deviate = flux - res.flux(i,_);
-                    res.chi2[i] = total(sqr(deviate[idm])) + total(limweight(deviate[idu]));
-                }
+        return res;
+    }
 
-                // Find the best chi2 among all the SEDs
-                res.bfit = min_id(res.chi2);
+    // Fit a whole catalog: 'flux' and 'err' are given as (source x filter), and 'z' and 'd' give
+    // the redshift and distance of each source (they are ignored if 'lib_obs' is true). The
+    // observed fluxes of the templates are computed once for each distinct redshift, and the
+    // sources are fitted in parallel (see parallel::set_threads()). The random realizations of
+    // each source are drawn from a separate seed, itself drawn from 'seed' in the order of the
+    // sources, so the result does not depend on the number of threads.
+    template<typename TLib, typename TFi, typename TypeSeed, typename TZ, typename TD>
+    std::vector<template_fit_res_t> template_fit_batch(const TLib& lib, TypeSeed& seed,
+        const vec<1,TZ>& z, const vec<1,TD>& d, const vec2d& flux, const vec2d& err,
+        const vec<1,TFi>& filters, template_fit_params params = template_fit_params()) {
+
+        const uint_t nsrc = flux.dims[0];
+        phypp_check(flux.dims == err.dims, "incompatible dimensions for flux and error (",
+            flux.dims, " vs. ", err.dims, ")");
+        phypp_check(flux.dims[1] == filters.size(), "incompatible number of filters and "
+            "fluxes (", filters.size(), " vs. ", flux.dims[1], ")");
+        if (!params.lib_obs) {
+            phypp_check(z.size() == nsrc && d.size() == nsrc, "there must be one redshift and "
+                "distance per source (got ", z.size(), " and ", d.size(), " for ", nsrc,
+                " sources)");
+        }
 
-                // Then normalize the templates to fit the observation
-                res.amp.resize(nsed);
-                for (uint_t i = 0; i < nsed; ++i) {
-                    vec1d model = res.flux(i,_);
+        std::vector<template_fit_res_t> res(nsrc);
 
-                    auto lres = linfit(flux[idm], 1.0, model[idm]);
-                    auto fres = mpfit([&](const vec1d& p) {
-                        auto deviate = flux - p[0]*model;
-                        deviate[idu] = sqrt(limweight(deviate[idu]));
-                        return deviate;
-                    }, lres.params);
+        vec<1,std::uint32_t> seeds(nsrc);
+        for (uint_t i : range(nsrc)) {
+            seeds.safe[i] = seed();
+        }
 
-                    res.amp[i] = fres.params[0];
+        // Group the sources with the same redshift and distance
+        vec1u groups;
+        vec1u sid = uindgen(nsrc);
+        if (params.lib_obs) {
+            groups = {0, nsrc};
+        } else {
+            sid = sort(sid, [&](uint_t i, uint_t j) {
+                return z.safe[i] < z.safe[j] || (z.safe[i] == z.safe[j] && d.safe[i] < d.safe[j]);
+            });
+
+            for (uint_t k : range(nsrc)) {
+                if (k == 0 || z.safe[sid.safe[k]] != z.safe[sid.safe[k-1]] ||
+                    d.safe[sid.safe[k]] != d.safe[sid.safe[k-1]]) {
+                    groups.push_back(k);
                 }
+            }
 
-                // Compute the error with MC simulation
-                res.amp_bfit_sim.resize(params.nsim);
-                res.amp_sim.resize(params.nsim);
-                res.sed_sim.resize(params.nsim);
-
-                const uint_t nflux = flux.size();
-                for (uint_t i = 0; i < params.nsim; ++i) {
-                    auto fsim = flux;
-                    fsim[idm] += randomn(seed, idm.size());
-
-                    vec<1,ttype> chi2(nsed);
-                    for (uint_t i = 0; i < nsed; ++i) {
-                        auto deviate = fsim - res.flux(i,_);
-                        chi2[i] = total(sqr(deviate[idm])) + total(limweight(deviate[idu]));
-                    }
-
-                    auto ised = min_id(chi2);
-                    res.sed_sim[i] = ised;
+            groups.push_back(nsrc);
+        }
 
-                    vec1d model = res.flux(ised,_);
-                    auto lres = linfit(fsim[idm], 1.0, model[idm]);
-                    auto fres = mpfit([&](const vec1d& p) {
-                        auto deviate = fsim - p[0]*model;
-                        deviate[idu] = sqrt(limweight(deviate[idu]));
-                        return deviate;
-                    }, lres.params);
-
-                    res.amp_sim[i] = fres.params[0];
-
-                    model = res.flux(res.bfit,_);
-                    lres = linfit(fsim[idm], 1.0, model[idm]);
-                    fres = mpfit([&](const vec1d& p) {
-                        auto deviate = fsim - p[0]*model;
-                        deviate[idu] = sqrt(limweight(deviate[idu]));
-                        return deviate;
-                    }, lres.params);
-
-                    res.amp_bfit_sim[i] = fres.params[0];
+        // If the library has a single wavelength grid, precompute the filter weights for all
+        // the redshifts at once
+        filter_operator op;
+        bool shared = impl::template_fit_impl::shared_lam_grid(lib.lam);
+        if (shared) {
+            if (params.lib_obs) {
+                op = make_filter_operator(filters, lib.lam.safe(0,_));
+            } else {
+                vec1d gz(groups.size()-1), gd(groups.size()-1);
+                for (uint_t g : range(gz)) {
+                    uint_t i = sid.safe[groups.safe[g]];
+                    gz.safe[g] = z.safe[i];
+                    gd.safe[g] = d.safe[i];
                 }
-            }
 
-            for (uint_t i = 0; i < nsed; ++i) {
-                res.flux(i,_) *= err;
+                op = make_filter_operator(filters, lib.lam.safe(0,_), gz, gd);
             }
-        } else {
-            // Compute chi2 & renormalization factor
-            auto weight = invsqr(err);
+        }
 
-            vec<1,ttype> tmp1(nsed), tmp2(nsed);
-            for (uint_t i = 0; i < nsed; ++i) {
-                auto tmp = res.flux(i,_);
-                tmp1[i] = total(weight*flux*tmp);
-                tmp2[i] = total(weight*tmp*tmp);
-            }
+        parallel::run(groups.size()-1, [&](uint_t g) {
+            const uint_t k0 = groups.safe[g], k1 = groups.safe[g+1];
+            if (k0 == k1) return;
 
-            res.amp = tmp1/tmp2;
-            if (params.renorm) {
-                tmp1 *= res.amp;
-                res.chi2 = total(weight*flux*flux) - tmp1;
+            vec2d tflux;
+            if (shared) {
+                tflux = sed2flux(op, lib.sed, params.lib_obs ? 0 : g);
+            } else if (params.lib_obs) {
+                tflux = template_observed(lib, filters);
             } else {
-                res.chi2 = total(weight*flux*flux) - 2.0*tmp1 + tmp2;
+                uint_t i = sid.safe[k0];
+                tflux = template_observed(lib, double(z.safe[i]), double(d.safe[i]), filters);
             }
 
-            // Find the best chi2 among all the SEDs
-            res.bfit = min_id(res.chi2);
-
-            // Compute the error with MC simulation
-            res.amp_bfit_sim.resize(params.nsim);
-            res.amp_sim.resize(params.nsim);
-            res.sed_sim.resize(params.nsim);
-
-            const uint_t nflux = flux.size();
-            for (uint_t i = 0; i < params.nsim; ++i) {
-                auto fsim = flux + randomn(seed, nflux)*err;
-                for (uint_t t = 0; t < nsed; ++t) {
-                    tmp1[t] = total(weight*fsim*res.flux(t,_));
-                }
+            parallel::run(k1 - k0, [&](uint_t k) {
+                const uint_t i = sid.safe[k0+k];
+                auto tseed = make_seed(seeds.safe[i]);
+                template_fit_res_t& r = res[i];
+                r.flux = tflux;
 
-                auto amp = tmp1/tmp2;
-                vec<1,ttype> chi2;
-                if (params.renorm) {
-                    tmp1 *= amp;
-                    chi2 = total(weight*fsim*fsim) - tmp1;
+                vec1d tf = flux.safe(i,_), te = err.safe(i,_);
+                if (params.ulim) {
+                    impl::template_fit_impl::fit_ulim(r, tseed, tf, te, params);
                 } else {
-                    chi2 = total(weight*fsim*fsim) - 2.0*tmp1 + tmp2;
+                    impl::template_fit_impl::fit_linear(r, tseed, tf, te, params);
                 }
 
-                auto ised = min_id(chi2);
-
-                res.amp_bfit_sim[i] = amp[res.bfit];
-                res.amp_sim[i] = amp[ised];
-                res.sed_sim[i] = ised;
-            }
-        }
-
-        for (uint_t f = 0; f < nfilter; ++f) {
-            res.flux(_,f) *= res.amp;
-        }
+                for (uint_t f : range(r.flux.dims[1])) {
+                    r.flux(_,f) *= r.amp;
+                }
+            });
+        });
 
         return res;
     }
@@ -382,7 +609,8 @@ namespace astro {
         using ttype = decltype(err[0]*flux[0]*res.flux[0]);
 
         if (params.ulim) {
-            vec1u idu = where(err < 0);
+            vec1b isu = err < 0;
+            vec1u idu = where(isu);
             vec1u idm = where(err > 0);
             err[idu] *= -1.0;
 
@@ -397,6 +625,16 @@ namespace astro {
 
             res.chi2 = dinf;
 
+            // Fluxes and templates divided by the errors
+            vec1d fw = flux/err;
+            vec2d rw(params.nsim, nfilter);
+            for (uint_t s : range(params.nsim)) {
+                rw(s,_) = rflux(s,_)/err;
+            }
+
+            mpfit_workspace ws(nfilter, nlib);
+            vec2d tw(nlib, nfilter);
+
             vec1u ilib = replicate(0, nlib);
             for (uint_t i : range(nseds)) {
                 if (!constraints(ilib)) continue;
@@ -404,19 +642,11 @@ namespace astro {
                 vec2f tpls(nlib, nfilter);
                 for (uint_t l : range(nlib)) {
                     tpls(l,_) = convflux[l](ilib[l],_);
+                    tw(l,_) = tpls(l,_)/err;
                 }
 
                 auto tres = linfit_pack(flux[idm], err[idm], tpls(_,idm));
-                auto fres = mpfit([&](const vec1d& p) {
-                    auto deviate = flux;
-                    for (uint_t l : range(nlib)) {
-                        deviate -= p[l]*tpls(l,_);
-                    }
-
-                    deviate /= err;
-                    deviate[idu] = sqrt(limweight(deviate[idu]));
-                    return deviate;
-                }, tres.params);
+                auto fres = impl::template_fit_impl::fit_ulim_amp(ws, fw, tw, isu, tres.params);
 
                 if (fres.chi2 < res.chi2) {
                     res.chi2 = fres.chi2;
@@ -425,16 +655,8 @@ namespace astro {
                 }
 
                 for (uint_t s : range(params.nsim)) {
-                    fres = mpfit([&](const vec1d& p) {
-                        auto deviate = rflux(s,_);
-                        for (uint_t l : range(nlib)) {
-                            deviate -= p[l]*tpls(l,_);
-                        }
-
-                        deviate /= err;
-                        deviate[idu] = sqrt(limweight(deviate[idu]));
-                        return deviate;
-                    }, tres.params);
+                    fres = impl::template_fit_impl::fit_ulim_amp(ws, rw(s,_), tw, isu,
+                        tres.params);
 
                     if (fres.chi2 < rchi2[s]) {
                         rchi2[s] = fres.chi2;
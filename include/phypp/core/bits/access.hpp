@@ -239,7 +239,7 @@ namespace vec_access {
 
     template<std::size_t Dim, typename T>
     struct is_index_vector<vec<Dim,T>> : std::integral_constant<bool,
-        std::is_integral<typename std::decay<typename std::remove_pointer<T>::type>::type>::value> {};
+        std::is_integral<typename std::decay<meta::rtype_t<T>>::type>::value> {};
 
     template<typename T>
     struct is_index_base : std::integral_constant<bool,
@@ -281,6 +281,52 @@ namespace vec_access {
         return phypp::range(rng.first, rng.last+1);
     }
 
+    inline uint_t range_first(impl::range_impl::full_range_t) {
+        return 0;
+    }
+
+    inline uint_t range_first(const impl::range_impl::left_range_t&) {
+        return 0;
+    }
+
+    inline uint_t range_first(const impl::range_impl::right_range_t& rng) {
+        return rng.first;
+    }
+
+    inline uint_t range_first(const impl::range_impl::left_right_range_t& rng) {
+        return rng.first;
+    }
+
+    // Check if the elements of a vector are located at base + i*stride in memory, and if
+    // so return 'base' and 'stride'. This is always true for a normal vector.
+    template<std::size_t Dim, typename Type, typename T>
+    bool get_linear(const vec<Dim,Type>& v, T*& base, std::ptrdiff_t& stride) {
+        base = const_cast<T*>(impl::ptr<Type>(v.data.data()));
+        stride = 1;
+        return true;
+    }
+
+    template<std::size_t Dim, typename Type, typename T>
+    bool get_linear(const vec<Dim,Type*>& v, T*& base, std::ptrdiff_t& stride) {
+        Type* b;
+        if (!v.data.linear(b, stride)) return false;
+        base = b;
+        return true;
+    }
+
+    // Trait to check if a list of indices generates a regular (strided) slice
+    template<typename T>
+    struct is_strided_index : std::integral_constant<bool,
+        std::is_integral<T>::value || meta::is_range<T>::value> {};
+
+    template<typename ... Args>
+    struct are_strided_indices : std::integral_constant<bool,
+        meta::are_all_true<meta::bool_list<is_strided_index<
+            typename std::decay<Args>::type>::value...>>::value> {};
+
+    template<>
+    struct are_strided_indices<> : std::true_type {};
+
     // Helper to build the result of v(_, ids, 5), i.e. when at least one index is not scalar.
     // The result is another array.
     template<bool IsSafe, bool IsConst, std::size_t Dim, std::size_t ODim, typename Type,
@@ -294,6 +340,7 @@ namespace vec_access {
             const vec<Dim,Type>, vec<Dim,Type>>::type;
         using type = typename std::conditional<IsConst,
             vec<ODim, const rptype*>, vec<ODim, rptype*>>::type;
+        using eptr = typename type::dtype*;
 
         // Functions to build the dimension of the resulting vector
         template<std::size_t IT, std::size_t IV, typename T>
@@ -321,9 +368,7 @@ namespace vec_access {
             resize_(t, v, meta::cte_t<IT+output_dim<T>::value>(), meta::cte_t<IV+input_dim<T>::value>(), args...);
         }
 
-        static void resize_(type& t, itype& v, meta::cte_t<ODim>, meta::cte_t<Dim>) {
-            t.resize();
-        }
+        static void resize_(type& t, itype& v, meta::cte_t<ODim>, meta::cte_t<Dim>) {}
 
         // Adapter to switch between safe/unsafe array indexing
         template<std::size_t D, typename T>
@@ -346,7 +391,7 @@ namespace vec_access {
         static void make_indices_impl_(type& t, uint_t& itx, itype& v, uint_t ivx, meta::cte_t<Dim-1>,
             const std::array<uint_t, Dim>& pitch, std::false_type, const T& ix) {
 
-            t.data[itx] = impl::ptr<Type>(v.data[ivx+to_idx<Dim-1>(v,ix)]);
+            t.data.indirect()[itx] = impl::ptr<Type>(v.data[ivx+to_idx<Dim-1>(v,ix)]);
             ++itx;
         }
 
@@ -355,7 +400,7 @@ namespace vec_access {
             const std::array<uint_t, Dim>& pitch, std::true_type, const T& rng) {
 
             for (uint_t j : range(rng, v.dims[Dim-1])) {
-                t.data[itx] = impl::ptr<Type>(v.data[ivx+j]);
+                t.data.indirect()[itx] = impl::ptr<Type>(v.data[ivx+j]);
                 ++itx;
             }
         }
@@ -372,7 +417,7 @@ namespace vec_access {
             const std::array<uint_t, Dim>& pitch, const vec<1,T>& ids) {
 
             for (uint_t j : ids) {
-                t.data[itx] = impl::ptr<Type>(v.data[ivx+to_idx<Dim-1>(v,j)]);
+                t.data.indirect()[itx] = impl::ptr<Type>(v.data[ivx+to_idx<Dim-1>(v,j)]);
                 ++itx;
             }
         }
@@ -413,6 +458,69 @@ namespace vec_access {
             }
         }
 
+        // Functions to build the strides of the resulting vector (regular slices only)
+        static void make_strides_(itype& v, std::ptrdiff_t& offset, uint_t* extents,
+            std::ptrdiff_t* steps, uint_t& nrun, meta::cte_t<Dim>,
+            const std::array<uint_t, Dim>& pitch) {}
+
+        template<std::size_t IV, typename T, typename ... Args2>
+        static void make_strides_impl_(itype& v, std::ptrdiff_t& offset, uint_t* extents,
+            std::ptrdiff_t* steps, uint_t& nrun, meta::cte_t<IV>,
+            const std::array<uint_t, Dim>& pitch, std::false_type, const T& ix, const Args2& ... i) {
+
+            offset += to_idx<IV>(v,ix)*pitch[IV];
+            make_strides_(v, offset, extents, steps, nrun, meta::cte_t<IV+1>(), pitch, i...);
+        }
+
+        template<std::size_t IV, typename T, typename ... Args2>
+        static void make_strides_impl_(itype& v, std::ptrdiff_t& offset, uint_t* extents,
+            std::ptrdiff_t* steps, uint_t& nrun, meta::cte_t<IV>,
+            const std::array<uint_t, Dim>& pitch, std::true_type, const T& rng, const Args2& ... i) {
+
+            impl::range_impl::check_bounds(rng, v.dims[IV]);
+            extents[nrun] = impl::range_impl::range_size(rng, v.dims[IV]);
+            steps[nrun] = pitch[IV];
+            ++nrun;
+            offset += range_first(rng)*pitch[IV];
+            make_strides_(v, offset, extents, steps, nrun, meta::cte_t<IV+1>(), pitch, i...);
+        }
+
+        template<std::size_t IV, typename T, typename ... Args2>
+        static void make_strides_(itype& v, std::ptrdiff_t& offset, uint_t* extents,
+            std::ptrdiff_t* steps, uint_t& nrun, meta::cte_t<IV> d,
+            const std::array<uint_t, Dim>& pitch, const T& ix, const Args2& ... i) {
+
+            make_strides_impl_(v, offset, extents, steps, nrun, d, pitch, meta::is_range<T>{}, ix, i...);
+        }
+
+        // Regular slice: the result only stores a base pointer and strides
+        template<typename ... UArgs>
+        static bool build_(type& t, itype& v, const std::array<uint_t, Dim>& pitch,
+            std::true_type, const UArgs& ... i) {
+
+            eptr base;
+            std::ptrdiff_t stride;
+            if (!get_linear(v, base, stride)) return false;
+
+            std::array<uint_t, Dim> extents;
+            std::array<std::ptrdiff_t, Dim> steps;
+            std::ptrdiff_t offset = 0;
+            uint_t nrun = 0;
+            make_strides_(v, offset, extents.data(), steps.data(), nrun, meta::cte_t<0>(), pitch, i...);
+            for (uint_t j = 0; j < nrun; ++j) {
+                steps[j] *= stride;
+            }
+
+            t.data.set_strided(base + offset*stride, extents.data(), steps.data(), nrun);
+            return true;
+        }
+
+        template<typename ... UArgs>
+        static bool build_(type&, itype&, const std::array<uint_t, Dim>&,
+            std::false_type, const UArgs& ...) {
+            return false;
+        }
+
         template<typename ... UArgs>
         static type access_(itype& v, const UArgs& ... i) {
             type t(impl::vec_ref_tag, get_parent(v));
@@ -427,8 +535,13 @@ namespace vec_access {
                 }
             }
 
-            uint_t itx = 0;
-            make_indices_(t, itx, v, 0, meta::cte_t<0>(), pitch, i...);
+            if (!build_(t, v, pitch, are_strided_indices<UArgs...>{}, i...)) {
+                // Scattered selection: store one pointer per element
+                t.resize();
+                uint_t itx = 0;
+                make_indices_(t, itx, v, 0, meta::cte_t<0>(), pitch, i...);
+            }
+
             return t;
         }
 
@@ -452,6 +565,7 @@ namespace vec_access {
             const vec<1,Type>, vec<1,Type>>::type;
         using type = typename std::conditional<IsConst,
             vec<1, const rptype*>, vec<1, rptype*>>::type;
+        using eptr = typename type::dtype*;
 
         // Adapter to switch between safe/unsafe array indexing
         template<typename T>
@@ -473,12 +587,20 @@ namespace vec_access {
         static type access(itype& v, const T& rng) {
             type t(impl::vec_ref_tag, get_parent(v));
             t.dims[0] = impl::range_impl::range_size(rng, v.dims[0]);
-            t.resize();
 
-            uint_t itx = 0;
-            for (uint_t i : range(rng, v.dims[0])) {
-                t.data[itx] = impl::ptr<Type>(v.data[i]);
-                ++itx;
+            eptr base;
+            std::ptrdiff_t stride;
+            if (get_linear(v, base, stride)) {
+                impl::range_impl::check_bounds(rng, v.dims[0]);
+                t.data = typename type::vtype(base + range_first(rng)*stride, t.dims[0], stride);
+            } else {
+                t.resize();
+                auto& p = t.data.indirect();
+                uint_t itx = 0;
+                for (uint_t i : range(rng, v.dims[0])) {
+                    p[itx] = impl::ptr<Type>(v.data[i]);
+                    ++itx;
+                }
             }
 
             return t;
@@ -490,9 +612,10 @@ namespace vec_access {
             t.dims[0] = ids.size();
             t.resize();
 
+            auto& p = t.data.indirect();
             uint_t itx = 0;
             for (uint_t i : ids) {
-                t.data[itx] = impl::ptr<Type>(v.data[to_idx(v,i)]);
+                p[itx] = impl::ptr<Type>(v.data[to_idx(v,i)]);
                 ++itx;
             }
 
@@ -592,14 +715,23 @@ namespace vec_access {
     template<typename V, typename T>
     auto bracket_access(V& parent, const T& rng) ->
         vec<1,meta::constify<typename V::rtype, V>*> {
-        vec<1,meta::constify<typename V::rtype, V>*> v(impl::vec_ref_tag, parent);
+        using type = vec<1,meta::constify<typename V::rtype, V>*>;
+        type v(impl::vec_ref_tag, parent);
         v.dims[0] = impl::range_impl::range_size(rng, parent.size());
-        v.data.resize(v.dims[0]);
 
-        uint_t itx = 0;
-        for (uint_t i : range(rng, parent.size())) {
-            v.data[itx] = impl::ptr<typename V::rtype>(parent.data[i]);
-            ++itx;
+        typename type::dtype* base;
+        std::ptrdiff_t stride;
+        if (get_linear(parent, base, stride)) {
+            impl::range_impl::check_bounds(rng, parent.size());
+            v.data = typename type::vtype(base + range_first(rng)*stride, v.dims[0], stride);
+        } else {
+            auto& p = v.data.indirect();
+            p.resize(v.dims[0]);
+            uint_t itx = 0;
+            for (uint_t i : range(rng, parent.size())) {
+                p[itx] = impl::ptr<typename V::rtype>(parent.data[i]);
+                ++itx;
+            }
         }
 
         return v;
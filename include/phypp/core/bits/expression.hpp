@@ -0,0 +1,591 @@
+#ifndef PHYPP_INCLUDING_CORE_VEC_BITS
+#error this file is not meant to be included separately, include "phypp/core/vec.hpp" instead
+#endif
+
+namespace phypp {
+    ////////////////////////////////////////////
+    //          Vector expressions            //
+    ////////////////////////////////////////////
+
+    // Arithmetic operators on vectors do not compute their result immediately. Instead, they
+    // return a vector expression, vec<Dim,impl::vec_expr<E>>, which only stores its operands
+    // and computes each element on demand. Chained operations are thus fused into a single
+    // loop, which is executed only once the expression is assigned to a vector, or read by a
+    // function (e.g., total()). Vector operands are stored by reference when they are
+    // lvalues, and moved inside the expression when they are temporaries.
+
+    // Mathematical operators
+    namespace impl {
+        struct op_mul_t {
+            template<typename T, typename U>
+            static auto apply(const T& t, const U& u) -> decltype(t*u) { return t*u; }
+        };
+        struct op_div_t {
+            template<typename T, typename U>
+            static auto apply(const T& t, const U& u) -> decltype(t/u) { return t/u; }
+        };
+        struct op_mod_t {
+            template<typename T, typename U>
+            static auto apply(const T& t, const U& u) -> decltype(t%u) { return t%u; }
+        };
+        struct op_add_t {
+            template<typename T, typename U>
+            static auto apply(const T& t, const U& u) -> decltype(t+u) { return t+u; }
+        };
+        struct op_sub_t {
+            template<typename T, typename U>
+            static auto apply(const T& t, const U& u) -> decltype(t-u) { return t-u; }
+        };
+
+        struct op_node_t {
+            op_mul_t operator * (op_node_t);
+            op_div_t operator / (op_node_t);
+            op_mod_t operator % (op_node_t);
+            op_add_t operator + (op_node_t);
+            op_sub_t operator - (op_node_t);
+        };
+
+        #define OP_TYPE(op) decltype(impl::op_node_t{} op impl::op_node_t{})
+
+        template<typename T>
+        using math_bake_type = typename std::decay<meta::rtype_t<
+            meta::data_type_t<meta::rtype_t<T>>>>::type;
+
+        template<typename OP, typename T, typename U>
+        struct op_res_t {
+            using type = typename std::decay<decltype(OP::apply(std::declval<math_bake_type<T>>(),
+                std::declval<math_bake_type<U>>()))>::type;
+        };
+
+        // Storage of a vector operand: a const reference for lvalues, a copy for rvalues
+        template<typename V>
+        using expr_storage_t = typename std::conditional<std::is_lvalue_reference<V>::value,
+            const typename std::decay<V>::type&, typename std::decay<V>::type>::type;
+
+        template<typename DT>
+        std::vector<DT>* expr_buffer_(...) {
+            return nullptr;
+        }
+
+        template<typename DT, std::size_t Dim, typename T, typename enable = typename std::enable_if<
+            std::is_same<meta::dtype_t<T>,DT>::value>::type>
+        std::vector<DT>* expr_buffer_(vec<Dim,T>* v) {
+            return &v->data;
+        }
+
+        template<typename DT, std::size_t Dim, typename E>
+        std::vector<DT>* expr_buffer_(vec<Dim,vec_expr<E>>* v) {
+            return v->expr.template buffer<DT>();
+        }
+
+        // Expression leaf: a vector
+        template<typename V>
+        struct expr_vec_leaf {
+            using vec_type = typename std::decay<V>::type;
+            using value_type = typename vec_type::rtype;
+
+            expr_storage_t<V> v;
+
+            template<typename T>
+            explicit expr_vec_leaf(T&& t) : v(std::forward<T>(t)) {}
+
+            auto get(uint_t i) const -> decltype(std::declval<const vec_type&>().safe[i]) {
+                return v.safe[i];
+            }
+
+            template<typename T>
+            bool aliases(const T& t) const {
+                return v.view_same(t);
+            }
+
+            // Storage of a temporary vector that can receive the result of the expression
+            template<typename DT>
+            std::vector<DT>* buffer() {
+                return buffer_<DT>(meta::cte_t<std::is_reference<V>::value>());
+            }
+
+            template<typename DT>
+            std::vector<DT>* buffer_(meta::cte_t<true>) {
+                return nullptr;
+            }
+
+            template<typename DT>
+            std::vector<DT>* buffer_(meta::cte_t<false>) {
+                return expr_buffer_<DT>(&v);
+            }
+        };
+
+        // Expression leaf: a scalar
+        template<typename T>
+        struct expr_scalar_leaf {
+            using value_type = T;
+
+            T v;
+
+            template<typename U>
+            explicit expr_scalar_leaf(const U& u) : v(u) {}
+
+            const T& get(uint_t) const {
+                return v;
+            }
+
+            template<typename U>
+            bool aliases(const U&) const {
+                return false;
+            }
+
+            template<typename DT>
+            std::vector<DT>* buffer() {
+                return nullptr;
+            }
+        };
+
+        // Expression node: binary operation
+        template<typename OP, typename L, typename R>
+        struct expr_binary {
+            using value_type = typename op_res_t<OP, typename L::value_type,
+                typename R::value_type>::type;
+
+            L l;
+            R r;
+
+            template<typename TL, typename TR>
+            expr_binary(TL&& tl, TR&& tr) : l(std::forward<TL>(tl)), r(std::forward<TR>(tr)) {}
+
+            value_type get(uint_t i) const {
+                return OP::apply(l.get(i), r.get(i));
+            }
+
+            template<typename T>
+            bool aliases(const T& t) const {
+                return l.aliases(t) || r.aliases(t);
+            }
+
+            template<typename DT>
+            std::vector<DT>* buffer() {
+                std::vector<DT>* b = l.template buffer<DT>();
+                return b ? b : r.template buffer<DT>();
+            }
+        };
+
+        // Expression node: negation
+        template<typename L>
+        struct expr_negate {
+            using value_type = typename std::decay<decltype(-std::declval<typename L::value_type>())>::type;
+
+            L l;
+
+            template<typename TL>
+            explicit expr_negate(TL&& tl) : l(std::forward<TL>(tl)) {}
+
+            value_type get(uint_t i) const {
+                return -l.get(i);
+            }
+
+            template<typename T>
+            bool aliases(const T& t) const {
+                return l.aliases(t);
+            }
+
+            template<typename DT>
+            std::vector<DT>* buffer() {
+                return l.template buffer<DT>();
+            }
+        };
+
+        template<typename V>
+        using expr_leaf_t = expr_vec_leaf<V>;
+
+        template<typename U>
+        using expr_scalar_t = expr_scalar_leaf<typename std::decay<const U&>::type>;
+
+        // Checks to enable the operator overloads
+        template<typename V, typename U>
+        struct expr_vec_vec : std::false_type {};
+
+        template<std::size_t Dim, typename T, typename U>
+        struct expr_vec_vec<vec<Dim,T>,vec<Dim,U>> : std::true_type {};
+
+        template<typename V, typename U>
+        using is_expr_vec_vec = expr_vec_vec<typename std::decay<V>::type, typename std::decay<U>::type>;
+
+        template<typename V, typename U>
+        using is_expr_vec_scalar = std::integral_constant<bool,
+            meta::is_vec<V>::value && !meta::is_vec<U>::value>;
+
+        template<typename V>
+        struct expr_dim;
+
+        template<std::size_t Dim, typename T>
+        struct expr_dim<vec<Dim,T>> : std::integral_constant<std::size_t, Dim> {};
+
+        template<typename V>
+        using expr_dim_t = expr_dim<typename std::decay<V>::type>;
+
+        // Return types of the operators
+        template<typename OP, typename V, typename U>
+        using expr_vv_t = vec<expr_dim_t<V>::value,
+            vec_expr<expr_binary<OP, expr_leaf_t<V>, expr_leaf_t<U>>>>;
+
+        template<typename OP, typename V, typename U>
+        using expr_vs_t = vec<expr_dim_t<V>::value,
+            vec_expr<expr_binary<OP, expr_leaf_t<V>, expr_scalar_t<U>>>>;
+
+        template<typename OP, typename U, typename V>
+        using expr_sv_t = vec<expr_dim_t<V>::value,
+            vec_expr<expr_binary<OP, expr_scalar_t<U>, expr_leaf_t<V>>>>;
+
+        template<typename V>
+        using expr_neg_t = vec<expr_dim_t<V>::value, vec_expr<expr_negate<expr_leaf_t<V>>>>;
+
+        // Same expression with different dimensions
+        template<std::size_t Dim, typename V>
+        using expr_reshape_t = vec<Dim, vec_expr<expr_leaf_t<V>>>;
+
+        // Compute the value of the expression into 'out'.
+        // When the expression owns a temporary vector of the right type, its storage is reused.
+        template<typename DT, std::size_t Dim, typename E>
+        void expr_eval(std::vector<DT>& out, vec<Dim,vec_expr<E>>& v) {
+            const uint_t n = v.size();
+            std::vector<DT>* b = v.expr.template buffer<DT>();
+            std::vector<DT> t;
+            if (!b || b->size() != n) {
+                t.resize(n);
+                b = &t;
+            }
+
+            if (parallel::use(n)) {
+                parallel::for_chunks(n, parallel::grain, [&](uint_t i0, uint_t i1) {
+                    for (uint_t i = i0; i < i1; ++i) {
+                        (*b)[i] = v.expr.get(i);
+                    }
+                });
+            } else {
+                for (uint_t i = 0; i < n; ++i) {
+                    (*b)[i] = v.expr.get(i);
+                }
+            }
+
+            out = std::move(*b);
+        }
+
+        // Read-only container interface for the 'data' member of an expression
+        template<typename V>
+        class expr_data {
+            const V* parent;
+
+        public :
+            using value_type = typename V::rtype;
+
+            class const_iterator {
+            public :
+                using difference_type = std::ptrdiff_t;
+                using value_type = typename V::rtype;
+                using pointer = const value_type*;
+                using reference = const value_type&;
+                using iterator_category = std::random_access_iterator_tag;
+
+            private :
+                const V* p = nullptr;
+                uint_t i = 0;
+                mutable value_type value;
+
+                friend expr_data;
+
+                const_iterator(const V* tp, uint_t ti) : p(tp), i(ti) {}
+
+            public :
+
+                const_iterator() = default;
+
+                // The value is cached inside the iterator, so the reference is only valid
+                // until the iterator is modified or destroyed
+                reference operator * () const { value = p->expr.get(i); return value; }
+                pointer operator -> () const { return &**this; }
+                value_type operator [] (difference_type n) const { return p->expr.get(i+n); }
+
+                const_iterator& operator ++ () { ++i; return *this; }
+                const_iterator& operator -- () { --i; return *this; }
+                const_iterator operator ++ (int) { const_iterator t = *this; ++i; return t; }
+                const_iterator operator -- (int) { const_iterator t = *this; --i; return t; }
+                const_iterator& operator += (difference_type n) { i += n; return *this; }
+                const_iterator& operator -= (difference_type n) { i -= n; return *this; }
+                const_iterator operator + (difference_type n) const { return const_iterator(p, i+n); }
+                const_iterator operator - (difference_type n) const { return const_iterator(p, i-n); }
+                friend const_iterator operator + (difference_type n, const const_iterator& t) {
+                    return t + n;
+                }
+
+                difference_type operator - (const const_iterator& t) const {
+                    return difference_type(i) - difference_type(t.i);
+                }
+
+                bool operator == (const const_iterator& t) const { return i == t.i; }
+                bool operator != (const const_iterator& t) const { return i != t.i; }
+                bool operator <  (const const_iterator& t) const { return i <  t.i; }
+                bool operator <= (const const_iterator& t) const { return i <= t.i; }
+                bool operator >  (const const_iterator& t) const { return i >  t.i; }
+                bool operator >= (const const_iterator& t) const { return i >= t.i; }
+            };
+
+            using iterator = const_iterator;
+
+            explicit expr_data(const V& p) : parent(&p) {}
+
+            uint_t size() const {
+                uint_t n = 1;
+                for (uint_t i = 0; i < parent->dims.size(); ++i) {
+                    n *= parent->dims[i];
+                }
+
+                return n;
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+            value_type operator [] (uint_t i) const {
+                return parent->expr.get(i);
+            }
+
+            value_type front() const {
+                return parent->expr.get(0);
+            }
+
+            value_type back() const {
+                return parent->expr.get(size()-1);
+            }
+
+            const_iterator begin() const {
+                return const_iterator(parent, 0);
+            }
+
+            const_iterator end() const {
+                return const_iterator(parent, size());
+            }
+
+            const_iterator cbegin() const {
+                return begin();
+            }
+
+            const_iterator cend() const {
+                return end();
+            }
+        };
+    }
+
+    namespace meta {
+        // Type obtained once an expression is evaluated (other types are unchanged)
+        template<typename T>
+        struct concrete_type {
+            using type = T;
+        };
+
+        template<std::size_t Dim, typename E>
+        struct concrete_type<vec<Dim,impl::vec_expr<E>>> {
+            using type = vec<Dim,typename E::value_type>;
+        };
+
+        template<typename T>
+        using concrete_t = typename concrete_type<typename std::decay<T>::type>::type;
+    }
+
+    // The vector expression
+    template<std::size_t Dim, typename E>
+    struct vec<Dim,impl::vec_expr<E>> {
+        using rtype = typename E::value_type;
+        using effective_type = vec<Dim,rtype>;
+        using dtype = meta::dtype_t<rtype>;
+        using drtype = rtype;
+        using vtype = impl::expr_data<vec>;
+        using dim_type = std::array<std::size_t, Dim>;
+        using const_iterator = typename vtype::const_iterator;
+        using iterator = const_iterator;
+
+        struct comparator {
+            bool operator() (const dtype& t1, const dtype& t2) const {
+                return t1 < t2;
+            }
+            template<typename U>
+            bool operator() (const dtype& t1, const U& t2) const {
+                return t1 < t2;
+            }
+            template<typename U>
+            bool operator() (const U& t1, const dtype& t2) const {
+                return t1 < t2;
+            }
+        };
+
+        E        expr;
+        vtype    data;
+        dim_type dims = {{0}};
+
+        template<typename ... Args>
+        explicit vec(dim_type d, Args&& ... args) :
+            expr(std::forward<Args>(args)...), data(*this), dims(d), safe(*this) {}
+
+        vec(const vec& v) : expr(v.expr), data(*this), dims(v.dims), safe(*this) {}
+        vec(vec&& v) : expr(std::move(v.expr)), data(*this), dims(v.dims), safe(*this) {}
+
+        vec& operator = (const vec&) = delete;
+        vec& operator = (vec&&) = delete;
+
+        bool empty() const {
+            return data.empty();
+        }
+
+        uint_t size() const {
+            return data.size();
+        }
+
+        // Evaluate the expression into a new vector
+        effective_type concretise() const & {
+            return *this;
+        }
+
+        effective_type concretise() && {
+            return std::move(*this);
+        }
+
+        template<std::size_t D, typename T>
+        bool view_same(const vec<D,T>& v) const {
+            return expr.aliases(v);
+        }
+
+        rtype back() const {
+            static_assert(Dim == 1, "cannot call back() on multidimensional verctors");
+            return data.back();
+        }
+
+        rtype front() const {
+            static_assert(Dim == 1, "cannot call front() on multidimensional verctors");
+            return data.front();
+        }
+
+        uint_t pitch(uint_t i) const {
+            uint_t p = 1;
+            for (uint_t j = i+1; j < Dim; ++j) {
+                p *= dims[j];
+            }
+            return p;
+        }
+
+        template<typename T>
+        static uint_t to_idx_(T ui, uint_t n, meta::cte_t<false>) {
+            phypp_check(ui < n, "index out of bounds (", ui, " vs. ", n, ")");
+            return ui;
+        }
+
+        template<typename T>
+        static uint_t to_idx_(T i, uint_t n, meta::cte_t<true>) {
+            if (i < 0) i += n;
+            phypp_check(i >= 0 && uint_t(i) < n, "index out of bounds (", i, " vs. ", n, ")");
+            return i;
+        }
+
+        template<typename T, typename enable =
+            typename std::enable_if<std::is_integral<T>::value>::type>
+        rtype operator [] (T i) const {
+            return expr.get(to_idx_(i, size(), meta::cte_t<std::is_signed<T>::value>()));
+        }
+
+        // Evaluate a subset of the expression. The result is returned as a new (const) vector;
+        // it cannot be used to modify the operands of the expression.
+        template<typename T, typename enable =
+            typename std::enable_if<std::is_integral<meta::rtype_t<T>>::value>::type>
+        const vec<1,rtype> operator [] (const vec<1,T>& ids) const {
+            vec<1,rtype> r(ids.size());
+            for (uint_t i = 0; i < ids.size(); ++i) {
+                r.safe[i] = expr.get(to_idx_(ids.safe[i], size(),
+                    meta::cte_t<std::is_signed<meta::rtype_t<T>>::value>()));
+            }
+
+            return r;
+        }
+
+        template<typename T, typename enable =
+            typename std::enable_if<meta::is_range<T>::value>::type>
+        const vec<1,rtype> operator [] (const T& rng) const {
+            vec<1,rtype> r;
+            for (uint_t i : range(rng, size())) {
+                r.push_back(expr.get(i));
+            }
+
+            return r;
+        }
+
+        template<typename ... Args, typename enable = typename std::enable_if<
+            meta::are_all_true<meta::bool_list<std::is_integral<Args>::value...>>::value>::type>
+        rtype operator () (Args ... i) const {
+            static_assert(sizeof...(Args) == Dim, "wrong number of indices for this vector");
+            return expr.get(flat_index_(meta::cte_t<0>(), 0, i...));
+        }
+
+        uint_t flat_index_(meta::cte_t<Dim>, uint_t idx) const {
+            return idx;
+        }
+
+        template<std::size_t D, typename T, typename ... Args>
+        uint_t flat_index_(meta::cte_t<D>, uint_t idx, T i, Args ... args) const {
+            return flat_index_(meta::cte_t<D+1>(), idx*dims[D] +
+                to_idx_(i, dims[D], meta::cte_t<std::is_signed<T>::value>()), args...);
+        }
+
+        vec operator + () const {
+            return *this;
+        }
+
+        impl::expr_neg_t<const vec&> operator - () const & {
+            return impl::expr_neg_t<const vec&>(dims, *this);
+        }
+
+        impl::expr_neg_t<vec> operator - () && {
+            return impl::expr_neg_t<vec>(dims, std::move(*this));
+        }
+
+        struct safe_proxy {
+            const vec& parent;
+
+            explicit safe_proxy(const vec& p) : parent(p) {}
+
+            rtype operator [] (uint_t i) const {
+                return parent.expr.get(i);
+            }
+
+            template<typename T, typename enable =
+                typename std::enable_if<std::is_integral<meta::rtype_t<T>>::value>::type>
+            const vec<1,rtype> operator [] (const vec<1,T>& ids) const {
+                vec<1,rtype> r(ids.size());
+                for (uint_t i = 0; i < ids.size(); ++i) {
+                    r.safe[i] = parent.expr.get(ids.safe[i]);
+                }
+
+                return r;
+            }
+
+            template<typename ... Args>
+            rtype operator () (Args ... i) const {
+                static_assert(sizeof...(Args) == Dim, "wrong number of indices for this vector");
+                return parent.expr.get(flat_index_(meta::cte_t<0>(), 0, i...));
+            }
+
+            uint_t flat_index_(meta::cte_t<Dim>, uint_t idx) const {
+                return idx;
+            }
+
+            template<std::size_t D, typename T, typename ... Args>
+            uint_t flat_index_(meta::cte_t<D>, uint_t idx, T i, Args ... args) const {
+                return flat_index_(meta::cte_t<D+1>(), idx*parent.dims[D] + uint_t(i), args...);
+            }
+        } safe;
+
+        const_iterator begin() const {
+            return data.begin();
+        }
+
+        const_iterator end() const {
+            return data.end();
+        }
+    };
+}
@@ -7,6 +7,15 @@ namespace phypp {
     template<std::size_t Dim, typename Type>
     struct vec;
 
+namespace impl {
+    // Vector expression type, see bits/expression.hpp
+    template<typename E>
+    struct vec_expr;
+
+    template<typename DT, std::size_t Dim, typename E>
+    void expr_eval(std::vector<DT>& out, vec<Dim,vec_expr<E>>& v);
+}
+
 namespace meta {
 
     // Helper to get the vector internal storage type.
@@ -27,12 +36,21 @@ namespace meta {
     // vec<D,T>       = T
     // vec<D,T*>      = T
     // vec<D,const T> = T
+    // vec<D,impl::vec_expr<E>> = type of the expression elements
+    template<typename T>
+    struct rtype {
+        using type = typename std::remove_cv<
+            typename std::remove_pointer<T>::type
+        >::type;
+    };
+
+    template<typename E>
+    struct rtype<impl::vec_expr<E>> {
+        using type = typename E::value_type;
+    };
+
     template<typename T>
-    using rtype_t = typename std::remove_cv<
-        typename std::remove_pointer<
-            typename std::remove_cv<T>::type
-        >::type
-    >::type;
+    using rtype_t = typename rtype<typename std::remove_cv<T>::type>::type;
 }
 
     // Helper to check if a given type is a generic vector.
@@ -148,15 +166,15 @@ namespace meta {
     // Trait to define if a vector type can be implicitly converted into another
     template<typename TFrom, typename TTo>
     using vec_implicit_convertible = impl::meta_impl::vec_implicit_convertible_<
-        typename std::decay<typename std::remove_pointer<TFrom>::type>::type,
-        typename std::decay<typename std::remove_pointer<TTo>::type>::type
+        typename std::decay<rtype_t<TFrom>>::type,
+        typename std::decay<rtype_t<TTo>>::type
     >;
 
     // Trait to define if a vector type can be explicitly converted into another
     template<typename TFrom, typename TTo>
     using vec_explicit_convertible = impl::meta_impl::vec_explicit_convertible_<
-        typename std::decay<typename std::remove_pointer<TFrom>::type>::type,
-        typename std::decay<typename std::remove_pointer<TTo>::type>::type
+        typename std::decay<rtype_t<TFrom>>::type,
+        typename std::decay<rtype_t<TTo>>::type
     >;
 
     // Trait to define if a vector type can be converted *only* explicitly into another
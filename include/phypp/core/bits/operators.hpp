@@ -8,152 +8,31 @@ namespace phypp {
     ////////////////////////////////////////////
 
     // Mathematical operators
-    namespace impl {
-        struct op_mul_t;
-        struct op_div_t;
-        struct op_mod_t;
-        struct op_add_t;
-        struct op_sub_t;
-
-        struct op_node_t {
-            op_mul_t operator * (op_node_t);
-            op_div_t operator / (op_node_t);
-            op_mod_t operator % (op_node_t);
-            op_add_t operator + (op_node_t);
-            op_sub_t operator - (op_node_t);
-        };
-
-        #define OP_TYPE(op) decltype(impl::op_node_t{} op impl::op_node_t{})
-
-        template<typename T>
-        using math_bake_type = typename std::decay<typename std::remove_pointer<
-            meta::data_type_t<typename std::remove_pointer<T>::type>>::type>::type;
-
-        template<typename OP, typename T, typename U>
-        struct op_res_t;
-
-        template<typename T, typename U>
-        struct op_res_t<op_mul_t, T, U> {
-            using type = typename std::decay<decltype(std::declval<math_bake_type<T>>() *
-                std::declval<math_bake_type<U>>())>::type;
-        };
-
-        template<typename T, typename U>
-        struct op_res_t<op_div_t, T, U> {
-            using type = typename std::decay<decltype(std::declval<math_bake_type<T>>() /
-                std::declval<math_bake_type<U>>())>::type;
-        };
-
-        template<typename T, typename U>
-        struct op_res_t<op_mod_t, T, U> {
-            using type = typename std::decay<decltype(std::declval<math_bake_type<T>>() %
-                std::declval<math_bake_type<U>>())>::type;
-        };
-
-        template<typename T, typename U>
-        struct op_res_t<op_add_t, T, U> {
-            using type = typename std::decay<decltype(std::declval<math_bake_type<T>>() +
-                std::declval<math_bake_type<U>>())>::type;
-        };
-
-        template<typename T, typename U>
-        struct op_res_t<op_sub_t, T, U> {
-            using type = typename std::decay<decltype(std::declval<math_bake_type<T>>() -
-                std::declval<math_bake_type<U>>())>::type;
-        };
-
-        template<typename T>
-        const T& get_element_(const T& t, uint_t i) {
-            return t;
-        }
-
-        template<std::size_t Dim, typename T>
-        auto get_element_(const vec<Dim,T>& t, uint_t i) -> decltype(t.safe[i]) {
-            return t.safe[i];
-        }
-    }
-
-    #define VECTORIZE(op, sop) \
-        template<std::size_t Dim, typename T, typename U> \
-        vec<Dim,typename impl::op_res_t<OP_TYPE(op),T,U>::type> operator op (const vec<Dim,T>& v, const vec<Dim,U>& u) { \
-            phypp_check(v.dims == u.dims, "incompatible dimensions in operator '" #op \
-                "' (", v.dims, " vs ", u.dims, ")"); \
-            vec<Dim,typename impl::op_res_t<OP_TYPE(op),T,U>::type> tv; tv.dims = v.dims; tv.reserve(v.size()); \
-            for (uint_t i : range(v)) { \
-                tv.data.push_back(impl::get_element_(v, i) op impl::get_element_(u, i)); \
-            } \
-            return tv; \
-        } \
-        template<std::size_t Dim, typename T, typename U> \
-        vec<Dim,typename impl::op_res_t<OP_TYPE(op),T,U>::type> operator op (const vec<Dim,T>& v, const U& u) { \
-            vec<Dim,typename impl::op_res_t<OP_TYPE(op),T,U>::type> tv; tv.dims = v.dims; tv.reserve(v.size()); \
-            for (uint_t i : range(v)) { \
-                tv.data.push_back(impl::get_element_(v, i) op u); \
-            } \
-            return tv; \
-        } \
-        template<std::size_t Dim, typename T, typename U, typename enable = typename std::enable_if< \
-            std::is_same<typename impl::op_res_t<OP_TYPE(op),T,U>::type, T>::value>::type> \
-        vec<Dim,T> operator op (vec<Dim,T>&& v, const vec<Dim,U>& u) { \
-            phypp_check(v.dims == u.dims, "incompatible dimensions in operator '" #op \
-                "' (", v.dims, " vs ", u.dims, ")"); \
-            for (uint_t i : range(v)) { \
-                v.data[i] sop impl::get_element_(u, i); \
-            } \
-            return std::move(v); \
-        } \
-        template<std::size_t Dim, typename T, typename U, typename enable = typename std::enable_if< \
-            std::is_same<typename impl::op_res_t<OP_TYPE(op),T,U>::type, T>::value>::type> \
-        vec<Dim,T> operator op (vec<Dim,T>&& v, const U& u) { \
-            for (auto& t : v) { \
-                t sop u; \
-            } \
-            return std::move(v); \
-        } \
-        template<std::size_t Dim, typename T, typename U, typename enable = typename std::enable_if< \
-            !meta::is_vec<U>::value>::type> \
-        vec<Dim,typename impl::op_res_t<OP_TYPE(op),U,T>::type> operator op (const U& u, const vec<Dim,T>& v) { \
-            vec<Dim,typename impl::op_res_t<OP_TYPE(op),T,U>::type> tv; tv.dims = v.dims; tv.reserve(v.size()); \
-            for (uint_t i : range(v)) { \
-                tv.data.push_back(u op impl::get_element_(v, i)); \
-            } \
-            return tv; \
-        } \
-        template<std::size_t Dim, typename T, typename U, typename enable = typename std::enable_if< \
-            std::is_same<typename impl::op_res_t<OP_TYPE(op),U,T>::type, T>::value>::type> \
-        vec<Dim,T> operator op (const vec<Dim,U>& u, vec<Dim,T>&& v) { \
+    // These return vector expressions (see bits/expression.hpp).
+    #define VECTORIZE(op) \
+        template<typename V, typename U, typename enable = typename std::enable_if< \
+            impl::is_expr_vec_vec<V,U>::value>::type> \
+        impl::expr_vv_t<OP_TYPE(op),V,U> operator op (V&& v, U&& u) { \
             phypp_check(v.dims == u.dims, "incompatible dimensions in operator '" #op \
                 "' (", v.dims, " vs ", u.dims, ")"); \
-            for (uint_t i : range(v)) { \
-                v.data[i] = impl::get_element_(u, i) op v.data[i]; \
-            } \
-            return std::move(v); \
+            return impl::expr_vv_t<OP_TYPE(op),V,U>(v.dims, std::forward<V>(v), std::forward<U>(u)); \
         } \
-        template<std::size_t Dim, typename T, typename U, typename enable = typename std::enable_if< \
-            std::is_same<typename impl::op_res_t<OP_TYPE(op),U,T>::type, T>::value>::type> \
-        vec<Dim,T> operator op (const U& u, vec<Dim,T>&& v) { \
-            for (auto& t : v) { \
-                t = u op t; \
-            } \
-            return std::move(v); \
+        template<typename V, typename U, typename enable = typename std::enable_if< \
+            impl::is_expr_vec_scalar<V,U>::value>::type> \
+        impl::expr_vs_t<OP_TYPE(op),V,U> operator op (V&& v, const U& u) { \
+            return impl::expr_vs_t<OP_TYPE(op),V,U>(v.dims, std::forward<V>(v), u); \
         } \
-        template<std::size_t Dim, typename T, typename U, typename enable = typename std::enable_if< \
-            std::is_same<typename impl::op_res_t<OP_TYPE(op),T,U>::type, T>::value && \
-            !std::is_pointer<U>::value>::type> \
-        vec<Dim,T> operator op (vec<Dim,T>&& v, vec<Dim,U>&& u) { \
-            phypp_check(v.dims == u.dims, "incompatible dimensions in operator '" #op \
-                "' (", v.dims, " vs ", u.dims, ")"); \
-            for (uint_t i : range(v)) { \
-                v.data[i] sop u.data[i]; \
-            } \
-            return std::move(v); \
+        template<typename U, typename V, typename enable = typename std::enable_if< \
+            impl::is_expr_vec_scalar<V,U>::value>::type> \
+        impl::expr_sv_t<OP_TYPE(op),U,V> operator op (const U& u, V&& v) { \
+            return impl::expr_sv_t<OP_TYPE(op),U,V>(v.dims, u, std::forward<V>(v)); \
         }
 
-    VECTORIZE(*, *=)
-    VECTORIZE(+, +=)
-    VECTORIZE(/, /=)
-    VECTORIZE(%, %=)
-    VECTORIZE(-, -=)
+    VECTORIZE(*)
+    VECTORIZE(+)
+    VECTORIZE(/)
+    VECTORIZE(%)
+    VECTORIZE(-)
 
     #undef VECTORIZE
 
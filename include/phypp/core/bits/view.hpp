@@ -0,0 +1,234 @@
+#ifndef PHYPP_INCLUDING_CORE_VEC_BITS
+#error this file is not meant to be included separately, include "phypp/core/vec.hpp" instead
+#endif
+
+namespace phypp {
+namespace impl {
+    // Storage of a vector view, i.e. vec<Dim,Type*>.
+    // Regular slices, i.e. views built only from scalar indices and ranges, are stored as
+    // a base pointer and a set of strides: creating them does not depend on the number of
+    // elements, and accessing them involves no pointer chasing. Scattered selections (made
+    // from index vectors) are stored as an explicit list of pointers, one per element.
+    // All the read-only operations behave like a std::vector<T*>. Operations that modify the
+    // list of pointers itself (e.g., sorting the view) first convert the storage into an
+    // explicit list of pointers.
+    template<typename T>
+    class view_data {
+    public :
+        using value_type = T*;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using indirect_type = std::vector<T*>;
+        using iterator = typename indirect_type::iterator;
+
+        class const_iterator {
+            const view_data* d = nullptr;
+            uint_t i = 0;
+
+            friend view_data;
+
+            const_iterator(const view_data* td, uint_t ti) : d(td), i(ti) {}
+
+        public :
+            using difference_type = std::ptrdiff_t;
+            using value_type = T*;
+            using pointer = T* const*;
+            using reference = T*;
+            using iterator_category = std::random_access_iterator_tag;
+
+            const_iterator() = default;
+
+            T* operator * () const { return (*d)[i]; }
+            T* operator [] (difference_type n) const { return (*d)[i+n]; }
+
+            const_iterator& operator ++ () { ++i; return *this; }
+            const_iterator& operator -- () { --i; return *this; }
+            const_iterator operator ++ (int) { const_iterator t = *this; ++i; return t; }
+            const_iterator operator -- (int) { const_iterator t = *this; --i; return t; }
+            const_iterator& operator += (difference_type n) { i += n; return *this; }
+            const_iterator& operator -= (difference_type n) { i -= n; return *this; }
+            const_iterator operator + (difference_type n) const { return const_iterator(d, i+n); }
+            const_iterator operator - (difference_type n) const { return const_iterator(d, i-n); }
+            friend const_iterator operator + (difference_type n, const const_iterator& t) {
+                return t + n;
+            }
+
+            difference_type operator - (const const_iterator& t) const {
+                return difference_type(i) - difference_type(t.i);
+            }
+
+            bool operator == (const const_iterator& t) const { return i == t.i; }
+            bool operator != (const const_iterator& t) const { return i != t.i; }
+            bool operator <  (const const_iterator& t) const { return i <  t.i; }
+            bool operator <= (const const_iterator& t) const { return i <= t.i; }
+            bool operator >  (const const_iterator& t) const { return i >  t.i; }
+            bool operator >= (const const_iterator& t) const { return i >= t.i; }
+        };
+
+    private :
+        enum class layout : char {
+            linear,  // base + i*stride
+            strided, // base + sum_k i_k*steps[k], with i_k the row-major index in 'extents'
+            indirect // ptrs[i]
+        };
+
+        layout mode_ = layout::linear;
+        T* base_ = nullptr;
+        uint_t size_ = 0;
+        std::ptrdiff_t stride_ = 1;
+        std::vector<uint_t> extents_;
+        std::vector<std::ptrdiff_t> steps_;
+        indirect_type ptrs_;
+
+        T* strided_get_(uint_t i) const {
+            std::ptrdiff_t off = 0;
+            for (uint_t k = extents_.size(); k-- != 0;) {
+                off += std::ptrdiff_t(i % extents_[k])*steps_[k];
+                i /= extents_[k];
+            }
+
+            return base_ + off;
+        }
+
+    public :
+        view_data() = default;
+
+        // Build a linear view: base, base+stride, ..., base+(n-1)*stride
+        view_data(T* base, uint_t n, std::ptrdiff_t stride = 1) :
+            base_(base), size_(n), stride_(stride) {}
+
+        // Build a strided view from a list of (extent, step) pairs, in row-major order.
+        // Dimensions are merged whenever possible, so that most regular slices end up in
+        // the linear layout.
+        void set_strided(T* base, const uint_t* extents, const std::ptrdiff_t* steps, uint_t n) {
+            ptrs_.clear();
+            extents_.clear();
+            steps_.clear();
+            base_ = base;
+            size_ = 1;
+
+            for (uint_t k = 0; k < n; ++k) {
+                size_ *= extents[k];
+                if (extents[k] == 1) continue;
+
+                if (!extents_.empty() && steps_.back() == steps[k]*std::ptrdiff_t(extents[k])) {
+                    extents_.back() *= extents[k];
+                    steps_.back() = steps[k];
+                } else {
+                    extents_.push_back(extents[k]);
+                    steps_.push_back(steps[k]);
+                }
+            }
+
+            if (size_ == 0) {
+                base_ = nullptr;
+            }
+
+            if (size_ == 0 || extents_.size() <= 1) {
+                mode_ = layout::linear;
+                stride_ = (extents_.empty() || size_ == 0 ? 1 : steps_[0]);
+                extents_.clear();
+                steps_.clear();
+            } else {
+                mode_ = layout::strided;
+            }
+        }
+
+        // Check if elements can be reached as base + i*stride, and if so return these.
+        bool linear(T*& base, std::ptrdiff_t& stride) const {
+            if (mode_ != layout::linear) return false;
+            base = base_;
+            stride = stride_;
+            return true;
+        }
+
+        bool is_indirect() const {
+            return mode_ == layout::indirect;
+        }
+
+        // Convert the storage into an explicit list of pointers, and return this list.
+        indirect_type& indirect() {
+            if (mode_ != layout::indirect) {
+                indirect_type p(size_);
+                for (uint_t i = 0; i < size_; ++i) {
+                    p[i] = (*this)[i];
+                }
+
+                ptrs_ = std::move(p);
+                extents_.clear();
+                steps_.clear();
+                base_ = nullptr;
+                size_ = 0;
+                mode_ = layout::indirect;
+            }
+
+            return ptrs_;
+        }
+
+        uint_t size() const {
+            return mode_ == layout::indirect ? ptrs_.size() : size_;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        T* operator [] (uint_t i) const {
+            switch (mode_) {
+            case layout::linear :   return base_ + std::ptrdiff_t(i)*stride_;
+            case layout::strided :  return strided_get_(i);
+            default :               return ptrs_[i];
+            }
+        }
+
+        T* front() const {
+            return (*this)[0];
+        }
+
+        T* back() const {
+            return (*this)[size()-1];
+        }
+
+        const_iterator cbegin() const {
+            return const_iterator(this, 0);
+        }
+
+        const_iterator cend() const {
+            return const_iterator(this, size());
+        }
+
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        const_iterator end() const {
+            return cend();
+        }
+
+        // Modifying operations: use the explicit list of pointers
+        iterator begin() {
+            return indirect().begin();
+        }
+
+        iterator end() {
+            return indirect().end();
+        }
+
+        void resize(uint_t n) {
+            indirect().resize(n);
+        }
+
+        void reserve(uint_t n) {
+            indirect().reserve(n);
+        }
+
+        void push_back(T* t) {
+            indirect().push_back(t);
+        }
+
+        void clear() {
+            *this = view_data();
+        }
+    };
+}
+}
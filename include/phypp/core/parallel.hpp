@@ -0,0 +1,467 @@
+#ifndef PHYPP_CORE_PARALLEL_HPP
+#define PHYPP_CORE_PARALLEL_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <exception>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include "phypp/core/typedefs.hpp"
+#include "phypp/core/range.hpp"
+
+namespace phypp {
+    // Execution policy tag: run the function in parallel, regardless of the global setting
+    struct par_t {};
+    static const par_t par = par_t{};
+
+namespace impl {
+    namespace parallel_impl {
+        inline uint_t& threads_() {
+            static uint_t n = [] {
+                const char* e = std::getenv("PHYPP_THREADS");
+                uint_t t = (e ? std::strtoul(e, nullptr, 10) : 0);
+                if (t == 0) t = std::thread::hardware_concurrency();
+                return t == 0 ? uint_t(1) : t;
+            }();
+            return n;
+        }
+
+        inline std::atomic<bool>& enabled_() {
+            static std::atomic<bool> e(false);
+            return e;
+        }
+
+        // Work-stealing scheduler.
+        // Each worker thread owns a queue of tasks: it pushes and pops tasks at the back
+        // (most recent first), while idle workers steal tasks from the front of the other
+        // queues (oldest first). Tasks submitted from outside the pool go into a shared
+        // queue. Workers with nothing to do park on a condition variable. Threads waiting
+        // for the completion of some tasks execute pending tasks in the meantime, so tasks
+        // can spawn and wait for other tasks without blocking the pool.
+        class scheduler_t {
+            struct queue_t {
+                std::mutex mutex;
+                std::deque<std::function<void()>> tasks;
+            };
+
+            struct thread_state_t {
+                scheduler_t* scheduler = nullptr;
+                uint_t queue = 0;
+            };
+
+            // queues_[0] is the shared queue, queues_[i] belongs to workers_[i-1]
+            std::vector<std::unique_ptr<queue_t>> queues_;
+            std::vector<std::thread> workers_;
+            std::atomic<uint_t> pending_;
+            std::atomic<uint_t> sleepers_;
+            std::atomic<bool> stop_;
+            std::mutex park_mutex_;
+            std::condition_variable park_cv_;
+
+            static thread_state_t& this_thread_() {
+                static thread_local thread_state_t s;
+                return s;
+            }
+
+            uint_t own_queue_() {
+                thread_state_t& s = this_thread_();
+                return s.scheduler == this ? s.queue : 0;
+            }
+
+            bool pop_(uint_t q, bool back, std::function<void()>& task) {
+                queue_t& qu = *queues_[q];
+                std::lock_guard<std::mutex> l(qu.mutex);
+                if (qu.tasks.empty()) return false;
+
+                if (back) {
+                    task = std::move(qu.tasks.back());
+                    qu.tasks.pop_back();
+                } else {
+                    task = std::move(qu.tasks.front());
+                    qu.tasks.pop_front();
+                }
+
+                --pending_;
+                return true;
+            }
+
+            bool try_pop_(std::function<void()>& task) {
+                const uint_t nq = queues_.size();
+                uint_t own = own_queue_();
+                if (own != 0 && pop_(own, true, task)) return true;
+                if (pop_(0, false, task)) return true;
+                for (uint_t i = 1; i < nq; ++i) {
+                    uint_t q = (own + i) % nq;
+                    if (q != 0 && pop_(q, false, task)) return true;
+                }
+
+                return false;
+            }
+
+            void worker_loop_(uint_t q) {
+                this_thread_().scheduler = this;
+                this_thread_().queue = q;
+                wait_until([this] { return stop_.load(); });
+            }
+
+        public :
+            explicit scheduler_t(uint_t nthread) : pending_(0), sleepers_(0), stop_(false) {
+                nthread = std::max(nthread, uint_t(1));
+                for (uint_t i = 0; i < nthread; ++i) {
+                    queues_.emplace_back(new queue_t());
+                }
+
+                for (uint_t i = 1; i < nthread; ++i) {
+                    workers_.emplace_back([this,i] { worker_loop_(i); });
+                }
+            }
+
+            ~scheduler_t() {
+                {
+                    std::lock_guard<std::mutex> l(park_mutex_);
+                    stop_ = true;
+                }
+                park_cv_.notify_all();
+                for (auto& t : workers_) {
+                    t.join();
+                }
+            }
+
+            // Number of threads executing tasks (workers, plus one waiting thread)
+            uint_t size() const {
+                return workers_.size() + 1;
+            }
+
+            void push(std::function<void()> task) {
+                queue_t& qu = *queues_[own_queue_()];
+                {
+                    std::lock_guard<std::mutex> l(qu.mutex);
+                    ++pending_;
+                    qu.tasks.push_back(std::move(task));
+                }
+
+                if (sleepers_ > 0) {
+                    std::lock_guard<std::mutex> l(park_mutex_);
+                    park_cv_.notify_one();
+                }
+            }
+
+            // Must be called after any change that can make the predicate of a waiting
+            // thread become true
+            void notify() {
+                if (sleepers_ > 0) {
+                    std::lock_guard<std::mutex> l(park_mutex_);
+                    park_cv_.notify_all();
+                }
+            }
+
+            // Execute one pending task, if any
+            bool run_one() {
+                std::function<void()> task;
+                if (!try_pop_(task)) return false;
+                task();
+                return true;
+            }
+
+            // Execute pending tasks until 'pred' returns true, and park when there are none
+            template<typename P>
+            void wait_until(P&& pred) {
+                while (!pred()) {
+                    if (run_one()) continue;
+
+                    std::unique_lock<std::mutex> l(park_mutex_);
+                    ++sleepers_;
+                    park_cv_.wait(l, [&] { return stop_ || pending_ > 0 || pred(); });
+                    --sleepers_;
+                    if (stop_) break;
+                }
+            }
+
+            // Same as above, giving up after some time.
+            // Returns the value of 'pred()'.
+            template<typename P>
+            bool wait_until(P&& pred, std::chrono::steady_clock::time_point deadline) {
+                while (!pred() && std::chrono::steady_clock::now() < deadline) {
+                    if (run_one()) continue;
+
+                    std::unique_lock<std::mutex> l(park_mutex_);
+                    ++sleepers_;
+                    park_cv_.wait_until(l, deadline, [&] { return stop_ || pending_ > 0 || pred(); });
+                    --sleepers_;
+                    if (stop_) break;
+                }
+
+                return pred();
+            }
+        };
+
+        inline std::unique_ptr<scheduler_t>& scheduler_ptr_() {
+            static std::unique_ptr<scheduler_t> p;
+            return p;
+        }
+
+        inline std::mutex& scheduler_mutex_() {
+            static std::mutex m;
+            return m;
+        }
+
+        inline scheduler_t& scheduler() {
+            std::lock_guard<std::mutex> l(scheduler_mutex_());
+            auto& p = scheduler_ptr_();
+            if (!p) p.reset(new scheduler_t(threads_()));
+            return *p;
+        }
+
+        template<typename T, typename F>
+        void set_promise_(std::promise<T>& p, F& f) {
+            p.set_value(f());
+        }
+
+        template<typename F>
+        void set_promise_(std::promise<void>& p, F& f) {
+            f();
+            p.set_value();
+        }
+
+        template<typename T>
+        struct future_state_ {
+            std::atomic<bool> done;
+            std::promise<T> promise;
+
+            future_state_() : done(false) {}
+        };
+    }
+}
+
+namespace parallel {
+    // Number of elements processed by each task. This does not depend on the number of
+    // threads, so that reductions (e.g., sums) give the same result on all machines.
+    static const uint_t grain = 16384;
+
+    // Maximum number of threads executing tasks (default: number of cores, or the value of
+    // the PHYPP_THREADS environment variable). Must not be changed while tasks are running.
+    inline uint_t threads() {
+        return impl::parallel_impl::threads_();
+    }
+
+    inline void set_threads(uint_t n) {
+        std::lock_guard<std::mutex> l(impl::parallel_impl::scheduler_mutex_());
+        impl::parallel_impl::threads_() = (n == 0 ? uint_t(1) : n);
+        impl::parallel_impl::scheduler_ptr_().reset();
+    }
+
+    // Run all supported functions in parallel by default (default: false)
+    inline bool enabled() {
+        return impl::parallel_impl::enabled_();
+    }
+
+    inline void set_enabled(bool e) {
+        impl::parallel_impl::enabled_() = e;
+    }
+
+    // Group of tasks executed by the thread pool, which can be waited for together.
+    // The first exception thrown by a task is rethrown by wait().
+    class task_group {
+        std::atomic<uint_t> running_;
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+
+    public :
+        task_group() : running_(0) {}
+        task_group(const task_group&) = delete;
+        task_group& operator = (const task_group&) = delete;
+
+        ~task_group() {
+            impl::parallel_impl::scheduler().wait_until([this] { return running_ == 0; });
+        }
+
+        template<typename F>
+        void run(F&& f) {
+            ++running_;
+            auto& s = impl::parallel_impl::scheduler();
+            typename std::decay<F>::type fc(std::forward<F>(f));
+            s.push([this,&s,fc]() mutable {
+                try {
+                    fc();
+                } catch (...) {
+                    std::lock_guard<std::mutex> l(error_mutex_);
+                    if (!error_) error_ = std::current_exception();
+                }
+
+                --running_;
+                s.notify();
+            });
+        }
+
+        // Wait for all tasks to finish, executing pending tasks in the meantime
+        void wait() {
+            impl::parallel_impl::scheduler().wait_until([this] { return running_ == 0; });
+
+            std::exception_ptr e;
+            {
+                std::lock_guard<std::mutex> l(error_mutex_);
+                std::swap(e, error_);
+            }
+
+            if (e) std::rethrow_exception(e);
+        }
+
+        // Same as wait(), but give up after 'duration' seconds (more if a task is being
+        // executed by this thread at that time). Returns true if all tasks are finished.
+        bool wait_for(double duration) {
+            auto deadline = std::chrono::steady_clock::now() +
+                std::chrono::microseconds(uint_t(duration*1e6));
+            if (!impl::parallel_impl::scheduler().wait_until(
+                [this] { return running_ == 0; }, deadline)) {
+                return false;
+            }
+
+            wait();
+            return true;
+        }
+    };
+
+    // Result of a task executed by the thread pool
+    template<typename T>
+    class future {
+        std::shared_ptr<impl::parallel_impl::future_state_<T>> state_;
+        std::future<T> future_;
+
+    public :
+        future() = default;
+        explicit future(std::shared_ptr<impl::parallel_impl::future_state_<T>> s) :
+            state_(std::move(s)), future_(state_->promise.get_future()) {}
+
+        bool valid() const {
+            return future_.valid();
+        }
+
+        bool ready() const {
+            return state_ && state_->done;
+        }
+
+        // Wait for the task to finish, executing pending tasks in the meantime
+        void wait() const {
+            auto s = state_.get();
+            impl::parallel_impl::scheduler().wait_until([s] { return s->done.load(); });
+        }
+
+        // Wait for the task to finish and return its result (or throw its exception)
+        T get() {
+            wait();
+            return future_.get();
+        }
+    };
+
+    // Execute 'f()' asynchronously in the thread pool. If the pool has no worker thread
+    // (parallel::threads() == 1), the task is executed when its result is requested.
+    template<typename F>
+    auto async(F&& f) -> future<decltype(f())> {
+        using rtype = decltype(f());
+        auto state = std::make_shared<impl::parallel_impl::future_state_<rtype>>();
+        future<rtype> r(state);
+
+        auto& s = impl::parallel_impl::scheduler();
+        typename std::decay<F>::type fc(std::forward<F>(f));
+        s.push([state,&s,fc]() mutable {
+            try {
+                impl::parallel_impl::set_promise_(state->promise, fc);
+            } catch (...) {
+                state->promise.set_exception(std::current_exception());
+            }
+
+            state->done = true;
+            s.notify();
+        });
+
+        return r;
+    }
+
+    // Number of tasks needed to process 'n' elements with a fixed grain size
+    inline uint_t chunks(uint_t n, uint_t g = grain) {
+        return (n + g - 1)/g;
+    }
+
+    // Returns true if processing 'n' elements should be done in parallel
+    inline bool use(uint_t n, bool force = false) {
+        return (force || enabled()) && threads() > 1 && chunks(n) > 1;
+    }
+
+    // Call f(i) for all i in [0,njob), spreading the calls over the thread pool. The
+    // order in which jobs are executed is unspecified, therefore each job must only write
+    // to its own output. Can be called from within another task.
+    template<typename F>
+    void run(uint_t njob, F&& f) {
+        if (njob > 1 && threads() > 1) {
+            // Jobs are picked in order from a shared counter by a few tasks, the
+            // calling thread taking part in the work
+            std::atomic<uint_t> next(0);
+            auto runner = [&]() {
+                uint_t i;
+                while ((i = next++) < njob) {
+                    f(i);
+                }
+            };
+
+            task_group g;
+            uint_t ntask = std::min(njob, threads()) - 1;
+            for (uint_t t = 0; t < ntask; ++t) {
+                g.run(runner);
+            }
+
+            std::exception_ptr e;
+            try {
+                runner();
+            } catch (...) {
+                e = std::current_exception();
+                next = njob;
+            }
+
+            try {
+                g.wait();
+            } catch (...) {
+                if (!e) e = std::current_exception();
+            }
+
+            if (e) std::rethrow_exception(e);
+        } else {
+            for (uint_t i = 0; i < njob; ++i) {
+                f(i);
+            }
+        }
+    }
+
+    // Call f(i0, i1) for consecutive ranges [i0,i1) of at most 'g' elements covering
+    // [0,n). The ranges only depend on 'n' and 'g'.
+    template<typename F>
+    void for_chunks(uint_t n, uint_t g, F&& f) {
+        run(chunks(n, g), [&](uint_t c) {
+            uint_t i0 = c*g;
+            uint_t i1 = std::min(n, i0 + g);
+            f(i0, i1);
+        });
+    }
+}
+
+    // Call f(x) for all values x of the range, in parallel, each task processing 'grain'
+    // consecutive values
+    template<typename T, typename F>
+    void parallel_for(const impl::range_impl::range_t<T>& r, uint_t grain, F&& f) {
+        grain = std::max(grain, uint_t(1));
+        parallel::for_chunks(r.n, grain, [&](uint_t i0, uint_t i1) {
+            for (uint_t i = i0; i < i1; ++i) {
+                f(r.b + r.d*i);
+            }
+        });
+    }
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include "phypp/core/range.hpp"
 #include "phypp/core/meta.hpp"
 #include "phypp/core/error.hpp"
+#include "phypp/core/parallel.hpp"
 #include "phypp/core/iterator_base.hpp"
 
 namespace phypp {
@@ -26,6 +27,7 @@ namespace phypp {
 #define PHYPP_INCLUDING_CORE_VEC_BITS
 #include "phypp/core/bits/helpers.hpp"
 #include "phypp/core/bits/iterator.hpp"
+#include "phypp/core/bits/view.hpp"
 #include "phypp/core/bits/access.hpp"
 #include "phypp/core/bits/initializer_list.hpp"
 #undef PHYPP_INCLUDING_CORE_VEC_BITS
@@ -123,6 +125,13 @@ namespace phypp {
             }
         }
 
+        // Evaluation of a temporary vector expression
+        template<typename E, typename enable = typename std::enable_if<
+            meta::vec_implicit_convertible<typename E::value_type,Type>::value>::type>
+        vec(vec<Dim,impl::vec_expr<E>>&& v) : dims(v.dims), safe(*this) {
+            impl::expr_eval(data, v);
+        }
+
         vec& operator = (meta::nested_initializer_list<Dim,meta::dtype_t<Type>> il) {
             impl::vec_ilist::helper<Dim, Type>::fill(*this, il);
             return *this;
@@ -345,13 +354,14 @@ namespace phypp {
         }
 
         template<typename T, typename enable =
-            typename std::enable_if<std::is_integral<T>::value>::type>
+            typename std::enable_if<std::is_integral<meta::rtype_t<T>>::value>::type>
         vec<1,Type*> operator [] (const vec<1,T>& i) {
             vec<1,Type*> v(impl::vec_ref_tag, *this);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
+                p[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
             }
             return v;
         }
@@ -360,22 +370,24 @@ namespace phypp {
             typename std::enable_if<std::is_integral<T>::value>::type>
         vec<1,Type*> operator [] (const vec<1,T*>& i) {
             vec<1,Type*> v(impl::vec_ref_tag, *this);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
+                p[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
             }
             return v;
         }
 
         template<typename T, typename enable =
-            typename std::enable_if<std::is_integral<T>::value>::type>
+            typename std::enable_if<std::is_integral<meta::rtype_t<T>>::value>::type>
         vec<1,const Type*> operator [] (const vec<1,T>& i) const {
             vec<1,const Type*> v(impl::vec_ref_tag, *this);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
+                p[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
             }
             return v;
         }
@@ -384,10 +396,11 @@ namespace phypp {
             typename std::enable_if<std::is_integral<T>::value>::type>
         vec<1,const Type*> operator [] (const vec<1,T*>& i) const {
             vec<1,const Type*> v(impl::vec_ref_tag, *this);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
+                p[j] = impl::ptr<Type>(data[to_idx(i.safe[j])]);
             }
             return v;
         }
@@ -458,13 +471,14 @@ namespace phypp {
             }
 
             template<typename T, typename enable =
-                typename std::enable_if<std::is_unsigned<T>::value>::type>
+                typename std::enable_if<std::is_unsigned<meta::rtype_t<T>>::value>::type>
             vec<1,Type*> operator [] (const vec<1,T>& i) {
                 vec<1,Type*> v(impl::vec_ref_tag, parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
+                    p[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
                 }
                 return v;
             }
@@ -473,22 +487,24 @@ namespace phypp {
                 typename std::enable_if<std::is_unsigned<T>::value>::type>
             vec<1,Type*> operator [] (const vec<1,T*>& i) {
                 vec<1,Type*> v(impl::vec_ref_tag, parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
+                    p[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
                 }
                 return v;
             }
 
             template<typename T, typename enable =
-                typename std::enable_if<std::is_unsigned<T>::value>::type>
+                typename std::enable_if<std::is_unsigned<meta::rtype_t<T>>::value>::type>
             vec<1,const Type*> operator [] (const vec<1,T>& i) const {
                 vec<1,const Type*> v(impl::vec_ref_tag, parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
+                    p[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
                 }
                 return v;
             }
@@ -497,10 +513,11 @@ namespace phypp {
                 typename std::enable_if<std::is_unsigned<T>::value>::type>
             vec<1,const Type*> operator [] (const vec<1,T*>& i) const {
                 vec<1,const Type*> v(impl::vec_ref_tag, parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
+                    p[j] = impl::ptr<Type>(parent.data[i.safe[j]]);
                 }
                 return v;
             }
@@ -633,7 +650,7 @@ namespace phypp {
         using effective_type = vec<Dim,rtype>;
         using dtype = Type;
         using drtype = rtype;
-        using vtype = std::vector<dtype*>;
+        using vtype = impl::view_data<dtype>;
         using dim_type = std::array<std::size_t, Dim>;
         struct comparator {
             bool operator() (const dtype* t1, const dtype* t2) {
@@ -749,6 +766,11 @@ namespace phypp {
             return static_cast<void*>(const_cast<vec<D,Type>*>(&v)) == parent;
         }
 
+        template<std::size_t D, typename E>
+        bool view_same(const vec<D,impl::vec_expr<E>>& v) const {
+            return v.view_same(*this);
+        }
+
         bool empty() const {
             return data.empty();
         }
@@ -859,13 +881,14 @@ namespace phypp {
         }
 
         template<typename T, typename enable =
-            typename std::enable_if<std::is_integral<T>::value>::type>
+            typename std::enable_if<std::is_integral<meta::rtype_t<T>>::value>::type>
         vec<1,Type*> operator [] (const vec<1,T>& i) {
             vec<1,Type*> v(impl::vec_ref_tag, parent);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = data[to_idx(i.safe[j])];
+                p[j] = data[to_idx(i.safe[j])];
             }
             return v;
         }
@@ -874,22 +897,24 @@ namespace phypp {
             typename std::enable_if<std::is_integral<T>::value>::type>
         vec<1,Type*> operator [] (const vec<1,T*>& i) {
             vec<1,Type*> v(impl::vec_ref_tag, parent);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = data[to_idx(i.safe[j])];
+                p[j] = data[to_idx(i.safe[j])];
             }
             return v;
         }
 
         template<typename T, typename enable =
-            typename std::enable_if<std::is_integral<T>::value>::type>
+            typename std::enable_if<std::is_integral<meta::rtype_t<T>>::value>::type>
         vec<1,const Type*> operator [] (const vec<1,T>& i) const {
             vec<1,const Type*> v(impl::vec_ref_tag, parent);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = data[to_idx(i.safe[j])];
+                p[j] = data[to_idx(i.safe[j])];
             }
             return v;
         }
@@ -898,10 +923,11 @@ namespace phypp {
             typename std::enable_if<std::is_integral<T>::value>::type>
         vec<1,const Type*> operator [] (const vec<1,T*>& i) const {
             vec<1,const Type*> v(impl::vec_ref_tag, parent);
-            v.data.resize(i.data.size());
+            auto& p = v.data.indirect();
+            p.resize(i.data.size());
             v.dims[0] = i.data.size();
             for (uint_t j = 0; j < i.data.size(); ++j) {
-                v.data[j] = data[to_idx(i.safe[j])];
+                p[j] = data[to_idx(i.safe[j])];
             }
             return v;
         }
@@ -972,13 +998,14 @@ namespace phypp {
             }
 
             template<typename T, typename enable =
-                typename std::enable_if<std::is_unsigned<T>::value>::type>
+                typename std::enable_if<std::is_unsigned<meta::rtype_t<T>>::value>::type>
             vec<1,Type*> operator [] (const vec<1,T>& i) {
                 vec<1,Type*> v(impl::vec_ref_tag, parent.parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = parent.data[i.safe[j]];
+                    p[j] = parent.data[i.safe[j]];
                 }
                 return v;
             }
@@ -987,22 +1014,24 @@ namespace phypp {
                 typename std::enable_if<std::is_unsigned<T>::value>::type>
             vec<1,Type*> operator [] (const vec<1,T*>& i) {
                 vec<1,Type*> v(impl::vec_ref_tag, parent.parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = parent.data[i.safe[j]];
+                    p[j] = parent.data[i.safe[j]];
                 }
                 return v;
             }
 
             template<typename T, typename enable =
-                typename std::enable_if<std::is_unsigned<T>::value>::type>
+                typename std::enable_if<std::is_unsigned<meta::rtype_t<T>>::value>::type>
             vec<1,const Type*> operator [] (const vec<1,T>& i) const {
                 vec<1,const Type*> v(impl::vec_ref_tag, parent.parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = parent.data[i.safe[j]];
+                    p[j] = parent.data[i.safe[j]];
                 }
                 return v;
             }
@@ -1011,10 +1040,11 @@ namespace phypp {
                 typename std::enable_if<std::is_unsigned<T>::value>::type>
             vec<1,const Type*> operator [] (const vec<1,T*>& i) const {
                 vec<1,const Type*> v(impl::vec_ref_tag, parent.parent);
-                v.data.resize(i.data.size());
+                auto& p = v.data.indirect();
+                p.resize(i.data.size());
                 v.dims[0] = i.data.size();
                 for (uint_t j = 0; j < i.data.size(); ++j) {
-                    v.data[j] = parent.data[i.safe[j]];
+                    p[j] = parent.data[i.safe[j]];
                 }
                 return v;
             }
@@ -1104,8 +1134,8 @@ namespace phypp {
             \
             template<typename U> \
             vec& operator op (U u) { \
-                for (auto& v : data) { \
-                    *v op u; \
+                for (uint_t i = 0; i < data.size(); ++i) { \
+                    *data[i] op u; \
                 } \
                 return *this; \
             }
@@ -1118,26 +1148,26 @@ namespace phypp {
 
         #undef OPERATOR
 
-        using base_iterator = typename vtype::iterator;
+        using base_iterator = typename vtype::const_iterator;
         using base_const_iterator = typename vtype::const_iterator;
 
         using iterator = impl::ptr_iterator_base<base_iterator, vec>;
         using const_iterator = impl::const_ptr_iterator_base<base_const_iterator, vec>;
 
         iterator begin() {
-            return data.begin();
+            return data.cbegin();
         }
 
         iterator end() {
-            return data.end();
+            return data.cend();
         }
 
         const_iterator begin() const {
-            return data.begin();
+            return data.cbegin();
         }
 
         const_iterator end() const {
-            return data.end();
+            return data.cend();
         }
 
     };
@@ -1168,6 +1198,7 @@ namespace phypp {
 }
 
 #define PHYPP_INCLUDING_CORE_VEC_BITS
+#include "phypp/core/bits/expression.hpp"
 #include "phypp/core/bits/operators.hpp"
 #undef PHYPP_INCLUDING_CORE_VEC_BITS
 
@@ -5,35 +5,104 @@
 #include <sstream>
 #include <tuple>
 #include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cstdint>
+#include <limits>
 #include "phypp/core/vec.hpp"
 #include "phypp/core/error.hpp"
+#include "phypp/core/parallel.hpp"
 #include "phypp/math/base.hpp"
+#include "phypp/io/filesystem.hpp"
 
 namespace phypp {
 namespace ascii {
     struct exception : std::runtime_error {
         exception(const std::string& w) : std::runtime_error(w) {}
     };
+}
+
+namespace impl {
+    namespace ascii_impl {
+        // Content of a file, memory-mapped when possible
+        class file_content {
+        public :
+            explicit file_content(const std::string& name) {
+                struct stat st;
+                if (::stat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                    map_ = impl::file_impl::file_mapping(name, 0, st.st_size);
+                }
+
+                if (map_.is_valid()) {
+                    b_ = map_.data();
+                    e_ = b_ + st.st_size;
+                    map_.advise(0, st.st_size, MADV_SEQUENTIAL);
+                } else {
+                    std::ifstream file(name.c_str(), std::ios::binary);
+                    buffer_.assign(std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>());
+                    b_ = buffer_.data();
+                    e_ = b_ + buffer_.size();
+                }
+            }
+
+            const char* begin() const {
+                return b_;
+            }
+
+            const char* end() const {
+                return e_;
+            }
+
+        private :
+            impl::file_impl::file_mapping map_;
+            std::string buffer_;
+            const char* b_ = nullptr;
+            const char* e_ = nullptr;
+        };
+
+        // End of the line starting at 'b' (position of the '\n', or 'e')
+        inline const char* line_end(const char* b, const char* e) {
+            const void* l = (b != e ? std::memchr(b, '\n', e - b) : nullptr);
+            return (l ? static_cast<const char*>(l) : e);
+        }
+
+        inline bool is_blank(const char* b, const char* e) {
+            for (; b != e; ++b) {
+                if (*b != ' ' && *b != '\t') return false;
+            }
+
+            return true;
+        }
+    }
+}
 
+namespace ascii {
     inline uint_t find_skip(const std::string& name) {
         phypp_check(file::exists(name), "cannot open file '"+name+"'");
 
-        std::string line;
+        impl::ascii_impl::file_content file(name);
 
         std::size_t n = 0;
-        std::ifstream file(name.c_str());
-        while (std::getline(file, line)) {
-            auto p = line.find_first_not_of(" \t");
-            if (p != line.npos && line[p] != '#') {
+        const char* p = file.begin();
+        const char* e = file.end();
+        while (p != e) {
+            const char* le = impl::ascii_impl::line_end(p, e);
+            const char* c = p;
+            while (c != le && (*c == ' ' || *c == '\t')) ++c;
+            if (c != le && *c != '#') {
                 break;
             }
 
             ++n;
+            p = (le == e ? e : le + 1);
         }
 
         return n;
     }
 
+
     template<typename T, typename ... Args>
     auto columns(std::size_t n, T& t, Args& ... args) ->
         decltype(std::tuple_cat(std::make_tuple(n), std::tie(t, args...))) {
@@ -100,78 +169,288 @@ namespace impl {
             read_table_resize_(n, args...);
         }
 
-        template<typename I, typename T>
-        bool read_value_(I& in, T& v, std::string& fallback) {
-            auto pos = in.tellg();
-            in >> fallback;
+        // Whitespace-separated values of a line of the table. Keeps track of the end of the
+        // line like an std::istringstream would, for compatibility of the error messages.
+        class line_reader {
+        public :
+            line_reader(const char* b, const char* e) : b_(b), e_(e), p_(b) {}
 
-            std::istringstream ss(fallback);
-            ss >> v;
-            if (ss.fail() || !ss.eof()) {
-                in.clear();
-                in.seekg(pos);
-                return false;
+            static bool is_space(char c) {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+            }
+
+            // Get the next value, or return false if there is none
+            bool next(const char*& vb, const char*& ve) {
+                while (p_ != e_ && is_space(*p_)) ++p_;
+                if (p_ == e_) {
+                    eof_ = true;
+                    return false;
+                }
+
+                vb = p_;
+                while (p_ != e_ && !is_space(*p_)) ++p_;
+                ve = p_;
+                if (p_ == e_) eof_ = true;
+
+                return true;
+            }
+
+            bool eof() const {
+                return eof_;
             }
 
+            std::string str() const {
+                return std::string(b_, e_);
+            }
+
+        private :
+            const char* b_;
+            const char* e_;
+            const char* p_;
+            bool eof_ = false;
+        };
+
+        // Parse numbers without going through streams (which are slow and locale dependent).
+        // The accepted syntax is that of operator >> in the "C" locale.
+        template<typename T>
+        bool parse_int_(const char* b, const char* e, T& v) {
+            using utype = typename std::make_unsigned<T>::type;
+
+            bool neg = false;
+            if (b != e && (*b == '+' || *b == '-')) {
+                neg = (*b == '-');
+                ++b;
+            }
+
+            if (b == e) return false;
+
+            // Largest absolute value
+            const utype vmax = (std::is_signed<T>::value ?
+                utype(std::numeric_limits<T>::max()) + (neg ? 1 : 0) :
+                std::numeric_limits<utype>::max());
+
+            utype r = 0;
+            for (; b != e; ++b) {
+                const unsigned d = static_cast<unsigned char>(*b) - '0';
+                if (d > 9) return false;
+                if (r > (vmax - d)/10) return false;
+                r = r*10 + d;
+            }
+
+            // Negative unsigned values wrap around, as with operator >>
+            v = static_cast<T>(neg ? utype(0) - r : r);
             return true;
         }
 
-        template<typename I, typename T>
-        bool read_value_float_(I& in, T& v, std::string& fallback) {
-            auto pos = in.tellg();
-            in >> fallback;
+        template<typename T>
+        struct float_traits;
 
-            std::istringstream ss(fallback);
-            ss >> v;
-            if (ss.fail()) {
-                std::string s = trim(toupper(fallback));
-                if (s == "NAN" || s == "+NAN" || s == "-NAN") {
-                    v = dnan;
-                    return true;
-                } else if (s == "+INF" || s == "INF+" || s == "INF") {
-                    v = dinf;
-                    return true;
-                } else if (s == "-INF" || s == "INF-") {
-                    v = -dinf;
-                    return true;
-                } else if (s == "NULL") {
-                    v = dnan;
-                    return true;
+        template<>
+        struct float_traits<double> {
+            // Largest mantissa and power of ten that are exactly represented
+            static constexpr std::uint64_t max_mantissa = (std::uint64_t(1) << 53);
+            static constexpr int max_exponent = 22;
+
+            static double pow10(int e) {
+                static const double p[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+                return p[e];
+            }
+
+            static double convert(const char* s, char** end) {
+                return std::strtod(s, end);
+            }
+        };
+
+        template<>
+        struct float_traits<float> {
+            static constexpr std::uint64_t max_mantissa = (std::uint64_t(1) << 24);
+            static constexpr int max_exponent = 10;
+
+            static float pow10(int e) {
+                static const float p[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f,
+                    1e8f, 1e9f, 1e10f};
+                return p[e];
+            }
+
+            static float convert(const char* s, char** end) {
+                return std::strtof(s, end);
+            }
+        };
+
+        template<typename T>
+        bool parse_float_(const char* b, const char* e, T& v) {
+            using traits = float_traits<T>;
+
+            const char* p = b;
+            bool neg = false;
+            if (p != e && (*p == '+' || *p == '-')) {
+                neg = (*p == '-');
+                ++p;
+            }
+
+            // Mantissa, keeping up to 19 significant digits
+            std::uint64_t m = 0;
+            int ndigit = 0, nsig = 0, exp = 0;
+            bool exact = true;
+            for (; p != e && *p >= '0' && *p <= '9'; ++p, ++ndigit) {
+                if (nsig < 19) {
+                    m = m*10 + (*p - '0');
+                    if (m != 0) ++nsig;
+                } else {
+                    ++exp;
+                    exact = false;
                 }
+            }
 
-                in.clear();
-                in.seekg(pos);
-                return false;
-            } else if (!ss.eof()) {
-                in.clear();
-                in.seekg(pos);
+            if (p != e && *p == '.') {
+                for (++p; p != e && *p >= '0' && *p <= '9'; ++p, ++ndigit) {
+                    if (nsig < 19) {
+                        m = m*10 + (*p - '0');
+                        if (m != 0) ++nsig;
+                        --exp;
+                    } else {
+                        exact = false;
+                    }
+                }
+            }
+
+            if (ndigit == 0) return false;
+
+            if (p != e && (*p == 'e' || *p == 'E')) {
+                ++p;
+                bool eneg = false;
+                if (p != e && (*p == '+' || *p == '-')) {
+                    eneg = (*p == '-');
+                    ++p;
+                }
+
+                if (p == e) return false;
+
+                int te = 0;
+                for (; p != e; ++p) {
+                    const unsigned d = static_cast<unsigned char>(*p) - '0';
+                    if (d > 9) return false;
+                    if (te < 100000) te = te*10 + d;
+                }
+
+                exp += (eneg ? -te : te);
+            }
+
+            if (p != e) return false;
+
+            if (m == 0) {
+                v = (neg ? -T(0) : T(0));
+                return true;
+            }
+
+            if (exact && m <= traits::max_mantissa &&
+                exp >= -traits::max_exponent && exp <= traits::max_exponent) {
+                // Both the mantissa and the power of ten are exact: a single rounding
+                T r = T(m);
+                r = (exp < 0 ? r/traits::pow10(-exp) : r*traits::pow10(exp));
+                v = (neg ? -r : r);
+                return true;
+            }
+
+            // Rare case: let the C library do the correct rounding
+            std::string tmp(b, e);
+            char* end = nullptr;
+            errno = 0;
+            T r = traits::convert(tmp.c_str(), &end);
+            if (end != tmp.c_str() + tmp.size()) return false;
+            if (errno == ERANGE && std::abs(r) == std::numeric_limits<T>::infinity()) {
+                // Overflow is an error, as with operator >>
                 return false;
             }
 
+            v = r;
             return true;
         }
 
-        template<typename I>
-        bool read_value_(I& in, float& v, std::string& fallback) {
-            return read_value_float_(in, v, fallback);
+        template<typename T>
+        using is_parsed_int = meta::bool_constant<std::is_integral<T>::value &&
+            !std::is_same<T,bool>::value && (sizeof(T) > 1)>;
+
+        template<typename T>
+        bool parse_value_(const char* b, const char* e, T& v, std::false_type) {
+            std::istringstream ss(std::string(b, e));
+            ss >> v;
+            return !ss.fail() && ss.eof();
+        }
+
+        template<typename T>
+        bool parse_value_(const char* b, const char* e, T& v, std::true_type) {
+            return parse_int_(b, e, v);
         }
 
-        template<typename I>
-        bool read_value_(I& in, double& v, std::string& fallback) {
-            return read_value_float_(in, v, fallback);
+        template<typename T>
+        bool parse_value_(const char* b, const char* e, T& v) {
+            return parse_value_(b, e, v, is_parsed_int<T>{});
         }
 
-        inline void read_table_(std::istringstream& fs, std::size_t i, std::size_t& j) {}
+        inline bool parse_value_(const char* b, const char* e, std::string& v) {
+            v.assign(b, e);
+            return true;
+        }
+
+        template<typename T>
+        bool parse_value_float_(const char* b, const char* e, T& v) {
+            if (parse_float_(b, e, v)) return true;
+
+            std::string s = toupper(std::string(b, e));
+            if (s == "NAN" || s == "+NAN" || s == "-NAN") {
+                v = dnan;
+                return true;
+            } else if (s == "+INF" || s == "INF+" || s == "INF") {
+                v = dinf;
+                return true;
+            } else if (s == "-INF" || s == "INF-") {
+                v = -dinf;
+                return true;
+            } else if (s == "NULL") {
+                v = dnan;
+                return true;
+            }
+
+            return false;
+        }
+
+        inline bool parse_value_(const char* b, const char* e, float& v) {
+            return parse_value_float_(b, e, v);
+        }
+
+        inline bool parse_value_(const char* b, const char* e, double& v) {
+            return parse_value_float_(b, e, v);
+        }
+
+        template<typename T>
+        bool read_value_(line_reader& in, T& v, std::string& fallback) {
+            const char* b;
+            const char* e;
+            if (!in.next(b, e)) {
+                return false;
+            }
+
+            if (!parse_value_(b, e, v)) {
+                fallback.assign(b, e);
+                return false;
+            }
+
+            return true;
+        }
+
+        inline void read_table_(line_reader& fs, std::size_t i, std::size_t& j) {}
 
         template<typename T, typename ... Args>
-        void read_table_(std::istringstream& fs, std::size_t i, std::size_t& j, vec<1,T>& v, Args& ... args);
+        void read_table_(line_reader& fs, std::size_t i, std::size_t& j, vec<1,T>& v, Args& ... args);
         template<typename U, typename ... VArgs, typename ... Args>
-        void read_table_(std::istringstream& fs, std::size_t i, std::size_t& j, std::tuple<U,VArgs&...> v, Args& ... args);
+        void read_table_(line_reader& fs, std::size_t i, std::size_t& j, std::tuple<U,VArgs&...> v, Args& ... args);
         template<typename ... Args>
-        void read_table_(std::istringstream& fs, std::size_t i, std::size_t& j, impl::placeholder_t, Args& ... args);
+        void read_table_(line_reader& fs, std::size_t i, std::size_t& j, impl::placeholder_t, Args& ... args);
 
         template<typename T, typename ... Args>
-        void read_table_(std::istringstream& fs, std::size_t i, std::size_t& j, vec<1,T>& v, Args& ... args) {
+        void read_table_(line_reader& fs, std::size_t i, std::size_t& j, vec<1,T>& v, Args& ... args) {
             std::string fb;
             if (!read_value_(fs, v[i], fb)) {
                 if (fb.empty()) {
@@ -184,15 +463,15 @@ namespace impl {
             read_table_(fs, i, ++j, args...);
         }
 
-        inline void read_table_cols_(std::istringstream& fs, std::size_t i, std::size_t& j, std::size_t k) {}
+        inline void read_table_cols_(line_reader& fs, std::size_t i, std::size_t& j, std::size_t k) {}
 
         template<typename T, typename ... VArgs>
-        void read_table_cols_(std::istringstream& fs, std::size_t i, std::size_t& j, std::size_t k, vec<2,T>& v, VArgs&... args);
+        void read_table_cols_(line_reader& fs, std::size_t i, std::size_t& j, std::size_t k, vec<2,T>& v, VArgs&... args);
         template<typename ... VArgs>
-        void read_table_cols_(std::istringstream& fs, std::size_t i, std::size_t& j, std::size_t k, impl::placeholder_t, VArgs&... args);
+        void read_table_cols_(line_reader& fs, std::size_t i, std::size_t& j, std::size_t k, impl::placeholder_t, VArgs&... args);
 
         template<typename T, typename ... VArgs>
-        void read_table_cols_(std::istringstream& fs, std::size_t i, std::size_t& j, std::size_t k, vec<2,T>& v, VArgs&... args) {
+        void read_table_cols_(line_reader& fs, std::size_t i, std::size_t& j, std::size_t k, vec<2,T>& v, VArgs&... args) {
             std::string fb;
             if (!read_value_(fs, v(i,k), fb)) {
                 if (fb.empty()) {
@@ -206,25 +485,24 @@ namespace impl {
         }
 
         template<typename ... VArgs>
-        void read_table_cols_(std::istringstream& fs, std::size_t i, std::size_t& j, std::size_t k, impl::placeholder_t, VArgs&... args) {
-            std::string s;
-            if (!(fs >> s)) {
-                if (fs.eof()) {
-                    throw ascii::exception("cannot extract value from file, "
-                        "too few columns on line l."+strn(i+1));
-                }
+        void read_table_cols_(line_reader& fs, std::size_t i, std::size_t& j, std::size_t k, impl::placeholder_t, VArgs&... args) {
+            const char* b;
+            const char* e;
+            if (!fs.next(b, e)) {
+                throw ascii::exception("cannot extract value from file, "
+                    "too few columns on line l."+strn(i+1));
             }
 
             read_table_cols_(fs, i, ++j, k, args...);
         }
 
         template<typename U, typename ... VArgs, std::size_t ... S>
-        void read_table_cols_i_(std::istringstream& fs, std::size_t i, std::size_t& j, std::size_t k, std::tuple<U,VArgs&...>& v, meta::seq_t<S...>) {
+        void read_table_cols_i_(line_reader& fs, std::size_t i, std::size_t& j, std::size_t k, std::tuple<U,VArgs&...>& v, meta::seq_t<S...>) {
             read_table_cols_(fs, i, j, k, std::get<S>(v)...);
         }
 
         template<typename U, typename ... VArgs, typename ... Args>
-        void read_table_(std::istringstream& fs, std::size_t i, std::size_t& j, std::tuple<U,VArgs&...> v, Args& ... args) {
+        void read_table_(line_reader& fs, std::size_t i, std::size_t& j, std::tuple<U,VArgs&...> v, Args& ... args) {
             std::size_t n = std::get<0>(v);
             for (std::size_t k = 0; k < n; ++k) {
                 read_table_cols_i_(fs, i, j, k, v, typename meta::gen_seq<1, sizeof...(VArgs)>::type());
@@ -234,63 +512,117 @@ namespace impl {
         }
 
         template<typename ... Args>
-        void read_table_(std::istringstream& fs, std::size_t i, std::size_t& j, impl::placeholder_t, Args& ... args) {
+        void read_table_(line_reader& fs, std::size_t i, std::size_t& j, impl::placeholder_t, Args& ... args) {
             if (fs.eof()) {
                 throw ascii::exception("cannot extract value at l."+strn(i+1)+":"+strn(j+1)+" from file, "
                     "too few columns on line l."+strn(i+1));
             }
 
-            std::string s;
-            fs >> s;
+            const char* b;
+            const char* e;
+            fs.next(b, e);
             read_table_(fs, i, ++j, args...);
         }
+
+        // Line-aligned part of a file, read by a single thread
+        struct chunk_t {
+            const char* b = nullptr;
+            const char* e = nullptr;
+            // Index of the first row, and number of rows
+            std::size_t i0 = 0, n = 0;
+            // Error message, if any
+            std::string error;
+        };
+
+        static const std::size_t chunk_size = 4*1024*1024;
     }
 }
 
 namespace ascii {
+    // The file is memory-mapped and split into chunks of lines, parsed in parallel. The
+    // rows are first counted to size the columns.
     template<typename ... Args>
     void read_table(const std::string& name, std::size_t skip, Args&& ... args) {
         phypp_check(file::exists(name), "cannot open file '"+name+"'");
 
         try {
-            std::string line;
-
-            std::size_t n = 0;
-            std::size_t rpos = 0; {
-                std::ifstream file(name.c_str());
-                while (!file.eof()) {
-                    std::getline(file, line);
-
-                    if (n < skip) {
-                        ++n;
-                        if (n == skip) {
-                            rpos = file.tellg();
-                        }
-                    } else {
-                        if (line.find_first_not_of(" \t") != line.npos) {
-                            ++n;
-                        }
-                    }
+            using impl::ascii_impl::chunk_t;
+
+            impl::ascii_impl::file_content file(name);
+            const char* p = file.begin();
+            const char* e = file.end();
+
+            // Skip the first lines (the last line counts even if it is empty)
+            for (std::size_t l = 0; l < skip; ++l) {
+                const char* le = impl::ascii_impl::line_end(p, e);
+                if (le == e) {
+                    if (l + 1 != skip) return;
+                    p = e;
+                } else {
+                    p = le + 1;
                 }
+            }
 
-                if (skip > n) return;
+            // Split the data in chunks
+            std::vector<chunk_t> chunks;
+            while (p != e) {
+                chunk_t c;
+                c.b = p;
+                if (std::size_t(e - p) > impl::ascii_impl::chunk_size) {
+                    const char* le = impl::ascii_impl::line_end(p + impl::ascii_impl::chunk_size, e);
+                    c.e = (le == e ? e : le + 1);
+                } else {
+                    c.e = e;
+                }
 
-                n -= skip;
+                p = c.e;
+                chunks.push_back(std::move(c));
             }
 
-            std::ifstream file(name.c_str());
-            file.seekg(rpos);
+            // Count the rows
+            parallel::run(chunks.size(), [&](uint_t ic) {
+                chunk_t& c = chunks[ic];
+                for (const char* l = c.b; l != c.e;) {
+                    const char* le = impl::ascii_impl::line_end(l, c.e);
+                    if (!impl::ascii_impl::is_blank(l, le)) ++c.n;
+                    l = (le == c.e ? c.e : le + 1);
+                }
+            });
+
+            std::size_t n = 0;
+            for (auto& c : chunks) {
+                c.i0 = n;
+                n += c.n;
+            }
 
             impl::ascii_impl::read_table_resize_(n, args...);
 
-            for (std::size_t i = 0; i < n; ++i) {
-                do {
-                    std::getline(file, line);
-                } while (line.find_first_not_of(" \t") == line.npos);
+            // Parse the values
+            parallel::run(chunks.size(), [&](uint_t ic) {
+                chunk_t& c = chunks[ic];
+                std::size_t i = c.i0;
+                try {
+                    for (const char* l = c.b; l != c.e;) {
+                        const char* le = impl::ascii_impl::line_end(l, c.e);
+                        if (!impl::ascii_impl::is_blank(l, le)) {
+                            impl::ascii_impl::line_reader fs(l, le);
+                            std::size_t j = 0;
+                            impl::ascii_impl::read_table_(fs, i, j, args...);
+                            ++i;
+                        }
 
-                std::istringstream fs(line);
-                std::size_t j = 0;
-                impl::ascii_impl::read_table_(fs, i, j, args...);
+                        l = (le == c.e ? c.e : le + 1);
+                    }
+                } catch (ascii::exception& ex) {
+                    c.error = ex.what();
+                }
+            });
+
+            // Report the first error in the file
+            for (auto& c : chunks) {
+                if (!c.error.empty()) {
+                    throw ascii::exception(c.error);
+                }
             }
         } catch (ascii::exception& e) {
             phypp_check(false, std::string(e.what())+" (reading "+name+")");
@@ -336,106 +668,195 @@ namespace impl {
             write_table_check_size_(n, i+sizeof...(VArgs), args...);
         }
 
-        inline void write_table_do_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        // Text of a value, identical to strn(), but without going through a stream for
+        // numbers. Returns the number of characters written in 'tmp' (at most 32), or npos
+        // if the value must be formatted with strn().
+        template<typename T>
+        std::size_t format_int_(T v, char* tmp) {
+            using utype = typename std::make_unsigned<T>::type;
+
+            char digits[24];
+            std::size_t nd = 0;
+            utype u = (v < 0 ? utype(0) - utype(v) : utype(v));
+            do {
+                digits[nd++] = '0' + char(u % 10);
+                u /= 10;
+            } while (u != 0);
+
+            std::size_t n = 0;
+            if (v < 0) tmp[n++] = '-';
+            while (nd != 0) tmp[n++] = digits[--nd];
+
+            return n;
+        }
+
+        template<typename T>
+        std::size_t format_value_(const T& v, char* tmp, std::true_type) {
+            return format_int_(v, tmp);
+        }
+
+        template<typename T>
+        std::size_t format_value_(const T&, char*, std::false_type) {
+            return npos;
+        }
+
+        template<typename T>
+        std::size_t format_value_(const T& v, char* tmp) {
+            return format_value_(v, tmp, is_parsed_int<T>{});
+        }
+
+        // Same format as operator << with the given precision ("%g")
+        template<typename T>
+        std::size_t format_float_(T v, char* tmp, int precision, double imax) {
+            if (v == std::trunc(v) && std::abs(v) < imax && !(v == 0 && std::signbit(v))) {
+                // Integer values are printed without decimals nor exponent
+                return format_int_((long long)(v), tmp);
+            }
+
+            return std::snprintf(tmp, 32, "%.*g", precision, double(v));
+        }
+
+        inline std::size_t format_value_(const double& v, char* tmp) {
+            return format_float_(v, tmp, 12, 1e12);
+        }
+
+        inline std::size_t format_value_(const float& v, char* tmp) {
+            return format_float_(v, tmp, 6, 1e6);
+        }
+
+        inline void write_table_pad_(std::string& buf, std::size_t cwidth, const std::string& sep,
+            std::size_t j, std::size_t n) {
+
+            if (j == 0) {
+                buf.append(sep.size(), ' ');
+            } else {
+                buf += sep;
+            }
+
+            if (n < cwidth) {
+                buf.append(cwidth - n, ' ');
+            }
+        }
+
+        template<typename T>
+        void write_table_cell_(std::string& buf, std::size_t cwidth, const std::string& sep,
+            std::size_t j, const T& v) {
+
+            char tmp[32];
+            std::size_t n = format_value_(v, tmp);
+            if (n != npos) {
+                write_table_pad_(buf, cwidth, sep, j, n);
+                buf.append(tmp, n);
+            } else {
+                std::string s = strn(v);
+                write_table_pad_(buf, cwidth, sep, j, s.size());
+                buf += s;
+            }
+        }
+
+        inline void write_table_cell_(std::string& buf, std::size_t cwidth, const std::string& sep,
+            std::size_t j, const std::string& v) {
+            write_table_pad_(buf, cwidth, sep, j, v.size());
+            buf += v;
+        }
+
+        inline void write_table_do_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t j) {
-            file << '\n';
+            buf += '\n';
         }
 
         template<typename Type, typename ... Args>
-        void write_table_do_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        void write_table_do_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t j, const vec<2,Type>& v, const Args& ... args);
 
         template<typename U, typename ... VArgs, typename ... Args>
-        void write_table_do_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        void write_table_do_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t j, const std::tuple<U,VArgs...>& v, const Args& ... args);
 
         template<typename Type, typename ... Args>
-        void write_table_do_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        void write_table_do_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t j, const vec<1,Type>& v, const Args& ... args) {
 
-            if (j == 0) {
-                file << std::string(sep.size(), ' ');
-            } else {
-                file << sep;
-            }
-
-            std::string s = strn(v[i]);
-            if (s.size() < cwidth) {
-                file << std::string(cwidth - s.size(), ' ');
-            }
-
-            file << s;
+            write_table_cell_(buf, cwidth, sep, j, v[i]);
 
-            write_table_do_(file, cwidth, sep, i, j+1, args...);
+            write_table_do_(buf, cwidth, sep, i, j+1, args...);
         }
 
         template<typename Type, typename ... Args>
-        void write_table_do_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        void write_table_do_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t j, const vec<2,Type>& v, const Args& ... args) {
 
             for (uint_t k : range(v.dims[1])) {
-                if (j == 0) {
-                    file << std::string(sep.size(), ' ');
-                } else {
-                    file << sep;
-                }
-
-                std::string s = strn(v(i,k));
-                if (s.size() < cwidth) {
-                    file << std::string(cwidth - s.size(), ' ');
-                }
-
-                file << s;
+                write_table_cell_(buf, cwidth, sep, j, v(i,k));
                 ++j;
             }
 
-            write_table_do_(file, cwidth, sep, i, j, args...);
+            write_table_do_(buf, cwidth, sep, i, j, args...);
         }
 
-        inline void write_table_do_tuple_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        inline void write_table_do_tuple_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t k, std::size_t j) {}
 
         template<typename Type, typename ... Args>
-        void write_table_do_tuple_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        void write_table_do_tuple_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t k, std::size_t j, const vec<2,Type>& v, const Args& ... args) {
 
-            if (j == 0) {
-                file << std::string(sep.size(), ' ');
-            } else {
-                file << sep;
-            }
-
-
-            std::string s = strn(v(i,k));
-            if (s.size() < cwidth) {
-                file << std::string(cwidth - s.size(), ' ');
-            }
-
-            file << s;
+            write_table_cell_(buf, cwidth, sep, j, v(i,k));
 
-            write_table_do_tuple_(file, cwidth, sep, i, k, j+1, args...);
+            write_table_do_tuple_(buf, cwidth, sep, i, k, j+1, args...);
         }
 
         template<typename U, typename ... VArgs, std::size_t ... S>
-        void write_table_do_tuple_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        void write_table_do_tuple_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t k, std::size_t j, const std::tuple<U,VArgs...>& v, meta::seq_t<S...>) {
 
-            write_table_do_tuple_(file, cwidth, sep, i, k, j, std::get<S>(v)...);
+            write_table_do_tuple_(buf, cwidth, sep, i, k, j, std::get<S>(v)...);
         }
 
         template<typename U, typename ... VArgs, typename ... Args>
-        void write_table_do_(std::ofstream& file, std::size_t cwidth, const std::string& sep,
+        void write_table_do_(std::string& buf, std::size_t cwidth, const std::string& sep,
             std::size_t i, std::size_t j, const std::tuple<U,VArgs...>& v, const Args& ... args) {
 
             uint_t m = std::get<0>(v); // number of column groups
             uint_t o = sizeof...(VArgs); // number of columns in a group
             for (uint_t k : range(m)) {
-                write_table_do_tuple_(file, cwidth, sep, i, k, j+k*o, v, 
+                write_table_do_tuple_(buf, cwidth, sep, i, k, j+k*o, v,
                     typename meta::gen_seq<1, sizeof...(VArgs)>::type()
                 );
             }
 
-            write_table_do_(file, cwidth, sep, i, j+m*o, args...);
+            write_table_do_(buf, cwidth, sep, i, j+m*o, args...);
+        }
+
+        // Number of rows formatted at once by a thread
+        static const std::size_t write_block = 16384;
+
+        // Format the rows by blocks in parallel, and write the blocks in order
+        template<typename ... Args>
+        void write_table_rows_(std::ofstream& file, std::size_t n, std::size_t cwidth,
+            const std::string& sep, const Args& ... args) {
+
+            const std::size_t nblock = (n + write_block - 1)/write_block;
+            const std::size_t nbatch = 4*std::max(parallel::threads(), uint_t(1));
+            std::vector<std::string> bufs(std::min(nblock, nbatch));
+
+            for (std::size_t b0 = 0; b0 < nblock; b0 += nbatch) {
+                const std::size_t nb = std::min(nbatch, nblock - b0);
+                parallel::run(nb, [&](uint_t k) {
+                    std::string& buf = bufs[k];
+                    buf.clear();
+
+                    const std::size_t i0 = (b0 + k)*write_block;
+                    const std::size_t i1 = std::min(i0 + write_block, n);
+                    for (std::size_t i = i0; i < i1; ++i) {
+                        write_table_do_(buf, cwidth, sep, i, 0, args...);
+                    }
+                });
+
+                for (std::size_t k = 0; k < nb; ++k) {
+                    file.write(bufs[k].data(), bufs[k].size());
+                }
+            }
         }
     }
 }
@@ -450,9 +871,7 @@ namespace ascii {
         phypp_check(file.is_open(), "could not open file "+filename+" to write data");
 
         try {
-            for (std::size_t i : range(n)) {
-                impl::ascii_impl::write_table_do_(file, cwidth, "", i, 0, args...);
-            }
+            impl::ascii_impl::write_table_rows_(file, n, cwidth, "", args...);
         } catch (ascii::exception& e) {
             phypp_check(false, std::string(e.what())+" (writing "+filename+")");
         }
@@ -474,9 +893,7 @@ namespace ascii {
             if (hdr.size() > 1 && hdr[0] == ' ') hdr = hdr.substr(1);
             file << "#" << hdr << "\n#\n";
 
-            for (std::size_t i : range(n)) {
-                impl::ascii_impl::write_table_do_(file, cwidth, "", i, 0, args...);
-            }
+            impl::ascii_impl::write_table_rows_(file, n, cwidth, "", args...);
         } catch (ascii::exception& e) {
             phypp_check(false, std::string(e.what())+" (writing "+filename+")");
         }
@@ -599,9 +1016,7 @@ namespace ascii {
         std::ofstream file(filename);
         phypp_check(file.is_open(), "could not open file "+filename+" to write data");
 
-        for (std::size_t i = 0; i < n; ++i) {
-            impl::ascii_impl::write_table_do_(file, cwidth, ",", i, 0, args...);
-        }
+        impl::ascii_impl::write_table_rows_(file, n, cwidth, ",", args...);
     }
 }
 }
@@ -7,6 +7,8 @@
 #include <cstring>
 #include <cstdio>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <fstream>
 #include <sstream>
 #include <ctime>
@@ -143,6 +145,82 @@ namespace impl {
 
             return ret;
         }
+
+        // Private memory mapping of a region of a file. The mapping is writable but changes
+        // are never written back to the file: the touched pages are copied on write.
+        class file_mapping {
+        public :
+            file_mapping() = default;
+
+            file_mapping(const std::string& filename, uint_t offset, uint_t size) {
+                int fd = ::open(filename.c_str(), O_RDONLY);
+                if (fd < 0) return;
+
+                struct stat st;
+                if (::fstat(fd, &st) != 0 || uint_t(st.st_size) < offset + size || size == 0) {
+                    ::close(fd);
+                    return;
+                }
+
+                // The offset of the mapping must be a multiple of the page size
+                uint_t page = ::sysconf(_SC_PAGESIZE);
+                shift_ = offset % page;
+                length_ = size + shift_;
+
+                void* p = ::mmap(nullptr, length_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                    offset - shift_);
+                ::close(fd);
+
+                if (p == MAP_FAILED) {
+                    length_ = 0;
+                    return;
+                }
+
+                base_ = static_cast<char*>(p);
+            }
+
+            file_mapping(const file_mapping&) = delete;
+            file_mapping& operator = (const file_mapping&) = delete;
+
+            file_mapping(file_mapping&& m) : base_(m.base_), shift_(m.shift_), length_(m.length_) {
+                m.base_ = nullptr;
+                m.length_ = 0;
+            }
+
+            file_mapping& operator = (file_mapping&& m) {
+                std::swap(base_, m.base_);
+                std::swap(shift_, m.shift_);
+                std::swap(length_, m.length_);
+                return *this;
+            }
+
+            ~file_mapping() {
+                if (base_) ::munmap(base_, length_);
+            }
+
+            bool is_valid() const {
+                return base_ != nullptr;
+            }
+
+            char* data() const {
+                return base_ + shift_;
+            }
+
+            // Give a hint to the kernel about the use of bytes [offset,offset+size)
+            void advise(uint_t offset, uint_t size, int advice) const {
+                if (!base_ || size == 0) return;
+
+                uint_t page = ::sysconf(_SC_PAGESIZE);
+                uint_t first = shift_ + offset;
+                uint_t afirst = first - first % page;
+                ::madvise(base_ + afirst, std::min(first + size, length_) - afirst, advice);
+            }
+
+        private :
+            char* base_ = nullptr;
+            uint_t shift_ = 0;
+            uint_t length_ = 0;
+        };
     }
 }
 
@@ -346,7 +424,7 @@ namespace file {
 #define VECTORIZE(name) \
     template<std::size_t Dim, typename Type, typename ... Args, \
         typename enable = typename std::enable_if< \
-            std::is_same<typename std::remove_pointer<Type>::type, std::string>::value>::type> \
+            std::is_same<meta::rtype_t<Type>, std::string>::value>::type> \
     auto name(const vec<Dim,Type>& v, const Args& ... args) -> \
         vec<Dim,decltype(name(v[0], args...))> { \
         using ntype = decltype(name(v[0], args...)); \
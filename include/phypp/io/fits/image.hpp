@@ -1,9 +1,69 @@
 #ifndef PHYPP_IO_FITS_IMAGE_HPP
 #define PHYPP_IO_FITS_IMAGE_HPP
 
+#include <sys/mman.h>
+#include <cstring>
+#include <fstream>
+#include <atomic>
+#include <thread>
 #include "phypp/io/fits/base.hpp"
 
 namespace phypp {
+namespace impl {
+    namespace fits_impl {
+        inline bool is_big_endian() {
+            const std::uint16_t one = 1;
+            unsigned char first;
+            std::memcpy(&first, &one, 1);
+            return first == 0;
+        }
+
+        // Reverse the byte order of 'n' values
+        inline void byteswap(std::uint32_t* p, uint_t n) {
+            for (uint_t i = 0; i < n; ++i) {
+                std::uint32_t v = p[i];
+                p[i] = (v >> 24) | ((v >> 8) & 0xff00u) | ((v << 8) & 0xff0000u) | (v << 24);
+            }
+        }
+
+        inline void byteswap(std::uint64_t* p, uint_t n) {
+            for (uint_t i = 0; i < n; ++i) {
+                std::uint64_t v = p[i];
+                v = ((v >> 8) & 0x00ff00ff00ff00ffull) | ((v & 0x00ff00ff00ff00ffull) << 8);
+                v = ((v >> 16) & 0x0000ffff0000ffffull) | ((v & 0x0000ffff0000ffffull) << 16);
+                p[i] = (v >> 32) | (v << 32);
+            }
+        }
+
+        template<std::size_t N>
+        struct byteswap_type;
+
+        template<>
+        struct byteswap_type<4> {
+            using type = std::uint32_t;
+        };
+
+        template<>
+        struct byteswap_type<8> {
+            using type = std::uint64_t;
+        };
+
+        // BITPIX of the FITS images that can be mapped directly to 'T' (0: none)
+        template<typename T>
+        struct mapped_bitpix : std::integral_constant<int, 0> {};
+
+        template<>
+        struct mapped_bitpix<float> : std::integral_constant<int, FLOAT_IMG> {};
+
+        template<>
+        struct mapped_bitpix<double> : std::integral_constant<int, DOUBLE_IMG> {};
+
+        template<>
+        struct mapped_bitpix<int_t> : std::integral_constant<int,
+            sizeof(int_t) == 8 ? LONGLONG_IMG : 0> {};
+    }
+}
+
 namespace fits {
     // FITS input table (read only)
     class input_image : public virtual impl::fits_impl::file_base {
@@ -50,6 +110,48 @@ namespace fits {
             fits_read_img(fptr_, type, 1, v.size(), &def, v.data.data(), &anynul, &status_);
         }
 
+        // Read the pixels of the region [p0,p1] (inclusive)
+        template<std::size_t Dim, typename Type>
+        void read_subset(const vec1u& p0, const vec1u& p1, vec<Dim,Type>& v) const {
+            status_ = 0;
+
+            int naxis;
+            fits_get_img_dim(fptr_, &naxis, &status_);
+            phypp_check_fits(naxis == Dim, "FITS file has wrong number of dimensions "
+                "(expected "+strn(Dim)+", got "+strn(naxis)+")");
+            phypp_check(p0.size() == Dim && p1.size() == Dim, "wrong number of dimensions "
+                "for region (expected ", Dim, ", got ", p0.size(), " and ", p1.size(), ")");
+
+            int bitpix;
+            std::vector<long> naxes(naxis);
+            fits_get_img_param(fptr_, naxis, &bitpix, &naxis, naxes.data(), &status_);
+
+            int type = impl::fits_impl::bitpix_to_type(bitpix);
+            phypp_check_fits(impl::fits_impl::traits<Type>::is_convertible(type), "wrong image type "
+                "(expected "+pretty_type_t(Type)+", got "+impl::fits_impl::type_to_string_(type)+")");
+
+            type = impl::fits_impl::traits<Type>::ttype;
+
+            std::array<long,Dim> fp0, fp1, inc;
+            for (uint_t i : range(Dim)) {
+                phypp_check(p0.safe[i] <= p1.safe[i] && p1.safe[i] < uint_t(naxes[Dim-1-i]),
+                    "region out of bounds (", p0, " to ", p1, " in dims ", image_dims(), ")");
+
+                v.dims[i] = p1.safe[i] - p0.safe[i] + 1;
+                fp0[Dim-1-i] = p0.safe[i] + 1;
+                fp1[Dim-1-i] = p1.safe[i] + 1;
+                inc[i] = 1;
+            }
+
+            v.resize();
+
+            Type def = impl::fits_impl::traits<Type>::def();
+            int anynul;
+            fits_read_subset(fptr_, type, fp0.data(), fp1.data(), inc.data(), &def,
+                v.data.data(), &anynul, &status_);
+            fits::phypp_check_cfitsio(status_, "cannot read region of '"+filename_+"'");
+        }
+
         template<typename Type = double>
         Type read_pixel(vec1u p) const {
             status_ = 0;
@@ -142,6 +244,45 @@ namespace fits {
             long naxes = 0;
             fits_create_img(fptr_, impl::fits_impl::traits<float>::image_type, 0, &naxes, &status_);
         }
+
+        // Create an image of the given dimensions without writing its pixels, so that it can
+        // be filled region by region with write_subset()
+        template<typename Type>
+        void create(const vec1u& dims) {
+            status_ = 0;
+
+            std::vector<long> naxes(dims.size());
+            for (uint_t i : range(dims)) {
+                naxes[i] = dims.safe[dims.size()-1-i];
+            }
+
+            fits_create_img(fptr_, impl::fits_impl::traits<Type>::image_type, dims.size(),
+                naxes.data(), &status_);
+            fits::phypp_check_cfitsio(status_, "cannot create image in '"+filename_+"'");
+        }
+
+        // Write the pixels of 'v' into the region of the image starting at 'p0'
+        template<std::size_t Dim, typename Type>
+        void write_subset(const vec1u& p0, const vec<Dim,Type>& v) {
+            status_ = 0;
+
+            phypp_check(p0.size() == Dim, "wrong number of dimensions for region (expected ",
+                Dim, ", got ", p0.size(), ")");
+
+            std::array<long,Dim> fp0, fp1;
+            for (uint_t i : range(Dim)) {
+                fp0[Dim-1-i] = p0.safe[i] + 1;
+                fp1[Dim-1-i] = p0.safe[i] + v.dims[i];
+            }
+
+            if (v.empty()) return;
+
+            using rtype = meta::rtype_t<Type>;
+            const auto& cv = v.concretise();
+            fits_write_subset(fptr_, impl::fits_impl::traits<rtype>::ttype, fp0.data(), fp1.data(),
+                const_cast<typename vec<Dim,rtype>::dtype*>(cv.data.data()), &status_);
+            fits::phypp_check_cfitsio(status_, "cannot write region of '"+filename_+"'");
+        }
     };
 
     // Input/output FITS table (read & write, modifies existing files)
@@ -190,6 +331,321 @@ namespace fits {
             write_impl_(v.concretise());
         }
     };
+
+    // Read only FITS image mapped in memory. Opening the image does not read any pixel: pixels
+    // are loaded from the disk by the system when they are first accessed, and converted to the
+    // native byte order at that point, one block at a time. This only works for uncompressed
+    // images stored with the same type as 'Type' (float, double or int_t) and without BSCALE
+    // or BZERO. Other images are read in memory through cfitsio, and are accessed the same way.
+    // Pointers and views to the pixels remain valid as long as the mapped_image is alive.
+    template<std::size_t Dim, typename Type>
+    class mapped_image : public input_image {
+        static_assert(std::is_arithmetic<Type>::value && !std::is_same<Type,bool>::value,
+            "mapped_image can only be used with numeric types");
+
+    public :
+        using dim_type = std::array<uint_t,Dim>;
+
+        // Number of pixels converted to the native byte order at once
+        static const uint_t block_size = 65536/sizeof(Type);
+
+        dim_type dims = {{0}};
+
+        explicit mapped_image(const std::string& filename) :
+            impl::fits_impl::file_base(impl::fits_impl::image_file, filename, impl::fits_impl::read_only),
+            input_image(filename) {
+            open_();
+        }
+
+        explicit mapped_image(const std::string& filename, uint_t hdu) :
+            impl::fits_impl::file_base(impl::fits_impl::image_file, filename, impl::fits_impl::read_only),
+            input_image(filename, hdu) {
+            open_();
+        }
+
+        mapped_image(mapped_image&&) = default;
+        mapped_image(const mapped_image&) = delete;
+        mapped_image& operator = (mapped_image&&) = delete;
+        mapped_image& operator = (const mapped_image&) = delete;
+
+        // Check if the pixels are read directly from the file (true), or from a copy in
+        // memory (false)
+        bool is_mapped() const {
+            return mapping_.is_valid();
+        }
+
+        uint_t size() const {
+            uint_t n = 1;
+            for (uint_t i : range(Dim)) {
+                n *= dims[i];
+            }
+
+            return n;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        // Pointer to the pixels [i0,i0+n) (flattened index)
+        const Type* data(uint_t i0, uint_t n) const {
+            phypp_check(i0 + n <= size(), "pixel range out of bounds (", i0+n, " vs. ", size(), ")");
+            prepare_(i0, n);
+            return data_ + i0;
+        }
+
+        const Type* data() const {
+            return data(0, size());
+        }
+
+        Type operator [] (uint_t i) const {
+            return *data(i, 1);
+        }
+
+        template<typename ... I>
+        Type operator () (I ... i) const {
+            static_assert(sizeof...(I) == Dim, "wrong number of indices for this image");
+            return *data(flat_index_(dim_type{{uint_t(i)...}}), 1);
+        }
+
+        // Ask the system to start loading the pixels [i0,i0+n) from the disk, so that they are
+        // ready by the time they are accessed
+        void prefetch(uint_t i0, uint_t n) const {
+            mapping_.advise(i0*sizeof(Type), std::min(n, size() - std::min(i0, size()))*sizeof(Type),
+                MADV_WILLNEED);
+        }
+
+        void prefetch(const vec1u& p0, const vec1u& p1) const {
+            check_region_(p0, p1);
+            dim_type d0, d1;
+            for (uint_t i : range(Dim)) {
+                d0[i] = p0.safe[i];
+                d1[i] = p1.safe[i];
+            }
+
+            uint_t i0 = flat_index_(d0);
+            prefetch(i0, flat_index_(d1) - i0 + 1);
+        }
+
+        // Read only view of the pixels of the region [p0,p1] (inclusive)
+        vec<Dim,const Type*> view(const vec1u& p0, const vec1u& p1) const {
+            check_region_(p0, p1);
+
+            vec<Dim,const Type*> v(impl::vec_ref_tag, const_cast<void*>(
+                static_cast<const void*>(this)));
+
+            dim_type d0;
+            std::array<std::ptrdiff_t,Dim> steps;
+            uint_t pitch = 1;
+            for (uint_t i = Dim; i-- != 0;) {
+                d0[i] = p0.safe[i];
+                v.dims[i] = p1.safe[i] - p0.safe[i] + 1;
+                steps[i] = pitch;
+                pitch *= dims[i];
+            }
+
+            for_rows_(p0, p1, [this](uint_t i0, uint_t n, uint_t) {
+                prepare_(i0, n);
+            });
+
+            v.data.set_strided(data_ + flat_index_(d0), v.dims.data(), steps.data(), Dim);
+            return v;
+        }
+
+        vec<Dim,const Type*> view() const {
+            vec1u p0(Dim), p1(Dim);
+            for (uint_t i : range(Dim)) {
+                p1.safe[i] = dims[i] - 1;
+            }
+
+            return view(p0, p1);
+        }
+
+        // Copy the pixels of the region [p0,p1] (inclusive) into 'v'
+        void read_subset(const vec1u& p0, const vec1u& p1, vec<Dim,Type>& v) const {
+            check_region_(p0, p1);
+
+            for (uint_t i : range(Dim)) {
+                v.dims[i] = p1.safe[i] - p0.safe[i] + 1;
+            }
+
+            v.resize();
+
+            for_rows_(p0, p1, [this,&v](uint_t i0, uint_t n, uint_t o) {
+                prepare_(i0, n);
+                std::copy(data_ + i0, data_ + i0 + n, v.data.begin() + o);
+            });
+        }
+
+        using input_image::read;
+
+        void read(vec<Dim,Type>& v) const {
+            v.dims = dims;
+            v.resize();
+
+            const Type* p = data();
+            std::copy(p, p + size(), v.data.begin());
+        }
+
+    private :
+        impl::file_impl::file_mapping mapping_;
+        std::vector<Type> buffer_;
+        Type* data_ = nullptr;
+        bool swap_ = false;
+        mutable std::vector<std::atomic<unsigned char>> blocks_;
+
+        void open_() {
+            status_ = 0;
+
+            int naxis;
+            fits_get_img_dim(fptr_, &naxis, &status_);
+            phypp_check_fits(naxis == Dim, "FITS file has wrong number of dimensions "
+                "(expected "+strn(Dim)+", got "+strn(naxis)+")");
+
+            int bitpix;
+            std::vector<long> naxes(naxis);
+            fits_get_img_param(fptr_, naxis, &bitpix, &naxis, naxes.data(), &status_);
+
+            for (uint_t i : range(naxis)) {
+                dims[i] = naxes[naxis-1-i];
+            }
+
+            LONGLONG hstart = 0, dstart = 0, dend = 0;
+            if (can_map_(bitpix)) {
+                status_ = 0;
+                fits_get_hduaddrll(fptr_, &hstart, &dstart, &dend, &status_);
+                if (status_ == 0 && is_plain_fits_(hstart)) {
+                    mapping_ = impl::file_impl::file_mapping(filename_, dstart, size()*sizeof(Type));
+                }
+            }
+
+            if (mapping_.is_valid()) {
+                data_ = reinterpret_cast<Type*>(mapping_.data());
+                swap_ = !impl::fits_impl::is_big_endian();
+                if (swap_) {
+                    blocks_ = std::vector<std::atomic<unsigned char>>(
+                        (size() + block_size - 1)/block_size);
+                }
+            } else {
+                // Cannot map this image, read it in memory
+                vec<Dim,Type> v;
+                input_image::read(v);
+                buffer_ = std::move(v.data);
+                data_ = buffer_.data();
+            }
+        }
+
+        bool can_map_(int bitpix) const {
+            if (impl::fits_impl::mapped_bitpix<Type>::value == 0) return false;
+            if (impl::fits_impl::mapped_bitpix<Type>::value != bitpix) return false;
+            if (size() == 0 || !file::exists(filename_)) return false;
+
+            status_ = 0;
+            if (fits_is_compressed_image(fptr_, &status_)) return false;
+
+            double bscale = 1.0, bzero = 0.0;
+            read_keyword("BSCALE", bscale);
+            read_keyword("BZERO", bzero);
+            return bscale == 1.0 && bzero == 0.0;
+        }
+
+        // Check that the HDU is stored as is in the file (and not, e.g., gzipped)
+        bool is_plain_fits_(LONGLONG hstart) const {
+            std::ifstream in(filename_, std::ios::binary);
+            char key[8];
+            in.seekg(hstart);
+            in.read(key, 8);
+            if (!in) return false;
+
+            std::string skey(key, 8);
+            return skey == "SIMPLE  " || skey == "XTENSION";
+        }
+
+        void swap_block_(Type* p, uint_t n, std::true_type) const {
+            using swap_t = typename impl::fits_impl::byteswap_type<sizeof(Type)>::type;
+            impl::fits_impl::byteswap(reinterpret_cast<swap_t*>(p), n);
+        }
+
+        void swap_block_(Type* p, uint_t n, std::false_type) const {}
+
+        // Convert the pixels [i0,i0+n) to the native byte order, if not done already.
+        // Blocks are converted by the first thread that reaches them, other threads wait.
+        void prepare_(uint_t i0, uint_t n) const {
+            if (!swap_ || n == 0) return;
+
+            const uint_t b1 = (i0 + n - 1)/block_size;
+            for (uint_t b = i0/block_size; b <= b1; ++b) {
+                auto& state = blocks_[b];
+                if (state.load(std::memory_order_acquire) == 2) continue;
+
+                unsigned char expected = 0;
+                if (state.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+                    uint_t first = b*block_size;
+                    swap_block_(data_ + first, std::min(block_size, size() - first),
+                        std::integral_constant<bool,
+                            impl::fits_impl::mapped_bitpix<Type>::value != 0>{});
+                    state.store(2, std::memory_order_release);
+                } else {
+                    while (state.load(std::memory_order_acquire) != 2) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }
+
+        uint_t flat_index_(const dim_type& p) const {
+            uint_t i0 = 0;
+            for (uint_t i : range(Dim)) {
+                phypp_check(p[i] < dims[i], "pixel out of bounds (", p[i], " vs. ", dims[i],
+                    " on dimension ", i, ")");
+                i0 = i0*dims[i] + p[i];
+            }
+
+            return i0;
+        }
+
+        void check_region_(const vec1u& p0, const vec1u& p1) const {
+            phypp_check(p0.size() == Dim && p1.size() == Dim, "wrong number of dimensions "
+                "for region (expected ", Dim, ", got ", p0.size(), " and ", p1.size(), ")");
+
+            for (uint_t i : range(Dim)) {
+                phypp_check(p0.safe[i] <= p1.safe[i] && p1.safe[i] < dims[i], "region out of "
+                    "bounds (", p0, " to ", p1, " in dims ", dims, ")");
+            }
+        }
+
+        // Call f(i0, n, o) for each contiguous row of pixels [i0,i0+n) of the region [p0,p1],
+        // with 'o' the flattened index of the first pixel of the row within the region
+        template<typename F>
+        void for_rows_(const vec1u& p0, const vec1u& p1, F&& f) const {
+            const uint_t n = p1.safe[Dim-1] - p0.safe[Dim-1] + 1;
+            dim_type p;
+            for (uint_t i : range(Dim)) {
+                p[i] = p0.safe[i];
+            }
+
+            uint_t o = 0;
+            while (true) {
+                f(flat_index_(p), n, o);
+                o += n;
+
+                // Move to the next row
+                uint_t i = Dim-1;
+                while (i != 0) {
+                    --i;
+                    if (p[i] < p1.safe[i]) {
+                        ++p[i];
+                        break;
+                    }
+
+                    p[i] = p0.safe[i];
+                    if (i == 0) return;
+                }
+
+                if (Dim == 1) return;
+            }
+        }
+    };
 }
 }
 
@@ -1,7 +1,10 @@
 #ifndef PHYPP_IO_FITS_TABLE_HPP
 #define PHYPP_IO_FITS_TABLE_HPP
 
+#include <cstring>
+#include <functional>
 #include "phypp/reflex/reflex_helpers.hpp"
+#include "phypp/core/parallel.hpp"
 #include "phypp/io/fits/base.hpp"
 #include "phypp/math/reduce.hpp"
 
@@ -114,6 +117,58 @@ namespace impl {
 
         template<typename T>
         struct is_readable_column_type<impl::named_t<T>> : is_readable_column_type<meta::decay_t<T>> {};
+
+        // Decoding of raw (big endian) table data, as stored on disk
+        template<typename R>
+        R read_raw_value(const unsigned char* p) {
+            R v;
+            unsigned char* d = reinterpret_cast<unsigned char*>(&v);
+        #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            std::memcpy(d, p, sizeof(R));
+        #else
+            for (uint_t i = 0; i < sizeof(R); ++i) {
+                d[i] = p[sizeof(R)-1-i];
+            }
+        #endif
+            return v;
+        }
+
+        // Decode 'nelem' values per row, starting at byte 'offset' of each row
+        template<typename R, typename D>
+        void decode_raw_column(const unsigned char* rows, uint_t rowlen, uint_t offset,
+            uint_t nelem, uint_t nrow, D* out) {
+
+            for (uint_t r = 0; r < nrow; ++r) {
+                const unsigned char* p = rows + r*rowlen + offset;
+                for (uint_t k = 0; k < nelem; ++k, p += sizeof(R), ++out) {
+                    *out = static_cast<D>(read_raw_value<R>(p));
+                }
+            }
+        }
+
+        template<typename D>
+        void decode_logical_column(const unsigned char* rows, uint_t rowlen, uint_t offset,
+            uint_t nelem, uint_t nrow, D* out) {
+
+            for (uint_t r = 0; r < nrow; ++r) {
+                const unsigned char* p = rows + r*rowlen + offset;
+                for (uint_t k = 0; k < nelem; ++k, ++p, ++out) {
+                    *out = (*p == 'T');
+                }
+            }
+        }
+
+        inline void decode_string_column(const unsigned char* rows, uint_t rowlen, uint_t offset,
+            uint_t nelem, uint_t width, uint_t nrow, std::string* out) {
+
+            for (uint_t r = 0; r < nrow; ++r) {
+                const char* p = reinterpret_cast<const char*>(rows + r*rowlen + offset);
+                for (uint_t k = 0; k < nelem; ++k, p += width, ++out) {
+                    const char* e = static_cast<const char*>(std::memchr(p, '\0', width));
+                    *out = trim(std::string(p, e ? e : p + width));
+                }
+            }
+        }
     }
 }
 
@@ -156,10 +211,11 @@ namespace fits {
                 column_info ci;
 
                 char name[80];
-                char type = 0;
+                char dtype[FLEN_VALUE];
                 long repeat = 0;
-                fits_get_bcolparms(fptr_, c+1, name, nullptr, &type, &repeat,
+                fits_get_bcolparms(fptr_, c+1, name, nullptr, dtype, &repeat,
                     nullptr, nullptr, nullptr, nullptr, &status_);
+                char type = dtype[0];
 
                 const uint_t max_dim = 256;
                 long axes[max_dim];
@@ -177,14 +233,15 @@ namespace fits {
                     ci.type = column_info::string;
                     break;
                 }
+                case 'L' : {
+                    ci.type = column_info::boolean;
+                    break;
+                }
                 case 'B' : {
-                    vec<1,char> v(repeat);
-                    char def = impl::fits_impl::traits<char>::def();
-                    int null;
-                    fits_read_col(fptr_, impl::fits_impl::traits<char>::ttype, c+1, 1, 1, repeat,
-                        &def, v.data.data(), &null, &status_);
-
-                    if (min(v) == 0 && max(v) <= 1) {
+                    // Boolean columns are written as bytes with a legal range of [0,1]
+                    uint_t tmin = 1, tmax = 0;
+                    if (getkey(hdr, "TLMIN"+strn(c+1), tmin) &&
+                        getkey(hdr, "TLMAX"+strn(c+1), tmax) && tmin == 0 && tmax == 1) {
                         ci.type = column_info::boolean;
                     } else {
                         ci.type = column_info::byte;
@@ -195,6 +252,7 @@ namespace fits {
                     ci.type = column_info::byte;
                     break;
                 }
+                case 'K' :
                 case 'J' :
                 case 'I' : {
                     ci.type = column_info::integer;
@@ -302,6 +360,9 @@ namespace fits {
 
         static constexpr uint_t max_column_dims = 256;
 
+        // Size of the blocks of rows read at once from row-oriented tables (bytes)
+        static constexpr uint_t chunk_size = 8*1024*1024;
+
     private :
 
         template<std::size_t Dim, typename Type,
@@ -531,6 +592,167 @@ namespace fits {
             }
         }
 
+        // Columns of a row-oriented table to decode from blocks of rows read at once
+        struct chunk_column_ {
+            uint_t offset = 0; // position of the column in a row (bytes)
+            std::function<void(const unsigned char*, uint_t, uint_t)> decode;
+        };
+
+        struct chunk_plan_ {
+            uint_t first_row = 0;
+            uint_t nrow = 0;
+            std::vector<chunk_column_> columns;
+        };
+
+        // Check that the values of a column do not need scaling or null substitution
+        bool read_column_is_raw_(int cid) const {
+            int hdutype = 0;
+            fits_get_hdu_type(fptr_, &hdutype, &status_);
+            if (hdutype != BINARY_TBL) return false;
+
+            const auto& col = fptr_->Fptr->tableptr[cid-1];
+            if (col.tscale != 1.0 || col.tzero != 0.0) return false;
+
+            long tnull;
+            bool has_null = read_keyword("TNULL"+strn(cid), tnull);
+            status_ = 0;
+            return !has_null;
+        }
+
+        // Register a decoder for a column, returns false if it must be read by cfitsio
+        template<typename T>
+        bool read_column_plan_(chunk_plan_&, const table_read_options&, T&, int, int,
+            long, const std::array<long,max_column_dims>&, uint_t) const {
+            return false;
+        }
+
+        template<std::size_t Dim, typename Type,
+            typename enable = typename std::enable_if<!std::is_same<Type,std::string>::value &&
+                !std::is_same<Type,char>::value>::type>
+        bool read_column_plan_(chunk_plan_& plan, const table_read_options& opts,
+            vec<Dim,Type>& v, int cid, int type, long repeat,
+            const std::array<long,max_column_dims>&, uint_t nrow) const {
+
+            // Nothing to read in an empty row range
+            if (nrow == 0) return false;
+
+            // Only exact conversions of unscaled values are done here, the others go
+            // through cfitsio
+            if (!impl::fits_impl::traits<Type>::is_convertible(type)) return false;
+            if (!read_column_is_raw_(cid)) return false;
+
+            using dtype = typename vec<Dim,Type>::dtype;
+            const uint_t rowlen = fptr_->Fptr->rowlength;
+            const uint_t nelem = repeat;
+            const uint_t vrow = v.size()/nrow;
+            if (nelem != vrow) return false;
+
+            chunk_column_ c;
+            c.offset = fptr_->Fptr->tableptr[cid-1].tbcol;
+            const uint_t offset = c.offset;
+            dtype* out = v.data.data();
+
+            #define PHYPP_DECODE_RAW(T) \
+                [=](const unsigned char* rows, uint_t i0, uint_t n) { \
+                    impl::fits_impl::decode_raw_column<T>(rows, rowlen, offset, nelem, n, \
+                        out + i0*nelem); \
+                }
+
+            switch (type) {
+            case TBYTE     : c.decode = PHYPP_DECODE_RAW(std::uint8_t); break;
+            case TSHORT    : c.decode = PHYPP_DECODE_RAW(std::int16_t); break;
+            case TLONG     : c.decode = PHYPP_DECODE_RAW(std::int32_t); break;
+            case TLONGLONG : c.decode = PHYPP_DECODE_RAW(std::int64_t); break;
+            case TFLOAT    : c.decode = PHYPP_DECODE_RAW(float); break;
+            case TDOUBLE   : c.decode = PHYPP_DECODE_RAW(double); break;
+            case TLOGICAL  :
+                c.decode = [=](const unsigned char* rows, uint_t i0, uint_t n) {
+                    impl::fits_impl::decode_logical_column(rows, rowlen, offset, nelem, n,
+                        out + i0*nelem);
+                };
+                break;
+            default : return false;
+            }
+
+            #undef PHYPP_DECODE_RAW
+
+            plan.columns.push_back(std::move(c));
+            return true;
+        }
+
+        template<std::size_t Dim>
+        bool read_column_plan_(chunk_plan_& plan, const table_read_options&,
+            vec<Dim,std::string>& v, int cid, int type, long repeat,
+            const std::array<long,max_column_dims>& naxes, uint_t nrow) const {
+
+            if (nrow == 0) return false;
+            if (type != TSTRING || naxes[0] == 0) return false;
+            if (!read_column_is_raw_(cid)) return false;
+
+            const uint_t rowlen = fptr_->Fptr->rowlength;
+            const uint_t width = naxes[0];
+            const uint_t nelem = repeat/width;
+            const uint_t vrow = v.size()/nrow;
+            if (nelem != vrow) return false;
+
+            chunk_column_ c;
+            c.offset = fptr_->Fptr->tableptr[cid-1].tbcol;
+            const uint_t offset = c.offset;
+            std::string* out = v.data.data();
+            c.decode = [=](const unsigned char* rows, uint_t i0, uint_t n) {
+                impl::fits_impl::decode_string_column(rows, rowlen, offset, nelem, width, n,
+                    out + i0*nelem);
+            };
+
+            plan.columns.push_back(std::move(c));
+            return true;
+        }
+
+        // Read blocks of rows once, and decode all the planned columns in parallel
+        read_sentry read_chunks_(const chunk_plan_& plan) const {
+            if (plan.columns.empty() || plan.nrow == 0) return read_sentry{};
+
+            status_ = 0;
+            const uint_t rowlen = fptr_->Fptr->rowlength;
+
+            // At least the number of rows cfitsio buffers at once, and a few MB
+            long optrows = 0;
+            fits_get_rowsize(fptr_, &optrows, &status_);
+            uint_t crows = std::max(std::max(uint_t(optrows), chunk_size/std::max(rowlen, uint_t(1))),
+                uint_t(1));
+            crows = std::min(crows, plan.nrow);
+
+            // Decode a block while the next one is read
+            std::vector<unsigned char> buf[2];
+            buf[0].resize(crows*rowlen);
+            buf[1].resize(crows*rowlen);
+
+            parallel::task_group tg;
+            uint_t ibuf = 0;
+            for (uint_t i0 = 0; i0 < plan.nrow; i0 += crows) {
+                const uint_t n = std::min(crows, plan.nrow - i0);
+                fits_read_tblbytes(fptr_, plan.first_row + i0 + 1, 1, n*rowlen,
+                    buf[ibuf].data(), &status_);
+
+                tg.wait();
+                if (status_ != 0) {
+                    return read_sentry{this, "could not read rows "+strn(plan.first_row + i0)+
+                        " to "+strn(plan.first_row + i0 + n)};
+                }
+
+                const unsigned char* rows = buf[ibuf].data();
+                for (const chunk_column_& c : plan.columns) {
+                    tg.run([&c,rows,i0,n]() { c.decode(rows, i0, n); });
+                }
+
+                ibuf = 1 - ibuf;
+            }
+
+            tg.wait();
+
+            return read_sentry{};
+        }
+
         struct do_read_struct_ {
             const input_table* tbl;
             const table_read_options& opts;
@@ -544,7 +766,8 @@ namespace fits {
 
         template<typename T>
         read_sentry read_column_(table_read_options opts,
-            const std::string& tcolname, T& value, std::false_type) const {
+            const std::string& tcolname, T& value, std::false_type,
+            chunk_plan_* plan = nullptr) const {
 
             static_assert(impl::fits_impl::is_readable_column_type<typename std::decay<T>::type>::value,
                 "this value cannot be read from a FITS file");
@@ -622,15 +845,22 @@ namespace fits {
             // Resize vector
             read_column_resize_(value, naxis, raxes);
 
-            // Read
-            read_column_impl_(opts, value, cid, naxis, axes, repeat, nrow, colfits);
+            // Read now, or later with the other columns of a row-oriented table
+            if (plan && !colfits && read_column_plan_(*plan, opts, value, cid, type, repeat,
+                axes, raxes[naxis-1])) {
+                plan->first_row = opts.first_row;
+                plan->nrow = raxes[naxis-1];
+            } else {
+                read_column_impl_(opts, value, cid, naxis, axes, repeat, nrow, colfits);
+            }
 
             return read_sentry{};
         }
 
         template<typename T>
         read_sentry read_column_(const table_read_options& opts,
-            const std::string& colname, reflex::struct_t<T> value, std::true_type) const {
+            const std::string& colname, reflex::struct_t<T> value, std::true_type,
+            chunk_plan_* = nullptr) const {
 
             #ifdef NO_REFLECTION
             static_assert(!std::is_same<T,T>::value,
@@ -645,7 +875,8 @@ namespace fits {
 
         template<typename T>
         read_sentry read_column_(const table_read_options& opts,
-            const std::string& colname, T& value, std::true_type) const {
+            const std::string& colname, T& value, std::true_type,
+            chunk_plan_* = nullptr) const {
 
             #ifdef NO_REFLECTION
             static_assert(!std::is_same<T,T>::value,
@@ -673,16 +904,30 @@ namespace fits {
 
     private :
 
-        void read_columns_impl_(const table_read_options&) const {
+        template<typename T>
+        read_sentry read_column_(const table_read_options& opts, const std::string& tcolname,
+            T&& value, chunk_plan_& plan) const {
+            return read_column_(opts, tcolname, std::forward<T>(value),
+                reflex::enabled<meta::decay_t<T>>{}, &plan);
+        }
+
+        void read_columns_impl_(chunk_plan_&, const table_read_options&) const {
             // Nothing more to do
         }
 
         template<typename T, typename ... Args>
-        void read_columns_impl_(const table_read_options& opts,
+        void read_columns_impl_(chunk_plan_& plan, const table_read_options& opts,
             const std::string& tcolname, T& value, Args&& ... args) const {
 
-            read_column(opts, tcolname, value);
-            read_columns_impl_(opts, std::forward<Args>(args)...);
+            read_column_(opts, tcolname, value, plan);
+            read_columns_impl_(plan, opts, std::forward<Args>(args)...);
+        }
+
+        template<typename ... Args>
+        void read_columns_planned_(const table_read_options& opts, Args&& ... args) const {
+            chunk_plan_ plan;
+            read_columns_impl_(plan, opts, std::forward<Args>(args)...);
+            read_chunks_(plan);
         }
 
     public :
@@ -704,7 +949,7 @@ namespace fits {
                 "arguments must be a sequence of 'column name', 'readable value'");
 
             // Read
-            read_columns_impl_(opts, std::forward<Args>(args)...);
+            read_columns_planned_(opts, std::forward<Args>(args)...);
         }
 
         template<typename ... Args, typename enable = typename std::enable_if<
@@ -725,35 +970,32 @@ namespace fits {
                 "arguments must be a sequence of 'column name', 'readable value'");
 
             // Read
-            read_columns_impl_(table_read_options{}, std::forward<Args>(args)...);
+            read_columns_planned_(table_read_options{}, std::forward<Args>(args)...);
         }
 
     private :
 
-        void read_columns_impl_(const table_read_options&, impl::ascii_impl::macroed_t, const std::string&) const {
+        void read_columns_impl_(chunk_plan_&, const table_read_options&, impl::ascii_impl::macroed_t,
+            const std::string&) const {
             // Nothing more to do
         }
 
         template<typename T, typename ... Args>
-        void read_columns_impl_(const table_read_options& opts, impl::ascii_impl::macroed_t,
-            std::string names, T& value, Args&& ... args) const {
+        void read_columns_impl_(chunk_plan_& plan, const table_read_options& opts,
+            impl::ascii_impl::macroed_t, std::string names, T& value, Args&& ... args) const {
 
             std::string tcolname = impl::ascii_impl::pop_macroed_name(names);
-            read_column(opts, impl::ascii_impl::bake_macroed_name(tcolname), value);
-            read_columns_impl_(opts, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
+            read_column_(opts, impl::ascii_impl::bake_macroed_name(tcolname), value, plan);
+            read_columns_impl_(plan, opts, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
         }
         template<typename T, typename ... Args>
-        void read_columns_impl_(const table_read_options& opts, impl::ascii_impl::macroed_t,
-            std::string names, const impl::named_t<T>& value, Args&& ... args) const {
+        void read_columns_impl_(chunk_plan_& plan, const table_read_options& opts,
+            impl::ascii_impl::macroed_t, std::string names, const impl::named_t<T>& value,
+            Args&& ... args) const {
 
             impl::ascii_impl::pop_macroed_name(names);
-            read_column(opts, value.name, value.obj);
-            read_columns_impl_(opts, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
-        }
-
-        template<typename ... Args>
-        void read_columns_impl_(impl::ascii_impl::macroed_t, const std::string& names, Args&& ... args) const {
-            read_columns_impl_(table_read_options{}, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
+            read_column_(opts, value.name, value.obj, plan);
+            read_columns_impl_(plan, opts, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
         }
 
     public :
@@ -771,7 +1013,7 @@ namespace fits {
                 "arguments must be a sequence of readable values");
 
             // Read
-            read_columns_impl_(opts, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
+            read_columns_planned_(opts, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
         }
 
         template<typename ... Args>
@@ -785,7 +1027,81 @@ namespace fits {
                 "arguments must be a sequence of readable values");
 
             // Read
-            read_columns_impl_(table_read_options{}, impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
+            read_columns_planned_(table_read_options{}, impl::ascii_impl::macroed_t{}, names,
+                std::forward<Args>(args)...);
+        }
+
+    private :
+
+        // Number of rows in a column
+        uint_t read_column_rows_(const std::string& tcolname) const {
+            uint_t nrow = 1;
+            if (read_keyword("NAXIS2", nrow) && nrow > 1) {
+                return nrow;
+            }
+
+            status_ = 0;
+            std::string colname = toupper(tcolname);
+            int cid;
+            fits_get_colnum(fptr_, CASEINSEN, const_cast<char*>(colname.c_str()), &cid, &status_);
+            if (status_ != 0) {
+                status_ = 0;
+                return 0;
+            }
+
+            std::array<long,max_column_dims> axes;
+            int naxis = 0;
+            fits_read_tdim(fptr_, cid, max_column_dims, &naxis, axes.data(), &status_);
+            return naxis == 0 ? 0 : axes[naxis-1];
+        }
+
+        template<typename F, typename ... Args>
+        void for_each_chunk_(table_read_options opts, uint_t nrow, uint_t chunk_rows, F&& func,
+            Args&& ... args) const {
+
+            phypp_check(chunk_rows > 0, "number of rows per chunk must be positive");
+
+            for (uint_t i0 = 0; i0 < nrow; i0 += chunk_rows) {
+                opts.first_row = i0;
+                opts.last_row = std::min(i0 + chunk_rows, nrow);
+                read_columns(opts, args...);
+                func(i0);
+            }
+        }
+
+    public :
+
+        // Read the columns by blocks of 'chunk_rows' rows, calling func(first_row) after each
+        // block is read. The columns then only contain the rows of the current block.
+        template<typename F, typename T, typename ... Args>
+        void for_each_chunk(const table_read_options& opts, uint_t chunk_rows, F&& func,
+            const std::string& tcolname, T&& value, Args&& ... args) const {
+            for_each_chunk_(opts, read_column_rows_(tcolname), chunk_rows, std::forward<F>(func),
+                tcolname, std::forward<T>(value), std::forward<Args>(args)...);
+        }
+
+        template<typename F, typename T, typename ... Args>
+        void for_each_chunk(uint_t chunk_rows, F&& func, const std::string& tcolname, T&& value,
+            Args&& ... args) const {
+            for_each_chunk(table_read_options{}, chunk_rows, std::forward<F>(func),
+                tcolname, std::forward<T>(value), std::forward<Args>(args)...);
+        }
+
+        template<typename F, typename ... Args>
+        void for_each_chunk(const table_read_options& opts, uint_t chunk_rows, F&& func,
+            impl::ascii_impl::macroed_t, const std::string& names, Args&& ... args) const {
+            std::string tnames = names;
+            std::string tcolname = impl::ascii_impl::bake_macroed_name(
+                impl::ascii_impl::pop_macroed_name(tnames));
+            for_each_chunk_(opts, read_column_rows_(tcolname), chunk_rows, std::forward<F>(func),
+                impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
+        }
+
+        template<typename F, typename ... Args>
+        void for_each_chunk(uint_t chunk_rows, F&& func, impl::ascii_impl::macroed_t,
+            const std::string& names, Args&& ... args) const {
+            for_each_chunk(table_read_options{}, chunk_rows, std::forward<F>(func),
+                impl::ascii_impl::macroed_t{}, names, std::forward<Args>(args)...);
         }
 
     public :
@@ -963,6 +1279,19 @@ namespace fits {
             // Nothing to do
         }
 
+        template<typename Type>
+        void write_column_write_range_(meta::type_list<Type>, int) {
+            // Nothing to do
+        }
+
+        void write_column_write_range_(meta::type_list<bool>, int cid) {
+            long tmin = 0, tmax = 1;
+            fits_update_key(fptr_, TLONG, const_cast<char*>(("TLMIN"+strn(cid)).c_str()),
+                &tmin, nullptr, &status_);
+            fits_update_key(fptr_, TLONG, const_cast<char*>(("TLMAX"+strn(cid)).c_str()),
+                &tmax, nullptr, &status_);
+        }
+
         struct do_write_struct_ {
             output_table* tbl;
             std::string base;
@@ -999,6 +1328,9 @@ namespace fits {
             // Set TDIM keyword (if needed)
             write_column_write_tdim_(dims, cid);
 
+            // Set legal range (to identify boolean columns)
+            write_column_write_range_(meta::type_list<vtype>{}, cid);
+
             // Write
             write_column_impl_(value, dims, cid);
         }
@@ -0,0 +1,333 @@
+#ifndef PHYPP_IO_FITS_TILE_HPP
+#define PHYPP_IO_FITS_TILE_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "phypp/core/parallel.hpp"
+#include "phypp/io/fits/image.hpp"
+
+namespace phypp {
+namespace fits {
+    struct tile_params {
+        // Dimensions of each tile, not counting the halo
+        uint_t width = 1024, height = 1024;
+        // Number of pixels read around each tile, on each side (clipped to the image edges)
+        uint_t halo = 0;
+        // Read the next tile in a separate thread while the current one is processed
+        bool prefetch = true;
+    };
+
+    // Region of a 2D image, with its pixels
+    template<typename Type>
+    struct tile {
+        // Index of this tile in the image (row-major)
+        uint_t id = npos;
+        // Region of the image held in 'data' (inclusive, halo included)
+        vec1u p0, p1;
+        // Region of the image that belongs to this tile (inclusive, halo excluded)
+        vec1u c0, c1;
+        // Pixels of the region [p0,p1]
+        vec<2,Type> data;
+
+        // View of the pixels that belong to this tile (the halo removed)
+        vec<2,Type*> core() {
+            return data((c0[0]-p0[0])-_-(c1[0]-p0[0]), (c0[1]-p0[1])-_-(c1[1]-p0[1]));
+        }
+
+        vec<2,const Type*> core() const {
+            return data((c0[0]-p0[0])-_-(c1[0]-p0[0]), (c0[1]-p0[1])-_-(c1[1]-p0[1]));
+        }
+    };
+}
+
+namespace impl {
+    namespace fits_impl {
+        // Split an image into tiles of fixed size
+        struct tile_grid {
+            std::array<uint_t,2> dims = {{0, 0}};
+            fits::tile_params params;
+            uint_t ny = 0, nx = 0;
+
+            tile_grid() = default;
+
+            tile_grid(const vec1u& d, const fits::tile_params& p) : params(p) {
+                phypp_check(d.size() == 2, "tiles can only be used on 2D images (got ",
+                    d.size(), " dimensions)");
+                phypp_check(p.width > 0 && p.height > 0, "tiles must not be empty (got ",
+                    p.height, "x", p.width, ")");
+
+                dims = {{d.safe[0], d.safe[1]}};
+                ny = (dims[0] + p.height - 1)/p.height;
+                nx = (dims[1] + p.width - 1)/p.width;
+            }
+
+            uint_t size() const {
+                return ny*nx;
+            }
+
+            // Fill the regions covered by tile 'i' (pixels are not read)
+            template<typename Type>
+            void locate(uint_t i, fits::tile<Type>& t) const {
+                phypp_check(i < size(), "tile index out of bounds (", i, " vs. ", size(), ")");
+
+                const uint_t ty = i/nx, tx = i%nx;
+                t.id = i;
+                t.c0 = {ty*params.height, tx*params.width};
+                t.c1 = {std::min(t.c0[0] + params.height, dims[0]) - 1,
+                        std::min(t.c0[1] + params.width,  dims[1]) - 1};
+                t.p0 = {t.c0[0] - std::min(params.halo, t.c0[0]),
+                        t.c0[1] - std::min(params.halo, t.c0[1])};
+                t.p1 = {std::min(t.c1[0] + params.halo, dims[0] - 1),
+                        std::min(t.c1[1] + params.halo, dims[1] - 1)};
+            }
+        };
+    }
+}
+
+namespace fits {
+    // Read a 2D FITS image tile by tile, so that only a few tiles are in memory at once.
+    // Tiles are returned in row-major order by next(). Unless disabled in the parameters, the
+    // following tile is read by a background thread in the meantime.
+    template<typename Type>
+    class tile_reader {
+    public :
+        explicit tile_reader(const std::string& filename, const tile_params& p = tile_params()) :
+            img_(filename) {
+            grid_ = impl::fits_impl::tile_grid(img_.image_dims(), p);
+        }
+
+        explicit tile_reader(const std::string& filename, uint_t hdu,
+            const tile_params& p = tile_params()) : img_(filename, hdu) {
+            grid_ = impl::fits_impl::tile_grid(img_.image_dims(), p);
+        }
+
+        tile_reader(const tile_reader&) = delete;
+        tile_reader& operator = (const tile_reader&) = delete;
+
+        ~tile_reader() {
+            stop_prefetch_();
+        }
+
+        // Dimensions of the whole image
+        vec1u dims() const {
+            return {grid_.dims[0], grid_.dims[1]};
+        }
+
+        const tile_params& params() const {
+            return grid_.params;
+        }
+
+        // Number of tiles in the image
+        uint_t size() const {
+            return grid_.size();
+        }
+
+        fits::header read_header() const {
+            std::lock_guard<std::mutex> l(file_mutex_);
+            return img_.read_header();
+        }
+
+        // Read a given tile
+        void read(uint_t i, tile<Type>& t) const {
+            grid_.locate(i, t);
+            std::lock_guard<std::mutex> l(file_mutex_);
+            img_.read_subset(t.p0, t.p1, t.data);
+        }
+
+        tile<Type> read(uint_t i) const {
+            tile<Type> t;
+            read(i, t);
+            return t;
+        }
+
+        // Get the next tile. Returns false once all the tiles have been read.
+        bool next(tile<Type>& t) {
+            if (next_ == size()) return false;
+
+            if (!grid_.params.prefetch) {
+                read(next_++, t);
+                return true;
+            }
+
+            if (!thread_.joinable()) {
+                fetched_ = next_;
+                ready_ = false;
+                stop_ = false;
+                thread_ = std::thread([this] { prefetch_loop_(); });
+            }
+
+            std::unique_lock<std::mutex> l(mutex_);
+            cv_.wait(l, [this] { return ready_; });
+
+            if (error_) {
+                std::exception_ptr e;
+                std::swap(e, error_);
+                ready_ = false;
+                next_ = size();
+                std::rethrow_exception(e);
+            }
+
+            std::swap(t, ahead_);
+            ready_ = false;
+            ++next_;
+            l.unlock();
+            cv_.notify_all();
+
+            return true;
+        }
+
+        // Go back to the first tile
+        void rewind() {
+            stop_prefetch_();
+            next_ = 0;
+        }
+
+    private :
+        fits::input_image img_;
+        impl::fits_impl::tile_grid grid_;
+        mutable std::mutex file_mutex_;
+        uint_t next_ = 0;
+
+        // Prefetching
+        std::thread thread_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        tile<Type> ahead_;
+        uint_t fetched_ = 0;
+        bool ready_ = false;
+        bool stop_ = false;
+        std::exception_ptr error_;
+
+        void prefetch_loop_() {
+            while (true) {
+                uint_t i;
+                {
+                    std::unique_lock<std::mutex> l(mutex_);
+                    cv_.wait(l, [this] { return stop_ || !ready_; });
+                    if (stop_ || fetched_ == size()) return;
+                    i = fetched_;
+                }
+
+                tile<Type> t;
+                std::exception_ptr e;
+                try {
+                    read(i, t);
+                } catch (...) {
+                    e = std::current_exception();
+                }
+
+                {
+                    std::lock_guard<std::mutex> l(mutex_);
+                    std::swap(ahead_, t);
+                    error_ = e;
+                    ready_ = true;
+                    ++fetched_;
+                }
+
+                cv_.notify_all();
+                if (e) return;
+            }
+        }
+
+        void stop_prefetch_() {
+            if (!thread_.joinable()) return;
+
+            {
+                std::lock_guard<std::mutex> l(mutex_);
+                stop_ = true;
+            }
+
+            cv_.notify_all();
+            thread_.join();
+            ready_ = false;
+            error_ = nullptr;
+        }
+    };
+
+    // Write a 2D FITS image tile by tile. The image is created with its final dimensions when
+    // the writer is built, and each tile only writes the pixels that belong to it (the halo is
+    // not written). Tiles can be written in any order, and from any thread.
+    template<typename Type>
+    class tile_writer {
+    public :
+        explicit tile_writer(const std::string& filename, const vec1u& d) : img_(filename) {
+            phypp_check(d.size() == 2, "tiles can only be used on 2D images (got ",
+                d.size(), " dimensions)");
+
+            img_.create<Type>(d);
+            dims_ = d;
+        }
+
+        tile_writer(const tile_writer&) = delete;
+        tile_writer& operator = (const tile_writer&) = delete;
+
+        vec1u dims() const {
+            return dims_;
+        }
+
+        void write_header(const fits::header& hdr) {
+            std::lock_guard<std::mutex> l(file_mutex_);
+            img_.write_header(hdr);
+        }
+
+        template<typename T>
+        void write(const tile<T>& t) {
+            auto c = t.core();
+            std::lock_guard<std::mutex> l(file_mutex_);
+            img_.write_subset(t.c0, c);
+        }
+
+        // Write an arbitrary region of the image, starting at 'p0'
+        template<typename T>
+        void write(const vec1u& p0, const vec<2,T>& v) {
+            std::lock_guard<std::mutex> l(file_mutex_);
+            img_.write_subset(p0, v);
+        }
+
+    private :
+        fits::output_image img_;
+        vec1u dims_;
+        std::mutex file_mutex_;
+    };
+
+    // Call f(t) for each tile of the image, in parallel. At most parallel::threads() tiles
+    // are processed at once, plus one being read in the background, which bounds the memory
+    // usage. The order in which tiles are processed is unspecified.
+    template<typename Type, typename F>
+    void for_each_tile(tile_reader<Type>& in, F&& f) {
+        const uint_t nbatch = std::max(parallel::threads(), uint_t(1));
+        std::vector<tile<Type>> tiles(nbatch);
+
+        in.rewind();
+        while (true) {
+            uint_t n = 0;
+            while (n < nbatch && in.next(tiles[n])) {
+                ++n;
+            }
+
+            if (n == 0) break;
+
+            parallel::run(n, [&](uint_t i) {
+                f(tiles[i]);
+            });
+        }
+    }
+
+    // Same as above, then write the modified tiles in 'out'. Only the pixels that belong to
+    // each tile are written, the halo is discarded.
+    template<typename TypeI, typename TypeO, typename F>
+    void for_each_tile(tile_reader<TypeI>& in, tile_writer<TypeO>& out, F&& f) {
+        phypp_check(count(in.dims() != out.dims()) == 0, "incompatible image dimensions (",
+            in.dims(), " vs. ", out.dims(), ")");
+
+        for_each_tile(in, [&](tile<TypeI>& t) {
+            f(t);
+            out.write(t);
+        });
+    }
+}
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include "phypp/core/vec.hpp"
 #include "phypp/core/range.hpp"
 #include "phypp/core/error.hpp"
+#include "phypp/math/simd.hpp"
 
 namespace phypp {
     static constexpr const double dnan = std::numeric_limits<double>::quiet_NaN();
@@ -128,7 +129,7 @@ namespace phypp {
             vec<Dim,decltype(name(v[0], args...))> { \
             using ntype = decltype(name(v[0], args...)); \
             vec<Dim,ntype> r; r.dims = v.dims; r.data.reserve(v.size()); \
-            for (auto& t : v.data) { \
+            for (const auto& t : v.data) { \
                 r.data.push_back(name(impl::dref<Type>(t), args...)); \
             } \
             return r; \
@@ -234,7 +235,7 @@ namespace phypp {
             vec<Dim,decltype(orig(v[0], args...))> { \
             using ntype = decltype(orig(v[0], args...)); \
             vec<Dim,ntype> r; r.dims = v.dims; r.data.reserve(v.size()); \
-            for (auto& t : v.data) { \
+            for (const auto& t : v.data) { \
                 r.data.push_back(orig(impl::dref<Type>(t), args...)); \
             } \
             return r; \
@@ -297,6 +298,25 @@ namespace phypp {
 
     #undef VECTORIZE
 
+    // Use SIMD kernels for the square root of float and double vectors
+    #define VECTORIZE_SIMD(name, type) \
+        template<std::size_t Dim> \
+        vec<Dim,type> name(const vec<Dim,type>& v) { \
+            vec<Dim,type> r(v.dims); \
+            impl::simd::name(v.data.data(), r.data.data(), v.size()); \
+            return r; \
+        } \
+        template<std::size_t Dim> \
+        vec<Dim,type> name(vec<Dim,type>&& v) { \
+            impl::simd::name(v.data.data(), v.data.data(), v.size()); \
+            return std::move(v); \
+        }
+
+    VECTORIZE_SIMD(sqrt, float);
+    VECTORIZE_SIMD(sqrt, double);
+
+    #undef VECTORIZE_SIMD
+
     // Create a range of n steps from i to j (inclusive)
     template<typename T, typename U = T>
     vec1d rgen(T i, U j, uint_t n) {
@@ -0,0 +1,338 @@
+#ifndef PHYPP_MATH_BITS_SELECT_HPP
+#define PHYPP_MATH_BITS_SELECT_HPP
+
+// Selection algorithms used by median(), percentiles() and friends (see reduce.hpp).
+// Not meant to be included directly.
+
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+namespace phypp {
+namespace impl {
+namespace selection {
+    // Find the values of rank 'ks[i]' in [first,last), and store them in 'out[i]'. The ranks
+    // must be sorted in increasing order. All the values are found in a single partitioning
+    // pass: the range is split around the middle rank, and each half is only processed
+    // for the ranks it contains. The values are reordered in the process.
+    template<typename I, typename T, typename C>
+    void multi_select(I first, I last, const uint_t* kb, const uint_t* ke, uint_t offset,
+        T* out, C&& comp) {
+
+        if (kb == ke) return;
+
+        const uint_t* km = kb + (ke - kb)/2;
+        I nth = first + (*km - offset);
+        std::nth_element(first, nth, last, comp);
+        out[km - kb] = *nth;
+
+        // Ranks equal to the middle one are already found
+        const uint_t* kl = km;
+        while (kl != kb && *(kl-1) == *km) {
+            --kl;
+            out[kl - kb] = *nth;
+        }
+
+        const uint_t* kr = km+1;
+        while (kr != ke && *kr == *km) {
+            out[kr - kb] = *nth;
+            ++kr;
+        }
+
+        multi_select(first, nth, kb, kl, offset, out, comp);
+        multi_select(nth+1, last, kr, ke, *km+1, out + (kr - kb), comp);
+    }
+
+    template<typename I, typename T>
+    void multi_select(I first, I last, const std::vector<uint_t>& ks, T* out) {
+        using vtype = typename std::iterator_traits<I>::value_type;
+        multi_select(first, last, ks.data(), ks.data() + ks.size(), 0, out,
+            std::less<vtype>());
+    }
+
+    // Radix selection for floating point values.
+    // The values are mapped to unsigned integers with the same ordering, and the
+    // selection is done by building a histogram of the most significant bits of these
+    // keys, and only keeping the values that fall in the same bins as the requested
+    // ranks. The input is read twice, but never copied or modified, so this is best for
+    // very large arrays.
+    template<typename T>
+    struct radix_traits;
+
+    template<>
+    struct radix_traits<float> {
+        using key_t = std::uint32_t;
+    };
+
+    template<>
+    struct radix_traits<double> {
+        using key_t = std::uint64_t;
+    };
+
+    template<typename T>
+    typename radix_traits<T>::key_t to_key(T v) {
+        using key_t = typename radix_traits<T>::key_t;
+        const key_t sign = key_t(1) << (8*sizeof(T) - 1);
+        key_t k;
+        std::memcpy(&k, &v, sizeof(T));
+        return (k & sign) ? ~k : (k | sign);
+    }
+
+    template<typename T>
+    T from_key(typename radix_traits<T>::key_t k) {
+        using key_t = typename radix_traits<T>::key_t;
+        const key_t sign = key_t(1) << (8*sizeof(T) - 1);
+        k = (k & sign) ? (k & ~sign) : ~k;
+        T v;
+        std::memcpy(&v, &k, sizeof(T));
+        return v;
+    }
+
+    static const uint_t radix_bits = 11;
+    static const uint_t radix_nbin = 1 << radix_bits;
+
+    // Below this size, the remaining keys are selected with std::nth_element()
+    static const uint_t radix_min_size = 4096;
+
+    // Arrays larger than this are processed with radix selection
+    static const uint_t radix_threshold = 1 << 16;
+
+    // Select ranks 'ks' among the keys in 'keys', knowing that they all share the bits
+    // above 'shift + radix_bits'
+    template<typename K>
+    void radix_select_keys(std::vector<K>& keys, int shift, const std::vector<uint_t>& ks,
+        K* out) {
+
+        if (keys.size() <= radix_min_size || shift < 0) {
+            multi_select(keys.begin(), keys.end(), ks, out);
+            return;
+        }
+
+        std::vector<uint_t> hist(radix_nbin);
+        for (K k : keys) {
+            ++hist[(k >> shift) & (radix_nbin - 1)];
+        }
+
+        // Locate the bin of each rank, and process the bins one by one
+        uint_t b = 0, before = 0;
+        uint_t i = 0;
+        while (i < ks.size()) {
+            while (before + hist[b] <= ks[i]) {
+                before += hist[b];
+                ++b;
+            }
+
+            std::vector<uint_t> tks;
+            uint_t i0 = i;
+            while (i < ks.size() && ks[i] < before + hist[b]) {
+                tks.push_back(ks[i] - before);
+                ++i;
+            }
+
+            std::vector<K> tkeys;
+            tkeys.reserve(hist[b]);
+            for (K k : keys) {
+                if (((k >> shift) & (radix_nbin - 1)) == b) tkeys.push_back(k);
+            }
+
+            radix_select_keys(tkeys, shift - int(radix_bits), tks, out + i0);
+        }
+    }
+
+    // Select ranks 'ks' among the values of [v,v+n) for which 'valid(v[i])' is true
+    template<typename T, typename F>
+    void radix_select(const T* v, uint_t n, F&& valid, const std::vector<uint_t>& ks, T* out) {
+        using key_t = typename radix_traits<T>::key_t;
+        const int shift = 8*sizeof(T) - radix_bits;
+
+        // First pass: histogram of the most significant bits
+        std::vector<uint_t> hist(radix_nbin);
+        for (uint_t i = 0; i < n; ++i) {
+            if (valid(v[i])) ++hist[to_key(v[i]) >> shift];
+        }
+
+        // Find the bins containing the requested ranks
+        std::vector<uint_t> bin_id(radix_nbin, npos);
+        std::vector<std::vector<uint_t>> bin_ks;
+        std::vector<uint_t> bin_first;
+        uint_t b = 0, before = 0;
+        for (uint_t i : range(ks)) {
+            while (before + hist[b] <= ks[i]) {
+                before += hist[b];
+                ++b;
+            }
+
+            if (bin_id[b] == npos) {
+                bin_id[b] = bin_ks.size();
+                bin_ks.emplace_back();
+                bin_first.push_back(i);
+            }
+
+            bin_ks.back().push_back(ks[i] - before);
+        }
+
+        // Second pass: gather the keys of these bins
+        std::vector<std::vector<key_t>> keys(bin_ks.size());
+        for (uint_t i : range(bin_id)) {
+            if (bin_id[i] != npos) keys[bin_id[i]].reserve(hist[i]);
+        }
+
+        for (uint_t i = 0; i < n; ++i) {
+            if (!valid(v[i])) continue;
+            key_t k = to_key(v[i]);
+            uint_t id = bin_id[k >> shift];
+            if (id != npos) keys[id].push_back(k);
+        }
+
+        // Finish the selection within each bin
+        std::vector<key_t> kout(ks.size());
+        for (uint_t i : range(keys)) {
+            radix_select_keys(keys[i], shift - int(radix_bits), bin_ks[i],
+                kout.data() + bin_first[i]);
+        }
+
+        for (uint_t i : range(ks)) {
+            out[i] = from_key<T>(kout[i]);
+        }
+    }
+
+    // Select ranks 'ks' among the values of 'v' for which 'valid(v[i])' is true. The ranks
+    // are computed from the number of valid values by calling 'get_ranks(n)'. Returns false
+    // if there is no valid value.
+    template<std::size_t Dim, typename Type, typename F, typename R>
+    bool select(const vec<Dim,Type>& v, F&& valid, R&& get_ranks,
+        std::vector<meta::rtype_t<Type>>& out, std::false_type) {
+
+        using rtype = meta::rtype_t<Type>;
+
+        // Copy the valid values, then select in place
+        std::vector<rtype> t;
+        t.reserve(v.size());
+        for (uint_t i : range(v)) {
+            rtype tv = v.safe[i];
+            if (valid(tv)) t.push_back(tv);
+        }
+
+        if (t.empty()) return false;
+
+        std::vector<uint_t> ks = get_ranks(t.size());
+        out.resize(ks.size());
+        multi_select(t.begin(), t.end(), ks, out.data());
+        return true;
+    }
+
+    template<std::size_t Dim, typename Type, typename F, typename R>
+    bool select(const vec<Dim,Type>& v, F&& valid, R&& get_ranks,
+        std::vector<meta::rtype_t<Type>>& out, std::true_type) {
+
+        using rtype = meta::rtype_t<Type>;
+        const rtype* p = simd::contiguous_data(v);
+        if (p && v.size() >= radix_threshold) {
+            uint_t n = 0;
+            for (uint_t i : range(v)) {
+                n += valid(p[i]);
+            }
+
+            if (n == 0) return false;
+
+            std::vector<uint_t> ks = get_ranks(n);
+            out.resize(ks.size());
+            radix_select(p, v.size(), valid, ks, out.data());
+            return true;
+        }
+
+        return select(v, valid, get_ranks, out, std::false_type{});
+    }
+
+    template<std::size_t Dim, typename Type, typename F, typename R>
+    bool select(const vec<Dim,Type>& v, F&& valid, R&& get_ranks,
+        std::vector<meta::rtype_t<Type>>& out) {
+        return select(v, std::forward<F>(valid), std::forward<R>(get_ranks), out,
+            simd::is_float<meta::rtype_t<Type>>{});
+    }
+
+    // Rank of the percentile 'u' among 'n' values
+    template<typename U>
+    uint_t percentile_rank(uint_t n, const U& u) {
+        double r = n*double(u);
+        return r <= 0.0 ? 0 : std::min(uint_t(r), n-1);
+    }
+
+    // Sorted ranks, and position of each original rank in the sorted list
+    inline std::vector<uint_t> sort_ranks(std::vector<uint_t>& ks, std::vector<uint_t>& order) {
+        order.resize(ks.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&ks](uint_t i, uint_t j) {
+            return ks[i] < ks[j];
+        });
+
+        std::vector<uint_t> sks(ks.size());
+        for (uint_t i : range(ks)) {
+            sks[i] = ks[order[i]];
+        }
+
+        return sks;
+    }
+
+    // Weighted median: the value 'v[j]' that precedes the value at which the cumulative
+    // sum of the weights, in order of increasing values, crosses half of the total weight.
+    // Works like quick select: the values are partitioned around a pivot, and only the
+    // side containing the crossing point is processed further.
+    template<typename T>
+    T weighted_median(std::vector<std::pair<T,double>>& vw, double totw) {
+        using pair_t = std::pair<T,double>;
+
+        auto first = vw.begin(), last = vw.end();
+        double before = 0.0;     // weight of the values below 'first'
+        bool has_prev = false;   // whether there are values below 'first'
+        T prev = 0;              // largest of these values
+
+        const double half = totw/2.0;
+        while (last - first > 1) {
+            // Median of three pivot
+            auto mid = first + (last - first)/2;
+            T a = first->first, b = mid->first, c = (last-1)->first;
+            T pivot = std::max(std::min(a,b), std::min(std::max(a,b),c));
+
+            auto m1 = std::partition(first, last, [pivot](const pair_t& p) {
+                return p.first < pivot;
+            });
+            auto m2 = std::partition(m1, last, [pivot](const pair_t& p) {
+                return !(pivot < p.first);
+            });
+
+            double wl = 0.0, we = 0.0;
+            for (auto i = first; i != m1; ++i) wl += i->second;
+            for (auto i = m1; i != m2; ++i) we += i->second;
+
+            if (before + wl > half) {
+                last = m1;
+            } else if (before + wl + we > half) {
+                // The crossing point is among the values equal to the pivot
+                if (before + wl + m1->second > half) {
+                    if (m1 == first) return has_prev ? prev : pivot;
+                    return std::max_element(first, m1, [](const pair_t& p1, const pair_t& p2) {
+                        return p1.first < p2.first;
+                    })->first;
+                }
+
+                return pivot;
+            } else {
+                before += wl + we;
+                has_prev = true;
+                prev = pivot;
+                first = m2;
+            }
+        }
+
+        if (first == last || before + first->second <= half) {
+            return dnan;
+        }
+
+        return has_prev ? prev : first->first;
+    }
+}
+}
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef PHYPP_INCLUDING_MATH_SIMD_BITS
+#error this file is not meant to be included separately, include "phypp/math/simd.hpp" instead
+#endif
+
+// This file is included once for each instruction set, with PHYPP_SIMD_NAMESPACE set to
+// the namespace containing the corresponding primitives (vload, vadd, ...), and
+// PHYPP_SIMD_TARGET to the function attribute enabling this instruction set.
+
+namespace phypp {
+namespace impl {
+namespace simd {
+namespace PHYPP_SIMD_NAMESPACE {
+    static const uint_t nd = reg<double>::n;
+
+    struct sum_op_ {
+        PHYPP_SIMD_TARGET vd operator() (vd x) const { return x; }
+        double scalar(double x) const { return x; }
+    };
+
+    struct sqr_op_ {
+        PHYPP_SIMD_TARGET vd operator() (vd x) const { return vmul(x, x); }
+        double scalar(double x) const { return x*x; }
+    };
+
+    struct sqr_dev_op_ {
+        double m;
+        PHYPP_SIMD_TARGET vd operator() (vd x) const { vd d = vsub(x, vset1(m)); return vmul(d, d); }
+        double scalar(double x) const { return (x - m)*(x - m); }
+    };
+
+    // Sum of f(x) over all elements, in double precision
+    template<bool SkipNaN, typename T, typename F>
+    PHYPP_SIMD_TARGET double accumulate(const T* p, uint_t n, F f) {
+        vd a0 = vset1(0.0), a1 = vset1(0.0);
+        uint_t i = 0;
+        for (; i + 2*nd <= n; i += 2*nd) {
+            vd x0 = vload_d(p+i);
+            vd x1 = vload_d(p+i+nd);
+            if (SkipNaN) {
+                a0 = vadd(a0, vzero_nan(f(x0), x0));
+                a1 = vadd(a1, vzero_nan(f(x1), x1));
+            } else {
+                a0 = vadd(a0, f(x0));
+                a1 = vadd(a1, f(x1));
+            }
+        }
+
+        double s = vhsum(vadd(a0, a1));
+        for (; i < n; ++i) {
+            if (SkipNaN && std::isnan(p[i])) continue;
+            s += f.scalar(p[i]);
+        }
+
+        return s;
+    }
+
+    template<bool SkipNaN, typename T>
+    PHYPP_SIMD_TARGET double sum(const T* p, uint_t n) {
+        return accumulate<SkipNaN>(p, n, sum_op_());
+    }
+
+    template<bool SkipNaN, typename T>
+    PHYPP_SIMD_TARGET double sum_sqr(const T* p, uint_t n) {
+        return accumulate<SkipNaN>(p, n, sqr_op_());
+    }
+
+    template<bool SkipNaN, typename T>
+    PHYPP_SIMD_TARGET double sum_sqr_dev(const T* p, uint_t n, double m) {
+        return accumulate<SkipNaN>(p, n, sqr_dev_op_{m});
+    }
+
+    // Integer sum, wrapping around on overflow like the scalar loop
+    template<typename T>
+    PHYPP_SIMD_TARGET T sum_int(const T* p, uint_t n) {
+        vi a = vzero_i();
+        uint_t i = 0;
+        for (; i + ni <= n; i += ni) {
+            a = vadd_i(a, vload_i(p+i));
+        }
+
+        std::uint64_t t[ni];
+        vstore_i(t, a);
+        std::uint64_t s = 0;
+        for (uint_t j = 0; j < ni; ++j) {
+            s += t[j];
+        }
+        for (; i < n; ++i) {
+            s += std::uint64_t(p[i]);
+        }
+
+        return T(s);
+    }
+
+    template<bool SkipNaN, typename T>
+    PHYPP_SIMD_TARGET void minmax(const T* p, uint_t n, T& mi, T& ma) {
+        using V = typename reg<T>::type;
+        static const uint_t nl = reg<T>::n;
+        const T inf = std::numeric_limits<T>::infinity();
+
+        V lo = vset1(inf), hi = vset1(-inf), fl = vset1(T(0));
+        uint_t i = 0;
+        for (; i + nl <= n; i += nl) {
+            V x = vload(p+i);
+            if (SkipNaN) {
+                lo = vmin(lo, vfill_nan(x, vset1(inf)));
+                hi = vmax(hi, vfill_nan(x, vset1(-inf)));
+            } else {
+                fl = vflag_nan(fl, x);
+                lo = vmin(lo, x);
+                hi = vmax(hi, x);
+            }
+        }
+
+        bool nan = !SkipNaN && vhas_nan(fl);
+
+        T tl[nl], th[nl];
+        vstore(tl, lo);
+        vstore(th, hi);
+        mi = inf;
+        ma = -inf;
+        for (uint_t j = 0; j < nl; ++j) {
+            if (tl[j] < mi) mi = tl[j];
+            if (th[j] > ma) ma = th[j];
+        }
+
+        for (; i < n; ++i) {
+            if (std::isnan(p[i])) {
+                nan = nan || !SkipNaN;
+                continue;
+            }
+
+            if (p[i] < mi) mi = p[i];
+            if (p[i] > ma) ma = p[i];
+        }
+
+        if (nan) {
+            mi = ma = std::numeric_limits<T>::quiet_NaN();
+        }
+    }
+
+    PHYPP_SIMD_TARGET inline uint_t count(const char* p, uint_t n) {
+        uint_t c = 0;
+        uint_t i = 0;
+        for (; i + nb <= n; i += nb) {
+            c += vcount_nonzero(p+i);
+        }
+        for (; i < n; ++i) {
+            c += (p[i] != 0);
+        }
+
+        return c;
+    }
+
+    template<typename T>
+    PHYPP_SIMD_TARGET void sqrt(const T* in, T* out, uint_t n) {
+        static const uint_t nl = reg<T>::n;
+        uint_t i = 0;
+        for (; i + nl <= n; i += nl) {
+            vstore(out+i, vsqrt(vload(in+i)));
+        }
+        for (; i < n; ++i) {
+            out[i] = std::sqrt(in[i]);
+        }
+    }
+
+    // Matrix products. The kernels below compute C += A*B, where A (n x o) and B (o x m) are
+    // given by their row and column strides (so that transposed matrices need no copy), and
+    // C (n x m) is contiguous. Blocks of A and B are first copied into contiguous panels that
+    // fit in the cache, then C is computed by tiles of gemm_mr x (2 registers) elements which
+    // are kept in registers during the whole loop over the common dimension.
+    static const uint_t gemm_mr = 4;
+    static const uint_t gemm_mc = 64;
+    static const uint_t gemm_kc = 256;
+    static const uint_t gemm_nc = 2048;
+
+    // C += A*B for one tile of C, with A and B packed; only the first ni x nj elements of the
+    // tile are written
+    template<typename T>
+    PHYPP_SIMD_TARGET void gemm_tile(uint_t nk, const T* pa, const T* pb, T* c, uint_t ldc,
+        uint_t ni, uint_t nj) {
+        using V = typename reg<T>::type;
+        static const uint_t nl = reg<T>::n;
+
+        V c00 = vset1(T(0)), c01 = c00, c10 = c00, c11 = c00;
+        V c20 = c00, c21 = c00, c30 = c00, c31 = c00;
+        for (uint_t p = 0; p < nk; ++p, pa += gemm_mr, pb += 2*nl) {
+            V b0 = vload(pb), b1 = vload(pb+nl);
+            V a = vset1(pa[0]);
+            c00 = vadd(c00, vmul(a, b0));
+            c01 = vadd(c01, vmul(a, b1));
+            a = vset1(pa[1]);
+            c10 = vadd(c10, vmul(a, b0));
+            c11 = vadd(c11, vmul(a, b1));
+            a = vset1(pa[2]);
+            c20 = vadd(c20, vmul(a, b0));
+            c21 = vadd(c21, vmul(a, b1));
+            a = vset1(pa[3]);
+            c30 = vadd(c30, vmul(a, b0));
+            c31 = vadd(c31, vmul(a, b1));
+        }
+
+        if (ni == gemm_mr && nj == 2*nl) {
+            vstore(c,         vadd(vload(c),         c00));
+            vstore(c+nl,      vadd(vload(c+nl),      c01));
+            c += ldc;
+            vstore(c,         vadd(vload(c),         c10));
+            vstore(c+nl,      vadd(vload(c+nl),      c11));
+            c += ldc;
+            vstore(c,         vadd(vload(c),         c20));
+            vstore(c+nl,      vadd(vload(c+nl),      c21));
+            c += ldc;
+            vstore(c,         vadd(vload(c),         c30));
+            vstore(c+nl,      vadd(vload(c+nl),      c31));
+        } else {
+            T t[gemm_mr*2*nl];
+            vstore(t,       c00); vstore(t+nl,   c01);
+            vstore(t+2*nl,  c10); vstore(t+3*nl, c11);
+            vstore(t+4*nl,  c20); vstore(t+5*nl, c21);
+            vstore(t+6*nl,  c30); vstore(t+7*nl, c31);
+            for (uint_t i = 0; i < ni; ++i)
+            for (uint_t j = 0; j < nj; ++j) {
+                c[i*ldc+j] += t[i*2*nl+j];
+            }
+        }
+    }
+
+    // C += A*B. If 'lower' is true, only the tiles that intersect the lower triangle of C
+    // are computed (for symmetric products, the upper triangle must then be filled by the
+    // caller).
+    template<typename T>
+    PHYPP_SIMD_TARGET void gemm(uint_t n, uint_t m, uint_t o, const T* a, uint_t ars,
+        uint_t acs, const T* b, uint_t brs, uint_t bcs, T* c, bool lower) {
+        static const uint_t nr = 2*reg<T>::n;
+
+        // Panels are only as large as needed for small matrices
+        const uint_t mc = std::min(gemm_mc, (n + gemm_mr - 1)/gemm_mr*gemm_mr);
+        const uint_t nc = std::min(gemm_nc, (m + nr - 1)/nr*nr);
+        const uint_t kc = std::min(gemm_kc, o);
+        std::vector<T> pa(mc*kc), pb(nc*kc);
+
+        for (uint_t j0 = 0; j0 < m; j0 += nc) {
+            const uint_t j1 = std::min(m, j0 + nc);
+            for (uint_t k0 = 0; k0 < o; k0 += kc) {
+                const uint_t k1 = std::min(o, k0 + kc);
+                const uint_t nk = k1 - k0;
+
+                // Pack B(k0:k1,j0:j1) in panels of nr columns, padded with zeros
+                for (uint_t jp = j0; jp < j1; jp += nr) {
+                    T* d = &pb[(jp - j0)*nk];
+                    const uint_t nj = std::min(nr, j1 - jp);
+                    for (uint_t p = 0; p < nk; ++p, d += nr) {
+                        const T* s = b + (k0 + p)*brs + jp*bcs;
+                        for (uint_t j = 0; j < nj; ++j) d[j] = s[j*bcs];
+                        for (uint_t j = nj; j < nr; ++j) d[j] = T(0);
+                    }
+                }
+
+                for (uint_t i0 = 0; i0 < n; i0 += mc) {
+                    const uint_t i1 = std::min(n, i0 + mc);
+                    if (lower && j0 >= i1) continue;
+
+                    // Pack A(i0:i1,k0:k1) in panels of gemm_mr rows, padded with zeros
+                    for (uint_t ip = i0; ip < i1; ip += gemm_mr) {
+                        T* d = &pa[(ip - i0)*nk];
+                        const uint_t ni = std::min(gemm_mr, i1 - ip);
+                        for (uint_t p = 0; p < nk; ++p, d += gemm_mr) {
+                            const T* s = a + ip*ars + (k0 + p)*acs;
+                            for (uint_t i = 0; i < ni; ++i) d[i] = s[i*ars];
+                            for (uint_t i = ni; i < gemm_mr; ++i) d[i] = T(0);
+                        }
+                    }
+
+                    for (uint_t ip = i0; ip < i1; ip += gemm_mr)
+                    for (uint_t jp = j0; jp < j1 && (!lower || jp < ip + gemm_mr); jp += nr) {
+                        gemm_tile(nk, &pa[(ip - i0)*nk], &pb[(jp - j0)*nk], c + ip*m + jp, m,
+                            std::min(gemm_mr, i1 - ip), std::min(nr, j1 - jp));
+                    }
+                }
+            }
+        }
+    }
+
+    // y = A*x, with A (n x o) contiguous
+    template<typename T>
+    PHYPP_SIMD_TARGET void gemv(uint_t n, uint_t o, const T* a, const T* x, T* y) {
+        using V = typename reg<T>::type;
+        static const uint_t nl = reg<T>::n;
+
+        for (uint_t i = 0; i < n; ++i, a += o) {
+            V s0 = vset1(T(0)), s1 = s0;
+            uint_t k = 0;
+            for (; k + 2*nl <= o; k += 2*nl) {
+                s0 = vadd(s0, vmul(vload(a+k),    vload(x+k)));
+                s1 = vadd(s1, vmul(vload(a+k+nl), vload(x+k+nl)));
+            }
+
+            T t[nl];
+            vstore(t, vadd(s0, s1));
+            T s = T(0);
+            for (uint_t j = 0; j < nl; ++j) {
+                s += t[j];
+            }
+            for (; k < o; ++k) {
+                s += a[k]*x[k];
+            }
+
+            y[i] = s;
+        }
+    }
+
+    // y += x*A, with A (n x m) contiguous
+    template<typename T>
+    PHYPP_SIMD_TARGET void gevm(uint_t n, uint_t m, const T* a, const T* x, T* y) {
+        using V = typename reg<T>::type;
+        static const uint_t nl = reg<T>::n;
+
+        for (uint_t k = 0; k < n; ++k, a += m) {
+            V xk = vset1(x[k]);
+            uint_t j = 0;
+            for (; j + nl <= m; j += nl) {
+                vstore(y+j, vadd(vload(y+j), vmul(xk, vload(a+j))));
+            }
+            for (; j < m; ++j) {
+                y[j] += x[k]*a[j];
+            }
+        }
+    }
+}
+}
+}
+}
@@ -0,0 +1,22 @@
+#ifndef PHYPP_MATH_BLAS_HPP
+#define PHYPP_MATH_BLAS_HPP
+
+// BLAS functions imported from fortran library
+// --------------------------------------------
+
+namespace blas {
+    extern "C" void dgemm_(char* transa, char* transb, int* m, int* n, int* k, double* alpha,
+        const double* a, int* lda, const double* b, int* ldb, double* beta, double* c, int* ldc);
+    extern "C" void sgemm_(char* transa, char* transb, int* m, int* n, int* k, float* alpha,
+        const float* a, int* lda, const float* b, int* ldb, float* beta, float* c, int* ldc);
+    extern "C" void dgemv_(char* trans, int* m, int* n, double* alpha, const double* a, int* lda,
+        const double* x, int* incx, double* beta, double* y, int* incy);
+    extern "C" void sgemv_(char* trans, int* m, int* n, float* alpha, const float* a, int* lda,
+        const float* x, int* incx, float* beta, float* y, int* incy);
+    extern "C" void dsyrk_(char* uplo, char* trans, int* n, int* k, double* alpha,
+        const double* a, int* lda, double* beta, double* c, int* ldc);
+    extern "C" void ssyrk_(char* uplo, char* trans, int* n, int* k, float* alpha,
+        const float* a, int* lda, float* beta, float* c, int* ldc);
+}
+
+#endif
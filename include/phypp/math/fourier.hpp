@@ -3,39 +3,436 @@
 
 #ifndef NO_FFTW
 #include <fftw3.h>
+#include <map>
+#include <mutex>
+#include <tuple>
 #endif
 #include "phypp/core/vec.hpp"
+#include "phypp/core/error.hpp"
 #include "phypp/math/complex.hpp"
 
 namespace phypp {
     #ifndef NO_FFTW
-    // Compute the Fast Fourier Transform (FFT) of the provided 2d array
-    inline vec2cd fft(const vec2d& v) {
-        vec2cd r(v.dims);
+    // Planning effort of the FFTW library. Higher efforts spend more time looking for the
+    // fastest algorithm for a given transform size, which pays off when many transforms of
+    // the same size are computed. Plans are cached, so this cost is only paid once per size.
+    enum class fft_planner : char {
+        estimate, measure, patient, exhaustive
+    };
 
-        fftw_plan p;
-        p = fftw_plan_dft_r2c_2d(v.dims[0], v.dims[1],
-            const_cast<double*>(v.data.data()),
-            reinterpret_cast<fftw_complex*>(r.data.data()), FFTW_ESTIMATE);
-        fftw_execute(p);
-        fftw_destroy_plan(p);
+    namespace impl {
+    namespace fftw_impl {
+        // Memory allocated with fftw_malloc(), with the alignment needed by FFTW's SIMD code
+        template<typename T>
+        class buffer_t {
+            T* data_ = nullptr;
+            uint_t size_ = 0;
+
+        public :
+            buffer_t() = default;
+            buffer_t(const buffer_t&) = delete;
+            buffer_t& operator = (const buffer_t&) = delete;
+
+            explicit buffer_t(uint_t n) {
+                resize(n);
+            }
+
+            ~buffer_t() {
+                if (data_) fftw_free(data_);
+            }
+
+            void resize(uint_t n) {
+                if (n == size_) return;
+                if (data_) fftw_free(data_);
+                data_ = (n == 0 ? nullptr : static_cast<T*>(fftw_malloc(n*sizeof(T))));
+                phypp_check(n == 0 || data_, "could not allocate memory for FFT (", n, " elements)");
+                size_ = n;
+            }
+
+            T* data() { return data_; }
+            uint_t size() const { return size_; }
+        };
+
+        enum class kind : char {
+            r2c, c2r
+        };
+
+        struct plan_key {
+            kind k;
+            std::vector<uint_t> dims;
+            uint_t howmany;
+            unsigned flags;
+            uint_t threads;
+            int align_in, align_out;
+            bool inplace;
+
+            bool operator < (const plan_key& o) const {
+                return std::tie(k, dims, howmany, flags, threads, align_in, align_out, inplace) <
+                    std::tie(o.k, o.dims, o.howmany, o.flags, o.threads, o.align_in, o.align_out,
+                        o.inplace);
+            }
+        };
+
+        struct state_t {
+            std::mutex mutex;
+            std::map<plan_key, fftw_plan> plans;
+            fft_planner planner = fft_planner::estimate;
+            uint_t threads = 1;
+
+            void clear() {
+                for (auto& p : plans) {
+                    fftw_destroy_plan(p.second);
+                }
+                plans.clear();
+            }
+
+            ~state_t() {
+                clear();
+            }
+        };
+
+        // Global state of the FFTW interface. The FFTW planner is not thread safe, so all
+        // calls to FFTW functions other than fftw_execute_*() must lock the mutex.
+        inline state_t& state() {
+            static state_t s;
+            return s;
+        }
+
+        inline unsigned planner_flags(fft_planner p) {
+            switch (p) {
+                case fft_planner::measure :    return FFTW_MEASURE;
+                case fft_planner::patient :    return FFTW_PATIENT;
+                case fft_planner::exhaustive : return FFTW_EXHAUSTIVE;
+                default :                      return FFTW_ESTIMATE;
+            }
+        }
+
+        inline int alignment(const void* p) {
+            return fftw_alignment_of(reinterpret_cast<double*>(const_cast<void*>(p)));
+        }
+
+        // Dimensions of the half spectrum of a real array
+        inline std::vector<uint_t> half_dims(std::vector<uint_t> dims) {
+            dims.back() = dims.back()/2 + 1;
+            return dims;
+        }
+
+        // Dimensions of a real array stored in place of its half spectrum, including the
+        // padding at the end of each row
+        inline std::vector<uint_t> padded_dims(std::vector<uint_t> dims) {
+            dims.back() = 2*(dims.back()/2 + 1);
+            return dims;
+        }
+
+        inline uint_t product(const std::vector<uint_t>& dims) {
+            uint_t n = 1;
+            for (uint_t d : dims) {
+                n *= d;
+            }
+
+            return n;
+        }
+
+        // Number of complex values in the half spectrum of a real array
+        inline uint_t half_size(const std::vector<uint_t>& dims) {
+            return product(half_dims(dims));
+        }
+
+        // Return a plan for 'howmany' real to complex (r2c) or complex to real (c2r)
+        // transforms of the given dimensions, stored one after the other in memory. The plan
+        // can be executed on any pair of arrays with the same alignment as 'in' and 'out'
+        // using fftw_execute_dft_r2c() or fftw_execute_dft_c2r(). If 'in' and 'out' are the
+        // same, the transform is done in place, and the real array is padded as FFTW expects.
+        // The plan is created on the first call, and cached for later use.
+        inline fftw_plan get_plan(kind k, const std::vector<uint_t>& dims, uint_t howmany,
+            const void* in, const void* out) {
+
+            state_t& s = state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+
+            plan_key key{k, dims, howmany, planner_flags(s.planner), s.threads,
+                alignment(in), alignment(out), in == out};
+
+            auto iter = s.plans.find(key);
+            if (iter != s.plans.end()) return iter->second;
+
+            std::vector<int> n(dims.begin(), dims.end());
+            std::vector<int> rembed, cembed = n;
+            cembed.back() = cembed.back()/2 + 1;
+            if (key.inplace) {
+                rembed = n;
+                rembed.back() = 2*cembed.back();
+            }
+
+            const int* rembed_ptr = (key.inplace ? rembed.data() : nullptr);
+            const int rdist = product(key.inplace ? padded_dims(dims) : dims);
+            const int cdist = half_size(dims);
+
+            // Planning may overwrite the arrays, so use scratch arrays with the same alignment
+            const uint_t nbyte = 2*cdist*howmany*sizeof(double);
+            buffer_t<char> bin(nbyte + 64), bout(key.inplace ? 0 : nbyte + 64);
+            char* tin = bin.data() + key.align_in;
+            char* tout = (key.inplace ? tin : bout.data() + key.align_out);
+
+            #ifndef NO_FFTW_THREADS
+            fftw_plan_with_nthreads(s.threads);
+            #endif
+
+            fftw_plan p;
+            if (k == kind::r2c) {
+                p = fftw_plan_many_dft_r2c(n.size(), n.data(), howmany,
+                    reinterpret_cast<double*>(tin), rembed_ptr, 1, rdist,
+                    reinterpret_cast<fftw_complex*>(tout), cembed.data(), 1, cdist, key.flags);
+            } else {
+                p = fftw_plan_many_dft_c2r(n.size(), n.data(), howmany,
+                    reinterpret_cast<fftw_complex*>(tin), cembed.data(), 1, cdist,
+                    reinterpret_cast<double*>(tout), rembed_ptr, 1, rdist, key.flags);
+            }
+
+            if (!p) {
+                vec1u d(dims.size());
+                std::copy(dims.begin(), dims.end(), d.data.begin());
+                phypp_check(false, "could not create FFTW plan for dimensions ", d);
+            }
+
+            s.plans.insert(std::make_pair(key, p));
+            return p;
+        }
+
+        inline void execute_r2c(const std::vector<uint_t>& dims, const double* in,
+            fftw_complex* out, uint_t howmany = 1) {
+            fftw_plan p = get_plan(kind::r2c, dims, howmany, in, out);
+            fftw_execute_dft_r2c(p, const_cast<double*>(in), out);
+        }
+
+        // Note: the input array is destroyed
+        inline void execute_c2r(const std::vector<uint_t>& dims, fftw_complex* in, double* out,
+            uint_t howmany = 1) {
+            fftw_plan p = get_plan(kind::c2r, dims, howmany, in, out);
+            fftw_execute_dft_c2r(p, in, out);
+        }
+
+        template<std::size_t Dim>
+        std::vector<uint_t> real_dims(const std::array<uint_t,Dim>& cdims, uint_t n) {
+            phypp_check(cdims[Dim-1] == n/2 + 1, "incompatible dimensions for the half spectrum (",
+                cdims[Dim-1], ") and real array (", n, "), expected ", n/2 + 1);
+
+            std::vector<uint_t> dims(cdims.begin(), cdims.end());
+            dims.back() = n;
+            return dims;
+        }
+
+        template<std::size_t Dim>
+        vec<Dim,complex<double>> make_spectrum(const std::vector<uint_t>& dims) {
+            vec<Dim,complex<double>> r;
+            std::copy(dims.begin(), dims.end(), r.dims.begin());
+            r.dims[Dim-1] = dims.back()/2 + 1;
+            r.resize();
+            return r;
+        }
+
+        // Forward transform along the last Dim-First dimensions
+        template<std::size_t First, std::size_t Dim>
+        vec<Dim,complex<double>> fft(const vec<Dim,double>& v) {
+            static_assert(Dim - First >= 1 && Dim - First <= 3,
+                "FFTs are only implemented in 1, 2 or 3 dimensions");
+
+            std::vector<uint_t> dims(v.dims.begin(), v.dims.end());
+            auto r = make_spectrum<Dim>(dims);
+            if (v.empty()) return r;
+
+            uint_t howmany = product(std::vector<uint_t>(dims.begin(), dims.begin() + First));
+            dims.erase(dims.begin(), dims.begin() + First);
+
+            execute_r2c(dims, v.data.data(), reinterpret_cast<fftw_complex*>(r.data.data()),
+                howmany);
+
+            return r;
+        }
+
+        // Backward transform along the last Dim-First dimensions
+        template<std::size_t First, std::size_t Dim>
+        vec<Dim,double> ifft(const vec<Dim,complex<double>>& v, uint_t n) {
+            static_assert(Dim - First >= 1 && Dim - First <= 3,
+                "FFTs are only implemented in 1, 2 or 3 dimensions");
+
+            std::vector<uint_t> dims = real_dims(v.dims, n);
+            vec<Dim,double> r;
+            std::copy(dims.begin(), dims.end(), r.dims.begin());
+            r.resize();
+            if (r.empty()) return r;
+
+            // The c2r transform destroys its input, so work on a copy
+            buffer_t<fftw_complex> tmp(v.size());
+            std::copy(v.data.begin(), v.data.end(), reinterpret_cast<complex<double>*>(tmp.data()));
+
+            uint_t howmany = product(std::vector<uint_t>(dims.begin(), dims.begin() + First));
+            dims.erase(dims.begin(), dims.begin() + First);
+
+            execute_c2r(dims, tmp.data(), r.data.data(), howmany);
+
+            return r;
+        }
+
+        template<std::size_t First, std::size_t Dim>
+        void inplace_fft(vec<Dim,complex<double>>& v, uint_t n, bool forward) {
+            static_assert(Dim - First >= 1 && Dim - First <= 3,
+                "FFTs are only implemented in 1, 2 or 3 dimensions");
+
+            std::vector<uint_t> dims = real_dims(v.dims, n);
+            if (v.empty()) return;
+
+            uint_t howmany = product(std::vector<uint_t>(dims.begin(), dims.begin() + First));
+            dims.erase(dims.begin(), dims.begin() + First);
+
+            fftw_complex* p = reinterpret_cast<fftw_complex*>(v.data.data());
+            if (forward) {
+                execute_r2c(dims, reinterpret_cast<double*>(p), p, howmany);
+            } else {
+                execute_c2r(dims, p, reinterpret_cast<double*>(p), howmany);
+            }
+        }
+    }
+    }
+
+    // Set the planning effort used for new FFT plans (default: fft_planner::estimate)
+    inline void fft_set_planner(fft_planner p) {
+        auto& s = impl::fftw_impl::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.planner = p;
+    }
+
+    // Set the number of threads used by each FFT (default: 1). Has no effect if FFTW was
+    // not compiled with thread support.
+    inline void fft_set_threads(uint_t n) {
+        #ifndef NO_FFTW_THREADS
+        auto& s = impl::fftw_impl::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        static bool init = (fftw_init_threads() != 0);
+        s.threads = (init && n != 0 ? n : 1);
+        #endif
+    }
+
+    // Destroy all the cached FFT plans
+    inline void fft_clear_plans() {
+        auto& s = impl::fftw_impl::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.clear();
+    }
+
+    // Load the FFTW "wisdom", i.e., plans saved from a previous run, to skip planning
+    inline bool fft_load_wisdom(const std::string& filename) {
+        auto& s = impl::fftw_impl::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return fftw_import_wisdom_from_filename(filename.c_str()) != 0;
+    }
+
+    // Save the FFTW "wisdom" accumulated so far, to be loaded in a later run
+    inline bool fft_save_wisdom(const std::string& filename) {
+        auto& s = impl::fftw_impl::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return fftw_export_wisdom_to_filename(filename.c_str()) != 0;
+    }
+
+    // Compute the Fast Fourier Transform (FFT) of the provided 1d, 2d or 3d array.
+    // Since the input is real, only the non-redundant half of the spectrum is returned: the
+    // last dimension of the output is n/2+1, where n is the last dimension of the input.
+    template<std::size_t Dim>
+    vec<Dim,complex<double>> fft(const vec<Dim,double>& v) {
+        return impl::fftw_impl::fft<0>(v);
+    }
+
+    // Compute the inverse Fast Fourier Transform of the provided half spectrum, as returned
+    // by fft(). Since the length of the last dimension of the real array cannot be inferred
+    // from that of the half spectrum, it must be provided in 'n'.
+    // Note: the result is not normalized, i.e., ifft(fft(v), n) == v*v.size().
+    template<std::size_t Dim>
+    vec<Dim,double> ifft(const vec<Dim,complex<double>>& v, uint_t n) {
+        return impl::fftw_impl::ifft<0>(v, n);
+    }
+
+    // Same as above, assuming that the real array has an even last dimension
+    template<std::size_t Dim>
+    vec<Dim,double> ifft(const vec<Dim,complex<double>>& v) {
+        phypp_check(v.dims[Dim-1] != 0, "cannot infer the dimensions of an empty spectrum");
+        return impl::fftw_impl::ifft<0>(v, 2*(v.dims[Dim-1] - 1));
+    }
+
+    // Compute the FFT of each slice v(i,...) of the provided array, i.e., N-1 dimensional
+    // transforms of all the elements along the first dimension, in a single call. This is
+    // faster than calling fft() for each slice, e.g., for a cube of image cutouts.
+    template<std::size_t Dim>
+    vec<Dim,complex<double>> fft_batch(const vec<Dim,double>& v) {
+        return impl::fftw_impl::fft<1>(v);
+    }
+
+    // Inverse of fft_batch()
+    template<std::size_t Dim>
+    vec<Dim,double> ifft_batch(const vec<Dim,complex<double>>& v, uint_t n) {
+        return impl::fftw_impl::ifft<1>(v, n);
+    }
+
+    // Copy a real array into a complex array with the layout expected by inplace_fft(),
+    // i.e., with the dimensions of the half spectrum, where each row of complex values holds
+    // the real values of the corresponding row of 'v' (followed by padding).
+    template<std::size_t Dim>
+    vec<Dim,complex<double>> fft_pack(const vec<Dim,double>& v) {
+        std::vector<uint_t> dims(v.dims.begin(), v.dims.end());
+        auto r = impl::fftw_impl::make_spectrum<Dim>(dims);
+        if (v.empty()) return r;
+
+        const uint_t nr = v.dims[Dim-1], nc = r.dims[Dim-1];
+        double* p = reinterpret_cast<double*>(r.data.data());
+        for (uint_t i : range(v.size()/nr)) {
+            std::copy(v.data.begin() + i*nr, v.data.begin() + (i+1)*nr, p + i*2*nc);
+        }
 
         return r;
     }
 
-    // Compute the Fast Fourier Transform (FFT) of the provided 2d array
-    inline vec2d ifft(const vec2cd& v) {
-        vec2d r(v.dims);
+    // Extract the real array stored in a complex array by inplace_ifft(). The length of the
+    // last dimension of the real array must be provided in 'n'.
+    template<std::size_t Dim>
+    vec<Dim,double> fft_unpack(const vec<Dim,complex<double>>& v, uint_t n) {
+        std::vector<uint_t> dims = impl::fftw_impl::real_dims(v.dims, n);
+        vec<Dim,double> r;
+        std::copy(dims.begin(), dims.end(), r.dims.begin());
+        r.resize();
+        if (r.empty()) return r;
 
-        fftw_plan p;
-        p = fftw_plan_dft_c2r_2d(v.dims[0], v.dims[1],
-            const_cast<fftw_complex*>(reinterpret_cast<const fftw_complex*>(v.data.data())),
-            r.data.data(), FFTW_ESTIMATE);
-        fftw_execute(p);
-        fftw_destroy_plan(p);
+        const uint_t nc = v.dims[Dim-1];
+        const double* p = reinterpret_cast<const double*>(v.data.data());
+        for (uint_t i : range(r.size()/n)) {
+            std::copy(p + i*2*nc, p + i*2*nc + n, r.data.begin() + i*n);
+        }
 
         return r;
     }
+
+    // In place versions of fft() and ifft(). The array 'v' has the dimensions of the half
+    // spectrum, and contains either the spectrum, or the real array (see fft_pack() and
+    // fft_unpack()). 'n' is the length of the last dimension of the real array. This saves
+    // the memory of the output array, and allows reusing the same array for many transforms.
+    template<std::size_t Dim>
+    void inplace_fft(vec<Dim,complex<double>>& v, uint_t n) {
+        impl::fftw_impl::inplace_fft<0>(v, n, true);
+    }
+
+    template<std::size_t Dim>
+    void inplace_ifft(vec<Dim,complex<double>>& v, uint_t n) {
+        impl::fftw_impl::inplace_fft<0>(v, n, false);
+    }
+
+    // In place versions of fft_batch() and ifft_batch()
+    template<std::size_t Dim>
+    void inplace_fft_batch(vec<Dim,complex<double>>& v, uint_t n) {
+        impl::fftw_impl::inplace_fft<1>(v, n, true);
+    }
+
+    template<std::size_t Dim>
+    void inplace_ifft_batch(vec<Dim,complex<double>>& v, uint_t n) {
+        impl::fftw_impl::inplace_fft<1>(v, n, false);
+    }
     #endif
 }
 
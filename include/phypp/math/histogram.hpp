@@ -161,80 +161,240 @@ namespace phypp {
         return b.safe[1] - b.safe[0];
     }
 
-    template<std::size_t Dim, typename Type, typename TypeB>
-    vec1u histogram(const vec<Dim,Type>& data, const vec<2,TypeB>& bins) {
-        phypp_check(bins.dims[0] == 2, "can only be called with a bin vector (expected "
-            "dims=[2,...], got dims=[", bins.dims, "])");
+    namespace impl {
+    namespace bin_impl {
+        // Find the bin containing a value, with the same rules as in_bin(): the first bin 'i'
+        // with bins(0,i) <= t < bins(1,i). Bins that are sorted and do not overlap are found
+        // with a binary search, and bins of equal width that touch each other are found
+        // directly from the value. Other bins are tested one by one.
+        template<typename TB>
+        struct bin_finder {
+            using btype = meta::rtype_t<TB>;
+            enum layout_t { uniform, sorted, any };
+
+            uint_t nbin = 0;
+            layout_t layout = any;
+            std::vector<btype> lo, up;
+            std::vector<btype> edges; // sorted edges of the intervals
+            std::vector<uint_t> bin;  // bin of [edges[k],edges[k+1]), or npos if none
+            double x0 = 0.0, dx = 0.0;
+
+            bin_finder() = default;
+
+            explicit bin_finder(const vec<2,TB>& bins) : nbin(bins.dims[1]) {
+                phypp_check(bins.dims[0] == 2, "can only be called with a bin vector (expected "
+                    "dims=[2,...], got dims=[", bins.dims, "])");
+
+                lo.resize(nbin);
+                up.resize(nbin);
+                for (uint_t b : range(nbin)) {
+                    lo[b] = bins.safe(0,b);
+                    up[b] = bins.safe(1,b);
+                }
+
+                if (nbin == 0) return;
+
+                bool is_sorted = true, contiguous = true;
+                for (uint_t b : range(nbin)) {
+                    if (!(lo[b] <= up[b]) || (b != 0 && !(lo[b] >= up[b-1]))) {
+                        is_sorted = false;
+                        break;
+                    }
+
+                    contiguous = contiguous && (b == 0 || lo[b] == up[b-1]);
+                }
+
+                if (!is_sorted) return;
+
+                layout = sorted;
+                for (uint_t b : range(nbin)) {
+                    if (edges.empty() || edges.back() != lo[b]) {
+                        if (!edges.empty()) bin.push_back(npos);
+                        edges.push_back(lo[b]);
+                    }
 
-        using rtype = meta::rtype_t<Type>;
-        vec<Dim,rtype> tmp = data;
+                    bin.push_back(b);
+                    edges.push_back(up[b]);
+                }
+
+                if (!contiguous) return;
+
+                // Equal widths: the bin is guessed from the value, then checked against the
+                // bounds, so the widths only need to be approximately equal
+                x0 = lo[0];
+                dx = (double(up[nbin-1]) - x0)/nbin;
+                if (!(dx > 0.0) || !std::isfinite(dx)) return;
+
+                for (uint_t b : range(nbin)) {
+                    if (std::abs((double(up[b]) - double(lo[b])) - dx) > 1e-3*dx) return;
+                }
+
+                layout = uniform;
+            }
+
+            // Index of the interval containing 't': 0 is before the first edge, and
+            // edges.size() is after the last one (only for sorted bins)
+            template<typename T>
+            uint_t interval(T t) const {
+                return std::upper_bound(edges.begin(), edges.end(), t) - edges.begin();
+            }
 
-        uint_t nbin = bins.dims[1];
-        vec1u counts(nbin);
+            // Bin of a given interval, or npos
+            uint_t bin_of(uint_t k) const {
+                return (k == 0 || k == edges.size() ? npos : bin[k-1]);
+            }
 
-        auto first = tmp.data.begin();
-        for (uint_t i : range(nbin)) {
-            auto last = std::partition(first, tmp.data.end(), [&bins,i](rtype t) {
-                return t >= bins.safe(0,i) && t < bins.safe(1,i);
-            });
+            // Bin containing 't', or npos
+            template<typename T>
+            uint_t find(T t) const {
+                switch (layout) {
+                case uniform : {
+                    if (!(t >= lo[0] && t < up[nbin-1])) return npos;
+
+                    double f = (double(t) - x0)/dx;
+                    uint_t k = (f > 0.0 ? std::min(uint_t(f), nbin-1) : 0);
+                    while (t < lo[k]) --k;
+                    while (!(t < up[k])) ++k;
+                    return k;
+                }
+                case sorted :
+                    return bin_of(interval(t));
+                default :
+                    for (uint_t b : range(nbin)) {
+                        if (t >= lo[b] && t < up[b]) return b;
+                    }
+
+                    return npos;
+                }
+            }
+        };
 
-            counts.safe[i] = last - first;
-            first = last;
+        template<typename TB>
+        bin_finder<TB> make_bin_finder(const vec<2,TB>& bins) {
+            return bin_finder<TB>(bins);
+        }
 
-            if (last == tmp.data.end()) break;
+        // Size of the blocks of values that are processed by each task
+        inline uint_t block_size(uint_t n) {
+            return std::max(parallel::grain, (n + 4*parallel::threads() - 1)/(4*parallel::threads()));
         }
 
-        return counts;
-    }
+        // Sum 'weight(i)' in the bin 'find(i)' of each value 'i' (ignored if npos), in one pass.
+        // In parallel, each block of values is summed in its own partial histogram, and the
+        // partial histograms are then added together.
+        template<typename R, typename FB, typename FW>
+        vec<1,R> accumulate(uint_t n, uint_t nbin, bool par, FB&& find, FW&& weight) {
+            auto fill = [&](uint_t i0, uint_t i1, vec<1,R>& h) {
+                for (uint_t i = i0; i < i1; ++i) {
+                    uint_t b = find(i);
+                    if (b != npos) h.safe[b] += weight(i);
+                }
+            };
+
+            vec<1,R> r(nbin);
+            if (parallel::use(n, par)) {
+                const uint_t g = block_size(n);
+                std::vector<vec<1,R>> tmp(parallel::chunks(n, g));
+                parallel::for_chunks(n, g, [&](uint_t i0, uint_t i1) {
+                    vec<1,R>& h = tmp[i0/g];
+                    h.resize(nbin);
+                    fill(i0, i1, h);
+                });
 
-    template<std::size_t Dim, typename Type, typename TypeB, typename TypeW>
-    vec<1,meta::rtype_t<TypeW>> histogram(const vec<Dim,Type>& data, const vec<Dim,TypeW>& weight,
-        const vec<2,TypeB>& bins) {
-        phypp_check(bins.dims[0] == 2, "can only be called with a bin vector (expected "
-            "dims=[2, ...], got dims=[", bins.dims, "])");
-        phypp_check(data.dims == weight.dims, "incompatible dimensions for data and weight "
-            "(", data.dims, " vs. ", weight.dims, ")");
+                for (auto& h : tmp) {
+                    r += h;
+                }
+            } else {
+                fill(0, n, r);
+            }
+
+            return r;
+        }
 
-        vec1u ids = uindgen(data.size());
+        // Values grouped by bin, with a counting sort: the values of bin 'b' are
+        // ids[offsets[b]] to ids[offsets[b+1]-1], in increasing order.
+        struct bin_groups {
+            vec1u offsets;
+            vec1u ids;
+        };
+
+        template<typename FB>
+        bin_groups group(uint_t n, uint_t nbin, bool par, FB&& find) {
+            vec1u bid(n);
+            if (parallel::use(n, par)) {
+                parallel::for_chunks(n, parallel::grain, [&](uint_t i0, uint_t i1) {
+                    for (uint_t i = i0; i < i1; ++i) {
+                        bid.safe[i] = find(i);
+                    }
+                });
+            } else {
+                for (uint_t i : range(n)) {
+                    bid.safe[i] = find(i);
+                }
+            }
 
-        uint_t nbin = bins.dims[1];
-        vec<1,meta::rtype_t<TypeW>> counts(nbin);
+            bin_groups g;
+            g.offsets.resize(nbin+1);
+            for (uint_t b : bid) {
+                if (b != npos) ++g.offsets.safe[b+1];
+            }
 
-        auto first = ids.data.begin();
-        for (uint_t i : range(nbin)) {
-            auto last = std::partition(first, ids.data.end(), [&bins,&data,i](uint_t id) {
-                return data.safe[id] >= bins.safe(0,i) && data.safe[id] < bins.safe(1,i);
-            });
+            for (uint_t b : range(nbin)) {
+                g.offsets.safe[b+1] += g.offsets.safe[b];
+            }
 
-            for (; first != last; ++first) {
-                counts.safe[i] += weight.safe[*first];
+            g.ids.resize(g.offsets.safe[nbin]);
+            vec1u pos = g.offsets;
+            for (uint_t i : range(n)) {
+                uint_t b = bid.safe[i];
+                if (b != npos) g.ids.safe[pos.safe[b]++] = i;
             }
 
-            if (last == ids.data.end()) break;
+            return g;
         }
+    }
+    }
 
-        return counts;
+    template<std::size_t Dim, typename Type, typename TypeB>
+    vec1u histogram(par_t, const vec<Dim,Type>& data, const vec<2,TypeB>& bins) {
+        auto b = impl::bin_impl::make_bin_finder(bins);
+        return impl::bin_impl::accumulate<uint_t>(data.size(), b.nbin, true,
+            [&](uint_t i) { return b.find(data.safe[i]); }, [](uint_t) { return 1u; });
+    }
+
+    template<std::size_t Dim, typename Type, typename TypeB>
+    vec1u histogram(const vec<Dim,Type>& data, const vec<2,TypeB>& bins) {
+        auto b = impl::bin_impl::make_bin_finder(bins);
+        return impl::bin_impl::accumulate<uint_t>(data.size(), b.nbin, parallel::enabled(),
+            [&](uint_t i) { return b.find(data.safe[i]); }, [](uint_t) { return 1u; });
+    }
+
+    template<std::size_t Dim, typename Type, typename TypeB, typename TypeW>
+    vec<1,meta::rtype_t<TypeW>> histogram(const vec<Dim,Type>& data, const vec<Dim,TypeW>& weight,
+        const vec<2,TypeB>& bins) {
+        phypp_check(data.dims == weight.dims, "incompatible dimensions for data and weight "
+            "(", data.dims, " vs. ", weight.dims, ")");
+
+        auto b = impl::bin_impl::make_bin_finder(bins);
+        return impl::bin_impl::accumulate<meta::rtype_t<TypeW>>(data.size(), b.nbin,
+            parallel::enabled(), [&](uint_t i) { return b.find(data.safe[i]); },
+            [&](uint_t i) { return weight.safe[i]; });
     }
 
     namespace impl {
+        // Call func(i, ids, i0, i1) for each bin 'i', where [i0,i1) are the indices in 'ids' of
+        // the values that fall in this bin (in increasing order).
         template<std::size_t Dim, typename Type, typename TypeB, typename F>
         void histogram_impl(const vec<Dim,Type>& data, const vec<2,TypeB>& bins, F&& func) {
-            phypp_check(bins.dims[0] == 2, "can only be called with a bin vector (expected "
-                "dims=[2, ...], got dims=[", bins.dims, "])");
+            auto b = bin_impl::make_bin_finder(bins);
+            bin_impl::bin_groups g = bin_impl::group(data.size(), b.nbin, parallel::enabled(),
+                [&](uint_t i) { return b.find(data.safe[i]); });
 
-            vec1u ids = uindgen(data.size());
             using iterator = vec1u::const_iterator;
-
-            uint_t nbin = bins.dims[1];
-            auto first = ids.data.begin();
-            for (uint_t i : range(nbin)) {
-                auto last = std::partition(first, ids.data.end(), [&bins,&data,i](uint_t id) {
-                    return data.safe[id] >= bins.safe(0,i) && data.safe[id] < bins.safe(1,i);
-                });
-
-                func(i, meta::add_const(ids), iterator{first}, iterator{last});
-
-                if (last == ids.data.end()) break;
+            const vec1u& ids = g.ids;
+            for (uint_t i : range(b.nbin)) {
+                func(i, ids, iterator{ids.data.begin() + g.offsets.safe[i]},
+                    iterator{ids.data.begin() + g.offsets.safe[i+1]});
             }
         }
     }
@@ -259,45 +419,36 @@ namespace phypp {
     }
 
     namespace impl {
+        // Call func(i, j, ids, i0, i1) for each cell '(i,j)', where [i0,i1) are the indices in
+        // 'ids' of the values that fall in this cell (in increasing order).
         template<std::size_t Dim, typename TypeX, typename TypeY, typename TypeBX,
             typename TypeBY, typename TypeF>
         void histogram2d_impl(const vec<Dim,TypeX>& x, const vec<Dim,TypeY>& y,
             const vec<2,TypeBX>& xbins, const vec<2,TypeBY>& ybins, TypeF&& func) {
 
-            phypp_check(xbins.dims[0] == 2, "can only be called with a bin vector (expected "
-                "dims=[2, ...], got dims=[", xbins.dims, "])");
-            phypp_check(ybins.dims[0] == 2, "can only be called with a bin vector (expected "
-                "dims=[2, ...], got dims=[", ybins.dims, "])");
             phypp_check(x.dims == y.dims, "incompatible dimensions for x and y (", x.dims, " vs. ",
                 y.dims, ")");
 
-            vec1u ids = uindgen(x.size());
-
-            uint_t nxbin = xbins.dims[1];
-            uint_t nybin = ybins.dims[1];
-
-            using iterator = vec1u::const_iterator;
-
-            auto firstx = ids.data.begin();
-            for (uint_t i : range(nxbin)) {
-                auto lastx = std::partition(firstx, ids.data.end(), [&xbins,&x,i](uint_t id) {
-                    return x.safe[id] >= xbins.safe(0,i) && x.safe[id] < xbins.safe(1,i);
-                });
+            auto bx = bin_impl::make_bin_finder(xbins);
+            auto by = bin_impl::make_bin_finder(ybins);
+            const uint_t nxbin = bx.nbin, nybin = by.nbin;
 
-                auto firsty = firstx;
-                for (uint_t j : range(nybin)) {
-                    auto lasty = std::partition(firsty, lastx, [&ybins,&y,j](uint_t id) {
-                        return y.safe[id] >= ybins.safe(0,j) && y.safe[id] < ybins.safe(1,j);
-                    });
-
-                    func(i, j, meta::add_const(ids), iterator{firsty}, iterator{lasty});
-
-                    if (lasty == lastx) break;
-                    firsty = lasty;
+            bin_impl::bin_groups g = bin_impl::group(x.size(), nxbin*nybin, parallel::enabled(),
+                [&](uint_t i) {
+                    uint_t ix = bx.find(x.safe[i]);
+                    if (ix == npos) return npos;
+                    uint_t iy = by.find(y.safe[i]);
+                    return iy == npos ? npos : ix*nybin + iy;
                 }
+            );
 
-                if (lastx == ids.data.end()) break;
-                firstx = lastx;
+            using iterator = vec1u::const_iterator;
+            const vec1u& ids = g.ids;
+            for (uint_t i : range(nxbin))
+            for (uint_t j : range(nybin)) {
+                uint_t c = i*nybin + j;
+                func(i, j, ids, iterator{ids.data.begin() + g.offsets.safe[c]},
+                    iterator{ids.data.begin() + g.offsets.safe[c+1]});
             }
         }
     }
@@ -306,14 +457,22 @@ namespace phypp {
     vec2u histogram2d(const vec<Dim,TypeX>& x, const vec<Dim,TypeY>& y,
         const vec<2,TypeBX>& xbins, const vec<2,TypeBY>& ybins) {
 
-        vec2u counts(xbins.dims[1], ybins.dims[1]);
-
-        using iterator = vec1u::const_iterator;
-        impl::histogram2d_impl(x, y, xbins, ybins,
-            [&](uint_t i, uint_t j, const vec1u& ids, iterator i0, iterator i1) {
-                counts.safe(i,j) = i1 - i0;
-            }
-        );
+        phypp_check(x.dims == y.dims, "incompatible dimensions for x and y (", x.dims, " vs. ",
+            y.dims, ")");
+
+        auto bx = impl::bin_impl::make_bin_finder(xbins);
+        auto by = impl::bin_impl::make_bin_finder(ybins);
+        const uint_t nybin = by.nbin;
+
+        vec2u counts(bx.nbin, nybin);
+        counts.data = impl::bin_impl::accumulate<uint_t>(x.size(), bx.nbin*nybin,
+            parallel::enabled(), [&](uint_t i) {
+                uint_t ix = bx.find(x.safe[i]);
+                if (ix == npos) return npos;
+                uint_t iy = by.find(y.safe[i]);
+                return iy == npos ? npos : ix*nybin + iy;
+            }, [](uint_t) { return 1u; }
+        ).data;
 
         return counts;
     }
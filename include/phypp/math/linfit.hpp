@@ -39,31 +39,13 @@ namespace phypp {
             linfit_result fr;
 
             uint_t np = cache.dims[0];
-            uint_t nm = cache.dims[1];
 
             // Solving 'y +/- e = sum over i of a[i]*x[i]' to get all a[i]'s
-            vec2d alpha(np,np);
-            vec1d beta(np);
-            auto tmp = flatten(y/ye);
-            for (uint_t i = 0; i < np; ++i) {
-                for (uint_t j = 0; j < np; ++j) {
-                    if (i <= j) {
-                        alpha.safe(i,j) = 0.0;
-                        // alpha(i,j) = sum over all points of x[i]*x[j]/e^2
-                        for (uint_t m = 0; m < nm; ++m) {
-                            alpha.safe(i,j) += cache.safe(i,m)*cache.safe(j,m);
-                        }
-                    } else {
-                        alpha.safe(i,j) = alpha.safe(j,i);
-                    }
-                }
-
-                beta.safe[i] = 0.0;
-                // beta[i] = sum over all points of x[i]*y/e^2
-                for (uint_t m = 0; m < nm; ++m) {
-                    beta.safe[i] += cache.safe(i,m)*tmp.safe[m];
-                }
-            }
+            // alpha(i,j) = sum over all points of x[i]*x[j]/e^2
+            // beta[i] = sum over all points of x[i]*y/e^2
+            vec1d tmp = flatten(y/ye);
+            vec2d alpha = matrix::product_transpose(cache);
+            vec1d beta = matrix::product(cache, tmp);
 
             if (!matrix::inplace_invert_symmetric(alpha)) {
                 fr.success = false;
@@ -81,13 +63,7 @@ namespace phypp {
             fr.errors = sqrt(matrix::diagonal(alpha));
             fr.cov = alpha;
 
-            vec1d model(nm);
-            for (uint_t m = 0; m < nm; ++m) {
-                model.safe[m] = 0.0;
-                for (uint_t i = 0; i < np; ++i) {
-                    model.safe[m] += fr.params.safe[i]*cache.safe(i,m);
-                }
-            }
+            vec1d model = matrix::product(fr.params, cache);
 
             fr.chi2 = total(sqr(model - tmp));
 
@@ -167,22 +143,11 @@ namespace phypp {
 
             cache.resize(np,nm);
             beta.resize(np);
-            alpha.resize(np,np);
             impl::linfit_make_cache_(cache, ye, 0, std::forward<Args>(args)...);
 
             // Solving 'y +/- e = sum over i of a[i]*x[i]' to get all a[i]'s
-            for (uint_t i = 0; i < np; ++i)
-            for (uint_t j = 0; j < np; ++j) {
-                if (i <= j) {
-                    alpha.safe(i,j) = 0.0;
-                    // alpha(i,j) = sum over all points of x[i]*x[j]/e^2
-                    for (uint_t m = 0; m < nm; ++m) {
-                        alpha.safe(i,j) += cache.safe(i,m)*cache.safe(j,m);
-                    }
-                } else {
-                    alpha.safe(i,j) = alpha.safe(j,i);
-                }
-            }
+            // alpha(i,j) = sum over all points of x[i]*x[j]/e^2
+            alpha = matrix::product_transpose(cache);
 
             if (!matrix::inplace_invert_symmetric(alpha)) {
                 fr.success = false;
@@ -205,27 +170,13 @@ namespace phypp {
 
             if (!fr.success) return;
 
-            uint_t np = cache.dims[0];
-            uint_t nm = cache.dims[1];
-
-            auto tmp = flatten(y/ye);
-            for (uint_t i = 0; i < np; ++i) {
-                beta.safe[i] = 0.0;
-                // beta[i] = sum over all points of x[i]*y/e^2
-                for (uint_t m = 0; m < nm; ++m) {
-                    beta.safe[i] += cache.safe(i,m)*tmp.safe[m];
-                }
-            }
+            // beta[i] = sum over all points of x[i]*y/e^2
+            vec1d tmp = flatten(y/ye);
+            beta = matrix::product(cache, tmp);
 
             fr.params = matrix::product(alpha, beta);
 
-            vec1d model(nm);
-            for (uint_t m = 0; m < nm; ++m) {
-                model.safe[m] = 0.0;
-                for (uint_t i = 0; i < np; ++i) {
-                    model.safe[m] += fr.params.safe[i]*cache.safe(i,m);
-                }
-            }
+            vec1d model = matrix::product(fr.params, cache);
 
             fr.chi2 = total(sqr(model - tmp));
         }
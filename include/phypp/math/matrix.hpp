@@ -4,12 +4,247 @@
 #ifndef NO_LAPACK
 #include "phypp/math/lapack.hpp"
 #endif
+#ifndef NO_BLAS
+#include "phypp/math/blas.hpp"
+#endif
 #include "phypp/core/vec.hpp"
 #include "phypp/core/error.hpp"
 #include "phypp/core/range.hpp"
 #include "phypp/math/base.hpp"
+#include "phypp/math/simd.hpp"
 
 namespace phypp {
+namespace impl {
+namespace matrix_impl {
+    // Element types for which products use the blocked kernels (or BLAS)
+    template<typename T>
+    using is_blas_type = simd::is_float<T>;
+
+    // Below this number of multiplications, products use simple loops
+    static const uint_t gemm_min_ops = 4096;
+    // Above this number of multiplications, products are done by BLAS (if available)
+    static const uint_t blas_min_ops = 262144;
+    // Above this number of elements, matrix-vector products are done by BLAS (if available)
+    static const uint_t blas_min_gemv = 65536;
+
+    // Contiguous vector with elements of type T: either the input, or a converted copy
+    // stored in 'tmp'
+    template<std::size_t Dim, typename T>
+    const vec<Dim,T>& dense(const vec<Dim,T>& v, vec<Dim,T>&) {
+        return v;
+    }
+
+    template<std::size_t Dim, typename T, typename U>
+    const vec<Dim,T>& dense(const vec<Dim,U>& v, vec<Dim,T>& tmp) {
+        tmp = v;
+        return tmp;
+    }
+
+#ifndef NO_BLAS
+    // BLAS works with column-major matrices, i.e., with the transpose of our matrices
+    inline void blas_gemm(char ta, char tb, int m, int n, int k, const double* a, int lda,
+        const double* b, int ldb, double* c, int ldc) {
+        double alpha = 1.0, beta = 0.0;
+        blas::dgemm_(&ta, &tb, &m, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+    }
+
+    inline void blas_gemm(char ta, char tb, int m, int n, int k, const float* a, int lda,
+        const float* b, int ldb, float* c, int ldc) {
+        float alpha = 1.0f, beta = 0.0f;
+        blas::sgemm_(&ta, &tb, &m, &n, &k, &alpha, a, &lda, b, &ldb, &beta, c, &ldc);
+    }
+
+    inline void blas_gemv(char t, int m, int n, const double* a, int lda, const double* x,
+        double* y) {
+        double alpha = 1.0, beta = 0.0;
+        int inc = 1;
+        blas::dgemv_(&t, &m, &n, &alpha, a, &lda, x, &inc, &beta, y, &inc);
+    }
+
+    inline void blas_gemv(char t, int m, int n, const float* a, int lda, const float* x,
+        float* y) {
+        float alpha = 1.0f, beta = 0.0f;
+        int inc = 1;
+        blas::sgemv_(&t, &m, &n, &alpha, a, &lda, x, &inc, &beta, y, &inc);
+    }
+
+    inline void blas_syrk(char uplo, char t, int n, int k, const double* a, int lda,
+        double* c, int ldc) {
+        double alpha = 1.0, beta = 0.0;
+        blas::dsyrk_(&uplo, &t, &n, &k, &alpha, a, &lda, &beta, c, &ldc);
+    }
+
+    inline void blas_syrk(char uplo, char t, int n, int k, const float* a, int lda,
+        float* c, int ldc) {
+        float alpha = 1.0f, beta = 0.0f;
+        blas::ssyrk_(&uplo, &t, &n, &k, &alpha, a, &lda, &beta, c, &ldc);
+    }
+#endif
+
+    // C = op(A)*op(B), where op(X) is either X or its transpose, op(A) is n x o and op(B) is
+    // o x m. All matrices are contiguous, and C is zero on input.
+    template<typename T>
+    void gemm_loop(uint_t n, uint_t m, uint_t o, const T* a, bool ta, const T* b, bool tb,
+        T* c) {
+        const uint_t ars = ta ? 1 : o, acs = ta ? n : 1;
+        const uint_t brs = tb ? 1 : m, bcs = tb ? o : 1;
+        for (uint_t i = 0; i < n; ++i)
+        for (uint_t k = 0; k < o; ++k) {
+            const T aik = a[i*ars + k*acs];
+            const T* bk = b + k*brs;
+            T* ci = c + i*m;
+            for (uint_t j = 0; j < m; ++j) {
+                ci[j] += aik*bk[j*bcs];
+            }
+        }
+    }
+
+    template<typename T>
+    void gemm(uint_t n, uint_t m, uint_t o, const T* a, bool ta, const T* b, bool tb, T* c,
+        std::false_type) {
+        gemm_loop(n, m, o, a, ta, b, tb, c);
+    }
+
+    template<typename T>
+    void gemm(uint_t n, uint_t m, uint_t o, const T* a, bool ta, const T* b, bool tb, T* c,
+        std::true_type) {
+        if (n == 0 || m == 0 || o == 0) return;
+
+        const uint_t ops = n*m*o;
+        if (ops < gemm_min_ops) {
+            gemm_loop(n, m, o, a, ta, b, tb, c);
+            return;
+        }
+
+    #ifndef NO_BLAS
+        if (ops >= blas_min_ops) {
+            // C^T = op(B)^T*op(A)^T
+            blas_gemm(tb ? 'T' : 'N', ta ? 'T' : 'N', m, n, o, b, tb ? o : m, a, ta ? n : o, c, m);
+            return;
+        }
+    #endif
+
+        simd::gemm(n, m, o, a, ta ? 1 : o, ta ? n : 1, b, tb ? 1 : m, tb ? o : 1, c);
+    }
+
+    // C = A*A^T, with A (n x o) contiguous, and C zero on input
+    template<typename T>
+    void syrk_lower_loop(uint_t n, uint_t o, const T* a, T* c) {
+        for (uint_t i = 0; i < n; ++i)
+        for (uint_t j = 0; j <= i; ++j) {
+            const T* ai = a + i*o;
+            const T* aj = a + j*o;
+            T s = T(0);
+            for (uint_t k = 0; k < o; ++k) {
+                s += ai[k]*aj[k];
+            }
+
+            c[i*n + j] = s;
+        }
+    }
+
+    template<typename T>
+    void syrk(uint_t n, uint_t o, const T* a, T* c, std::false_type) {
+        syrk_lower_loop(n, o, a, c);
+    }
+
+    template<typename T>
+    void syrk(uint_t n, uint_t o, const T* a, T* c, std::true_type) {
+        if (n == 0 || o == 0) return;
+
+        const uint_t ops = n*(n+1)/2*o;
+        if (ops < gemm_min_ops) {
+            syrk_lower_loop(n, o, a, c);
+            return;
+        }
+
+    #ifndef NO_BLAS
+        if (ops >= blas_min_ops) {
+            // Upper triangle of C^T = A^T^T*A^T, i.e., lower triangle of C
+            blas_syrk('U', 'T', n, o, a, o, c, n);
+            return;
+        }
+    #endif
+
+        simd::gemm(n, n, o, a, o, 1, a, 1, o, c, true);
+    }
+
+    // y = op(A)*x, with A (n x o if not transposed, o x n otherwise) contiguous, and y zero
+    // on input
+    template<typename T>
+    void gemv(uint_t n, uint_t o, const T* a, bool ta, const T* x, T* y, std::false_type) {
+        if (ta) {
+            for (uint_t k = 0; k < o; ++k)
+            for (uint_t i = 0; i < n; ++i) {
+                y[i] += a[k*n + i]*x[k];
+            }
+        } else {
+            for (uint_t i = 0; i < n; ++i)
+            for (uint_t k = 0; k < o; ++k) {
+                y[i] += a[i*o + k]*x[k];
+            }
+        }
+    }
+
+    template<typename T>
+    void gemv(uint_t n, uint_t o, const T* a, bool ta, const T* x, T* y, std::true_type) {
+        if (n == 0 || o == 0) return;
+
+    #ifndef NO_BLAS
+        if (n*o >= blas_min_gemv) {
+            if (ta) {
+                blas_gemv('N', n, o, a, n, x, y);
+            } else {
+                blas_gemv('T', o, n, a, o, x, y);
+            }
+            return;
+        }
+    #endif
+
+        if (ta) {
+            simd::gevm(o, n, a, x, y);
+        } else {
+            simd::gemv(n, o, a, x, y);
+        }
+    }
+
+    // r = op(A)*op(B)
+    template<typename T, typename TA, typename TB>
+    void product(vec<2,T>& r, const vec<2,TA>& a, bool ta, const vec<2,TB>& b, bool tb) {
+        vec<2,T> tmpa, tmpb;
+        const vec<2,T>& da = dense(a, tmpa);
+        const vec<2,T>& db = dense(b, tmpb);
+        gemm(r.dims[0], r.dims[1], ta ? a.dims[0] : a.dims[1], da.data.data(), ta,
+            db.data.data(), tb, r.data.data(), is_blas_type<T>{});
+    }
+
+    // r = A*A^T
+    template<typename T, typename TA>
+    void product_self(vec<2,T>& r, const vec<2,TA>& a) {
+        vec<2,T> tmpa;
+        const vec<2,T>& da = dense(a, tmpa);
+        const uint_t n = a.dims[0];
+        syrk(n, a.dims[1], da.data.data(), r.data.data(), is_blas_type<T>{});
+
+        for (uint_t i = 0; i < n; ++i)
+        for (uint_t j = i+1; j < n; ++j) {
+            r.safe(i,j) = r.safe(j,i);
+        }
+    }
+
+    // r = op(A)*x
+    template<typename T, typename TA, typename TX>
+    void product(vec<1,T>& r, const vec<2,TA>& a, bool ta, const vec<1,TX>& x) {
+        vec<2,T> tmpa;
+        vec<1,T> tmpx;
+        const vec<2,T>& da = dense(a, tmpa);
+        const vec<1,T>& dx = dense(x, tmpx);
+        gemv(r.dims[0], x.dims[0], da.data.data(), ta, dx.data.data(), r.data.data(),
+            is_blas_type<T>{});
+    }
+}
+}
+
 namespace matrix {
     using phypp::transpose;
 
@@ -18,19 +253,32 @@ namespace matrix {
         phypp_check(a.dims[1] == b.dims[0], "incompatible dimensions in matrix-matrix multiplication "
             "(", a.dims, " x ", b.dims, ")");
 
-        const uint_t o = a.dims[1];
-
         using ntype_t = decltype(a(0,0)*b(0,0));
-        const uint_t n = a.dims[0];
-        const uint_t m = b.dims[1];
+        vec<2,ntype_t> r(a.dims[0], b.dims[1]);
+        impl::matrix_impl::product(r, a, false, b, false);
+        return r;
+    }
 
-        vec<2,ntype_t> r(n,m);
-        for (uint_t i : range(n))
-        for (uint_t j : range(m))
-        for (uint_t k : range(o)) {
-            r.safe(i,j) += a.safe(i,k)*b.safe(k,j);
-        }
+    // A*B^T, e.g., for cross products between the rows of A and B
+    template<typename TypeA, typename TypeB>
+    auto product_transpose(const vec<2,TypeA>& a, const vec<2,TypeB>& b) ->
+        vec<2,decltype(a(0,0)*b(0,0))> {
+        phypp_check(a.dims[1] == b.dims[1], "incompatible dimensions in matrix-matrix multiplication "
+            "(", a.dims, " x transpose of ", b.dims, ")");
+
+        using ntype_t = decltype(a(0,0)*b(0,0));
+        vec<2,ntype_t> r(a.dims[0], b.dims[0]);
+        impl::matrix_impl::product(r, a, false, b, true);
+        return r;
+    }
 
+    // A*A^T, e.g., the normal matrix of a linear fit with one model per row of A. Only half of
+    // the matrix is computed, the result is symmetric.
+    template<typename TypeA>
+    auto product_transpose(const vec<2,TypeA>& a) -> vec<2,decltype(a(0,0)*a(0,0))> {
+        using ntype_t = decltype(a(0,0)*a(0,0));
+        vec<2,ntype_t> r(a.dims[0], a.dims[0]);
+        impl::matrix_impl::product_self(r, a);
         return r;
     }
 
@@ -39,36 +287,20 @@ namespace matrix {
         phypp_check(a.dims[1] == b.dims[0], "incompatible dimensions in matrix-vector multiplication "
             "(", a.dims, " x ", b.dims, ")");
 
-        const uint_t o = a.dims[1];
-
         using ntype_t = decltype(a(0,0)*b(0,0));
-        const uint_t n = a.dims[0];
-
-        vec<1,ntype_t> r(n);
-        for (uint_t i : range(n))
-        for (uint_t k : range(o)) {
-            r.safe(i) += a.safe(i,k)*b.safe(k);
-        }
-
+        vec<1,ntype_t> r(a.dims[0]);
+        impl::matrix_impl::product(r, a, false, b);
         return r;
     }
 
     template<typename TypeA, typename TypeB>
     auto product(const vec<1,TypeB>& b, const vec<2,TypeA>& a) -> vec<1,decltype(a(0,0)*b(0,0))> {
-        phypp_check(a.dims[1] == b.dims[0], "incompatible dimensions in vector-matrix multiplication "
-            "(", a.dims, " x ", b.dims, ")");
-
-        const uint_t o = a.dims[0];
+        phypp_check(a.dims[0] == b.dims[0], "incompatible dimensions in vector-matrix multiplication "
+            "(", b.dims, " x ", a.dims, ")");
 
         using ntype_t = decltype(a(0,0)*b(0,0));
-        const uint_t n = a.dims[1];
-
-        vec<1,ntype_t> r = arr<ntype_t>(n);
-        for (uint_t i : range(n))
-        for (uint_t k : range(o)) {
-            r.safe(i) += b.safe(k)*a.safe(k,i);
-        }
-
+        vec<1,ntype_t> r(a.dims[1]);
+        impl::matrix_impl::product(r, a, true, b);
         return r;
     }
 
@@ -90,11 +322,20 @@ namespace matrix {
         phypp_check(v.dims[0] == v.dims[1], "can only be called on square matrix (got ",
             v.dims, ")");
 
-        decltype(v(_,0)) d(impl::vec_ref_tag, impl::vec_access::get_parent(v));
+        using vtype = decltype(v(_,0));
+        vtype d(impl::vec_ref_tag, impl::vec_access::get_parent(v));
         d.dims[0] = v.dims[0];
-        d.resize();
-        for (uint_t i : range(d)) {
-            d.safe[i] = impl::ptr<Type>(v.safe(i,i));
+
+        typename vtype::dtype* base;
+        std::ptrdiff_t stride;
+        if (impl::vec_access::get_linear(v, base, stride)) {
+            d.data = typename vtype::vtype(base, d.dims[0], stride*(v.dims[0]+1));
+        } else {
+            d.resize();
+            auto& p = d.data.indirect();
+            for (uint_t i : range(d)) {
+                p[i] = impl::ptr<Type>(v.safe(i,i));
+            }
         }
 
         return d;
@@ -105,11 +346,20 @@ namespace matrix {
         phypp_check(v.dims[0] == v.dims[1], "can only be called on square matrix (got ",
             v.dims, ")");
 
-        decltype(v(_,0)) d(impl::vec_ref_tag, impl::vec_access::get_parent(v));
+        using vtype = decltype(v(_,0));
+        vtype d(impl::vec_ref_tag, impl::vec_access::get_parent(v));
         d.dims[0] = v.dims[0];
-        d.resize();
-        for (uint_t i : range(d)) {
-            d.data[i] = impl::ptr<Type>(v.safe(i,i));
+
+        typename vtype::dtype* base;
+        std::ptrdiff_t stride;
+        if (impl::vec_access::get_linear(v, base, stride)) {
+            d.data = typename vtype::vtype(base, d.dims[0], stride*(v.dims[0]+1));
+        } else {
+            d.resize();
+            auto& p = d.data.indirect();
+            for (uint_t i : range(d)) {
+                p[i] = impl::ptr<Type>(v.safe(i,i));
+            }
         }
 
         return d;
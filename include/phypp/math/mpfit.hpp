@@ -4,6 +4,7 @@
 #include "phypp/core/vec.hpp"
 #include "phypp/core/error.hpp"
 #include "phypp/core/range.hpp"
+#include "phypp/core/parallel.hpp"
 #include "phypp/utility/generic.hpp"
 #include "phypp/math/base.hpp"
 #include "phypp/math/matrix.hpp"
@@ -19,8 +20,9 @@ namespace phypp {
     //  - In IDL, the MPFIT routine does support not recursive calls (i.e. fitting a model that itself
     //    calls MPFIT). There is a way around this problem, although it is tedious. The C++ version
     //    supports recursion naturally.
+    //  - Explicit derivatives are given as a single function computing the whole Jacobian
+    //    matrix, rather than per parameter.
     //  - For simplicity, the C++ version does not support:
-    //      - specifying explicit derivatives,
     //      - registering a callback for each iteration,
     //      - tied parameters.
     //
@@ -87,154 +89,269 @@ namespace phypp {
         bool nocovar = false;  // do not compute errors and covariance matrix (faster)
     };
 
+    // Buffers used by mpfit() for a given number of data points and parameters. A workspace
+    // can be reused for any number of fits to avoid memory allocations (it is resized
+    // automatically if needed), but must not be shared between threads.
+    struct mpfit_workspace {
+        uint_t npt = 0;    // number of data points
+        uint_t nparam = 0; // number of parameters
+
+        mpfit_workspace() = default;
+        mpfit_workspace(uint_t m, uint_t np) {
+            resize(m, np);
+        }
+
+        void resize(uint_t m, uint_t np) {
+            if (np != nparam) {
+                nparam = np;
+                defaults = mpfit_options(np);
+                xall.resize(np);
+                ifree.resize(np);
+                ipiv.resize(np);
+                for (vec1d* v : {&x, &h, &qtf, &diag, &llim, &ulim, &mastep, &wa1, &wa2, &wa3,
+                    &wb1, &wb2, &wb3, &wb4}) {
+                    v->resize(np);
+                }
+
+                r.resize(np, np);
+            }
+
+            if (m != npt || jall.dims[0] != np) {
+                npt = m;
+                fvec.resize(m);
+                wa4.resize(m);
+                fp.resize(m);
+                fm.resize(m);
+                fjac.resize(np, m);
+                jall.resize(np, m);
+            }
+        }
+
+        // Internal buffers
+        mpfit_options defaults;
+        vec1u ifree, ipiv;
+        vec1d xall, x, h, qtf, diag, llim, ulim, mastep, wa1, wa2, wa3, wb1, wb2, wb3, wb4;
+        vec1d fvec, wa4, fp, fm;
+        vec2d fjac, jall, r;
+    };
+
+namespace impl {
+namespace mpfit_impl {
     // Numerically stable sqrt(total(sqr(v)))
-    double mpfit_enorm(const vec1d& v) {
+    inline double enorm(const double* v, uint_t n) {
         const double dwarf = sqrt(std::numeric_limits<double>::min()*1.5)*10.0;
         const double giant = sqrt(std::numeric_limits<double>::max())*0.1;
 
-        auto mm = minmax(v);
-        double mx = max(abs(mm.first), abs(mm.second));
-        if (mx == 0.0) return 0.0;
+        double mx = 0.0;
+        bool finite = false;
+        for (uint_t i = 0; i < n; ++i) {
+            if (is_nan(v[i])) continue;
+            finite = true;
+            double a = std::abs(v[i]);
+            if (a > mx) mx = a;
+        }
 
-        if (mx > giant/v.size() || mx < dwarf*v.size()) {
-            double res = 0.0;
-            for (double x : v) {
-                res += sqr(x/mx);
+        if (finite && mx == 0.0) return 0.0;
+
+        double res = 0.0;
+        if (mx > giant/n || mx < dwarf*n) {
+            for (uint_t i = 0; i < n; ++i) {
+                res += sqr(v[i]/mx);
             }
 
             return mx*sqrt(res);
         } else {
-            double res = 0.0;
-            for (double x : v) {
-                res += sqr(x);
+            for (uint_t i = 0; i < n; ++i) {
+                res += sqr(v[i]);
             }
 
             return sqrt(res);
         }
     }
 
-    // Compute the Jacobian matrix with finite difference derivatives
+    // Deviate functions either return the deviates, or write them in their second argument
     template<typename F>
-    vec2d mpfit_fdjac2(F&& deviate, const vec1d& xall, const vec1u& ifree, const vec1d& x,
-        const vec1d& fvec, const mpfit_options& options) {
+    struct is_inplace_deviate {
+        template<typename U>
+        static auto test(U* f) -> decltype((*f)(std::declval<const vec1d&>(),
+            std::declval<vec1d&>()), std::true_type{});
 
-        const double eps = sqrt(std::numeric_limits<double>::epsilon());
+        template<typename U>
+        static std::false_type test(...);
+
+        static const bool value = decltype(test<F>(nullptr))::value;
+    };
+
+    template<typename F>
+    void evaluate(F& deviate, const vec1d& p, vec1d& d, std::true_type) {
+        deviate(p, d);
+    }
+
+    template<typename F>
+    void evaluate(F& deviate, const vec1d& p, vec1d& d, std::false_type) {
+        uint_t m = d.size();
+        d = flatten(deviate(p));
+        phypp_check(d.size() == m, "the deviate function must always return the same number "
+            "of elements (got ", d.size(), " instead of ", m, ")");
+    }
+
+    template<typename F>
+    void evaluate(F& deviate, const vec1d& p, vec1d& d) {
+        evaluate(deviate, p, d, std::integral_constant<bool, is_inplace_deviate<F>::value>{});
+    }
 
-        const uint_t m = fvec.size();
-        const uint_t n = x.size();
+    // Tag for fits without a user-provided Jacobian
+    struct no_jacobian {};
 
-        vec2d fjac(n, m);
+    // Compute the Jacobian matrix with finite difference derivatives.
+    // fjac(p,k) is the derivative of the deviate k with respect to the free parameter p.
+    template<typename F>
+    void jacobian(mpfit_workspace& ws, F& deviate, no_jacobian&, uint_t n,
+        const mpfit_options& options) {
+
+        const double eps = sqrt(std::numeric_limits<double>::epsilon());
+        const uint_t m = ws.npt;
+        double* fjac = ws.fjac.data.data();
 
         // Calculate the step
-        vec1d h(n);
-        for (uint_t p : range(n)) {
-            uint_t ip = ifree[p];
+        for (uint_t p = 0; p < n; ++p) {
+            uint_t ip = ws.ifree.safe[p];
+            double& h = ws.h.safe[p];
+            double x = ws.x.safe[p];
 
-            if (options.deriv_rstep[ip] != 0.0) {
+            if (options.deriv_rstep.safe[ip] != 0.0) {
                 // If relative step is given, use that
-                h[p] = abs(options.deriv_rstep[ip]*x[p]);
-            } else if (options.deriv_step[ip] != 0.0) {
+                h = std::abs(options.deriv_rstep.safe[ip]*x);
+            } else if (options.deriv_step.safe[ip] != 0.0) {
                 // If step is given, use that
-                h[p] = options.deriv_step[ip];
+                h = options.deriv_step.safe[ip];
             } else {
-                h[p] = eps*abs(x[p]);
+                h = eps*std::abs(x);
             }
 
             // Prevent zero step
-            if (h[p] == 0.0) h[p] = eps;
+            if (h == 0.0) h = eps;
 
-            // Reverse the sign of the step if using backward derivative or if using forward derivative
-            // and the function would be evaluated beyond the provided upper limit.
-            if (options.deriv[ip] == mpfit_options::deriv_backward ||
-                (!is_nan(options.upper_limit[ip]) && x[p] > options.upper_limit[ip] - h[p])) {
-                h[p] = -h[p];
+            // Reverse the sign of the step if using backward derivative or if using forward
+            // derivative and the function would be evaluated beyond the provided upper limit.
+            if (options.deriv.safe[ip] == mpfit_options::deriv_backward ||
+                (!is_nan(options.upper_limit.safe[ip]) && x > options.upper_limit.safe[ip] - h)) {
+                h = -h;
             }
         }
 
         // Compute the matrix for each parameter
-        for (uint_t p : range(n)) {
-            uint_t ip = ifree[p];
-
-            vec1d xp = xall;
-            xp[ip] += h[p];
-            vec1d fp = flatten(deviate(xp));
-
-            if (options.deriv[ip] == mpfit_options::deriv_backward ||
-                options.deriv[ip] == mpfit_options::deriv_forward ||
-                options.deriv[ip] == mpfit_options::deriv_auto) {
+        for (uint_t p = 0; p < n; ++p) {
+            uint_t ip = ws.ifree.safe[p];
+            double h = ws.h.safe[p];
+            double x0 = ws.xall.safe[ip];
+            double* fj = fjac + p*m;
+
+            ws.xall.safe[ip] = x0 + h;
+            evaluate(deviate, ws.xall, ws.fp);
+
+            if (options.deriv.safe[ip] == mpfit_options::deriv_backward ||
+                options.deriv.safe[ip] == mpfit_options::deriv_forward ||
+                options.deriv.safe[ip] == mpfit_options::deriv_auto) {
                 // One sided derivative
-                fjac(p,_) = (fp - fvec)/h[p];
+                for (uint_t k = 0; k < m; ++k) {
+                    fj[k] = (ws.fp.safe[k] - ws.fvec.safe[k])/h;
+                }
             } else {
                 // Two sided derivative
-                xp[ip] = xall[ip] - h[p];
-                vec1d fm = flatten(deviate(xp));
-                fjac(p,_) = (fp - fm)/(2.0*h[p]);
+                ws.xall.safe[ip] = x0 - h;
+                evaluate(deviate, ws.xall, ws.fm);
+                for (uint_t k = 0; k < m; ++k) {
+                    fj[k] = (ws.fp.safe[k] - ws.fm.safe[k])/(2.0*h);
+                }
             }
+
+            ws.xall.safe[ip] = x0;
         }
+    }
 
-        return fjac;
+    // Get the Jacobian matrix from the user-provided function, which fills the derivatives
+    // for all the parameters
+    template<typename F, typename J>
+    void jacobian(mpfit_workspace& ws, F&, J& jac, uint_t n, const mpfit_options&) {
+        const uint_t m = ws.npt;
+        jac(ws.xall, ws.jall);
+        phypp_check(ws.jall.dims[0] == ws.nparam && ws.jall.dims[1] == m, "the Jacobian "
+            "function must not resize the matrix (expected ", ws.nparam, "x", m, ", got ",
+            ws.jall.dims, ")");
+
+        for (uint_t p = 0; p < n; ++p) {
+            const double* src = ws.jall.data.data() + ws.ifree.safe[p]*m;
+            std::copy(src, src + m, ws.fjac.data.data() + p*m);
+        }
     }
 
-    // Compute QR factorization of a matrix such that a(ipiv,_) = q*r
-    void mpfit_qrfac(vec2d& a, vec1u& ipiv, vec1d& rdiag, vec1d& acnorm) {
+    // Compute QR factorization of the n x m matrix 'a' such that a(ipiv,_) = q*r
+    inline void qrfac(double* a, uint_t n, uint_t m, uint_t* ipiv, double* rdiag,
+        double* acnorm, double* wa) {
         const double eps = std::numeric_limits<double>::epsilon();
 
-        const uint_t n = a.dims[0];
-        const uint_t m = a.dims[1];
-
-        acnorm.resize(n);
-        for (uint_t i : range(n)) {
-            acnorm[i] = mpfit_enorm(a(i,_));
+        for (uint_t i = 0; i < n; ++i) {
+            acnorm[i] = enorm(a + i*m, m);
+            rdiag[i] = acnorm[i];
+            wa[i] = rdiag[i];
+            ipiv[i] = i;
         }
 
-        rdiag = acnorm;
-        vec1d wa = rdiag;
-        ipiv = uindgen(n);
-
         uint_t minmn = std::min(n, m);
-        for (uint_t i : range(minmn)) {
+        for (uint_t i = 0; i < minmn; ++i) {
             {
-                uint_t kmax;
-                double rmax = max(rdiag[i-_], kmax);
-                if (!is_nan(rmax) && kmax != 0) {
+                // Largest remaining norm, ignoring NaNs
+                uint_t kmax = npos;
+                for (uint_t k = i; k < n; ++k) {
+                    if (!is_nan(rdiag[k]) && (kmax == npos || rdiag[k] > rdiag[kmax])) {
+                        kmax = k;
+                    }
+                }
+
+                if (kmax != npos && kmax != i) {
                     // Exchange rows
-                    kmax += i;
                     std::swap(ipiv[i], ipiv[kmax]);
                     rdiag[kmax] = rdiag[i];
                     wa[kmax] = wa[i];
                 }
             }
 
-            uint_t li = ipiv[i];
-            vec1d aii = a(li,i-_);
-            double ajnorm = mpfit_enorm(aii);
+            double* ai = a + ipiv[i]*m;
+            double ajnorm = enorm(ai + i, m - i);
 
             if (ajnorm != 0.0) {
-                if (a(li,i) < 0.0) ajnorm = -ajnorm;
-
-                aii /= ajnorm;
-                aii[0] += 1;
-                a(li,i-_) = aii;
-
-                if (i+1 < n) {
-                    for (uint_t k : range(i+1,n)) {
-                        uint_t lk = ipiv[k];
-                        vec1d aik = a(lk,i-_);
-                        if (a(li,i) != 0.0) {
-                            a(lk,i-_) = aik - aii*total(aik*aii)/a(li,i);
+                if (ai[i] < 0.0) ajnorm = -ajnorm;
+
+                for (uint_t j = i; j < m; ++j) {
+                    ai[j] /= ajnorm;
+                }
+
+                ai[i] += 1;
+
+                for (uint_t k = i+1; k < n; ++k) {
+                    double* ak = a + ipiv[k]*m;
+                    if (ai[i] != 0.0) {
+                        double s = 0.0;
+                        for (uint_t j = i; j < m; ++j) {
+                            s += ak[j]*ai[j];
                         }
 
-                        if (rdiag[k] != 0.0) {
-                            double temp = a(lk,i)/rdiag[k];
-                            temp = 1.0 - sqr(temp);
-                            if (temp < 0.0) temp = 0.0;
-                            rdiag[k] *= sqrt(temp);
-                            temp = rdiag[k]/wa[k];
+                        for (uint_t j = i; j < m; ++j) {
+                            ak[j] -= ai[j]*s/ai[i];
+                        }
+                    }
 
-                            if (0.05*sqr(temp) <= eps) {
-                                rdiag[k] = mpfit_enorm(a(lk,(i+1)-_));
-                                wa[k] = rdiag[k];
-                            }
+                    if (rdiag[k] != 0.0) {
+                        double temp = ak[i]/rdiag[k];
+                        temp = 1.0 - sqr(temp);
+                        if (temp < 0.0) temp = 0.0;
+                        rdiag[k] *= sqrt(temp);
+                        temp = rdiag[k]/wa[k];
+
+                        if (0.05*sqr(temp) <= eps) {
+                            rdiag[k] = enorm(ak + i + 1, m - i - 1);
+                            wa[k] = rdiag[k];
                         }
                     }
                 }
@@ -244,29 +361,29 @@ namespace phypp {
         }
     }
 
-    // Solve the linear system (Q*R)*x = B
-    void mpfit_qrsolv(vec2d& r, const vec1u& ipiv, const vec1d& diag, const vec1d& qtf,
-        vec1d& x, vec1d& sdiag) {
-
-        const uint_t n = r.dims[0];
-        const uint_t m = r.dims[1];
-
-        vec1u delm = uindgen(n)*(m+1); // Diagonal elements of r
+    // Solve the linear system (Q*R)*x = B, with R stored in the n x n matrix 'r'
+    inline void qrsolv(double* r, uint_t n, const uint_t* ipiv, const double* diag,
+        const double* qtf, double* x, double* sdiag, double* wa) {
 
         // Copy r and (q transpose)*b to preserve input and initialize s.
         // In particular, save the diagonal elements of r in x.
-        for (uint_t j : range(n)) {
-            r(j,j-_-(n-1)) = r(j-_-(n-1),j);
-        }
+        for (uint_t j = 0; j < n; ++j) {
+            for (uint_t k = j; k < n; ++k) {
+                r[j*n+k] = r[k*n+j];
+            }
 
-        x = r[delm];
-        vec1d wa = qtf;
+            x[j] = r[j*n+j];
+            wa[j] = qtf[j];
+        }
 
         // Eliminate the diagonal matrix d using a givens rotation
-        for (uint_t j : range(n)) {
+        for (uint_t j = 0; j < n; ++j) {
             uint_t l = ipiv[j];
             if (diag[l] == 0.0) break;
-            sdiag[j-_] = 0.0;
+            for (uint_t k = j; k < n; ++k) {
+                sdiag[k] = 0.0;
+            }
+
             sdiag[j] = diag[l];
 
             // The transformations to eliminate the row of d modify only a
@@ -274,46 +391,49 @@ namespace phypp {
             // is initially zero.
             double qtbpj = 0.0;
 
-            for (uint_t k : range(j,n)) {
+            for (uint_t k = j; k < n; ++k) {
                 if (sdiag[k] == 0.0) continue;
 
+                double* rk = r + k*n;
                 double sine = 0.0, cosine = 0.0;
-                if (abs(r(k,k)) < abs(sdiag[k])) {
-                    double cotan = r(k,k)/sdiag[k];
+                if (std::abs(rk[k]) < std::abs(sdiag[k])) {
+                    double cotan = rk[k]/sdiag[k];
                     sine = 0.5/sqrt(0.25 + 0.25*sqr(cotan));
                     cosine = sine*cotan;
                 } else {
-                    double tang = sdiag[k]/r(k,k);
+                    double tang = sdiag[k]/rk[k];
                     cosine = 0.5/sqrt(0.25 + 0.25*sqr(tang));
                     sine = cosine*tang;
                 }
 
                 // Compute the modified diagonal element of r and the
                 // modified element of ((q transpose)*b,0).
-                r(k,k) = cosine*r(k,k) + sine*sdiag[k];
+                rk[k] = cosine*rk[k] + sine*sdiag[k];
                 double temp = cosine*wa[k] + sine*qtbpj;
                 qtbpj = -sine*wa[k] + cosine*qtbpj;
                 wa[k] = temp;
 
                 // Accumulate the transformation in the row of s
-                if (k < n-1) {
-                    vec1d tmp = cosine*r(k,(k+1)-_-(n-1)) + sine*sdiag[(k+1)-_-(n-1)];
-                    sdiag[(k+1)-_-(n-1)] = -sine*r(k,(k+1)-_-(n-1)) + cosine*sdiag[(k+1)-_-(n-1)];
-                    r(k,(k+1)-_-(n-1)) = tmp;
+                for (uint_t t = k+1; t < n; ++t) {
+                    temp = cosine*rk[t] + sine*sdiag[t];
+                    sdiag[t] = -sine*rk[t] + cosine*sdiag[t];
+                    rk[t] = temp;
                 }
             }
 
-            sdiag[j] = r(j,j);
-            r(j,j) = x(j);
+            sdiag[j] = r[j*n+j];
+            r[j*n+j] = x[j];
         }
 
         // Solve the triangular system for z.  If the system is singular
         // then obtain a least squares solution
         uint_t nsing = n;
-        for (uint_t j : range(n)) {
+        for (uint_t j = 0; j < n; ++j) {
             if (sdiag[j] == 0.0) {
                 nsing = j;
-                wa[j-_] = 0.0;
+                for (uint_t k = j; k < n; ++k) {
+                    wa[k] = 0.0;
+                }
                 break;
             }
         }
@@ -324,36 +444,46 @@ namespace phypp {
             uint_t j = nsing-1;
             while (j > 0u) {
                 --j;
-                wa[j] -= total(r(j,(j+1)-_-(nsing-1))*wa[(j+1)-_-(nsing-1)]);
+                double s = 0.0;
+                for (uint_t t = j+1; t < nsing; ++t) {
+                    s += r[j*n+t]*wa[t];
+                }
+
+                wa[j] -= s;
                 wa[j] /= sdiag[j];
             }
         }
 
         // Permute the components of z back to components of x
-        x[ipiv] = wa;
+        for (uint_t j = 0; j < n; ++j) {
+            x[ipiv[j]] = wa[j];
+        }
     }
 
     // Determine the levenberg-marquardt parameter
-    void mpfit_lmpar(vec2d& r, const vec1u& ipiv, const vec1d& diag, const vec1d& qtf,
-        double delta, vec1d& x, vec1d& sdiag, double& par) {
+    inline void lmpar(double* r, uint_t n, const uint_t* ipiv, const double* diag,
+        const double* qtf, double delta, double* x, double* sdiag, double& par,
+        double* wa1, double* wa2, double* wa3) {
 
         const double dwarf = sqrt(std::numeric_limits<double>::min()*1.5)*10.0;
         const double eps = std::numeric_limits<double>::epsilon();
 
-        const uint_t n = r.dims[0];
-        const uint_t m = r.dims[1];
-
-        vec1u delm = uindgen(n)*(m+1); // Diagonal elements of r
-
         // Compute and store in x the gauss-newton direction.  If the
         // jacobian is rank-deficient, obtain a least-squares solution
         uint_t nsing = n;
-        vec1d wa1 = qtf;
-        double rthresh = max(abs(r[delm]))*eps;
-        for (uint_t j : range(delm)) {
-            if (abs(r[delm[j]]) < rthresh) {
+        double rthresh = 0.0;
+        for (uint_t j = 0; j < n; ++j) {
+            wa1[j] = qtf[j];
+            rthresh = std::max(rthresh, std::abs(r[j*n+j]));
+        }
+
+        rthresh *= eps;
+        for (uint_t j = 0; j < n; ++j) {
+            if (std::abs(r[j*n+j]) < rthresh) {
                 nsing = j;
-                wa1[j-_] = 0.0;
+                for (uint_t k = j; k < n; ++k) {
+                    wa1[k] = 0.0;
+                }
                 break;
             }
         }
@@ -363,19 +493,24 @@ namespace phypp {
             uint_t j = nsing;
             while (j > 0u) {
                 --j;
-                wa1[j] /= r(j,j);
-                if (j >= 1u) {
-                    wa1[_-(j-1)] -= r(j,_-(j-1))*wa1[j];
+                wa1[j] /= r[j*n+j];
+                for (uint_t t = 0; t < j; ++t) {
+                    wa1[t] -= r[j*n+t]*wa1[j];
                 }
             }
         }
 
-        x[ipiv] = wa1;
+        for (uint_t j = 0; j < n; ++j) {
+            x[ipiv[j]] = wa1[j];
+        }
 
         // Evaluate the function at the origin, and test for acceptance of
         // the gauss-newton direction
-        vec1d wa2 = diag*x;
-        double dxnorm = mpfit_enorm(wa2);
+        for (uint_t j = 0; j < n; ++j) {
+            wa2[j] = diag[j]*x[j];
+        }
+
+        double dxnorm = enorm(wa2, n);
         double fp = dxnorm - delta;
         if (fp <= 0.1*delta) {
             par = 0.0;
@@ -387,24 +522,36 @@ namespace phypp {
         // this bound to zero.
         double parl = 0.0;
         if (nsing >= n) {
-            wa1 = diag[ipiv]*wa2[ipiv]/dxnorm;
+            for (uint_t j = 0; j < n; ++j) {
+                wa1[j] = diag[ipiv[j]]*wa2[ipiv[j]]/dxnorm;
+            }
+
+            wa1[0] /= r[0]; // Degenerate case
+            for (uint_t j = 1; j < n; ++j) {
+                double s = 0.0;
+                for (uint_t t = 0; t < j; ++t) {
+                    s += r[j*n+t]*wa1[t];
+                }
 
-            wa1[0] /= r(0,0); // Degenerate case
-            for (uint_t j : range(1u,n)) {
-                wa1[j] -= total(r(j,_-(j-1))*wa1[_-(j-1)]);
-                wa1[j] /= r(j,j);
+                wa1[j] -= s;
+                wa1[j] /= r[j*n+j];
             }
 
-            double temp = mpfit_enorm(wa1);
+            double temp = enorm(wa1, n);
             parl = ((fp/delta)/temp)/temp;
         }
 
         // Calculate an upper bound, paru, for the zero of the function
-        for (uint_t j : range(n)) {
-            wa1[j] = total(r(j,_-j)*qtf[_-j])/diag[ipiv[j]];
+        for (uint_t j = 0; j < n; ++j) {
+            double s = 0.0;
+            for (uint_t t = 0; t <= j; ++t) {
+                s += r[j*n+t]*qtf[t];
+            }
+
+            wa1[j] = s/diag[ipiv[j]];
         }
 
-        double gnorm = mpfit_enorm(wa1);
+        double gnorm = enorm(wa1, n);
         double paru = gnorm/delta;
         if (paru == 0.0) {
             paru = dwarf/std::min(delta, 0.1);
@@ -424,27 +571,37 @@ namespace phypp {
             }
 
             double temp = sqrt(par);
-            wa1 = temp*diag;
-            mpfit_qrsolv(r, ipiv, wa1, qtf, x, sdiag);
-            wa2 = diag*x;
-            dxnorm = mpfit_enorm(wa2);
+            for (uint_t j = 0; j < n; ++j) {
+                wa1[j] = temp*diag[j];
+            }
+
+            qrsolv(r, n, ipiv, wa1, qtf, x, sdiag, wa3);
+            for (uint_t j = 0; j < n; ++j) {
+                wa2[j] = diag[j]*x[j];
+            }
+
+            dxnorm = enorm(wa2, n);
             temp = fp;
             fp = dxnorm - delta;
 
-            if (abs(fp) <= 0.1*delta || (parl == 0.0 && fp <= temp && temp < 0.0)) {
+            if (std::abs(fp) <= 0.1*delta || (parl == 0.0 && fp <= temp && temp < 0.0)) {
                 break;
             }
 
             // Compute the newton correction
-            wa1 = (diag*wa2)[ipiv]/dxnorm;
+            for (uint_t j = 0; j < n; ++j) {
+                wa1[j] = diag[ipiv[j]]*wa2[ipiv[j]]/dxnorm;
+            }
 
-            for (uint_t j : range(n-1)) {
+            for (uint_t j = 0; j+1 < n; ++j) {
                 wa1[j] /= sdiag[j];
-                wa1[(j+1)-_-(n-1)] -= r(j,(j+1)-_-(n-1))*wa1[j];
+                for (uint_t t = j+1; t < n; ++t) {
+                    wa1[t] -= r[j*n+t]*wa1[j];
+                }
             }
             wa1[n-1] /= sdiag[n-1]; // Degenerate case
 
-            temp = mpfit_enorm(wa1);
+            temp = enorm(wa1, n);
             double parc = ((fp/delta)/temp)/temp;
 
             // Depending on the sign of the function, update parl or paru
@@ -459,22 +616,22 @@ namespace phypp {
         }
     }
 
-    // Compute convariance matrix from Jacobian
-    vec2d mpfit_covar(vec2d r, const vec1u& ipiv) {
-        phypp_check(r.dims[0] == r.dims[1], "matrix must be squared (got ", r.dims, ")");
-        const uint_t n = r.dims[0];
-
+    // Compute convariance matrix from the n x n matrix 'r' (modified in place)
+    inline void covar(double* r, uint_t n, const uint_t* ipiv, double* wa) {
         // Form the inverse of r in the full upper triangle of r
         uint_t l = 0;
         const double tol = 1e-14;
-        double tolr = tol*abs(r(0,0));
-        for (uint_t k : range(n)) {
-            if (abs(r(k,k)) <= tolr) break;
-            r(k,k) = 1.0/r(k,k);
-            for (uint_t j : range(k)) {
-                double temp = r(k,k)*r(k,j);
-                r(k,j) = 0.0;
-                r(k,_-j) -= temp*r(j,_-j);
+        double tolr = tol*std::abs(r[0]);
+        for (uint_t k = 0; k < n; ++k) {
+            double* rk = r + k*n;
+            if (std::abs(rk[k]) <= tolr) break;
+            rk[k] = 1.0/rk[k];
+            for (uint_t j = 0; j < k; ++j) {
+                double temp = rk[k]*rk[j];
+                rk[j] = 0.0;
+                for (uint_t t = 0; t <= j; ++t) {
+                    rk[t] -= temp*r[j*n+t];
+                }
             }
 
             l = k+1;
@@ -482,145 +639,199 @@ namespace phypp {
 
         // Form the full upper triangle of the inverse of (r transpose)*r
         // in the full upper triangle of r
-        for (uint_t k : range(l)) {
-            for (uint_t j : range(k)) {
-                r(j,_-j) += r(k,j)*r(k,_-j);
+        for (uint_t k = 0; k < l; ++k) {
+            double* rk = r + k*n;
+            for (uint_t j = 0; j < k; ++j) {
+                for (uint_t t = 0; t <= j; ++t) {
+                    r[j*n+t] += rk[j]*rk[t];
+                }
             }
 
-            r(k,_-k) *= r(k,k);
+            double temp = rk[k];
+            for (uint_t t = 0; t <= k; ++t) {
+                rk[t] *= temp;
+            }
         }
 
         // Form the full lower triangle of the covariance matrix
         // in the strict lower triangle of r and in wa
-        vec1d wa(n);
-        for (uint_t j : range(n)) {
+        for (uint_t j = 0; j < n; ++j) {
             uint_t jj = ipiv[j];
-            uint_t sing = j+1 > l;
-            for (uint_t i : range(j)) {
+            bool sing = j+1 > l;
+            for (uint_t i = 0; i < j; ++i) {
                 if (sing) {
-                    r(j,i) = 0.0;
+                    r[j*n+i] = 0.0;
                 }
 
                 uint_t ii = ipiv[i];
                 if (ii > jj) {
-                    r(jj,ii) = r(j,i);
+                    r[jj*n+ii] = r[j*n+i];
                 } else if (ii < jj) {
-                    r(ii,jj) = r(j,i);
+                    r[ii*n+jj] = r[j*n+i];
                 }
             }
 
-            wa[jj] = r(j,j);
+            wa[jj] = r[j*n+j];
         }
 
         // Symmetrize the covariance matrix in r
-        for (uint_t j : range(n)) {
-            r(j,_-j) = r(_-j,j);
-            r(j,j) = wa[j];
+        for (uint_t j = 0; j < n; ++j) {
+            for (uint_t t = 0; t < j; ++t) {
+                r[j*n+t] = r[t*n+j];
+            }
+
+            r[j*n+j] = wa[j];
         }
+    }
 
-        return r;
+    // Setup the workspace and evaluate the deviates at the starting point. The number of data
+    // points is known in advance for in-place deviate functions, else it is given by the
+    // first evaluation.
+    template<typename F>
+    void start(mpfit_workspace& ws, F& deviate, const vec1d& params, std::true_type) {
+        phypp_check(ws.npt != 0, "the workspace must be created with the number of data "
+            "points when using an in-place deviate function");
+        ws.resize(ws.npt, params.size());
+        ws.xall = params;
+        deviate(ws.xall, ws.fvec);
     }
 
     template<typename F>
-    mpfit_result mpfit(F&& deviate, vec1d xall, mpfit_options options = mpfit_options()) {
+    void start(mpfit_workspace& ws, F& deviate, const vec1d& params, std::false_type) {
+        vec1d fvec = flatten(deviate(params));
+        ws.resize(fvec.size(), params.size());
+        ws.xall = params;
+        std::swap(ws.fvec, fvec);
+    }
+
+    template<typename F, typename J>
+    mpfit_result solve(mpfit_workspace& ws, F& deviate, J& jac, const vec1d& params,
+        const mpfit_options& opts) {
+
         const double eps = std::numeric_limits<double>::epsilon();
 
         mpfit_result res;
 
-        if (options.nparam == 0u) {
-            // No option provided, use defaults
-            options = mpfit_options(xall.size());
-        } else {
-            phypp_check(options.nparam == xall.size(), "incompatible number of elements in options "
-                "with provided parameters ("+strn(options.nparam)+" vs "+strn(xall.size())+")");
-        }
+        const uint_t np = params.size();
 
-        // Note: be carefull that limits are NaN by default, thus !(a == b) != (a != b)
-        vec1u ifree = where(!options.frozen && !(options.upper_limit == options.lower_limit));
+        start(ws, deviate, params,
+            std::integral_constant<bool, is_inplace_deviate<F>::value>{});
 
-        vec1d llim = options.lower_limit[ifree];
-        vec1d ulim = options.upper_limit[ifree];
-        vec1u ilow = where(!is_nan(llim));
-        vec1u iup = where(!is_nan(ulim));
-        bool anylim = !ilow.empty() || !iup.empty();
+        const mpfit_options& options = (opts.nparam == 0u ? ws.defaults : opts);
+        if (opts.nparam != 0u) {
+            phypp_check(options.nparam == np, "incompatible number of elements in options "
+                "with provided parameters ("+strn(options.nparam)+" vs "+strn(np)+")");
+        }
 
-        vec1d mastep = options.max_step[ifree];
-        vec1u imima = where(mastep != 0.0);
-        bool anymima = !imima.empty();
+        const uint_t m = ws.npt;
+        double* const fjac = ws.fjac.data.data();
+        double* const r = ws.r.data.data();
+        uint_t* const ipiv = ws.ipiv.data.data();
+        vec1d& x = ws.x;
+        vec1d& fvec = ws.fvec;
+        vec1d& qtf = ws.qtf;
+        vec1d& diag = ws.diag;
+        vec1d& llim = ws.llim;
+        vec1d& ulim = ws.ulim;
+        vec1d& mastep = ws.mastep;
+        vec1d& wa1 = ws.wa1;
+        vec1d& wa2 = ws.wa2;
+        vec1d& wa3 = ws.wa3;
+        vec1d& wa4 = ws.wa4;
 
-        const uint_t n = ifree.size();
+        // Note: be carefull that limits are NaN by default, thus !(a == b) != (a != b)
+        uint_t n = 0;
+        bool anylim = false, anymima = false;
+        for (uint_t ip = 0; ip < np; ++ip) {
+            if (options.frozen.safe[ip] ||
+                options.upper_limit.safe[ip] == options.lower_limit.safe[ip]) continue;
+
+            ws.ifree.safe[n] = ip;
+            x.safe[n] = ws.xall.safe[ip];
+            llim.safe[n] = options.lower_limit.safe[ip];
+            ulim.safe[n] = options.upper_limit.safe[ip];
+            mastep.safe[n] = options.max_step.safe[ip];
+            anylim = anylim || !is_nan(llim.safe[n]) || !is_nan(ulim.safe[n]);
+            anymima = anymima || mastep.safe[n] != 0.0;
+            ++n;
+        }
 
         // Initialization
-        vec1d x = xall[ifree];
-        vec1d fvec = flatten(deviate(xall));
-        double fnorm = mpfit_enorm(fvec);
+        double fnorm = enorm(fvec.data.data(), m);
         double fnorm1 = fnorm;
-        vec1d qtf(n);
 
-        const uint_t npt = fvec.size();
-
-        res.dof = npt - n;
+        res.dof = m - n;
         uint_t iter = 1u;
         double factor = 100.0;
         double delta = dnan;
         double par = 0.0;
         double xnorm = dnan;
-        vec1d diag;
-        vec2d fjac;
-        vec1u ipiv;
 
         // l.3243 mpfit.pro
         while (true) {
-            fjac = mpfit_fdjac2(deviate, xall, ifree, x, fvec, options);
+            jacobian(ws, deviate, jac, n, options);
 
             // Set derivatives of frozen parameters to zero
-            for (uint_t p : range(n)) {
-                if (!is_nan(llim[p]) && total(fvec*fjac(p,_)) > 0.0) {
-                    fjac(p,_) = 0.0;
+            for (uint_t p = 0; p < n; ++p) {
+                double* fj = fjac + p*m;
+                bool lo = !is_nan(llim.safe[p]), up = !is_nan(ulim.safe[p]);
+                if (!lo && !up) continue;
+
+                double s = 0.0;
+                for (uint_t k = 0; k < m; ++k) {
+                    s += fvec.safe[k]*fj[k];
                 }
-                if (!is_nan(ulim[p]) && total(fvec*fjac(p,_)) < 0.0) {
-                    fjac(p,_) = 0.0;
+
+                if ((lo && s > 0.0) || (up && s < 0.0)) {
+                    std::fill(fj, fj + m, 0.0);
                 }
             }
 
             // Compute QR factorization of the Jacobian
             // l.3338 mpfit.pro
-            vec1d wa1, wa2;
-            mpfit_qrfac(fjac, ipiv, wa1, wa2);
+            qrfac(fjac, n, m, ipiv, wa1.data.data(), wa2.data.data(), wa3.data.data());
 
             if (iter == 1u) {
-                diag = wa2;
-                for (uint_t p : range(n)) {
-                    if (diag[p] == 0.0) diag[p] = 1.0;
+                for (uint_t p = 0; p < n; ++p) {
+                    diag.safe[p] = (wa2.safe[p] == 0.0 ? 1.0 : wa2.safe[p]);
+                    wa3.safe[p] = diag.safe[p]*x.safe[p];
                 }
 
-                vec1d wa3 = diag*x;
-                xnorm = mpfit_enorm(wa3);
+                xnorm = enorm(wa3.data.data(), n);
                 delta = factor*xnorm;
                 if (delta == 0.0) delta = factor;
             }
 
             // Form (Q transpose)*fvec and store the first n components in qtf
             // l.3371 mpfit.pro
-            vec1d wa4 = fvec;
-            for (uint_t p : range(n)) {
-                uint_t lp = ipiv[p];
-                if (fjac(lp,p) != 0.0) {
-                    wa4[p-_] -= fjac(lp,p-_)*total(fjac(lp,p-_)*wa4[p-_])/fjac(lp,p);
+            std::copy(fvec.begin(), fvec.end(), wa4.begin());
+            for (uint_t p = 0; p < n; ++p) {
+                double* fj = fjac + ipiv[p]*m;
+                if (fj[p] != 0.0) {
+                    double s = 0.0;
+                    for (uint_t k = p; k < m; ++k) {
+                        s += fj[k]*wa4.safe[k];
+                    }
+
+                    for (uint_t k = p; k < m; ++k) {
+                        wa4.safe[k] -= fj[k]*s/fj[p];
+                    }
                 }
 
-                fjac(lp,p) = wa1(p);
-                qtf[p] = wa4[p];
+                fj[p] = wa1.safe[p];
+                qtf.safe[p] = wa4.safe[p];
             }
 
             // Reform the Jacobian matrix (only need square R factor)
             // l.3388 mpfit.pro
-            fjac = fjac(ipiv,_-(n-1));
+            for (uint_t p = 0; p < n; ++p) {
+                std::copy(fjac + ipiv[p]*m, fjac + ipiv[p]*m + n, r + p*n);
+            }
 
             // Check for overflow
             bool stop = false;
-            for (double d : fjac) {
-                if (!is_finite(d)) {
+            for (uint_t i = 0; i < n*n; ++i) {
+                if (!is_finite(r[i])) {
                     res.success = false;
                     res.reason = mpfit_result::overflow;
                     stop = true;
@@ -633,10 +844,15 @@ namespace phypp {
             // l.3401 mpfit.pro
             double gnorm = 0.0;
             if (fnorm != 0.0) {
-                for (uint_t p : range(n)) {
+                for (uint_t p = 0; p < n; ++p) {
                     uint_t l = ipiv[p];
-                    if (wa2[l] != 0.0) {
-                        gnorm = std::max(gnorm, abs(total(fjac(p,_-p)*qtf[_-p])/wa2[l]));
+                    if (wa2.safe[l] != 0.0) {
+                        double s = 0.0;
+                        for (uint_t t = 0; t <= p; ++t) {
+                            s += r[p*n+t]*qtf.safe[t];
+                        }
+
+                        gnorm = std::max(gnorm, std::abs(s/wa2.safe[l]));
                     }
                 }
             }
@@ -649,83 +865,109 @@ namespace phypp {
             }
 
             // Rescale if necessary
-            diag = max(diag, wa2);
+            for (uint_t p = 0; p < n; ++p) {
+                diag.safe[p] = std::max(diag.safe[p], wa2.safe[p]);
+            }
 
             double ratio = 0.0;
             bool success = false;
             while (!success) {
                 // Determine the levenberg-marquardt parameter
                 // l.3429 mpfit.pro
-                mpfit_lmpar(fjac, ipiv, diag, qtf, delta, wa1, wa2, par);
+                lmpar(r, n, ipiv, diag.data.data(), qtf.data.data(), delta, wa1.data.data(),
+                    wa2.data.data(), par, ws.wb1.data.data(), ws.wb2.data.data(),
+                    ws.wb3.data.data());
 
                 // Store the direction p and x+p. Calculate the norm of p
-                wa1 *= -1.0;
+                for (uint_t p = 0; p < n; ++p) {
+                    wa1.safe[p] *= -1.0;
+                }
 
                 double alpha = 1.0;
                 if (!anylim && !anymima) {
                     // No parameter limits, so just move to new position WA2
-                    wa2 = x + wa1;
+                    for (uint_t p = 0; p < n; ++p) {
+                        wa2.safe[p] = x.safe[p] + wa1.safe[p];
+                    }
                 } else {
                     // Respect the limits.  If a step were to go out of bounds, then
                     // we should take a step in the same direction but shorter distance.
                     // The step should take us right to the limit in that case.
                     if (anylim) {
-                        wa1[ilow] = max(wa1[ilow], 0.0);
-                        wa1[iup] = min(wa1[iup], 0.0);
-
-                        vec1b dwa1 = abs(wa1) > eps;
-                        vec1u whl = where(dwa1 && x + wa1 < llim);
-                        if (!whl.empty()) {
-                            double mi = min((llim[whl] - x[whl])/wa1[whl]);
-                            alpha = std::min(alpha, mi);
+                        for (uint_t p = 0; p < n; ++p) {
+                            if (!is_nan(llim.safe[p])) wa1.safe[p] = std::max(wa1.safe[p], 0.0);
+                            if (!is_nan(ulim.safe[p])) wa1.safe[p] = std::min(wa1.safe[p], 0.0);
                         }
 
-                        vec1u whu = where(dwa1 && x + wa1 > ulim);
-                        if (!whu.empty()) {
-                            double mi = min((ulim[whu] - x[whu])/wa1[whu]);
-                            alpha = std::min(alpha, mi);
+                        double mil = dinf, miu = dinf;
+                        for (uint_t p = 0; p < n; ++p) {
+                            if (!(std::abs(wa1.safe[p]) > eps)) continue;
+
+                            double xp = x.safe[p] + wa1.safe[p];
+                            if (xp < llim.safe[p]) {
+                                mil = std::min(mil, (llim.safe[p] - x.safe[p])/wa1.safe[p]);
+                            }
+                            if (xp > ulim.safe[p]) {
+                                miu = std::min(miu, (ulim.safe[p] - x.safe[p])/wa1.safe[p]);
+                            }
                         }
+
+                        alpha = std::min(alpha, mil);
+                        alpha = std::min(alpha, miu);
                     }
 
                     if (anymima) {
-                        vec1d nwa1 = wa1*alpha;
-                        double mrat = max(abs(nwa1[imima])/abs(mastep[imima]));
+                        double mrat = 0.0;
+                        for (uint_t p = 0; p < n; ++p) {
+                            if (mastep.safe[p] == 0.0) continue;
+                            mrat = std::max(mrat,
+                                std::abs(wa1.safe[p]*alpha)/std::abs(mastep.safe[p]));
+                        }
+
                         if (mrat > 1.0) {
                             alpha /= mrat;
                         }
                     }
 
                     // Scale the resulting vector
-                    wa1 *= alpha;
-                    wa2 = x + wa1;
+                    for (uint_t p = 0; p < n; ++p) {
+                        wa1.safe[p] *= alpha;
+                        wa2.safe[p] = x.safe[p] + wa1.safe[p];
+                    }
 
                     if (anylim) {
                         // Adjust the final output values.  If the step put us exactly
                         // on a boundary, make sure we peg it there.
-                        //                ... nonzero *LIM ...       ... zero *LIM ...
-                        vec1d ulim1 = ulim*(1.0 - sign(ulim)*eps) - (ulim == 0.0)*eps;
-                        vec1d llim1 = llim*(1.0 + sign(llim)*eps) + (llim == 0.0)*eps;
-
-                        vec1u wh = where(wa2 >= ulim1);
-                        wa2[wh] = ulim[wh];
-                        wh = where(wa2 <= llim1);
-                        wa2[wh] = llim[wh];
+                        for (uint_t p = 0; p < n; ++p) {
+                            double ul = ulim.safe[p], ll = llim.safe[p];
+                            //                ... nonzero *LIM ...       ... zero *LIM ...
+                            double ulim1 = ul*(1.0 - sign(ul)*eps) - (ul == 0.0)*eps;
+                            double llim1 = ll*(1.0 + sign(ll)*eps) + (ll == 0.0)*eps;
+
+                            if (wa2.safe[p] >= ulim1) wa2.safe[p] = ul;
+                            if (wa2.safe[p] <= llim1) wa2.safe[p] = ll;
+                        }
                     }
                 }
 
-                vec1d wa3 = diag*wa1;
-                double pnorm = mpfit_enorm(wa3);
+                for (uint_t p = 0; p < n; ++p) {
+                    wa3.safe[p] = diag.safe[p]*wa1.safe[p];
+                }
+
+                double pnorm = enorm(wa3.data.data(), n);
 
                 // On the first iteration, adjust the initial step bound
                 if (iter == 1u) {
                     delta = std::min(delta, pnorm);
                 }
 
-                xall[ifree] = wa2;
+                for (uint_t p = 0; p < n; ++p) {
+                    ws.xall.safe[ws.ifree.safe[p]] = wa2.safe[p];
+                }
 
                 // Evaluate the function at x+p and calculate its norm
-                wa4 = flatten(deviate(xall));
-                fnorm1 = mpfit_enorm(wa4);
+                evaluate(deviate, ws.xall, wa4);
+                fnorm1 = enorm(wa4.data.data(), m);
 
                 // Compute the scaled actual reduction
                 double actred = -1.0;
@@ -735,15 +977,22 @@ namespace phypp {
 
                 // Compute the scaled predicted reduction and the scaled directional
                 // derivative
-                for (uint_t j : range(n)) {
-                    wa3[j] = 0.0;
-                    wa3[_-j] += fjac(j,_-j)*wa1[ipiv[j]];
+                for (uint_t j = 0; j < n; ++j) {
+                    wa3.safe[j] = 0.0;
+                    double w = wa1.safe[ipiv[j]];
+                    for (uint_t t = 0; t <= j; ++t) {
+                        wa3.safe[t] += r[j*n+t]*w;
+                    }
                 }
 
                 // Remember, alpha is the fraction of the full LM step actually
                 // taken
                 double prered, dirder; {
-                    double temp1 = mpfit_enorm(alpha*wa3)/fnorm;
+                    for (uint_t j = 0; j < n; ++j) {
+                        ws.wb4.safe[j] = alpha*wa3.safe[j];
+                    }
+
+                    double temp1 = enorm(ws.wb4.data.data(), n)/fnorm;
                     double temp2 = (sqrt(alpha*par)*pnorm)/fnorm;
                     prered = sqr(temp1) + sqr(temp2)/0.5;
                     dirder = -(sqr(temp1) + sqr(temp2));
@@ -774,11 +1023,13 @@ namespace phypp {
 
                 if (ratio >= 0.0001) {
                     // Successful iteration.  Update x, fvec, and their norms
-                    x = wa2;
-                    wa2 = diag*x;
+                    for (uint_t p = 0; p < n; ++p) {
+                        x.safe[p] = wa2.safe[p];
+                        wa2.safe[p] = diag.safe[p]*x.safe[p];
+                    }
 
-                    fvec = wa4;
-                    xnorm = mpfit_enorm(wa2);
+                    std::swap(fvec, wa4);
+                    xnorm = enorm(wa2.data.data(), n);
                     fnorm = fnorm1;
                     ++iter;
 
@@ -786,7 +1037,8 @@ namespace phypp {
                 }
 
                 // Tests for convergence
-                bool ftol = abs(actred) <= options.ftol && prered <= options.ftol && 0.5*ratio <= 1.0;
+                bool ftol = std::abs(actred) <= options.ftol && prered <= options.ftol &&
+                    0.5*ratio <= 1.0;
                 bool xtol = delta <= options.xtol*xnorm;
                 if (ftol || xtol) {
                     res.success = true;
@@ -809,7 +1061,7 @@ namespace phypp {
                     break;
                 }
 
-                if (abs(actred) <= eps && prered <= eps && 0.5*ratio <= 1.0) {
+                if (std::abs(actred) <= eps && prered <= eps && 0.5*ratio <= 1.0) {
                     res.success = false;
                     res.reason = mpfit_result::ftol;
                     stop = true;
@@ -834,39 +1086,110 @@ namespace phypp {
             if (stop) break;
 
             // Check for over/underflow
-            if (!is_finite(ratio) || count(!is_finite(wa1)) != 0 ||
-                count(!is_finite(wa2)) != 0 || count(!is_finite(x)) != 0) {
+            bool finite = is_finite(ratio);
+            for (uint_t p = 0; p < n; ++p) {
+                finite = finite && is_finite(wa1.safe[p]) && is_finite(wa2.safe[p]) &&
+                    is_finite(x.safe[p]);
+            }
+
+            if (!finite) {
                 res.success = false;
                 res.reason = mpfit_result::overflow;
                 break;
             }
         }
 
-        xall[ifree] = x;
+        for (uint_t p = 0; p < n; ++p) {
+            ws.xall.safe[ws.ifree.safe[p]] = x.safe[p];
+        }
 
-        res.params = xall;
-        fvec = flatten(deviate(xall));
-        fnorm = mpfit_enorm(fvec);
+        res.params = ws.xall;
+        evaluate(deviate, ws.xall, fvec);
+        fnorm = enorm(fvec.data.data(), m);
         res.chi2 = sqr(std::max(fnorm, fnorm1));
         res.iter = iter;
 
         if (!options.nocovar) {
             // (very carefully) set the covariance matrix
-            vec2d cv = mpfit_covar(fjac, ipiv);
+            covar(r, n, ipiv, wa1.data.data());
 
             // Fill in actual covariance matrix, accounting for fixed
             // parameters.
-            res.covar.resize(xall.size(), xall.size());
-            res.covar(ifree,ifree) = cv;
+            res.covar.resize(np, np);
+            res.errors.resize(np);
+            for (uint_t i = 0; i < n; ++i)
+            for (uint_t j = 0; j < n; ++j) {
+                res.covar.safe(ws.ifree.safe[i],ws.ifree.safe[j]) = r[i*n+j];
+            }
 
             // Compute errors in parameters
-            res.errors = matrix::diagonal(res.covar);
-            vec1u wh = where(res.errors >= 0.0);
-            res.errors[wh] = sqrt(res.errors[wh]);
+            for (uint_t i = 0; i < np; ++i) {
+                double v = res.covar.safe(i,i);
+                res.errors.safe[i] = (v >= 0.0 ? sqrt(v) : v);
+            }
         }
 
         return res;
     }
+}
+}
+
+    // Numerically stable sqrt(total(sqr(v)))
+    inline double mpfit_enorm(const vec1d& v) {
+        return impl::mpfit_impl::enorm(v.data.data(), v.size());
+    }
+
+    // Fit using finite difference derivatives.
+    // 'deviate(p)' returns the deviates for the parameters 'p', or alternatively
+    // 'deviate(p, d)' writes them in 'd' (only when a workspace is provided, see below).
+    template<typename F>
+    mpfit_result mpfit(F&& deviate, vec1d xall, mpfit_options options = mpfit_options()) {
+        mpfit_workspace ws;
+        impl::mpfit_impl::no_jacobian jac;
+        return impl::mpfit_impl::solve(ws, deviate, jac, xall, options);
+    }
+
+    // Fit using explicit derivatives.
+    // 'jacobian(p, j)' writes in 'j(i,k)' the derivative of the deviate 'k' with respect to the
+    // parameter 'i', for the parameters 'p'. The matrix is already allocated, and the rows of
+    // frozen parameters are not used.
+    template<typename F, typename J>
+    mpfit_result mpfit(F&& deviate, J&& jacobian, vec1d xall,
+        mpfit_options options = mpfit_options()) {
+        mpfit_workspace ws;
+        return impl::mpfit_impl::solve(ws, deviate, jacobian, xall, options);
+    }
+
+    // Same as above, reusing the buffers of an existing workspace.
+    template<typename F>
+    mpfit_result mpfit(mpfit_workspace& ws, F&& deviate, const vec1d& xall,
+        const mpfit_options& options = mpfit_options()) {
+        impl::mpfit_impl::no_jacobian jac;
+        return impl::mpfit_impl::solve(ws, deviate, jac, xall, options);
+    }
+
+    template<typename F, typename J>
+    mpfit_result mpfit(mpfit_workspace& ws, F&& deviate, J&& jacobian, const vec1d& xall,
+        const mpfit_options& options = mpfit_options()) {
+        return impl::mpfit_impl::solve(ws, deviate, jacobian, xall, options);
+    }
+
+    // Run 'nfit' independent fits in parallel. 'fit(i, ws)' must perform the fit number 'i'
+    // (typically calling mpfit() with the provided workspace, which is shared by all the fits
+    // done by the same task) and return its result.
+    template<typename F>
+    std::vector<mpfit_result> mpfit_batch(uint_t nfit, F&& fit) {
+        std::vector<mpfit_result> res(nfit);
+        uint_t grain = std::max(uint_t(1), nfit/(8*parallel::threads()));
+        parallel::for_chunks(nfit, grain, [&](uint_t i0, uint_t i1) {
+            mpfit_workspace ws;
+            for (uint_t i = i0; i < i1; ++i) {
+                res[i] = fit(i, ws);
+            }
+        });
+
+        return res;
+    }
 
     // Wrapper around mpfit() for standard deviate (y - ytest)/yerr, where y and yerr are given and
     // ytest is compted from a model function taking as a first argument the position x at which to
@@ -129,6 +129,11 @@ namespace phypp {
         inplace_shuffle(seed, v);
         return v;
     }
+
+    template<std::size_t Dim, typename E, typename T>
+    vec<Dim,typename E::value_type> shuffle(T& seed, vec<Dim,impl::vec_expr<E>> v) {
+        return shuffle(seed, std::move(v).concretise());
+    }
 }
 
 #endif
@@ -7,6 +7,8 @@
 #include "phypp/core/string_conversion.hpp"
 #include "phypp/utility/generic.hpp"
 #include "phypp/math/base.hpp"
+#include "phypp/math/simd.hpp"
+#include "phypp/math/bits/select.hpp"
 
 namespace phypp {
     namespace meta {
@@ -16,35 +18,173 @@ namespace phypp {
             double>::type;
     }
 
+    namespace impl {
+        // The reductions below use SIMD kernels (see simd.hpp) when the elements are
+        // contiguous in memory and of a supported type, and fall back to a plain loop
+        // otherwise.
+        template<typename T>
+        using simd_sum_ = std::integral_constant<bool,
+            simd::is_float<T>::value || simd::is_int64<T>::value>;
+
+        template<std::size_t Dim, typename Type>
+        meta::total_return_type<meta::rtype_t<Type>> total_(const vec<Dim,Type>& v, std::false_type) {
+            meta::total_return_type<meta::rtype_t<Type>> total = 0;
+            for (auto& t : v) {
+                total += t;
+            }
+
+            return total;
+        }
+
+        template<std::size_t Dim, typename Type>
+        meta::total_return_type<meta::rtype_t<Type>> total_(const vec<Dim,Type>& v, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p) return total_(v, std::false_type{});
+            return simd::sum<false>(p, v.size());
+        }
+
+        template<std::size_t Dim, typename Type>
+        uint_t count_(const vec<Dim,Type>& v) {
+            auto p = simd::contiguous_data(v);
+            if (p) {
+                return simd::count(reinterpret_cast<const char*>(p), v.size());
+            }
+
+            uint_t n = 0u;
+            for (bool b : v) {
+                if (b) ++n;
+            }
+
+            return n;
+        }
+
+        template<std::size_t Dim, typename Type>
+        double mean_(const vec<Dim,Type>& v, std::false_type) {
+            double total = 0.0;
+            for (auto& t : v) {
+                total += t;
+            }
+
+            return total/v.size();
+        }
+
+        template<std::size_t Dim, typename Type>
+        double mean_(const vec<Dim,Type>& v, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p) return mean_(v, std::false_type{});
+            return simd::sum<false>(p, v.size())/v.size();
+        }
+
+        // Value returned when there is no valid element to select from: NaN for floating
+        // point types, and zero for integer types (which cannot hold NaN)
+        template<typename T>
+        T no_valid_value_(std::true_type) {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+
+        template<typename T>
+        T no_valid_value_(std::false_type) {
+            return T(0);
+        }
+
+        template<typename T>
+        T no_valid_value() {
+            return no_valid_value_<T>(std::is_floating_point<T>{});
+        }
+    }
+
+    namespace impl {
+        // Parallel versions. The input is split in chunks of fixed size (parallel::grain),
+        // each chunk is reduced independently, and the results of all chunks are then
+        // combined in order. Results therefore only depend on whether the parallel policy is
+        // used, not on the number of threads.
+        template<typename R, typename F, typename C>
+        R par_reduce_(uint_t n, R init, F&& chunk, C&& combine) {
+            std::vector<R> tmp(parallel::chunks(n));
+            parallel::for_chunks(n, parallel::grain, [&](uint_t i0, uint_t i1) {
+                tmp[i0/parallel::grain] = chunk(i0, i1);
+            });
+
+            for (auto& t : tmp) {
+                init = combine(init, t);
+            }
+
+            return init;
+        }
+
+        template<typename R, std::size_t Dim, typename Type>
+        R sum_range_(const vec<Dim,Type>& v, uint_t i0, uint_t i1, std::false_type) {
+            R total = 0;
+            for (uint_t i = i0; i < i1; ++i) {
+                total += v.safe[i];
+            }
+
+            return total;
+        }
+
+        template<typename R, std::size_t Dim, typename Type>
+        R sum_range_(const vec<Dim,Type>& v, uint_t i0, uint_t i1, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p) return sum_range_<R>(v, i0, i1, std::false_type{});
+            return simd::sum<false>(p + i0, i1 - i0);
+        }
+
+        template<std::size_t Dim, typename Type>
+        uint_t count_range_(const vec<Dim,Type>& v, uint_t i0, uint_t i1) {
+            auto p = simd::contiguous_data(v);
+            if (p) {
+                return simd::count(reinterpret_cast<const char*>(p) + i0, i1 - i0);
+            }
+
+            uint_t n = 0u;
+            for (uint_t i = i0; i < i1; ++i) {
+                if (v.safe[i]) ++n;
+            }
+
+            return n;
+        }
+    }
+
+    template<std::size_t Dim, typename Type>
+    meta::total_return_type<meta::rtype_t<Type>> total(par_t, const vec<Dim,Type>& v) {
+        using rtype = meta::total_return_type<meta::rtype_t<Type>>;
+        return impl::par_reduce_(v.size(), rtype(0), [&](uint_t i0, uint_t i1) {
+            return impl::sum_range_<rtype>(v, i0, i1, impl::simd_sum_<meta::rtype_t<Type>>{});
+        }, [](rtype t1, rtype t2) { return t1 + t2; });
+    }
+
     template<std::size_t Dim, typename Type>
     meta::total_return_type<meta::rtype_t<Type>> total(const vec<Dim,Type>& v) {
-        meta::total_return_type<meta::rtype_t<Type>> total = 0;
-        for (auto& t : v) {
-            total += t;
-        }
+        if (parallel::enabled()) return total(par, v);
+        return impl::total_(v, impl::simd_sum_<meta::rtype_t<Type>>{});
+    }
 
-        return total;
+    template<std::size_t Dim = 1, typename Type = bool, typename enable =
+        typename std::enable_if<std::is_same<meta::rtype_t<Type>, bool>::value>::type>
+    uint_t count(par_t, const vec<Dim,Type>& v) {
+        return impl::par_reduce_(v.size(), uint_t(0), [&](uint_t i0, uint_t i1) {
+            return impl::count_range_(v, i0, i1);
+        }, [](uint_t t1, uint_t t2) { return t1 + t2; });
     }
 
     template<std::size_t Dim = 1, typename Type = bool, typename enable =
         typename std::enable_if<std::is_same<meta::rtype_t<Type>, bool>::value>::type>
     uint_t count(const vec<Dim,Type>& v) {
-        uint_t n = 0u;
-        for (bool b : v) {
-            if (b) ++n;
-        }
+        if (parallel::enabled()) return count(par, v);
+        return impl::count_(v);
+    }
 
-        return n;
+    template<std::size_t Dim, typename Type>
+    double mean(par_t, const vec<Dim,Type>& v) {
+        return impl::par_reduce_(v.size(), 0.0, [&](uint_t i0, uint_t i1) {
+            return impl::sum_range_<double>(v, i0, i1, impl::simd::is_float<meta::rtype_t<Type>>{});
+        }, [](double t1, double t2) { return t1 + t2; })/v.size();
     }
 
     template<std::size_t Dim, typename Type>
     double mean(const vec<Dim,Type>& v) {
-        double total = 0.0;
-        for (auto& t : v) {
-            total += t;
-        }
-
-        return total/v.size();
+        if (parallel::enabled()) return mean(par, v);
+        return impl::mean_(v, impl::simd::is_float<meta::rtype_t<Type>>{});
     }
 
     template<std::size_t Dim, typename Type, typename TypeW>
@@ -108,6 +248,7 @@ namespace phypp {
         return strn(round(100.0*fraction_of(std::forward<Args>(args)...)))+"%";
     }
 
+    // Median of the values of 'v', ignoring NaN values. Reorders the values.
     template<std::size_t Dim, typename Type>
     meta::rtype_t<Type> inplace_median(vec<Dim,Type>& v) {
         phypp_check(!v.empty(), "cannot find the median of an empty vector");
@@ -115,28 +256,42 @@ namespace phypp {
         using vtype = typename vec<Dim,Type>::vtype;
         using dtype = typename vtype::value_type;
 
-        uint_t nwrong = 0;
-        for (auto& t : v) {
-            nwrong += is_nan(t);
-        }
+        // Move the NaN values to the end, so that the selection only compares valid values
+        auto last = std::partition(v.data.begin(), v.data.end(), [](dtype i) {
+            return !is_nan(impl::dref<Type>(i));
+        });
 
-        if (nwrong == v.size()) return dnan;
+        if (last == v.data.begin()) return impl::no_valid_value<meta::rtype_t<Type>>();
 
-        std::ptrdiff_t offset = (v.size()-nwrong)/2;
-        std::nth_element(v.data.begin(), v.data.begin() + offset, v.data.end(),
+        std::ptrdiff_t offset = (last - v.data.begin())/2;
+        std::nth_element(v.data.begin(), v.data.begin() + offset, last,
             [](dtype i, dtype j) {
-                if (is_nan(impl::dref<Type>(i))) return false;
-                if (is_nan(impl::dref<Type>(j))) return true;
                 return impl::dref<Type>(i) < impl::dref<Type>(j);
             }
         );
 
-        return *(v.begin() + offset);
+        return impl::dref<Type>(*(v.data.begin() + offset));
     }
 
+    // Median of the values of 'v', ignoring NaN values. Only the valid values are copied,
+    // and large contiguous arrays of floating point values are not copied at all.
     template<std::size_t Dim, typename Type>
-    meta::rtype_t<Type> median(vec<Dim,Type> v) {
-        return inplace_median(v);
+    meta::rtype_t<Type> median(const vec<Dim,Type>& v) {
+        phypp_check(!v.empty(), "cannot find the median of an empty vector");
+
+        using rtype = meta::rtype_t<Type>;
+        std::vector<rtype> r;
+        bool found = impl::selection::select(v,
+            [](rtype t) { return !is_nan(t); },
+            [](uint_t n) { return std::vector<uint_t>{n/2}; }, r);
+
+        return found ? r[0] : impl::no_valid_value<rtype>();
+    }
+
+    template<std::size_t Dim, typename E>
+    typename E::value_type median(vec<Dim,impl::vec_expr<E>> v) {
+        auto t = std::move(v).concretise();
+        return inplace_median(t);
     }
 
     template<std::size_t Dim, typename Type, typename TypeW>
@@ -145,84 +300,142 @@ namespace phypp {
         phypp_check(v.dims == w.dims, "incompatible dimensions between values and weights "
             "(", v.dims, " vs. ", w.dims, ")");
 
+        using rtype = meta::rtype_t<Type>;
+        std::vector<std::pair<rtype,double>> vw;
+        vw.reserve(v.size());
+
         double totw = 0;
         for (uint_t i : range(v)) {
-            if (!is_nan(v.safe[i]) && !is_nan(w.safe[i])) totw += w.safe[i];
-        }
-
-        vec1u ids = sort(v);
-
-        double tot = 0;
-        for (uint_t i : range(ids)) {
-            uint_t j = ids.safe[i];
-            if (!is_nan(v.safe[j]) && !is_nan(w.safe[j])) {
-                tot += w.safe[j];
-                if (tot > totw/2.0) {
-                    if (i == 0) return v.safe[j];
-                    else        return v.safe[ids.safe[i-1]];
-                }
+            if (!is_nan(v.safe[i]) && !is_nan(w.safe[i])) {
+                totw += w.safe[i];
+                vw.emplace_back(v.safe[i], w.safe[i]);
             }
         }
 
-        return dnan;
+        if (vw.empty()) return impl::no_valid_value<rtype>();
+
+        return impl::selection::weighted_median(vw, totw);
     }
 
     template<std::size_t Dim, typename Type, typename U>
     meta::rtype_t<Type> percentile(const vec<Dim,Type>& v, const U& u) {
         phypp_check(!v.empty(), "cannot find the percentiles of an empty vector");
 
-        vec1u ok = where(is_finite(v));
-        if (ok.empty()) return 0;
+        using rtype = meta::rtype_t<Type>;
+        std::vector<rtype> r;
+        bool found = impl::selection::select(v,
+            [](rtype t) { return is_finite(t); },
+            [&u](uint_t n) { return std::vector<uint_t>{impl::selection::percentile_rank(n, u)}; },
+            r);
 
-        // TODO: (fixme) use same algorithm than median
-        typename vec<1,Type>::effective_type t = v.safe[ok];
-        std::ptrdiff_t offset = clamp(t.size()*u, 0u, t.size()-1);
-        std::nth_element(t.begin(), t.begin() + offset, t.end());
-        return *(t.begin() + offset);
+        return found ? r[0] : 0;
     }
 
     namespace impl {
-        template<std::size_t Dim, typename Type>
-        void percentiles_(vec<1,Type>& r, uint_t i, vec<Dim,Type>& t) {}
+        inline void percentiles_ranks_(std::vector<uint_t>& ks, uint_t n) {}
 
-        template<std::size_t Dim, typename Type, typename U, typename ... Args>
-        void percentiles_(vec<1,Type>& r, uint_t i, vec<Dim,Type>& t, const U& u, const Args& ... args) {
-            std::ptrdiff_t offset = clamp(t.size()*u, 0u, t.size()-1);
-            std::nth_element(t.begin(), t.begin() + offset, t.end());
-            r.safe[i] = *(t.begin() + offset);
-            ++i;
-
-            percentiles_(r, i, t, args...);
+        template<typename U, typename ... Args>
+        void percentiles_ranks_(std::vector<uint_t>& ks, uint_t n, const U& u,
+            const Args& ... args) {
+            ks.push_back(selection::percentile_rank(n, u));
+            percentiles_ranks_(ks, n, args...);
         }
     }
 
+    // Compute several percentiles at once. All the percentiles are found in a single
+    // partitioning pass over the data.
     template<std::size_t Dim, typename Type, typename ... Args>
     typename vec<1,Type>::effective_type percentiles(const vec<Dim,Type>& v, const Args& ... args) {
         phypp_check(!v.empty(), "cannot find the percentiles of an empty vector");
 
-        vec1u ok = where(is_finite(v));
-        typename vec<1,Type>::effective_type t;
-        if (ok.empty()) return t;
-        t = v.safe[ok];
-
-        typename vec<1,Type>::effective_type r = arr<meta::rtype_t<Type>>(sizeof...(Args));
-        impl::percentiles_(r, 0, t, args...);
+        using rtype = meta::rtype_t<Type>;
+        typename vec<1,Type>::effective_type r;
+
+        // The ranks are found sorted, so keep track of the requested order
+        std::vector<uint_t> order;
+        std::vector<rtype> tr;
+        bool found = impl::selection::select(v,
+            [](rtype t) { return is_finite(t); },
+            [&](uint_t n) {
+                std::vector<uint_t> ks;
+                impl::percentiles_ranks_(ks, n, args...);
+                return impl::selection::sort_ranks(ks, order);
+            }, tr);
+
+        if (!found) return r;
+
+        r = arr<rtype>(sizeof...(Args));
+        for (uint_t i : range(tr)) {
+            r.safe[order[i]] = tr[i];
+        }
 
         return r;
     }
 
+    // Flag the values that are within 'sigma' times the median absolute deviation (MAD)
+    // from the median. With 'niter' > 1, the median and MAD are computed again using only
+    // the values that were kept, until no more value is clipped or 'niter' is reached.
+    // The values are partitioned around the median at each iteration, so that the values
+    // to clip are removed from each side without disturbing the partition, and the next
+    // selection starts from nearly ordered data.
     template<std::size_t Dim, typename Type>
-    vec<Dim,bool> sigma_clip(const vec<Dim,Type>& tv, double sigma) {
-        auto v = tv.concretise();
-        auto med = inplace_median(v);
-        auto mad = median(abs(v - med));
-        // Note: cannot use 'v' below, since the order of the values has changed!
+    vec<Dim,bool> sigma_clip(const vec<Dim,Type>& tv, double sigma, uint_t niter = 1) {
+        using rtype = meta::rtype_t<Type>;
+
+        std::vector<rtype> v;
+        v.reserve(tv.size());
+        for (uint_t i : range(tv)) {
+            rtype t = tv.safe[i];
+            if (!is_nan(t)) v.push_back(t);
+        }
+
+        auto absdiff = [](rtype a, rtype b) { return a > b ? a - b : b - a; };
+
+        double med = dnan, mad = dnan;
+        std::vector<rtype> dev(v.size());
+        // Values before 'split' are not larger than the values after it (partition left by
+        // the previous iteration), so the new median only needs to be searched on one side
+        uint_t split = 0;
+        for (uint_t iter = 0; iter < std::max(niter, uint_t(1)) && !v.empty(); ++iter) {
+            auto mid = v.begin() + v.size()/2;
+            if (mid < v.begin() + split) {
+                std::nth_element(v.begin(), mid, v.begin() + split);
+            } else {
+                std::nth_element(v.begin() + split, mid, v.end());
+            }
+
+            med = *mid;
+
+            dev.resize(v.size());
+            for (uint_t i : range(v)) {
+                dev[i] = absdiff(v[i], *mid);
+            }
+
+            auto dmid = dev.begin() + dev.size()/2;
+            std::nth_element(dev.begin(), dmid, dev.end());
+            mad = *dmid;
+
+            if (iter+1 == niter) break;
+
+            // Remove clipped values from each side of the partition
+            auto clip = [&](rtype t) { return !(std::abs(t - med) < sigma*mad); };
+            auto lend = std::remove_if(v.begin(), mid, clip);
+            auto rend = std::remove_if(mid, v.end(), clip);
+            uint_t nleft = lend - v.begin();
+            uint_t nright = rend - mid;
+            if (nleft + nright == v.size()) break;
+
+            std::copy(mid, rend, v.begin() + nleft);
+            v.resize(nleft + nright);
+            split = nleft;
+        }
+
         return abs(tv - med) < sigma*mad;
     }
 
     namespace impl {
         template<std::size_t Dim, typename Type>
-        typename vec<Dim,Type>::const_iterator min_(const vec<Dim,Type>& v) {
+        typename vec<Dim,Type>::const_iterator min_(const vec<Dim,Type>& v, std::false_type) {
             phypp_check(!v.empty(), "cannot find the minimum of an empty vector");
 
             auto iter = std::min_element(v.begin(), v.end(), [](meta::rtype_t<Type> t1, meta::rtype_t<Type> t2){
@@ -236,7 +449,7 @@ namespace phypp {
         }
 
         template<std::size_t Dim, typename Type>
-        typename vec<Dim,Type>::const_iterator max_(const vec<Dim,Type>& v) {
+        typename vec<Dim,Type>::const_iterator max_(const vec<Dim,Type>& v, std::false_type) {
             phypp_check(!v.empty(), "cannot find the maximum of an empty vector");
 
             auto iter = std::max_element(v.begin(), v.end(), [](meta::rtype_t<Type> t1, meta::rtype_t<Type> t2){
@@ -251,7 +464,7 @@ namespace phypp {
 
         template<std::size_t Dim, typename Type>
         std::pair<typename vec<Dim,Type>::const_iterator, typename vec<Dim,Type>::const_iterator>
-            minmax_(const vec<Dim,Type>& v) {
+            minmax_(const vec<Dim,Type>& v, std::false_type) {
             phypp_check(!v.empty(), "cannot find the maximum/minimum of an empty vector");
 
             // We cannot take care of NaN using std::minmax_element and the trick of
@@ -284,6 +497,131 @@ namespace phypp {
 
             return res;
         }
+
+        // Fast versions: find the extrema with SIMD kernels, then locate the first
+        // occurrence (or last, for the maximum of minmax_) to get the same iterators as above.
+        template<typename T>
+        uint_t simd_find_(const T* p, uint_t n, T x) {
+            for (uint_t i = 0; i < n; ++i) {
+                if (p[i] == x) return i;
+            }
+
+            return 0;
+        }
+
+        template<typename T>
+        uint_t simd_rfind_(const T* p, uint_t n, T x) {
+            for (uint_t i = n; i-- != 0;) {
+                if (p[i] == x) return i;
+            }
+
+            return 0;
+        }
+
+        template<std::size_t Dim, typename Type>
+        typename vec<Dim,Type>::const_iterator min_(const vec<Dim,Type>& v, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p || v.empty()) return min_(v, std::false_type{});
+
+            meta::rtype_t<Type> mi, ma;
+            simd::minmax<true>(p, v.size(), mi, ma);
+            return v.begin() + simd_find_(p, v.size(), mi);
+        }
+
+        template<std::size_t Dim, typename Type>
+        typename vec<Dim,Type>::const_iterator max_(const vec<Dim,Type>& v, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p || v.empty()) return max_(v, std::false_type{});
+
+            meta::rtype_t<Type> mi, ma;
+            simd::minmax<true>(p, v.size(), mi, ma);
+            return v.begin() + simd_find_(p, v.size(), ma);
+        }
+
+        template<std::size_t Dim, typename Type>
+        std::pair<typename vec<Dim,Type>::const_iterator, typename vec<Dim,Type>::const_iterator>
+            minmax_(const vec<Dim,Type>& v, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p || v.empty()) return minmax_(v, std::false_type{});
+
+            meta::rtype_t<Type> mi, ma;
+            simd::minmax<true>(p, v.size(), mi, ma);
+            return std::make_pair(v.begin() + simd_find_(p, v.size(), mi),
+                v.begin() + simd_rfind_(p, v.size(), ma));
+        }
+
+        // Position of the first minimum (or maximum) in [i0,i1), or npos if the range only
+        // contains NaN
+        template<bool Max, std::size_t Dim, typename Type>
+        uint_t extremum_range_(const vec<Dim,Type>& v, uint_t i0, uint_t i1, std::false_type) {
+            uint_t id = npos;
+            for (uint_t i = i0; i < i1; ++i) {
+                if (is_nan(v.safe[i])) continue;
+                if (id == npos || (Max ? v.safe[id] < v.safe[i] : v.safe[i] < v.safe[id])) {
+                    id = i;
+                }
+            }
+
+            return id;
+        }
+
+        template<bool Max, std::size_t Dim, typename Type>
+        uint_t extremum_range_(const vec<Dim,Type>& v, uint_t i0, uint_t i1, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p) return extremum_range_<Max>(v, i0, i1, std::false_type{});
+
+            meta::rtype_t<Type> mi, ma;
+            simd::minmax<true>(p + i0, i1 - i0, mi, ma);
+            for (uint_t i = i0; i < i1; ++i) {
+                if (p[i] == (Max ? ma : mi)) return i;
+            }
+
+            return npos;
+        }
+
+        template<bool Max, std::size_t Dim, typename Type>
+        uint_t par_extremum_(const vec<Dim,Type>& v) {
+            phypp_check(!v.empty(), "cannot find the ", Max ? "maximum" : "minimum",
+                " of an empty vector");
+
+            uint_t id = par_reduce_(v.size(), npos, [&](uint_t i0, uint_t i1) {
+                return extremum_range_<Max>(v, i0, i1, simd::is_float<meta::rtype_t<Type>>{});
+            }, [&](uint_t i1, uint_t i2) {
+                if (i1 == npos) return i2;
+                if (i2 == npos) return i1;
+                return (Max ? v.safe[i1] < v.safe[i2] : v.safe[i2] < v.safe[i1]) ? i2 : i1;
+            });
+
+            return id == npos ? 0 : id;
+        }
+
+        template<std::size_t Dim, typename Type>
+        typename vec<Dim,Type>::const_iterator min_(const vec<Dim,Type>& v) {
+            if (parallel::enabled()) return v.begin() + par_extremum_<false>(v);
+            return min_(v, simd::is_float<meta::rtype_t<Type>>{});
+        }
+
+        template<std::size_t Dim, typename Type>
+        typename vec<Dim,Type>::const_iterator max_(const vec<Dim,Type>& v) {
+            if (parallel::enabled()) return v.begin() + par_extremum_<true>(v);
+            return max_(v, simd::is_float<meta::rtype_t<Type>>{});
+        }
+
+        template<std::size_t Dim, typename Type>
+        std::pair<typename vec<Dim,Type>::const_iterator, typename vec<Dim,Type>::const_iterator>
+            minmax_(const vec<Dim,Type>& v) {
+            return minmax_(v, simd::is_float<meta::rtype_t<Type>>{});
+        }
+    }
+
+    template<std::size_t Dim, typename Type>
+    meta::rtype_t<Type> min(par_t, const vec<Dim,Type>& v) {
+        return v.safe[impl::par_extremum_<false>(v)];
+    }
+
+    template<std::size_t Dim, typename Type>
+    meta::rtype_t<Type> max(par_t, const vec<Dim,Type>& v) {
+        return v.safe[impl::par_extremum_<true>(v)];
     }
 
     template<std::size_t Dim, typename Type>
@@ -410,29 +748,77 @@ namespace phypp {
         return r;
     }
 
-    template<std::size_t Dim, typename Type>
-    double rms(const vec<Dim,Type>& v) {
-        double sum = 0;
-        for (auto& t : v) {
-            sum += t*t;
+    namespace impl {
+        template<std::size_t Dim, typename Type>
+        double rms_(const vec<Dim,Type>& v, std::false_type) {
+            double sum = 0;
+            for (auto& t : v) {
+                sum += t*t;
+            }
+
+            return sqrt(sum/v.size());
+        }
+
+        template<std::size_t Dim, typename Type>
+        double rms_(const vec<Dim,Type>& v, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p) return rms_(v, std::false_type{});
+            return sqrt(simd::sum_sqr<false>(p, v.size())/v.size());
+        }
+
+        template<std::size_t Dim, typename Type>
+        double stddev_(const vec<Dim,Type>& v, std::false_type) {
+            return rms(v - mean(v));
+        }
+
+        template<std::size_t Dim, typename Type>
+        double stddev_(const vec<Dim,Type>& v, std::true_type) {
+            auto p = simd::contiguous_data(v);
+            if (!p) return stddev_(v, std::false_type{});
+            double m = simd::sum<false>(p, v.size())/v.size();
+            return sqrt(simd::sum_sqr_dev<false>(p, v.size(), m)/v.size());
         }
+    }
 
-        return sqrt(sum/v.size());
+    template<std::size_t Dim, typename Type>
+    double rms(const vec<Dim,Type>& v) {
+        return impl::rms_(v, impl::simd::is_float<meta::rtype_t<Type>>{});
     }
 
     template<std::size_t Dim, typename Type>
     double stddev(const vec<Dim,Type>& v) {
-        return rms(v - mean(v));
+        return impl::stddev_(v, impl::simd::is_float<meta::rtype_t<Type>>{});
     }
 
     template<std::size_t Dim, typename Type>
     meta::rtype_t<Type> mad(const vec<Dim,Type>& v) {
-        return median(abs(v - median(v)));
+        phypp_check(!v.empty(), "cannot find the MAD of an empty vector");
+
+        // Use a single buffer for both medians
+        using rtype = meta::rtype_t<Type>;
+        std::vector<rtype> t;
+        t.reserve(v.size());
+        for (uint_t i : range(v)) {
+            rtype tv = v.safe[i];
+            if (!is_nan(tv)) t.push_back(tv);
+        }
+
+        if (t.empty()) return dnan;
+
+        auto mid = t.begin() + t.size()/2;
+        std::nth_element(t.begin(), mid, t.end());
+        rtype med = *mid;
+        for (auto& tv : t) {
+            tv = (tv > med ? tv - med : med - tv);
+        }
+
+        std::nth_element(t.begin(), mid, t.end());
+        return *mid;
     }
 
     namespace impl {
         template<typename F, F f, std::size_t Dim, typename Type, typename ... Args>
-        auto run_index_(uint_t dim, const vec<Dim,Type>& v, Args&& ... args) ->
+        auto run_index_(bool par, uint_t dim, const vec<Dim,Type>& v, Args&& ... args) ->
         vec<Dim-1,typename meta::return_type<F>::type> {
 
             vec<Dim-1,typename meta::return_type<F>::type> r;
@@ -472,14 +858,25 @@ namespace phypp {
         //  Final recipe:
         //      ((u/mpitch)*dim[d] + i)*mpitch + (u%mpitch)
 
-            vec<1,meta::rtype_t<Type>> tmp(v.dims[dim]);
-            for (uint_t i : range(r)) {
-                uint_t base = (i%mpitch) + (i/mpitch)*v.dims[dim]*mpitch;
-                for (uint_t j : range(tmp)) {
-                    tmp.safe[j] = v.safe[base + j*mpitch];
-                }
+            auto run_range = [&](uint_t i0, uint_t i1) {
+                vec<1,meta::rtype_t<Type>> tmp(v.dims[dim]);
+                for (uint_t i = i0; i < i1; ++i) {
+                    uint_t base = (i%mpitch) + (i/mpitch)*v.dims[dim]*mpitch;
+                    for (uint_t j : range(tmp)) {
+                        tmp.safe[j] = v.safe[base + j*mpitch];
+                    }
 
-                r.safe[i] = (*f)(tmp, std::forward<Args>(args)...);
+                    r.safe[i] = (*f)(tmp, std::forward<Args>(args)...);
+                }
+            };
+
+            if (par || parallel::enabled()) {
+                // Each output element is independent: split them in chunks containing
+                // about parallel::grain input elements
+                uint_t g = std::max(uint_t(1), parallel::grain/std::max(uint_t(1), v.dims[dim]));
+                parallel::for_chunks(r.size(), g, run_range);
+            } else {
+                run_range(0, r.size());
             }
 
             return r;
@@ -600,7 +997,17 @@ namespace phypp {
                 "(", dim, " vs. ", v.dims, ")"); \
             using wrapper = func ## _run_index_wrapper_<meta::rtype_t<Type>, Args...>; \
             using fptr = decltype(&wrapper::run); \
-            return impl::run_index_<fptr, &wrapper::run>(dim, v, std::forward<Args>(args)...); \
+            return impl::run_index_<fptr, &wrapper::run>(false, dim, v, std::forward<Args>(args)...); \
+        } \
+        \
+        template<std::size_t Dim, typename Type, typename ... Args> \
+        auto partial_ ## func (par_t, uint_t dim, const vec<Dim,Type>& v, Args&& ... args) -> \
+        vec<Dim-1, decltype(func(std::declval<vec<1,meta::rtype_t<Type>>>(), std::forward<Args>(args)...))> { \
+            phypp_check(dim < Dim, "reduction dimension is incompatible with input vector " \
+                "(", dim, " vs. ", v.dims, ")"); \
+            using wrapper = func ## _run_index_wrapper_<meta::rtype_t<Type>, Args...>; \
+            using fptr = decltype(&wrapper::run); \
+            return impl::run_index_<fptr, &wrapper::run>(true, dim, v, std::forward<Args>(args)...); \
         }
 
     MAKE_PARTIAL(total);
@@ -0,0 +1,569 @@
+#ifndef PHYPP_MATH_SIMD_HPP
+#define PHYPP_MATH_SIMD_HPP
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include "phypp/core/vec.hpp"
+
+// Explicit SIMD kernels are only available on x86 with GCC or clang, since we rely on
+// function-level target attributes to compile several instruction sets in the same binary.
+// They can be disabled altogether with -DNO_SIMD.
+#if !defined(NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define PHYPP_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace phypp {
+namespace impl {
+namespace simd {
+    // Supported instruction sets, from the least to the most capable.
+    enum class isa : char {
+        scalar, sse2, avx2, avx512
+    };
+
+    // Find the best instruction set supported by the current CPU.
+    inline isa supported_isa() {
+    #ifdef PHYPP_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return isa::avx512;
+        if (__builtin_cpu_supports("avx2"))    return isa::avx2;
+        if (__builtin_cpu_supports("sse2"))    return isa::sse2;
+    #endif
+        return isa::scalar;
+    }
+
+    // The instruction set can be limited with the PHYPP_SIMD environment variable
+    // ("scalar", "sse2", "avx2" or "avx512"), e.g., to benchmark the kernels.
+    inline isa requested_isa_() {
+        const char* v = std::getenv("PHYPP_SIMD");
+        if (!v)                            return isa::avx512;
+        if (std::strcmp(v, "scalar") == 0) return isa::scalar;
+        if (std::strcmp(v, "sse2") == 0)   return isa::sse2;
+        if (std::strcmp(v, "avx2") == 0)   return isa::avx2;
+        return isa::avx512;
+    }
+
+    inline isa& current_isa_() {
+        static isa i = std::min(requested_isa_(), supported_isa());
+        return i;
+    }
+
+    // Instruction set used by the kernels
+    inline isa current_isa() {
+        return current_isa_();
+    }
+
+    // Change the instruction set used by the kernels (not thread safe).
+    // The requested set is capped to what the CPU supports, and the actual value is returned.
+    inline isa set_isa(isa i) {
+        return current_isa_() = std::min(i, supported_isa());
+    }
+
+    // Element types for which kernels are available
+    template<typename T>
+    struct is_float : std::integral_constant<bool,
+        std::is_same<T,float>::value || std::is_same<T,double>::value> {};
+
+    template<typename T>
+    struct is_int64 : std::integral_constant<bool,
+        std::is_same<T,int_t>::value || std::is_same<T,uint_t>::value> {};
+
+    // Get a pointer to the elements of a vector if they are contiguous in memory, or null.
+    template<std::size_t Dim, typename Type>
+    const meta::dtype_t<Type>* contiguous_data(const vec<Dim,Type>& v) {
+        return v.data.data();
+    }
+
+    template<std::size_t Dim, typename Type>
+    const Type* contiguous_data(const vec<Dim,Type*>& v) {
+        Type* base;
+        std::ptrdiff_t stride;
+        if (v.data.linear(base, stride) && stride == 1) {
+            return base;
+        } else {
+            return nullptr;
+        }
+    }
+
+    template<std::size_t Dim, typename E>
+    const typename E::value_type* contiguous_data(const vec<Dim,impl::vec_expr<E>>&) {
+        return nullptr;
+    }
+
+    // Register types and primitive operations for each instruction set.
+    // The kernels themselves are written once in bits/simd_kernels.hpp, using these.
+    namespace scalar {
+        using vd = double;
+        using vf = float;
+        using vi = std::uint64_t;
+        static const uint_t ni = 1;
+        static const uint_t nb = 1;
+
+        template<typename T>
+        struct reg;
+
+        template<>
+        struct reg<double> {
+            using type = vd;
+            static const uint_t n = 1;
+        };
+
+        template<>
+        struct reg<float> {
+            using type = vf;
+            static const uint_t n = 1;
+        };
+
+        inline vd vload(const double* p) { return *p; }
+        inline vf vload(const float* p) { return *p; }
+        inline vd vload_d(const double* p) { return *p; }
+        inline vd vload_d(const float* p) { return *p; }
+        inline void vstore(double* p, vd x) { *p = x; }
+        inline void vstore(float* p, vf x) { *p = x; }
+        inline vd vset1(double x) { return x; }
+        inline vf vset1(float x) { return x; }
+        inline vd vadd(vd x, vd y) { return x + y; }
+        inline vd vsub(vd x, vd y) { return x - y; }
+        inline vd vmul(vd x, vd y) { return x*y; }
+        inline vf vadd(vf x, vf y) { return x + y; }
+        inline vf vmul(vf x, vf y) { return x*y; }
+        inline vd vmin(vd x, vd y) { return y < x ? y : x; }
+        inline vf vmin(vf x, vf y) { return y < x ? y : x; }
+        inline vd vmax(vd x, vd y) { return y > x ? y : x; }
+        inline vf vmax(vf x, vf y) { return y > x ? y : x; }
+        inline vd vsqrt(vd x) { return std::sqrt(x); }
+        inline vf vsqrt(vf x) { return std::sqrt(x); }
+        inline vd vzero_nan(vd v, vd x) { return std::isnan(x) ? 0.0 : v; }
+        inline vd vfill_nan(vd x, vd f) { return std::isnan(x) ? f : x; }
+        inline vf vfill_nan(vf x, vf f) { return std::isnan(x) ? f : x; }
+        inline vd vflag_nan(vd f, vd x) { return std::isnan(x) ? x : f; }
+        inline vf vflag_nan(vf f, vf x) { return std::isnan(x) ? x : f; }
+        inline bool vhas_nan(vd f) { return std::isnan(f); }
+        inline bool vhas_nan(vf f) { return std::isnan(f); }
+        inline double vhsum(vd x) { return x; }
+        inline uint_t vcount_nonzero(const char* p) { return *p != 0; }
+        inline vi vzero_i() { return 0; }
+        inline vi vload_i(const void* p) { vi x; std::memcpy(&x, p, sizeof(vi)); return x; }
+        inline vi vadd_i(vi x, vi y) { return x + y; }
+        inline void vstore_i(void* p, vi x) { std::memcpy(p, &x, sizeof(vi)); }
+    }
+
+#ifdef PHYPP_SIMD_X86
+    namespace sse2 {
+        #define PHYPP_SIMD_TARGET __attribute__((target("sse2")))
+
+        using vd = __m128d;
+        using vf = __m128;
+        using vi = __m128i;
+        static const uint_t ni = 2;
+        static const uint_t nb = 16;
+
+        template<typename T>
+        struct reg;
+
+        template<>
+        struct reg<double> {
+            using type = vd;
+            static const uint_t n = 2;
+        };
+
+        template<>
+        struct reg<float> {
+            using type = vf;
+            static const uint_t n = 4;
+        };
+
+        PHYPP_SIMD_TARGET inline vd vload(const double* p) { return _mm_loadu_pd(p); }
+        PHYPP_SIMD_TARGET inline vf vload(const float* p) { return _mm_loadu_ps(p); }
+        PHYPP_SIMD_TARGET inline vd vload_d(const double* p) { return _mm_loadu_pd(p); }
+        PHYPP_SIMD_TARGET inline vd vload_d(const float* p) {
+            return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+        }
+        PHYPP_SIMD_TARGET inline void vstore(double* p, vd x) { _mm_storeu_pd(p, x); }
+        PHYPP_SIMD_TARGET inline void vstore(float* p, vf x) { _mm_storeu_ps(p, x); }
+        PHYPP_SIMD_TARGET inline vd vset1(double x) { return _mm_set1_pd(x); }
+        PHYPP_SIMD_TARGET inline vf vset1(float x) { return _mm_set1_ps(x); }
+        PHYPP_SIMD_TARGET inline vd vadd(vd x, vd y) { return _mm_add_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vd vsub(vd x, vd y) { return _mm_sub_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmul(vd x, vd y) { return _mm_mul_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vadd(vf x, vf y) { return _mm_add_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmul(vf x, vf y) { return _mm_mul_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmin(vd x, vd y) { return _mm_min_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmin(vf x, vf y) { return _mm_min_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmax(vd x, vd y) { return _mm_max_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmax(vf x, vf y) { return _mm_max_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vsqrt(vd x) { return _mm_sqrt_pd(x); }
+        PHYPP_SIMD_TARGET inline vf vsqrt(vf x) { return _mm_sqrt_ps(x); }
+        PHYPP_SIMD_TARGET inline vd vzero_nan(vd v, vd x) {
+            return _mm_and_pd(v, _mm_cmpord_pd(x, x));
+        }
+        PHYPP_SIMD_TARGET inline vd vfill_nan(vd x, vd f) {
+            vd m = _mm_cmpord_pd(x, x);
+            return _mm_or_pd(_mm_and_pd(m, x), _mm_andnot_pd(m, f));
+        }
+        PHYPP_SIMD_TARGET inline vf vfill_nan(vf x, vf f) {
+            vf m = _mm_cmpord_ps(x, x);
+            return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, f));
+        }
+        PHYPP_SIMD_TARGET inline vd vflag_nan(vd f, vd x) {
+            return _mm_or_pd(f, _mm_cmpunord_pd(x, x));
+        }
+        PHYPP_SIMD_TARGET inline vf vflag_nan(vf f, vf x) {
+            return _mm_or_ps(f, _mm_cmpunord_ps(x, x));
+        }
+        PHYPP_SIMD_TARGET inline bool vhas_nan(vd f) {
+            return _mm_movemask_pd(_mm_cmpunord_pd(f, f)) != 0;
+        }
+        PHYPP_SIMD_TARGET inline bool vhas_nan(vf f) {
+            return _mm_movemask_ps(_mm_cmpunord_ps(f, f)) != 0;
+        }
+        PHYPP_SIMD_TARGET inline double vhsum(vd x) {
+            double t[2];
+            _mm_storeu_pd(t, x);
+            return t[0] + t[1];
+        }
+        PHYPP_SIMD_TARGET inline uint_t vcount_nonzero(const char* p) {
+            vi x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            unsigned int m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128()));
+            return 16 - __builtin_popcount(m);
+        }
+        PHYPP_SIMD_TARGET inline vi vzero_i() { return _mm_setzero_si128(); }
+        PHYPP_SIMD_TARGET inline vi vload_i(const void* p) {
+            return _mm_loadu_si128(static_cast<const __m128i*>(p));
+        }
+        PHYPP_SIMD_TARGET inline vi vadd_i(vi x, vi y) { return _mm_add_epi64(x, y); }
+        PHYPP_SIMD_TARGET inline void vstore_i(void* p, vi x) {
+            _mm_storeu_si128(static_cast<__m128i*>(p), x);
+        }
+
+        #undef PHYPP_SIMD_TARGET
+    }
+
+    namespace avx2 {
+        #define PHYPP_SIMD_TARGET __attribute__((target("avx2")))
+
+        using vd = __m256d;
+        using vf = __m256;
+        using vi = __m256i;
+        static const uint_t ni = 4;
+        static const uint_t nb = 32;
+
+        template<typename T>
+        struct reg;
+
+        template<>
+        struct reg<double> {
+            using type = vd;
+            static const uint_t n = 4;
+        };
+
+        template<>
+        struct reg<float> {
+            using type = vf;
+            static const uint_t n = 8;
+        };
+
+        PHYPP_SIMD_TARGET inline vd vload(const double* p) { return _mm256_loadu_pd(p); }
+        PHYPP_SIMD_TARGET inline vf vload(const float* p) { return _mm256_loadu_ps(p); }
+        PHYPP_SIMD_TARGET inline vd vload_d(const double* p) { return _mm256_loadu_pd(p); }
+        PHYPP_SIMD_TARGET inline vd vload_d(const float* p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+        PHYPP_SIMD_TARGET inline void vstore(double* p, vd x) { _mm256_storeu_pd(p, x); }
+        PHYPP_SIMD_TARGET inline void vstore(float* p, vf x) { _mm256_storeu_ps(p, x); }
+        PHYPP_SIMD_TARGET inline vd vset1(double x) { return _mm256_set1_pd(x); }
+        PHYPP_SIMD_TARGET inline vf vset1(float x) { return _mm256_set1_ps(x); }
+        PHYPP_SIMD_TARGET inline vd vadd(vd x, vd y) { return _mm256_add_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vd vsub(vd x, vd y) { return _mm256_sub_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmul(vd x, vd y) { return _mm256_mul_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vadd(vf x, vf y) { return _mm256_add_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmul(vf x, vf y) { return _mm256_mul_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmin(vd x, vd y) { return _mm256_min_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmin(vf x, vf y) { return _mm256_min_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmax(vd x, vd y) { return _mm256_max_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmax(vf x, vf y) { return _mm256_max_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vsqrt(vd x) { return _mm256_sqrt_pd(x); }
+        PHYPP_SIMD_TARGET inline vf vsqrt(vf x) { return _mm256_sqrt_ps(x); }
+        PHYPP_SIMD_TARGET inline vd vzero_nan(vd v, vd x) {
+            return _mm256_and_pd(v, _mm256_cmp_pd(x, x, _CMP_ORD_Q));
+        }
+        PHYPP_SIMD_TARGET inline vd vfill_nan(vd x, vd f) {
+            return _mm256_blendv_pd(f, x, _mm256_cmp_pd(x, x, _CMP_ORD_Q));
+        }
+        PHYPP_SIMD_TARGET inline vf vfill_nan(vf x, vf f) {
+            return _mm256_blendv_ps(f, x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+        }
+        PHYPP_SIMD_TARGET inline vd vflag_nan(vd f, vd x) {
+            return _mm256_or_pd(f, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        }
+        PHYPP_SIMD_TARGET inline vf vflag_nan(vf f, vf x) {
+            return _mm256_or_ps(f, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+        }
+        PHYPP_SIMD_TARGET inline bool vhas_nan(vd f) {
+            return _mm256_movemask_pd(_mm256_cmp_pd(f, f, _CMP_UNORD_Q)) != 0;
+        }
+        PHYPP_SIMD_TARGET inline bool vhas_nan(vf f) {
+            return _mm256_movemask_ps(_mm256_cmp_ps(f, f, _CMP_UNORD_Q)) != 0;
+        }
+        PHYPP_SIMD_TARGET inline double vhsum(vd x) {
+            double t[4];
+            _mm256_storeu_pd(t, x);
+            return (t[0] + t[1]) + (t[2] + t[3]);
+        }
+        PHYPP_SIMD_TARGET inline uint_t vcount_nonzero(const char* p) {
+            vi x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            unsigned int m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+            return 32 - __builtin_popcount(m);
+        }
+        PHYPP_SIMD_TARGET inline vi vzero_i() { return _mm256_setzero_si256(); }
+        PHYPP_SIMD_TARGET inline vi vload_i(const void* p) {
+            return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+        }
+        PHYPP_SIMD_TARGET inline vi vadd_i(vi x, vi y) { return _mm256_add_epi64(x, y); }
+        PHYPP_SIMD_TARGET inline void vstore_i(void* p, vi x) {
+            _mm256_storeu_si256(static_cast<__m256i*>(p), x);
+        }
+
+        #undef PHYPP_SIMD_TARGET
+    }
+
+    // With gcc, the AVX-512 intrinsics that start from an "undefined" register (e.g.,
+    // _mm512_cvtps_pd, _mm512_min_ps) trigger false -Wmaybe-uninitialized warnings once
+    // inlined in the kernels, so these are disabled for the primitives and the AVX-512 kernels
+    #if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    #endif
+
+    namespace avx512 {
+        #define PHYPP_SIMD_TARGET __attribute__((target("avx512f")))
+
+        using vd = __m512d;
+        using vf = __m512;
+        using vi = __m512i;
+        static const uint_t ni = 8;
+        static const uint_t nb = 32;
+
+        template<typename T>
+        struct reg;
+
+        template<>
+        struct reg<double> {
+            using type = vd;
+            static const uint_t n = 8;
+        };
+
+        template<>
+        struct reg<float> {
+            using type = vf;
+            static const uint_t n = 16;
+        };
+
+        PHYPP_SIMD_TARGET inline vd vload(const double* p) { return _mm512_loadu_pd(p); }
+        PHYPP_SIMD_TARGET inline vf vload(const float* p) { return _mm512_loadu_ps(p); }
+        PHYPP_SIMD_TARGET inline vd vload_d(const double* p) { return _mm512_loadu_pd(p); }
+        PHYPP_SIMD_TARGET inline vd vload_d(const float* p) { return _mm512_cvtps_pd(_mm256_loadu_ps(p)); }
+        PHYPP_SIMD_TARGET inline void vstore(double* p, vd x) { _mm512_storeu_pd(p, x); }
+        PHYPP_SIMD_TARGET inline void vstore(float* p, vf x) { _mm512_storeu_ps(p, x); }
+        PHYPP_SIMD_TARGET inline vd vset1(double x) { return _mm512_set1_pd(x); }
+        PHYPP_SIMD_TARGET inline vf vset1(float x) { return _mm512_set1_ps(x); }
+        PHYPP_SIMD_TARGET inline vd vadd(vd x, vd y) { return _mm512_add_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vd vsub(vd x, vd y) { return _mm512_sub_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmul(vd x, vd y) { return _mm512_mul_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vadd(vf x, vf y) { return _mm512_add_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmul(vf x, vf y) { return _mm512_mul_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmin(vd x, vd y) { return _mm512_min_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmin(vf x, vf y) { return _mm512_min_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vmax(vd x, vd y) { return _mm512_max_pd(x, y); }
+        PHYPP_SIMD_TARGET inline vf vmax(vf x, vf y) { return _mm512_max_ps(x, y); }
+        PHYPP_SIMD_TARGET inline vd vsqrt(vd x) { return _mm512_sqrt_pd(x); }
+        PHYPP_SIMD_TARGET inline vf vsqrt(vf x) { return _mm512_sqrt_ps(x); }
+        PHYPP_SIMD_TARGET inline vd vzero_nan(vd v, vd x) {
+            return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(x, x, _CMP_ORD_Q), v);
+        }
+        PHYPP_SIMD_TARGET inline vd vfill_nan(vd x, vd f) {
+            return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_ORD_Q), f, x);
+        }
+        PHYPP_SIMD_TARGET inline vf vfill_nan(vf x, vf f) {
+            return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_ORD_Q), f, x);
+        }
+        PHYPP_SIMD_TARGET inline vd vflag_nan(vd f, vd x) {
+            return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q), f, x);
+        }
+        PHYPP_SIMD_TARGET inline vf vflag_nan(vf f, vf x) {
+            return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), f, x);
+        }
+        PHYPP_SIMD_TARGET inline bool vhas_nan(vd f) {
+            return _mm512_cmp_pd_mask(f, f, _CMP_UNORD_Q) != 0;
+        }
+        PHYPP_SIMD_TARGET inline bool vhas_nan(vf f) {
+            return _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q) != 0;
+        }
+        PHYPP_SIMD_TARGET inline double vhsum(vd x) {
+            double t[8];
+            _mm512_storeu_pd(t, x);
+            return ((t[0] + t[1]) + (t[2] + t[3])) + ((t[4] + t[5]) + (t[6] + t[7]));
+        }
+        // Byte comparisons need AVX512BW, use AVX2 instead
+        PHYPP_SIMD_TARGET inline uint_t vcount_nonzero(const char* p) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            unsigned int m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+            return 32 - __builtin_popcount(m);
+        }
+        PHYPP_SIMD_TARGET inline vi vzero_i() { return _mm512_setzero_si512(); }
+        PHYPP_SIMD_TARGET inline vi vload_i(const void* p) { return _mm512_loadu_si512(p); }
+        PHYPP_SIMD_TARGET inline vi vadd_i(vi x, vi y) { return _mm512_add_epi64(x, y); }
+        PHYPP_SIMD_TARGET inline void vstore_i(void* p, vi x) { _mm512_storeu_si512(p, x); }
+
+        #undef PHYPP_SIMD_TARGET
+    }
+
+    #if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic pop
+    #endif
+#endif
+}
+}
+}
+
+// Instantiate the kernels for each instruction set
+#define PHYPP_INCLUDING_MATH_SIMD_BITS
+
+#define PHYPP_SIMD_NAMESPACE scalar
+#define PHYPP_SIMD_TARGET
+#include "phypp/math/bits/simd_kernels.hpp"
+#undef PHYPP_SIMD_TARGET
+#undef PHYPP_SIMD_NAMESPACE
+
+#ifdef PHYPP_SIMD_X86
+#define PHYPP_SIMD_NAMESPACE sse2
+#define PHYPP_SIMD_TARGET __attribute__((target("sse2")))
+#include "phypp/math/bits/simd_kernels.hpp"
+#undef PHYPP_SIMD_TARGET
+#undef PHYPP_SIMD_NAMESPACE
+
+#define PHYPP_SIMD_NAMESPACE avx2
+#define PHYPP_SIMD_TARGET __attribute__((target("avx2")))
+#include "phypp/math/bits/simd_kernels.hpp"
+#undef PHYPP_SIMD_TARGET
+#undef PHYPP_SIMD_NAMESPACE
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define PHYPP_SIMD_NAMESPACE avx512
+#define PHYPP_SIMD_TARGET __attribute__((target("avx512f")))
+#include "phypp/math/bits/simd_kernels.hpp"
+#undef PHYPP_SIMD_TARGET
+#undef PHYPP_SIMD_NAMESPACE
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+#undef PHYPP_INCLUDING_MATH_SIMD_BITS
+
+namespace phypp {
+namespace impl {
+namespace simd {
+    // Run a kernel with the current instruction set
+#ifdef PHYPP_SIMD_X86
+    #define PHYPP_SIMD_DISPATCH(call) \
+        switch (current_isa()) { \
+        case isa::avx512 : return avx512::call; \
+        case isa::avx2 :   return avx2::call; \
+        case isa::sse2 :   return sse2::call; \
+        default :          return scalar::call; \
+        }
+#else
+    #define PHYPP_SIMD_DISPATCH(call) \
+        return scalar::call;
+#endif
+
+    // Sum of all elements. If SkipNaN is true, NaN elements are ignored, else they propagate.
+    // Floating point values are accumulated in double precision.
+    template<bool SkipNaN>
+    double sum(const float* p, uint_t n) {
+        PHYPP_SIMD_DISPATCH(sum<SkipNaN>(p, n))
+    }
+
+    template<bool SkipNaN>
+    double sum(const double* p, uint_t n) {
+        PHYPP_SIMD_DISPATCH(sum<SkipNaN>(p, n))
+    }
+
+    template<bool SkipNaN>
+    int_t sum(const int_t* p, uint_t n) {
+        PHYPP_SIMD_DISPATCH(sum_int(p, n))
+    }
+
+    template<bool SkipNaN>
+    uint_t sum(const uint_t* p, uint_t n) {
+        PHYPP_SIMD_DISPATCH(sum_int(p, n))
+    }
+
+    // Sum of the squares of all elements
+    template<bool SkipNaN, typename T>
+    double sum_sqr(const T* p, uint_t n) {
+        PHYPP_SIMD_DISPATCH(sum_sqr<SkipNaN>(p, n))
+    }
+
+    // Sum of the squared differences to 'm'
+    template<bool SkipNaN, typename T>
+    double sum_sqr_dev(const T* p, uint_t n, double m) {
+        PHYPP_SIMD_DISPATCH(sum_sqr_dev<SkipNaN>(p, n, m))
+    }
+
+    // Smallest and largest element. If SkipNaN is true, NaN elements are ignored and the
+    // result is (+inf,-inf) if there are only NaNs; else the result is (NaN,NaN) if there
+    // is at least one NaN.
+    template<bool SkipNaN, typename T>
+    void minmax(const T* p, uint_t n, T& mi, T& ma) {
+        PHYPP_SIMD_DISPATCH(minmax<SkipNaN>(p, n, mi, ma))
+    }
+
+    // Number of non-zero bytes
+    inline uint_t count(const char* p, uint_t n) {
+        PHYPP_SIMD_DISPATCH(count(p, n))
+    }
+
+    // Square root of each element (in and out can be the same)
+    template<typename T>
+    void sqrt(const T* in, T* out, uint_t n) {
+        PHYPP_SIMD_DISPATCH(sqrt(in, out, n))
+    }
+
+    // C += A*B, with A (n x o) and B (o x m) given by their row and column strides, and C
+    // (n x m) contiguous. If 'lower' is true, the upper triangle of C is only partially
+    // computed (for symmetric products).
+    template<typename T>
+    void gemm(uint_t n, uint_t m, uint_t o, const T* a, uint_t ars, uint_t acs,
+        const T* b, uint_t brs, uint_t bcs, T* c, bool lower = false) {
+        PHYPP_SIMD_DISPATCH(gemm(n, m, o, a, ars, acs, b, brs, bcs, c, lower))
+    }
+
+    // y = A*x, with A (n x o) contiguous
+    template<typename T>
+    void gemv(uint_t n, uint_t o, const T* a, const T* x, T* y) {
+        PHYPP_SIMD_DISPATCH(gemv(n, o, a, x, y))
+    }
+
+    // y += x*A, with A (n x m) contiguous
+    template<typename T>
+    void gevm(uint_t n, uint_t m, const T* a, const T* x, T* y) {
+        PHYPP_SIMD_DISPATCH(gevm(n, m, a, x, y))
+    }
+
+    #undef PHYPP_SIMD_DISPATCH
+}
+}
+}
+
+#endif
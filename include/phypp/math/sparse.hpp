@@ -0,0 +1,325 @@
+#ifndef PHYPP_MATH_SPARSE_HPP
+#define PHYPP_MATH_SPARSE_HPP
+
+#include <vector>
+#include <algorithm>
+#include "phypp/core/vec.hpp"
+#include "phypp/core/error.hpp"
+#include "phypp/core/range.hpp"
+
+namespace phypp {
+namespace matrix {
+    // Sparse symmetric matrix. Only the lower triangle is stored, by columns: element (i,j)
+    // with i >= j is stored in column j. Columns can be filled from different threads, as long
+    // as each column is only modified by one thread at a time.
+    class sparse_symmetric {
+    public :
+        using column_t = std::vector<std::pair<uint_t,double>>;
+
+    private :
+        std::vector<column_t> cols_;
+
+    public :
+        sparse_symmetric() = default;
+        explicit sparse_symmetric(uint_t n) : cols_(n) {}
+
+        uint_t size() const {
+            return cols_.size();
+        }
+
+        uint_t nonzeros() const {
+            uint_t n = 0;
+            for (auto& c : cols_) {
+                n += c.size();
+            }
+
+            return n;
+        }
+
+        // Add 'v' to the elements (i,j) and (j,i)
+        void add(uint_t i, uint_t j, double v) {
+            if (i < j) std::swap(i, j);
+            phypp_check(i < cols_.size(), "index out of bounds (", i, " vs. ", cols_.size(), ")");
+
+            column_t& c = cols_[j];
+            for (auto& e : c) {
+                if (e.first == i) {
+                    e.second += v;
+                    return;
+                }
+            }
+
+            c.push_back(std::make_pair(i, v));
+        }
+
+        double operator() (uint_t i, uint_t j) const {
+            if (i < j) std::swap(i, j);
+            phypp_check(i < cols_.size(), "index out of bounds (", i, " vs. ", cols_.size(), ")");
+
+            for (auto& e : cols_[j]) {
+                if (e.first == i) return e.second;
+            }
+
+            return 0.0;
+        }
+
+        // Elements (i,j) of column j, with i >= j, in no particular order
+        const column_t& column(uint_t j) const {
+            return cols_[j];
+        }
+
+        vec1d product(const vec1d& x) const {
+            phypp_check(x.size() == cols_.size(), "matrix and vector must have the same "
+                "dimensions (got ", cols_.size(), " and ", x.size(), ")");
+
+            vec1d r(x.size());
+            for (uint_t j : range(cols_.size())) {
+                for (auto& e : cols_[j]) {
+                    r.safe[e.first] += e.second*x.safe[j];
+                    if (e.first != j) {
+                        r.safe[j] += e.second*x.safe[e.first];
+                    }
+                }
+            }
+
+            return r;
+        }
+
+        vec2d dense() const {
+            vec2d r(cols_.size(), cols_.size());
+            for (uint_t j : range(cols_.size())) {
+                for (auto& e : cols_[j]) {
+                    r.safe(e.first,j) = r.safe(j,e.first) = e.second;
+                }
+            }
+
+            return r;
+        }
+    };
+
+    // Sparse LDL^T decomposition of a symmetric positive definite matrix, with a given
+    // elimination order (which should be chosen to limit the fill-in of L).
+    class sparse_cholesky {
+        uint_t n_ = 0;
+        vec1u perm_, iperm_;
+        // L is stored by columns, without the unit diagonal, with sorted row indices
+        std::vector<uint_t> lp_, li_;
+        std::vector<double> lx_;
+        vec1d d_;
+
+    public :
+        // Factorize 'a', eliminating the rows in the order given by 'order' (a permutation of
+        // the indices of 'a', or empty for the natural order). Returns false if the matrix is not
+        // positive definite.
+        bool factorize(const sparse_symmetric& a, const vec1u& order = vec1u{}) {
+            n_ = a.size();
+            if (order.empty()) {
+                perm_ = uindgen(n_);
+            } else {
+                phypp_check(order.size() == n_, "elimination order must have the same size as "
+                    "the matrix (got ", order.size(), " and ", n_, ")");
+                perm_ = order;
+            }
+
+            iperm_.resize(n_);
+            for (uint_t k : range(n_)) {
+                iperm_.safe[perm_.safe[k]] = k;
+            }
+
+            // Full pattern of the permuted matrix, by columns
+            std::vector<uint_t> ap(n_+1), ai;
+            std::vector<double> ax;
+            for (uint_t j : range(n_)) {
+                for (auto& e : a.column(j)) {
+                    ++ap[iperm_.safe[j]+1];
+                    if (e.first != j) ++ap[iperm_.safe[e.first]+1];
+                }
+            }
+
+            for (uint_t k : range(n_)) {
+                ap[k+1] += ap[k];
+            }
+
+            ai.resize(ap[n_]);
+            ax.resize(ap[n_]);
+            {
+                std::vector<uint_t> pos(ap.begin(), ap.end()-1);
+                for (uint_t j : range(n_)) {
+                    uint_t pj = iperm_.safe[j];
+                    for (auto& e : a.column(j)) {
+                        uint_t pi = iperm_.safe[e.first];
+                        ai[pos[pj]] = pi; ax[pos[pj]] = e.second; ++pos[pj];
+                        if (pi != pj) {
+                            ai[pos[pi]] = pj; ax[pos[pi]] = e.second; ++pos[pi];
+                        }
+                    }
+                }
+            }
+
+            // Symbolic factorization: elimination tree and number of elements per column of L
+            const uint_t none = npos;
+            std::vector<uint_t> parent(n_), flag(n_), lnz(n_);
+            for (uint_t k : range(n_)) {
+                parent[k] = none;
+                flag[k] = k;
+                lnz[k] = 0;
+                for (uint_t p = ap[k]; p < ap[k+1]; ++p) {
+                    uint_t i = ai[p];
+                    if (i >= k) continue;
+
+                    for (; flag[i] != k; i = parent[i]) {
+                        if (parent[i] == none) parent[i] = k;
+                        ++lnz[i];
+                        flag[i] = k;
+                    }
+                }
+            }
+
+            lp_.assign(n_+1, 0);
+            for (uint_t k : range(n_)) {
+                lp_[k+1] = lp_[k] + lnz[k];
+            }
+
+            li_.resize(lp_[n_]);
+            lx_.resize(lp_[n_]);
+            d_.resize(n_);
+
+            // Numeric factorization, one row of L at a time
+            std::vector<double> y(n_);
+            std::vector<uint_t> pattern(n_);
+            for (uint_t k : range(n_)) {
+                y[k] = 0.0;
+                uint_t top = n_;
+                flag[k] = k;
+                lnz[k] = 0;
+
+                for (uint_t p = ap[k]; p < ap[k+1]; ++p) {
+                    uint_t i = ai[p];
+                    if (i > k) continue;
+
+                    y[i] += ax[p];
+                    uint_t len = 0;
+                    for (; flag[i] != k; i = parent[i]) {
+                        pattern[len++] = i;
+                        flag[i] = k;
+                    }
+
+                    while (len > 0) {
+                        pattern[--top] = pattern[--len];
+                    }
+                }
+
+                double dk = y[k];
+                y[k] = 0.0;
+                for (; top < n_; ++top) {
+                    uint_t i = pattern[top];
+                    double yi = y[i];
+                    y[i] = 0.0;
+
+                    uint_t p2 = lp_[i] + lnz[i];
+                    for (uint_t p = lp_[i]; p < p2; ++p) {
+                        y[li_[p]] -= lx_[p]*yi;
+                    }
+
+                    double lki = yi/d_.safe[i];
+                    dk -= lki*yi;
+                    li_[p2] = k;
+                    lx_[p2] = lki;
+                    ++lnz[i];
+                }
+
+                if (!(dk > 0.0)) {
+                    return false;
+                }
+
+                d_.safe[k] = dk;
+            }
+
+            return true;
+        }
+
+        // Number of non-zero elements in L
+        uint_t nonzeros() const {
+            return li_.size();
+        }
+
+        // Solve A x = b
+        vec1d solve(const vec1d& b) const {
+            phypp_check(b.size() == n_, "matrix and vector must have the same dimensions (",
+                "got ", n_, " and ", b.size(), ")");
+
+            vec1d x(n_);
+            for (uint_t k : range(n_)) {
+                x.safe[k] = b.safe[perm_.safe[k]];
+            }
+
+            for (uint_t j : range(n_)) {
+                for (uint_t p = lp_[j]; p < lp_[j+1]; ++p) {
+                    x.safe[li_[p]] -= lx_[p]*x.safe[j];
+                }
+            }
+
+            for (uint_t j : range(n_)) {
+                x.safe[j] /= d_.safe[j];
+            }
+
+            for (uint_t j = n_; j-- > 0;) {
+                for (uint_t p = lp_[j]; p < lp_[j+1]; ++p) {
+                    x.safe[j] -= lx_[p]*x.safe[li_[p]];
+                }
+            }
+
+            vec1d r(n_);
+            for (uint_t k : range(n_)) {
+                r.safe[perm_.safe[k]] = x.safe[k];
+            }
+
+            return r;
+        }
+
+        // Diagonal of the inverse of A, computed from the elements of the inverse that
+        // match the non-zero elements of L (Takahashi's equations).
+        vec1d inverse_diagonal() const {
+            std::vector<double> zx(li_.size());
+            vec1d zd(n_);
+
+            // Element (i,k) of the inverse, for i < k in the pattern of L
+            auto z = [&](uint_t i, uint_t k) {
+                if (i == k) return zd.safe[i];
+                if (i > k) std::swap(i, k);
+                auto b = li_.begin() + lp_[i], e = li_.begin() + lp_[i+1];
+                auto it = std::lower_bound(b, e, k);
+                return zx[it - li_.begin()];
+            };
+
+            for (uint_t j = n_; j-- > 0;) {
+                const uint_t p0 = lp_[j], p1 = lp_[j+1];
+                for (uint_t p = p0; p < p1; ++p) {
+                    double s = 0.0;
+                    for (uint_t q = p0; q < p1; ++q) {
+                        s -= lx_[q]*z(li_[p], li_[q]);
+                    }
+
+                    zx[p] = s;
+                }
+
+                double s = 1.0/d_.safe[j];
+                for (uint_t p = p0; p < p1; ++p) {
+                    s -= lx_[p]*zx[p];
+                }
+
+                zd.safe[j] = s;
+            }
+
+            vec1d r(n_);
+            for (uint_t k : range(n_)) {
+                r.safe[perm_.safe[k]] = zd.safe[k];
+            }
+
+            return r;
+        }
+    };
+}
+}
+
+#endif
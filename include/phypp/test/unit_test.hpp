@@ -36,6 +36,9 @@ namespace phypp {
         template<std::size_t D, typename T>
         struct is_float_<vec<D,T>> : is_float_<typename std::remove_pointer<T>::type> {
         };
+        template<std::size_t D, typename E>
+        struct is_float_<vec<D,impl::vec_expr<E>>> : is_float_<typename E::value_type> {
+        };
     }
 
     template<typename T1, typename T2>
@@ -1,6 +1,9 @@
 #ifndef PHYPP_UTILITY_GENERIC_HPP
 #define PHYPP_UTILITY_GENERIC_HPP
 
+#include <cstring>
+#include <limits>
+#include <unordered_map>
 #include "phypp/core/vec.hpp"
 #include "phypp/core/meta.hpp"
 #include "phypp/core/range.hpp"
@@ -228,9 +231,41 @@ namespace phypp {
     }
 
     // Return the indices of the vector where the value is 'true'.
+    template<std::size_t Dim, typename Type, typename enable =
+        typename std::enable_if<std::is_same<meta::rtype_t<Type>,bool>::value>::type>
+    vec1u where(par_t, const vec<Dim,Type>& v) {
+        // Find the indices in each chunk, then concatenate them in order
+        const uint_t n = v.size();
+        std::vector<std::vector<uint_t>> tmp(parallel::chunks(n));
+        parallel::for_chunks(n, parallel::grain, [&](uint_t i0, uint_t i1) {
+            auto& t = tmp[i0/parallel::grain];
+            for (uint_t i = i0; i < i1; ++i) {
+                if (v.safe[i]) {
+                    t.push_back(i);
+                }
+            }
+        });
+
+        uint_t nid = 0;
+        for (auto& t : tmp) {
+            nid += t.size();
+        }
+
+        vec1u ids;
+        ids.data.reserve(nid);
+        for (auto& t : tmp) {
+            ids.data.insert(ids.data.end(), t.begin(), t.end());
+        }
+
+        ids.dims[0] = ids.data.size();
+        return ids;
+    }
+
     template<std::size_t Dim, typename Type, typename enable =
         typename std::enable_if<std::is_same<meta::rtype_t<Type>,bool>::value>::type>
     vec1u where(const vec<Dim,Type>& v) {
+        if (parallel::enabled()) return where(par, v);
+
         vec1u ids;
         ids.data.reserve(n_elements(v));
         for (uint_t i : range(v)) {
@@ -298,6 +333,184 @@ namespace phypp {
         return res;
     }
 
+    // Sort engine: stable LSD radix argsort for arithmetic values, on (key,index) pairs.
+    namespace impl {
+    namespace sort_impl {
+        // Map a value to an unsigned key with the same ordering. For floating point values,
+        // -0 and +0 are given the same key (they compare equal), and NaNs are sorted last.
+        template<typename T, typename enable = void>
+        struct radix_key {
+            static const bool value = false;
+        };
+
+        template<typename T>
+        struct radix_key<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+            static const bool value = true;
+            using type = typename std::conditional<(sizeof(T) > 4), std::uint64_t, std::uint32_t>::type;
+            using stype = typename std::make_signed<type>::type;
+
+            static type get(T t) {
+                // Flip the sign bit of signed values, so that negative values come first
+                return std::is_signed<T>::value ?
+                    type(stype(t)) ^ (type(1) << (8*sizeof(type)-1)) : type(t);
+            }
+        };
+
+        template<typename T>
+        struct radix_key<T, typename std::enable_if<std::is_floating_point<T>::value &&
+            (sizeof(T) == 4 || sizeof(T) == 8)>::type> {
+            static const bool value = true;
+            using type = typename std::conditional<sizeof(T) == 8, std::uint64_t, std::uint32_t>::type;
+
+            static type get(T t) {
+                if (t != t) return type(-1);
+                if (t == 0) t = 0;
+
+                type k;
+                std::memcpy(&k, &t, sizeof(T));
+                // Negative values: flip all bits, positive values: flip the sign bit
+                const type sign = type(1) << (8*sizeof(type)-1);
+                return (k & sign) ? ~k : (k | sign);
+            }
+        };
+
+        template<typename T>
+        using is_radix_sortable = radix_key<typename std::decay<T>::type>;
+
+        template<typename K, typename I>
+        struct radix_entry {
+            K key;
+            I id;
+        };
+
+        // Sort the pairs in 'a', using 'b' as temporary storage, 8 bits at a time. Passes where
+        // all the keys share the same digit are skipped. Returns the sorted array.
+        template<typename K, typename I>
+        std::vector<radix_entry<K,I>>& radix_sort_(std::vector<radix_entry<K,I>>& a,
+            std::vector<radix_entry<K,I>>& b, bool par) {
+
+            const uint_t n = a.size();
+            const uint_t nd = sizeof(K);
+            const uint_t nc = parallel::use(n, par) ?
+                std::min(parallel::chunks(n), 4*parallel::threads()) : 1;
+            const uint_t g = (n + nc - 1)/nc;
+
+            // Histograms of all the digits, for each chunk
+            std::vector<uint_t> hist(nc*nd*256);
+            parallel::run(nc, [&](uint_t c) {
+                uint_t* h = &hist[c*nd*256];
+                for (uint_t i = c*g, i1 = std::min(n, c*g + g); i < i1; ++i) {
+                    K k = a[i].key;
+                    for (uint_t d = 0; d < nd; ++d) {
+                        ++h[d*256 + ((k >> (8*d)) & 0xff)];
+                    }
+                }
+            });
+
+            std::vector<uint_t> total(nd*256), offset(nc*256);
+            for (uint_t c = 0; c < nc; ++c)
+            for (uint_t j = 0; j < nd*256; ++j) {
+                total[j] += hist[c*nd*256 + j];
+            }
+
+            auto* src = &a;
+            auto* dst = &b;
+            bool moved = false;
+            for (uint_t d = 0; d < nd; ++d) {
+                bool trivial = false;
+                for (uint_t j = 0; j < 256; ++j) {
+                    if (total[d*256 + j] == n) {
+                        trivial = true;
+                        break;
+                    }
+                }
+
+                if (trivial) continue;
+
+                if (moved && nc > 1) {
+                    // The order changed since the histograms were computed, so the per-chunk
+                    // counts must be computed again for this digit
+                    parallel::run(nc, [&](uint_t c) {
+                        uint_t* h = &hist[c*nd*256 + d*256];
+                        std::fill(h, h + 256, uint_t(0));
+                        for (uint_t i = c*g, i1 = std::min(n, c*g + g); i < i1; ++i) {
+                            ++h[((*src)[i].key >> (8*d)) & 0xff];
+                        }
+                    });
+                }
+
+                // Each chunk writes its elements after those of the previous chunks with the
+                // same digit, which keeps the sort stable
+                uint_t o = 0;
+                for (uint_t j = 0; j < 256; ++j)
+                for (uint_t c = 0; c < nc; ++c) {
+                    offset[c*256 + j] = o;
+                    o += hist[c*nd*256 + d*256 + j];
+                }
+
+                parallel::run(nc, [&](uint_t c) {
+                    uint_t* off = &offset[c*256];
+                    for (uint_t i = c*g, i1 = std::min(n, c*g + g); i < i1; ++i) {
+                        const auto& e = (*src)[i];
+                        (*dst)[off[(e.key >> (8*d)) & 0xff]++] = e;
+                    }
+                });
+
+                std::swap(src, dst);
+                moved = true;
+            }
+
+            return *src;
+        }
+
+        template<typename I, std::size_t Dim, typename Type>
+        void radix_argsort_(const vec<Dim,Type>& v, vec1u& r, bool par) {
+            using rkey = is_radix_sortable<meta::rtype_t<Type>>;
+            using entry = radix_entry<typename rkey::type, I>;
+
+            const uint_t n = v.size();
+            std::vector<entry> a(n), b(n);
+            if (parallel::use(n, par)) {
+                parallel::for_chunks(n, parallel::grain, [&](uint_t i0, uint_t i1) {
+                    for (uint_t i = i0; i < i1; ++i) {
+                        a[i].key = rkey::get(v.safe[i]);
+                        a[i].id = i;
+                    }
+                });
+            } else {
+                for (uint_t i : range(n)) {
+                    a[i].key = rkey::get(v.safe[i]);
+                    a[i].id = i;
+                }
+            }
+
+            const std::vector<entry>& s = radix_sort_(a, b, par);
+
+            r.resize(n);
+            for (uint_t i : range(n)) {
+                r.safe[i] = s[i].id;
+            }
+        }
+
+        // Stable argsort of an arithmetic vector, same result as std::stable_sort (NaNs last)
+        template<std::size_t Dim, typename Type>
+        vec1u radix_argsort(const vec<Dim,Type>& v, bool par) {
+            vec1u r;
+            // Use 32 bit indices when possible, to keep the pairs small
+            if (v.size() <= std::numeric_limits<std::uint32_t>::max()) {
+                radix_argsort_<std::uint32_t>(v, r, par);
+            } else {
+                radix_argsort_<uint_t>(v, r, par);
+            }
+
+            return r;
+        }
+
+        // Below this size, std::stable_sort is faster
+        static const uint_t radix_min_size = 256;
+    }
+    }
+
     // In a sorted vector, return the first indices of each non unique sequence, effectively returning
     // indices to all values that are different in the vector.
     // By construction, the returned indices point to sorted values in the original vector.
@@ -372,35 +585,188 @@ namespace phypp {
         return r;
     }
 
+    namespace impl {
+        // Key type used to hash the values, void if not supported
+        template<typename T1, typename T2, typename enable = void>
+        struct match_hash_key {
+            using type = void;
+        };
+
+        template<typename T1, typename T2>
+        struct match_hash_key<T1, T2, typename std::enable_if<
+            std::is_arithmetic<T1>::value && std::is_arithmetic<T2>::value>::type> {
+            using type = typename std::common_type<T1,T2>::type;
+        };
+
+        template<>
+        struct match_hash_key<std::string, std::string> {
+            using type = std::string;
+        };
+
+        // Equality used by all the join strategies: both values are converted to the key type
+        // first, if there is one
+        template<typename T1, typename T2>
+        bool match_equal_(const T1& a, const T2& b, std::true_type) {
+            return a == b;
+        }
+
+        template<typename T1, typename T2>
+        bool match_equal_(const T1& a, const T2& b, std::false_type) {
+            using key_t = typename match_hash_key<T1,T2>::type;
+            return key_t(a) == key_t(b);
+        }
+
+        template<typename T1, typename T2>
+        bool match_equal(const T1& a, const T2& b) {
+            return match_equal_(a, b,
+                std::is_same<typename match_hash_key<T1,T2>::type, void>{});
+        }
+
+        // Join strategies for match(). Each stores in 'best[i]' the index of the first element
+        // of 'v2' equal to 'v1[i]', or npos if there is none.
+        template<std::size_t D1, std::size_t D2, typename Type1, typename Type2>
+        void match_nested_(const vec<D1,Type1>& v1, const vec<D2,Type2>& v2,
+            std::vector<uint_t>& best) {
+            for (uint_t i : range(v1))
+            for (uint_t j : range(v2)) {
+                if (match_equal(v1.safe[i], v2.safe[j])) {
+                    best[i] = j;
+                    break;
+                }
+            }
+        }
+
+        template<std::size_t D1, std::size_t D2, typename Type1, typename Type2>
+        void match_hash_(const vec<D1,Type1>& v1, const vec<D2,Type2>& v2,
+            std::vector<uint_t>& best) {
+            using key_t = typename match_hash_key<meta::rtype_t<Type1>, meta::rtype_t<Type2>>::type;
+            static_assert(!std::is_same<key_t,void>::value, "cannot hash these types");
+
+            // Only the first occurrence of each value of v2 is kept
+            std::unordered_map<key_t,uint_t> map;
+            map.reserve(v2.size());
+            for (uint_t j : range(v2)) {
+                map.emplace(key_t(v2.safe[j]), j);
+            }
+
+            for (uint_t i : range(v1)) {
+                auto iter = map.find(key_t(v1.safe[i]));
+                if (iter != map.end()) {
+                    best[i] = iter->second;
+                }
+            }
+        }
+
+        // The sorted join requires radix sortable types, and that converting them to their
+        // common type preserves the order (not the case when mixing signed and unsigned integers)
+        template<typename T1, typename T2, typename enable = void>
+        struct match_sortable : std::false_type {};
+
+        template<typename T1, typename T2>
+        struct match_sortable<T1, T2, typename std::enable_if<
+            sort_impl::is_radix_sortable<T1>::value && sort_impl::is_radix_sortable<T2>::value &&
+            (std::is_signed<T1>::value == std::is_signed<T2>::value ||
+            std::is_floating_point<typename std::common_type<T1,T2>::type>::value)>::type> :
+            std::true_type {};
+
+        // Both vectors are sorted (stable, so equal values of v2 are sorted by index) and
+        // traversed once.
+        template<std::size_t D1, std::size_t D2, typename Type1, typename Type2>
+        void match_sorted_(const vec<D1,Type1>& v1, const vec<D2,Type2>& v2,
+            std::vector<uint_t>& best) {
+            using key_t = typename match_hash_key<meta::rtype_t<Type1>, meta::rtype_t<Type2>>::type;
+
+            vec1u s1 = sort_impl::radix_argsort(v1, parallel::enabled());
+            vec1u s2 = sort_impl::radix_argsort(v2, parallel::enabled());
+
+            uint_t p = 0, q = 0;
+            const uint_t n1 = s1.size(), n2 = s2.size();
+            while (p < n1 && q < n2) {
+                uint_t i = s1.safe[p], j = s2.safe[q];
+                key_t a = v1.safe[i], b = v2.safe[j];
+                if (a < b) {
+                    ++p;
+                } else if (b < a) {
+                    ++q;
+                } else if (a == b) {
+                    best[i] = j;
+                    ++p;
+                } else {
+                    // NaN, which are sorted last
+                    break;
+                }
+            }
+        }
+
+        // Below this number of comparisons, the nested loop is fastest. The hash join is only
+        // faster than the sorted join when the hash table (built from 'v2') is much smaller than
+        // 'v1' (see test/speed/match.cpp).
+        static const uint_t match_nested_max = 4096;
+        static const uint_t match_hash_ratio = 4;
+
+        template<std::size_t D1, std::size_t D2, typename Type1, typename Type2>
+        void match_(const vec<D1,Type1>& v1, const vec<D2,Type2>& v2, std::vector<uint_t>& best,
+            std::true_type, std::true_type) {
+            // Arithmetic values
+            if (v1.size()*v2.size() <= match_nested_max) {
+                match_nested_(v1, v2, best);
+            } else if (match_hash_ratio*v2.size() <= v1.size()) {
+                match_hash_(v1, v2, best);
+            } else {
+                match_sorted_(v1, v2, best);
+            }
+        }
+
+        template<std::size_t D1, std::size_t D2, typename Type1, typename Type2>
+        void match_(const vec<D1,Type1>& v1, const vec<D2,Type2>& v2, std::vector<uint_t>& best,
+            std::true_type, std::false_type) {
+            // Other hashable values
+            if (v1.size()*v2.size() <= match_nested_max) {
+                match_nested_(v1, v2, best);
+            } else {
+                match_hash_(v1, v2, best);
+            }
+        }
+
+        template<std::size_t D1, std::size_t D2, typename Type1, typename Type2>
+        void match_(const vec<D1,Type1>& v1, const vec<D2,Type2>& v2, std::vector<uint_t>& best,
+            std::false_type, std::false_type) {
+            match_nested_(v1, v2, best);
+        }
+    }
+
     // Compare the two provided vectors and push indices where the two match into 'id1' and 'id2'.
     // If both 'v1' and 'v2' are only composed of unique values, this function is symmetric. Else,
     // only the index of the first value of 'v2' that matches that of 'v1' is stored.
+    // Depending on the type and size of the vectors, this is done with a nested loop, a hash
+    // table, or by sorting both vectors.
     template<std::size_t D1, std::size_t D2, typename Type1, typename Type2>
     void match(const vec<D1,Type1>& v1, const vec<D2,Type2>& v2, vec1u& id1, vec1u& id2) {
-        // TODO: (optimization) sort v2 and use a binary search
-        // must find the right criterion on each vector's size to see
-        // when this is profitable
-
-        uint_t n1 = v1.size();
-        uint_t n2 = v2.size();
-        uint_t n = std::min(n1, n2);
-
-        id1.data.reserve(n/2 + id1.size());
-        id2.data.reserve(n/2 + id2.size());
+        using t1 = meta::rtype_t<Type1>;
+        using t2 = meta::rtype_t<Type2>;
+        using hashable = std::integral_constant<bool,
+            !std::is_same<typename impl::match_hash_key<t1,t2>::type, void>::value>;
+        using sortable = impl::match_sortable<t1,t2>;
+
+        std::vector<uint_t> best(v1.size(), npos);
+        impl::match_(v1, v2, best, hashable{}, sortable{});
+
+        uint_t n = 0;
+        for (uint_t j : best) {
+            n += j != npos;
+        }
 
-        for (uint_t i : range(n1))
-        for (uint_t j : range(n2)) {
-            if (v2.safe[j] == v1.safe[i]) {
+        id1.data.reserve(n + id1.size());
+        id2.data.reserve(n + id2.size());
+        for (uint_t i : range(best.size())) {
+            if (best[i] != npos) {
                 id1.data.push_back(i);
-                id2.data.push_back(j);
-                break;
+                id2.data.push_back(best[i]);
             }
         }
 
         id1.dims[0] = id1.data.size();
-        id1.data.shrink_to_fit();
         id2.dims[0] = id2.data.size();
-        id2.data.shrink_to_fit();
     }
 
     template<typename T, typename enable = typename std::enable_if<!meta::is_vec<T>::value>::type>
@@ -440,6 +806,17 @@ namespace phypp {
         return r;
     }
 
+    template<std::size_t Dim, typename E>
+    impl::expr_reshape_t<1,const vec<Dim,impl::vec_expr<E>>&> flatten(
+        const vec<Dim,impl::vec_expr<E>>& v) {
+        return impl::expr_reshape_t<1,const vec<Dim,impl::vec_expr<E>>&>({{v.size()}}, v);
+    }
+
+    template<std::size_t Dim, typename E>
+    impl::expr_reshape_t<1,vec<Dim,impl::vec_expr<E>>> flatten(vec<Dim,impl::vec_expr<E>>&& v) {
+        return impl::expr_reshape_t<1,vec<Dim,impl::vec_expr<E>>>({{v.size()}}, std::move(v));
+    }
+
     template<std::size_t Dim, typename Type, typename ... Args>
     vec<meta::dim_total<Args...>::value, Type> reform(const vec<Dim,Type>& v, Args&& ... args) {
         vec<meta::dim_total<Args...>::value, Type> r;
@@ -508,12 +885,53 @@ namespace phypp {
         return r;
     }
 
+    template<std::size_t Dim, typename E, typename ... Args>
+    impl::expr_reshape_t<meta::dim_total<Args...>::value,const vec<Dim,impl::vec_expr<E>>&>
+        reform(const vec<Dim,impl::vec_expr<E>>& v, Args&& ... args) {
+        using rtype = impl::expr_reshape_t<meta::dim_total<Args...>::value,
+            const vec<Dim,impl::vec_expr<E>>&>;
+        typename rtype::dim_type d;
+        impl::set_array(d, std::forward<Args>(args)...);
+        uint_t nsize = 1;
+        for (uint_t i : range(meta::dim_total<Args...>::value)) {
+            nsize *= d[i];
+        }
+
+        phypp_check(v.size() == nsize,
+            "incompatible dimensions ("+strn(v.dims)+" vs "+strn(d)+")");
+
+        return rtype(d, v);
+    }
+
+    template<std::size_t Dim, typename E, typename ... Args>
+    impl::expr_reshape_t<meta::dim_total<Args...>::value,vec<Dim,impl::vec_expr<E>>>
+        reform(vec<Dim,impl::vec_expr<E>>&& v, Args&& ... args) {
+        using rtype = impl::expr_reshape_t<meta::dim_total<Args...>::value,
+            vec<Dim,impl::vec_expr<E>>>;
+        typename rtype::dim_type d;
+        impl::set_array(d, std::forward<Args>(args)...);
+        uint_t nsize = 1;
+        for (uint_t i : range(meta::dim_total<Args...>::value)) {
+            nsize *= d[i];
+        }
+
+        phypp_check(v.size() == nsize,
+            "incompatible dimensions ("+strn(v.dims)+" vs "+strn(d)+")");
+
+        return rtype(d, std::move(v));
+    }
+
     template<typename Type>
     vec<1,Type> reverse(vec<1,Type> v) {
         std::reverse(v.data.begin(), v.data.end());
         return v;
     }
 
+    template<typename E>
+    vec<1,typename E::value_type> reverse(vec<1,impl::vec_expr<E>> v) {
+        return reverse(std::move(v).concretise());
+    }
+
     template<typename Type>
     vec<2,Type> transpose(const vec<2,Type>& v) {
         vec<2,Type> r(impl::vec_nocopy_tag, v);
@@ -533,6 +951,11 @@ namespace phypp {
         return r;
     }
 
+    template<typename E>
+    vec<2,typename E::value_type> transpose(const vec<2,impl::vec_expr<E>>& v) {
+        return transpose(v.concretise());
+    }
+
     template<std::size_t Dim, typename Type = double, typename ... Args>
     vec<Dim+meta::dim_total<Args...>::value, meta::rtype_t<Type>>
         replicate(const vec<Dim,Type>& t, Args&& ... args) {
@@ -561,18 +984,85 @@ namespace phypp {
         return v;
     }
 
+    namespace impl {
+        // Stable sort of the indices 'r' by chunks, followed by rounds of pairwise merges.
+        // Since both steps are stable, the result is the same as std::stable_sort.
+        template<typename C>
+        void par_stable_sort_(vec1u& r, C comp) {
+            const uint_t n = r.size();
+            parallel::for_chunks(n, parallel::grain, [&](uint_t i0, uint_t i1) {
+                std::stable_sort(r.data.begin() + i0, r.data.begin() + i1, comp);
+            });
+
+            std::vector<uint_t> tmp(n);
+            for (uint_t w = parallel::grain; w < n; w *= 2) {
+                parallel::for_chunks(n, 2*w, [&](uint_t i0, uint_t i1) {
+                    uint_t im = std::min(i0 + w, i1);
+                    std::merge(r.data.begin() + i0, r.data.begin() + im,
+                        r.data.begin() + im, r.data.begin() + i1, tmp.begin() + i0, comp);
+                });
+
+                std::swap(r.data, tmp);
+            }
+        }
+    }
+
+    namespace impl {
+        template<std::size_t Dim, typename Type>
+        vec1u sort_(const vec<Dim,Type>& v, bool par, std::false_type) {
+            vec1u r = uindgen(v.size());
+            auto comp = [&v](uint_t i, uint_t j) {
+                return typename vec<Dim,Type>::comparator()(v.data[i], v.data[j]);
+            };
+
+            if (par) {
+                par_stable_sort_(r, comp);
+            } else {
+                std::stable_sort(r.data.begin(), r.data.end(), comp);
+            }
+
+            return r;
+        }
+
+        template<std::size_t Dim, typename Type>
+        vec1u sort_(const vec<Dim,Type>& v, bool par, std::true_type) {
+            if (v.size() >= sort_impl::radix_min_size) {
+                return sort_impl::radix_argsort(v, par);
+            } else {
+                return sort_(v, false, std::false_type{});
+            }
+        }
+
+        template<typename Type>
+        using sort_radix_t = std::integral_constant<bool,
+            sort_impl::is_radix_sortable<meta::rtype_t<Type>>::value>;
+    }
+
+    // Arithmetic values are sorted with a radix sort, other types with a merge sort.
     template<std::size_t Dim, typename Type>
-    vec1u sort(const vec<Dim,Type>& v) {
+    vec1u sort(par_t, const vec<Dim,Type>& v) {
+        return impl::sort_(v, true, impl::sort_radix_t<Type>{});
+    }
+
+    template<std::size_t Dim, typename Type, typename F>
+    vec1u sort(par_t, const vec<Dim,Type>& v, F&& comp) {
         vec1u r = uindgen(v.size());
-        std::stable_sort(r.data.begin(), r.data.end(), [&v](uint_t i, uint_t j) {
-            return typename vec<Dim,Type>::comparator()(v.data[i], v.data[j]);
+        impl::par_stable_sort_(r, [&v,&comp](uint_t i, uint_t j) {
+            return comp(v.safe[i], v.safe[j]);
         });
 
         return r;
     }
 
+    template<std::size_t Dim, typename Type>
+    vec1u sort(const vec<Dim,Type>& v) {
+        return impl::sort_(v, parallel::enabled(), impl::sort_radix_t<Type>{});
+    }
+
     template<std::size_t Dim, typename Type, typename F>
     vec1u sort(const vec<Dim,Type>& v, F&& comp) {
+        if (parallel::enabled()) return sort(par, v, std::forward<F>(comp));
+
         vec1u r = uindgen(v.size());
         std::stable_sort(r.data.begin(), r.data.end(), [&v,&comp](uint_t i, uint_t j) {
             return comp(v.safe[i], v.safe[j]);
@@ -581,9 +1071,30 @@ namespace phypp {
         return r;
     }
 
+    namespace impl {
+        template<std::size_t Dim, typename Type>
+        void inplace_sort_(vec<Dim,Type>& v, std::false_type) {
+            std::stable_sort(v.data.begin(), v.data.end(), typename vec<Dim,Type>::comparator());
+        }
+
+        template<std::size_t Dim, typename Type>
+        void inplace_sort_(vec<Dim,Type>& v, std::true_type) {
+            if (v.size() < sort_impl::radix_min_size) {
+                inplace_sort_(v, std::false_type{});
+                return;
+            }
+
+            vec1u r = sort_impl::radix_argsort(v, parallel::enabled());
+            std::vector<meta::rtype_t<Type>> t(v.begin(), v.end());
+            for (uint_t i : range(r)) {
+                v.safe[i] = t[r.safe[i]];
+            }
+        }
+    }
+
     template<std::size_t Dim, typename Type>
     void inplace_sort(vec<Dim,Type>& v) {
-        std::stable_sort(v.data.begin(), v.data.end(), typename vec<Dim,Type>::comparator());
+        impl::inplace_sort_(v, impl::sort_radix_t<Type>{});
     }
 
     template<std::size_t Dim, typename Type, typename F>
@@ -124,7 +124,7 @@ namespace phypp {
     }
 
     template<std::size_t Dim, typename Type, typename enable = typename std::enable_if<
-        std::is_same<typename std::remove_pointer<Type>::type, std::string>::value>::type>
+        std::is_same<meta::rtype_t<Type>, std::string>::value>::type>
     vec<Dim,bool> regex_match(const vec<Dim,Type>& v, const std::string& regex) {
         regex_t re;
         build_regex_(regex, re, REG_EXTENDED | REG_NOSUB);
@@ -502,7 +502,7 @@ namespace phypp {
     #define VECTORIZE(name) \
         template<std::size_t Dim, typename Type, typename ... Args, \
             typename enable = typename std::enable_if< \
-                std::is_same<typename std::remove_pointer<Type>::type, std::string>::value>::type> \
+                std::is_same<meta::rtype_t<Type>, std::string>::value>::type> \
         auto name(const vec<Dim,Type>& v, const Args& ... args) -> \
             vec<Dim,decltype(name(v[0], args...))> { \
             using ntype = decltype(name(v[0], args...)); \
@@ -650,7 +650,7 @@ namespace phypp {
     }
 
     template<std::size_t Dim, typename Type, typename enable = typename std::enable_if<
-        std::is_same<typename std::remove_pointer<Type>::type, std::string>::value>::type>
+        std::is_same<meta::rtype_t<Type>, std::string>::value>::type>
     std::string collapse(const vec<Dim,Type>& v) {
         std::string r;
         for (auto& s : v) {
@@ -661,7 +661,7 @@ namespace phypp {
     }
 
     template<std::size_t Dim, typename Type, typename enable = typename std::enable_if<
-        std::is_same<typename std::remove_pointer<Type>::type, std::string>::value>::type>
+        std::is_same<meta::rtype_t<Type>, std::string>::value>::type>
     std::string collapse(const vec<Dim,Type>& v, const std::string& sep) {
         std::string r;
         bool first = true;
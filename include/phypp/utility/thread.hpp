@@ -3,7 +3,12 @@
 
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include "phypp/core/vec.hpp"
+#include "phypp/core/parallel.hpp"
 
 namespace phypp {
 namespace thread {
@@ -152,43 +157,64 @@ namespace thread {
         }
     };
 
+    /// Execute jobs one after the other, in the order they were pushed, in a background thread.
+    /** The thread sleeps while there is no job to execute, and wakes up as soon as a new job
+        is pushed. For independent jobs, prefer parallel::task_group or parallel::async, which
+        use the shared thread pool.
+    **/
     class worker {
-        std::atomic<bool>                      stop_on_empty_;
-        lock_free_queue<std::function<void()>> jobs_;
-        std::unique_ptr<std::thread>           thread_;
+        std::mutex                        mutex_;
+        std::condition_variable           cv_;
+        std::deque<std::function<void()>> jobs_;
+        bool                              stop_on_empty_ = false;
+        std::unique_ptr<std::thread>      thread_;
 
         void consume_loop_() {
-            while (!stop_on_empty_ || !jobs_.empty()) {
-                std::function<void()> job;
-                while (jobs_.pop(job)) {
-                    job();
-                }
+            std::unique_lock<std::mutex> l(mutex_);
+            while (true) {
+                cv_.wait(l, [this] { return stop_on_empty_ || !jobs_.empty(); });
+                if (jobs_.empty()) break;
 
-                sleep_for(0.05);
+                std::function<void()> job = std::move(jobs_.front());
+                jobs_.pop_front();
+
+                l.unlock();
+                job();
+                l.lock();
             }
         }
 
     public :
 
-        worker() : stop_on_empty_(false) {}
+        worker() = default;
 
         ~worker() {
             wait();
         }
 
         void push(std::function<void()> job) {
+            {
+                std::lock_guard<std::mutex> l(mutex_);
+                jobs_.push_back(std::move(job));
+            }
+
             if (!thread_) {
                 thread_ = std::unique_ptr<std::thread>(new std::thread(
                     &worker::consume_loop_, this
                 ));
             }
 
-            jobs_.push(std::move(job));
+            cv_.notify_one();
         }
 
         void wait() {
             if (thread_ && thread_->joinable()) {
-                stop_on_empty_ = true;
+                {
+                    std::lock_guard<std::mutex> l(mutex_);
+                    stop_on_empty_ = true;
+                }
+
+                cv_.notify_one();
                 thread_->join();
                 thread_ = nullptr;
                 stop_on_empty_ = false;
@@ -0,0 +1,97 @@
+#include <phypp.hpp>
+
+namespace speed_test {
+    template<std::size_t D, typename T>
+    vec1u sort1(const vec<D,T>& v) {
+        vec1u r = uindgen(v.size());
+        std::stable_sort(r.begin(), r.end(), [&v](uint_t i, uint_t j) {
+            return v.safe[i] < v.safe[j];
+        });
+        return r;
+    }
+
+    template<typename F>
+    uint_t join(F&& f, uint_t n1) {
+        std::vector<uint_t> best(n1, npos);
+        f(best);
+        uint_t n = 0;
+        for (uint_t j : best) {
+            n += j != npos;
+        }
+
+        return n;
+    }
+}
+
+int phypp_main(int argc, char* argv[]) {
+    uint_t n1 = 1000000;
+    uint_t n2 = 1000000;
+    uint_t navg = 1;
+    uint_t threads = 1;
+    bool nested = false;
+
+    read_args(argc, argv, arg_list(n1, n2, navg, threads, nested));
+
+    parallel::set_threads(threads);
+
+    auto seed = make_seed(42);
+    vec1u id1 = randomi(seed, 0, 4*n2, n1);
+    vec1u id2 = randomi(seed, 0, 4*n2, n2);
+    vec1d x = randomn(seed, n1);
+
+    // Sorting: stable sort of indices, radix sort (integers and floats)
+    uint_t res = 0;
+    double t = profile([&]() {
+        res += speed_test::sort1(id1)[0];
+    }, navg);
+    print("sort (stable_sort, integers): ", t);
+
+    t = profile([&]() {
+        res += sort(id1)[0];
+    }, navg);
+    print("sort (radix, integers):       ", t);
+
+    t = profile([&]() {
+        res += speed_test::sort1(x)[0];
+    }, navg);
+    print("sort (stable_sort, floats):   ", t);
+
+    t = profile([&]() {
+        res += sort(x)[0];
+    }, navg);
+    print("sort (radix, floats):         ", t);
+
+    // Join strategies
+    uint_t nm = 0;
+    if (nested) {
+        t = profile([&]() {
+            nm = speed_test::join([&](std::vector<uint_t>& b) {
+                impl::match_nested_(id1, id2, b);
+            }, n1);
+        }, navg);
+        print("match (nested): ", t, " (", nm, " matches)");
+    }
+
+    t = profile([&]() {
+        nm = speed_test::join([&](std::vector<uint_t>& b) {
+            impl::match_hash_(id1, id2, b);
+        }, n1);
+    }, navg);
+    print("match (hash):   ", t, " (", nm, " matches)");
+
+    t = profile([&]() {
+        nm = speed_test::join([&](std::vector<uint_t>& b) {
+            impl::match_sorted_(id1, id2, b);
+        }, n1);
+    }, navg);
+    print("match (sorted): ", t, " (", nm, " matches)");
+
+    t = profile([&]() {
+        vec1u i1, i2;
+        match(id1, id2, i1, i2);
+        nm = i1.size();
+    }, navg);
+    print("match (auto):   ", t, " (", nm, " matches)");
+
+    return res == npos;
+}
@@ -0,0 +1,68 @@
+#include <phypp.hpp>
+
+namespace speed_test {
+    // Naive i-j-k loop
+    vec2d product1(const vec2d& a, const vec2d& b) {
+        vec2d r(a.dims[0], b.dims[1]);
+        for (uint_t i : range(a.dims[0]))
+        for (uint_t j : range(b.dims[1]))
+        for (uint_t k : range(a.dims[1])) {
+            r.safe(i,j) += a.safe(i,k)*b.safe(k,j);
+        }
+
+        return r;
+    }
+
+    // Blocked kernel, without BLAS
+    vec2d product2(const vec2d& a, const vec2d& b) {
+        vec2d r(a.dims[0], b.dims[1]);
+        const uint_t o = a.dims[1];
+        impl::simd::gemm(r.dims[0], r.dims[1], o, a.data.data(), o, 1,
+            b.data.data(), r.dims[1], 1, r.data.data());
+        return r;
+    }
+}
+
+int phypp_main(int argc, char* argv[]) {
+    uint_t n = 500;
+    uint_t navg = 1;
+    bool naive = true;
+
+    read_args(argc, argv, arg_list(n, navg, naive));
+
+    auto seed = make_seed(42);
+    vec2d a = randomn(seed, n, n);
+    vec2d b = randomn(seed, n, n);
+    vec1d x = randomn(seed, n);
+
+    double res = 0.0;
+    double t;
+    if (naive) {
+        t = profile([&]() {
+            res += speed_test::product1(a, b)(0,0);
+        }, navg);
+        print("product (naive):   ", t);
+    }
+
+    t = profile([&]() {
+        res += speed_test::product2(a, b)(0,0);
+    }, navg);
+    print("product (blocked): ", t);
+
+    t = profile([&]() {
+        res += matrix::product(a, b)(0,0);
+    }, navg);
+    print("product (auto):    ", t);
+
+    t = profile([&]() {
+        res += matrix::product_transpose(a)(0,0);
+    }, navg);
+    print("product_transpose: ", t);
+
+    t = profile([&]() {
+        res += matrix::product(a, x)[0] + matrix::product(x, a)[0];
+    }, navg);
+    print("product (vector):  ", t);
+
+    return res == 0.0;
+}
@@ -0,0 +1,87 @@
+#include <phypp.hpp>
+#include <phypp/math/mpfit.hpp>
+
+int phypp_main(int argc, char* argv[]) {
+    uint_t nfit = 2000;
+    uint_t npt = 50;
+    uint_t navg = 1;
+    uint_t threads = 1;
+
+    read_args(argc, argv, arg_list(nfit, npt, navg, threads));
+
+    parallel::set_threads(threads);
+
+    // Many small Gaussian fits
+    auto seed = make_seed(42);
+    vec1d x = rgen(-5.0, 5.0, npt);
+    vec2d y(nfit, npt);
+    for (uint_t i : range(nfit)) {
+        y(i,_) = 2.0*exp(-sqr(x - 0.3)/(2.0*sqr(0.8))) + 0.5 + 0.05*randomn(seed, npt);
+    }
+
+    vec1d p0 = {1.0, 0.0, 1.0, 0.0};
+
+    auto deviate = [&](uint_t i, const vec1d& p, vec1d& d) {
+        for (uint_t k : range(npt)) {
+            d.safe[k] = y.safe(i,k) - (p[0]*exp(-sqr(x.safe[k] - p[1])/(2.0*sqr(p[2]))) + p[3]);
+        }
+    };
+
+    auto jacobian = [&](const vec1d& p, vec2d& j) {
+        for (uint_t k : range(npt)) {
+            double dx = x.safe[k] - p[1];
+            double g = exp(-sqr(dx)/(2.0*sqr(p[2])));
+            j.safe(0,k) = -g;
+            j.safe(1,k) = -p[0]*g*dx/sqr(p[2]);
+            j.safe(2,k) = -p[0]*g*sqr(dx)/(p[2]*sqr(p[2]));
+            j.safe(3,k) = -1.0;
+        }
+    };
+
+    double res = 0.0;
+    double t = profile([&]() {
+        for (uint_t i : range(nfit)) {
+            res += mpfit([&](const vec1d& p) {
+                vec1d d(npt);
+                deviate(i, p, d);
+                return d;
+            }, p0).chi2;
+        }
+    }, navg);
+    print("mpfit (finite differences):      ", t);
+
+    t = profile([&]() {
+        for (uint_t i : range(nfit)) {
+            res += mpfit([&](const vec1d& p) {
+                vec1d d(npt);
+                deviate(i, p, d);
+                return d;
+            }, jacobian, p0).chi2;
+        }
+    }, navg);
+    print("mpfit (explicit derivatives):    ", t);
+
+    t = profile([&]() {
+        mpfit_workspace ws(npt, p0.size());
+        for (uint_t i : range(nfit)) {
+            res += mpfit(ws, [&](const vec1d& p, vec1d& d) {
+                deviate(i, p, d);
+            }, jacobian, p0).chi2;
+        }
+    }, navg);
+    print("mpfit (workspace):               ", t);
+
+    t = profile([&]() {
+        auto r = mpfit_batch(nfit, [&](uint_t i, mpfit_workspace& ws) {
+            ws.resize(npt, p0.size());
+            return mpfit(ws, [&](const vec1d& p, vec1d& d) {
+                deviate(i, p, d);
+            }, jacobian, p0);
+        });
+
+        res += r[0].chi2;
+    }, navg);
+    print("mpfit_batch:                     ", t);
+
+    return res == 0.0;
+}
@@ -0,0 +1,60 @@
+#include <phypp.hpp>
+#include <phypp/astro/template_fit.hpp>
+
+int phypp_main(int argc, char* argv[]) {
+    uint_t nsed = 1000;
+    uint_t nlam = 2000;
+    uint_t nfilter = 30;
+    uint_t nz = 20;
+    uint_t navg = 1;
+
+    read_args(argc, argv, arg_list(nsed, nlam, nfilter, nz, navg));
+
+    struct {
+        vec2d lam, sed;
+    } lib;
+
+    auto seed = make_seed(42);
+    vec1d lam = rgen_log(0.05, 1000.0, nlam);
+    lib.lam = replicate(lam, nsed);
+    lib.sed = randomu(seed, nsed, nlam);
+
+    vec<1,astro::filter_t> filters(nfilter);
+    for (uint_t f : range(filters)) {
+        double l0 = 0.3*pow(1.2, f);
+        filters[f].lam = rgen(l0, 1.3*l0, 100);
+        filters[f].res = replicate(1.0/(0.3*l0), 100);
+        filters[f].rlam = 1.15*l0;
+    }
+
+    vec1d z = rgen(0.1, 4.0, nz);
+    vec1d d = lumdist(z, cosmo_wmap());
+
+    double res = 0.0;
+    double t = profile([&]() {
+        for (uint_t iz : range(nz)) {
+            auto tlib = lib;
+            tlib.sed = lsun2uJy(z[iz], d[iz], tlib.lam, tlib.sed);
+            tlib.lam *= (1.0 + z[iz]);
+            for (uint_t f : range(filters)) {
+                res += astro::sed2flux(filters[f], tlib.lam, tlib.sed)[0];
+            }
+        }
+    }, navg);
+    print("sed2flux (per filter): ", t);
+
+    astro::filter_operator op;
+    t = profile([&]() {
+        op = astro::make_filter_operator(filters, lam, z, d);
+    }, navg);
+    print("filter operator (build): ", t);
+
+    t = profile([&]() {
+        for (uint_t iz : range(nz)) {
+            res += astro::sed2flux(op, lib.sed, iz)(0,0);
+        }
+    }, navg);
+    print("filter operator (apply): ", t);
+
+    return res == 0.0;
+}
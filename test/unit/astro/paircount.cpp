@@ -0,0 +1,82 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+vec1u brute_pair_count(const vec1d& ra1, const vec1d& dec1, const vec1d& ra2,
+    const vec1d& dec2, const vec2d& bins, bool self) {
+    vec1u counts(bins.dims[1]);
+    for (uint_t i : range(ra1))
+    for (uint_t j : range(self ? i+1 : 0, ra2.size())) {
+        double d = angdist(ra1[i], dec1[i], ra2[j], dec2[j]);
+        for (uint_t b : range(counts)) {
+            if (d >= bins(0,b) && d < bins(1,b)) {
+                ++counts[b];
+                break;
+            }
+        }
+    }
+
+    return counts;
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    auto seed = make_seed(42);
+    vec1d ra = 150.0 + 0.2*randomu(seed, 2000);
+    vec1d dec = 2.0 + 0.2*randomu(seed, 2000);
+    vec1d rra = 150.0 + 0.2*randomu(seed, 2000);
+    vec1d rdec = 2.0 + 0.2*randomu(seed, 2000);
+
+    // Clustered sources
+    vec1u cid = uindgen(500) + 1500;
+    ra[cid] = 150.1 + randomn(seed, 500)*0.001;
+    dec[cid] = 2.1 + randomn(seed, 500)*0.001;
+
+    vec2d bins = e10(make_bins(log10(1.0), log10(300.0), 12));
+    vec2d gbins = {{0.0, 10.0, 50.0}, {5.0, 30.0, 5000.0}};
+
+    for (uint_t nthread : {1, 4}) {
+        parallel::set_threads(nthread);
+
+        check(pair_count(ra, dec, bins), brute_pair_count(ra, dec, ra, dec, bins, true));
+        check(pair_count(ra, dec, gbins), brute_pair_count(ra, dec, ra, dec, gbins, true));
+        check(pair_count(ra, dec, rra, rdec, bins),
+            brute_pair_count(ra, dec, rra, rdec, bins, false));
+    }
+
+    // Same as the brute force estimator
+    vec1u dd = brute_pair_count(ra, dec, ra, dec, bins, true);
+    vec1u dr = brute_pair_count(ra, dec, rra, rdec, bins, false);
+    vec1u rr = brute_pair_count(rra, rdec, rra, rdec, bins, true);
+    double norm1 = rra.size()/double(ra.size());
+    double norm2 = norm1*((rra.size() - 1.0)/(ra.size() - 1.0));
+    vec1d w0 = ((2.0*dd*norm2 - dr*norm1) + (2.0*rr - dr*norm1))/(2.0*rr);
+
+    vec1d w = angcorrel(ra, dec, rra, rdec, bins);
+    check(max(abs(w - w0)) < 1e-12, true);
+
+    // Jackknife: removing a region is the same as not having it in the first place
+    vec1u reg = floor(4*(ra - 150.0)/0.2001);
+    vec1u rreg = floor(4*(rra - 150.0)/0.2001);
+    vec2d wjk;
+    vec1d w2 = angcorrel(ra, dec, rra, rdec, bins, reg, rreg, wjk);
+    check(max(abs(w2 - w0)) < 1e-12, true);
+    check(wjk.dims[0], 4u);
+
+    bool same = true;
+    for (uint_t k : range(4)) {
+        vec1u id = where(reg != k), rid = where(rreg != k);
+        vec1d wk = angcorrel(ra[id], dec[id], rra[rid], rdec[rid], bins);
+        same = same && max(abs(wk - wjk(k,_))) < 1e-12;
+    }
+
+    check(same, true);
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+#include <phypp.hpp>
+#include <phypp/astro/qstack.hpp>
+#include <phypp/test/unit_test.hpp>
+
+// Reference implementation: cutouts taken from the image in memory
+vec2f ref_cutout(const vec2f& img, double x, double y, uint_t hsize) {
+    long x0 = round(x-hsize) - 1, y0 = round(y-hsize) - 1;
+    vec2f cut = replicate(fnan, 2*hsize+1, 2*hsize+1);
+    for (long cy = 0; cy < long(2*hsize+1); ++cy)
+    for (long cx = 0; cx < long(2*hsize+1); ++cx) {
+        long ty = y0 + cy, tx = x0 + cx;
+        if (ty >= 0 && ty < long(img.dims[0]) && tx >= 0 && tx < long(img.dims[1])) {
+            cut.safe(cy,cx) = img.safe(ty,tx);
+        }
+    }
+
+    return cut;
+}
+
+fits::header make_header(uint_t nx, uint_t ny, double rx, double ry) {
+    make_wcs_header_params p;
+    p.pixel_scale = 1.0;
+    p.sky_ref_ra = 150.0;
+    p.sky_ref_dec = 2.0;
+    p.pixel_ref_x = rx;
+    p.pixel_ref_y = ry;
+    p.dims_x = nx;
+    p.dims_y = ny;
+
+    fits::header hdr;
+    make_wcs_header(p, hdr);
+    return hdr;
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    file::mkdir("out");
+
+    const uint_t nx = 300, ny = 200, hsize = 5;
+    auto seed = make_seed(42);
+    vec2f img = randomn(seed, ny, nx);
+    vec2f wht = 1.0 + randomu(seed, ny, nx);
+    img(30-_-33,40-_-43) = fnan;
+
+    fits::header hdr = make_header(nx, ny, 150.0, 100.0);
+    fits::write("out/qstack_img.fits", img, hdr);
+    fits::write("out/qstack_wht.fits", wht, hdr);
+
+    // Random positions, some on the edges or outside of the image
+    astro::wcs w(hdr);
+    vec1d x = -10 + (nx + 20)*randomu(seed, 2000), y = -10 + (ny + 20)*randomu(seed, 2000);
+    vec1d ra, dec;
+    xy2ad(w, x, y, ra, dec);
+    ad2xy(w, ra, dec, x, y);
+
+    for (bool keep_nan : {false, true}) {
+        qstack_params p;
+        p.keep_nan = keep_nan;
+        p.save_offsets = true;
+
+        vec3f cube1, cube2;
+        vec1u ids1, ids2;
+        qstack_output o1 = qstack(ra, dec, "out/qstack_img.fits", hsize, cube1, ids1, p);
+        p.thread = 3;
+        qstack_output o2 = qstack(ra, dec, "out/qstack_img.fits", hsize, cube2, ids2, p);
+
+        check(ids1, ids2);
+        check(count(cube1 != cube2 && is_finite(cube1)), 0u);
+        check(o1.dx, o2.dx);
+
+        bool good = true;
+        uint_t nref = 0;
+        for (uint_t i : range(ra)) {
+            long x0 = round(x[i]-hsize), y0 = round(y[i]-hsize);
+            long x1 = round(x[i]+hsize), y1 = round(y[i]+hsize);
+            if (x1 < 1 || x0 >= long(nx) || y1 < 1 || y0 >= long(ny)) continue;
+
+            vec2f cut = ref_cutout(img, x[i], y[i], hsize);
+            if (!keep_nan && count(!is_finite(cut)) != 0) continue;
+
+            good = good && nref < ids1.size() && ids1[nref] == i &&
+                count(cube1(nref,_,_) != cut && is_finite(cut)) == 0 &&
+                count(is_finite(cube1(nref,_,_)) != is_finite(cut)) == 0;
+            ++nref;
+        }
+
+        check(good, true);
+        check(nref, ids1.size());
+    }
+
+    // With a weight map
+    {
+        qstack_params p;
+        vec3f cube1, wcube1, cube2, wcube2;
+        vec1u ids1, ids2;
+        qstack(ra, dec, "out/qstack_img.fits", "out/qstack_wht.fits", hsize, cube1, wcube1, ids1, p);
+        p.thread = 3;
+        qstack(ra, dec, "out/qstack_img.fits", "out/qstack_wht.fits", hsize, cube2, wcube2, ids2, p);
+
+        check(ids1, ids2);
+        check(cube1, cube2);
+        check(wcube1, wcube2);
+        for (uint_t k : range(ids1)) {
+            uint_t i = ids1[k];
+            check(cube1(k,_,_), ref_cutout(img, x[i], y[i], hsize));
+            check(wcube1(k,_,_), ref_cutout(wht, x[i], y[i], hsize));
+        }
+    }
+
+    // Sectioned image, with overlapping sections
+    {
+        const uint_t nx1 = 160;
+        fits::write("out/qstack_s1.fits", img(_,0-_-(nx1-1)), make_header(nx1, ny, 150.0, 100.0));
+        fits::write("out/qstack_s2.fits", img(_,140-_-(nx-1)), make_header(nx-140, ny, 10.0, 100.0));
+        ascii::write_table("out/qstack.sectfits", 0, vec1s{"qstack_s1.fits", "qstack_s2.fits"});
+
+        qstack_params p;
+        p.save_section = true;
+        vec3f cube1, cube2;
+        vec1u ids1, ids2;
+        qstack(ra, dec, "out/qstack_img.fits", hsize, cube1, ids1, p);
+        p.thread = 3;
+        qstack_output o2 = qstack(ra, dec, "out/qstack.sectfits", hsize, cube2, ids2, p);
+
+        check(ids2.size(), ids1.size());
+        check(o2.sect.size(), ids2.size());
+        vec1u s1 = sort(ids1), s2 = sort(ids2);
+        check(ids1[s1], ids2[s2]);
+        check(cube1(s1,_,_), cube2(s2,_,_));
+    }
+
+    // Streaming cutouts and online stacking
+    {
+        qstack_params p;
+        vec3f cube;
+        vec1u ids;
+        qstack(ra, dec, "out/qstack_img.fits", hsize, cube, ids, p);
+
+        p.thread = 3;
+        vec1u sids;
+        bool same = true;
+        astro::qstack_accumulator acc(hsize, {0.5});
+        qstack_stream<float>(ra, dec, "out/qstack_img.fits", hsize,
+            [&](const qstack_cutout<float>& c) {
+                sids.push_back(c.id);
+                uint_t k = where_first(ids == c.id);
+                same = same && k != npos && count(cube(k,_,_) != c.flux) == 0;
+                acc.add(c.flux);
+            }, p);
+
+        check(same, true);
+        check(sids[sort(sids)], ids);
+        check(acc.count(), ids.size());
+        check(max(abs(acc.mean() - qstack_mean(cube))) < 1e-5, true);
+        vec2d m = partial_mean(0, vec3d(cube));
+        check(max(abs(acc.variance() - (partial_mean(0, sqr(vec3d(cube))) - m*m))) < 1e-4, true);
+        check(max(abs(acc.median() - qstack_median(cube))) < 0.15, true);
+
+        // With weights
+        vec3f wcube;
+        qstack(ra, dec, "out/qstack_img.fits", "out/qstack_wht.fits", hsize, cube, wcube, ids, p);
+        astro::qstack_accumulator wacc(hsize);
+        qstack_stream<float>(ra, dec, "out/qstack_img.fits", "out/qstack_wht.fits", hsize,
+            [&](const qstack_cutout<float>& c) {
+                wacc.add(c.flux, c.weight);
+            }, p);
+
+        check(wacc.count(), ids.size());
+        check(max(abs(wacc.mean() - qstack_mean(cube, wcube))) < 1e-5, true);
+
+        // Cutouts with bad pixels: these are ignored, like a batch stack with zero weights
+        {
+            vec3d ncube = cube;
+            vec3d nwcube = wcube;
+            auto nseed = make_seed(42);
+            vec1u bad = where(randomu(nseed, ncube.size()) < 0.1);
+            ncube.safe[bad[uindgen(bad.size()/2)]] = dnan;
+            nwcube.safe[bad[uindgen(bad.size() - bad.size()/2) + bad.size()/2]] = dnan;
+
+            astro::qstack_accumulator nacc(hsize, {0.5});
+            astro::qstack_accumulator nwacc(hsize);
+            for (uint_t k : range(ids)) {
+                nacc.add(ncube(k,_,_).concretise());
+                nwacc.add(ncube(k,_,_).concretise(), nwcube(k,_,_).concretise());
+            }
+
+            vec3d gcube = ncube;
+            vec3d gwcube = nwcube;
+            vec1u nbad = where(!is_finite(ncube));
+            vec1u wbad = where(!is_finite(ncube) || !is_finite(nwcube));
+            gcube.safe[nbad] = 0.0;
+            vec3d ucube = replicate(1.0, cube.dims);
+            ucube.safe[nbad] = 0.0;
+            gwcube.safe[wbad] = 0.0;
+            vec3d gfcube = ncube;
+            gfcube.safe[wbad] = 0.0;
+
+            check(count(!is_finite(nacc.mean())), 0u);
+            check(max(abs(nacc.mean() - qstack_mean(gcube, ucube))) < 1e-5, true);
+            check(max(abs(nwacc.mean() - qstack_mean(gfcube, gwcube))) < 1e-5, true);
+            check(max(abs(nacc.median() - qstack_median(ncube))) < 0.15, true);
+        }
+
+        // Bootstrap
+        auto bseed = make_seed(42);
+        astro::qstack_bootstrap_accumulator<> bacc(hsize, 10, 0.5, bseed);
+        for (uint_t k : range(ids)) {
+            bacc.add(cube(k,_,_).concretise());
+        }
+
+        vec3d bmean = bacc.mean();
+        check(bmean.dims[0], 10u);
+        check(bmean.dims[1], 2*hsize+1);
+        check(count(!is_finite(bmean)), 0u);
+
+        // Same realizations whatever the order of the sources
+        bseed = make_seed(42);
+        astro::qstack_bootstrap_accumulator<> racc(hsize, 10, 0.5, bseed);
+        for (uint_t k : range(ids)) {
+            uint_t rk = ids.size()-1-k;
+            racc.add(rk, cube(rk,_,_).concretise());
+        }
+
+        same = true;
+        for (uint_t b : range(10)) {
+            same = same && racc.realization(b).count() == bacc.realization(b).count();
+        }
+
+        check(same, true);
+        check(max(abs(racc.mean() - bmean)) < 1e-5, true);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include <phypp.hpp>
+#include <phypp/astro/qxmatch.hpp>
+#include <phypp/test/unit_test.hpp>
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    // Positions close to the pole and across RA=0/360
+    auto seed = make_seed(42);
+    vec1d ra1 = 360*randomu(seed, 3000), dec1 = 90 - 20*randomu(seed, 3000);
+    vec1d ra2 = 360*randomu(seed, 2000), dec2 = 90 - 20*randomu(seed, 2000);
+    ra1[0] = 359.9999; dec1[0] = 0.0;
+    ra2[0] = 0.0001;   dec2[0] = 0.0;
+
+    for (uint_t thread : {1, 3})
+    for (uint_t nth : {1, 3}) {
+        qxmatch_params p;
+        p.nth = nth;
+        p.thread = thread;
+
+        qxmatch_res r1 = qxmatch(ra1, dec1, ra2, dec2, p);
+        qxmatch_res s1 = qxmatch(ra1, dec1, p);
+        p.brute_force = true;
+        qxmatch_res r2 = qxmatch(ra1, dec1, ra2, dec2, p);
+        qxmatch_res s2 = qxmatch(ra1, dec1, p);
+
+        check(r1.id, r2.id);
+        check(r1.rid, r2.rid);
+        check(max(abs(r1.d - r2.d)) < 1e-6, true);
+        check(max(abs(r1.rd - r2.rd)) < 1e-6, true);
+        check(s1.id, s2.id);
+        check(max(abs(s1.d - s2.d)) < 1e-6, true);
+    }
+
+    check(qxmatch(ra1, dec1, ra2, dec2).id(0,0), 0u);
+
+    // Reusing the same index for several catalogs
+    sky_index idx(ra2, dec2);
+    for (uint_t i = 0; i < 3; ++i) {
+        vec1d tra = 360*randomu(seed, 100), tdec = 90 - 20*randomu(seed, 100);
+        qxmatch_params p;
+        p.nth = 2;
+        qxmatch_res r1 = qxmatch(tra, tdec, idx, p);
+        p.brute_force = true;
+        qxmatch_res r2 = qxmatch(tra, tdec, ra2, dec2, p);
+        check(r1.id, r2.id);
+        check(r1.rid, r2.rid);
+    }
+
+    // Single position queries
+    vec1u id;
+    vec1d d;
+    idx.nearest(10.0, 85.0, 4, id, d);
+    vec1d td = angdist(ra2, dec2, 10.0, 85.0);
+    check(id, uindgen(ra2.size())[sort(td)][uindgen(4)]);
+    check(max(abs(d - td[id])) < 1e-6, true);
+    check(idx.within(10.0, 85.0, 3600.0), where(td <= 3600.0));
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
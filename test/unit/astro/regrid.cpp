@@ -0,0 +1,104 @@
+#include <phypp.hpp>
+#include <phypp/astro/regrid.hpp>
+#include <phypp/test/unit_test.hpp>
+
+fits::header make_header(uint_t nx, uint_t ny, double scale, double rx, double ry) {
+    make_wcs_header_params p;
+    p.pixel_scale = scale;
+    p.sky_ref_ra = 150.0;
+    p.sky_ref_dec = 2.0;
+    p.pixel_ref_x = rx;
+    p.pixel_ref_y = ry;
+    p.dims_x = nx;
+    p.dims_y = ny;
+
+    fits::header hdr;
+    make_wcs_header(p, hdr);
+    return hdr;
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    file::mkdir("out");
+
+    const uint_t nx = 120, ny = 80;
+    auto seed = make_seed(42);
+    vec2d img = randomn(seed, ny, nx);
+    vec1u sdims = {ny, nx};
+    fits::header hdr = make_header(nx, ny, 1.0, 60.5, 40.5);
+
+    // Same grid: nothing changes
+    {
+        regridder rg(hdr, sdims, hdr, sdims);
+        check(max(abs(rg.regrid(img) - img)) < 1e-6, true);
+
+        regrid_params p;
+        p.method = regrid_method::bilinear;
+        regridder rgb(hdr, sdims, hdr, sdims, p);
+        check(max(abs(rgb.regrid(img) - img)) < 1e-6, true);
+
+        p.method = regrid_method::lanczos;
+        regridder rgl(hdr, sdims, hdr, sdims, p);
+        check(max(abs(rgl.regrid(img) - img)) < 1e-6, true);
+    }
+
+    // Pixels twice larger: sum of 2x2 blocks
+    {
+        vec1u dims = {ny/2, nx/2};
+        fits::header hdr2 = make_header(nx/2, ny/2, 2.0, 30.5, 20.5);
+        regridder rg(hdr, sdims, hdr2, dims);
+        vec2d res = rg.regrid(img);
+
+        vec2d ref(dims[0], dims[1]);
+        for (uint_t y : range(ref.dims[0]))
+        for (uint_t x : range(ref.dims[1])) {
+            ref.safe(y,x) = img.safe(2*y,2*x) + img.safe(2*y+1,2*x) +
+                img.safe(2*y,2*x+1) + img.safe(2*y+1,2*x+1);
+        }
+
+        check(max(abs(res - ref)) < 1e-6, true);
+    }
+
+    // Shifted grid with smaller pixels, covering the whole input: flux is conserved
+    {
+        fits::header hdr2 = make_header(200, 200, 0.7, 100.3, 99.8);
+        vec1u dims = {200, 200};
+
+        regrid_params p;
+        regridder rg1(hdr, sdims, hdr2, dims, p);
+        vec2d res1 = rg1.regrid(img);
+        check(abs(total(res1) - total(img)) < 1e-6*total(abs(img)), true);
+
+        // Multithreading does not change the result
+        p.thread = 3;
+        p.stripe = 7;
+        regridder rg3(hdr, sdims, hdr2, dims, p);
+        check(rg3.regrid(img), res1);
+
+        // Regridding a region, using only the input pixels it needs
+        vec1u p0 = {40, 30}, p1 = {129, 159};
+        vec1u s0, s1;
+        check(rg3.source_region(p0, p1, s0, s1), true);
+        vec2d sub = img(s0[0]-_-s1[0], s0[1]-_-s1[1]);
+        vec2d res2(p1[0]-p0[0]+1, p1[1]-p0[1]+1);
+        rg3.regrid(sub, s0, p0, res2);
+        check(res2, res1(p0[0]-_-p1[0], p0[1]-_-p1[1]));
+
+        // Regridding from file to file, by bands of rows
+        fits::write("out/regrid_in.fits", img, hdr);
+        p.max_pixels = 1000;
+        regrid("out/regrid_in.fits", "out/regrid_out.fits", hdr2, dims, p);
+        vec2d res3;
+        fits::read("out/regrid_out.fits", res3);
+        check(res3, res1);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#include <phypp.hpp>
+#include <phypp/astro/template_fit.hpp>
+#include <phypp/test/unit_test.hpp>
+
+struct library_t {
+    vec2d lam, sed;
+};
+
+// Maximum relative difference, requiring NaN at the same places
+template<std::size_t D>
+double max_rel_diff(const vec<D,double>& a, const vec<D,double>& b) {
+    if (a.dims != b.dims || count(is_nan(a) != is_nan(b)) != 0) return dinf;
+    vec1u id = where(is_finite(a));
+    return id.empty() ? 0.0 : max(abs(a[id] - b[id])/(abs(a[id]) + 1e-10*max(abs(a[id]))));
+}
+
+// Reference: trapezoidal integral of the product of the linearly interpolated SED and filter
+// response, on the sorted union of both wavelength grids
+double sed2flux_ref(const astro::filter_t& f, const vec1d& lam, const vec1d& sed) {
+    if (f.lam.front() < lam.front() || f.lam.back() >= lam.back()) return dnan;
+
+    vec1d x = f.lam;
+    append(x, lam[where(lam > f.lam.front() && lam < f.lam.back())]);
+    inplace_sort(x);
+
+    vec1d y = interpolate(sed, lam, x)*interpolate(f.res, f.lam, x);
+    return integrate(x, y);
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    // Irregular wavelength grid, smooth SEDs
+    auto seed = make_seed(42);
+    const uint_t nsed = 15, nlam = 500;
+    vec1d lam = rgen_log(0.1, 200.0, nlam);
+    lam[uindgen(nlam/2)*2+1] *= 1.0 + 0.001*randomu(seed, nlam/2);
+
+    library_t lib;
+    lib.lam = replicate(lam, nsed);
+    lib.sed.resize(nsed, nlam);
+    for (uint_t s : range(nsed)) {
+        lib.sed(s,_) = 1e10*exp(-sqr(log10(lam) - 0.1*s)/0.3)*(1.0 + 0.05*randomn(seed, nlam));
+    }
+
+    // Filters with irregular responses, including filters partly or fully outside of the grid
+    vec<1,astro::filter_t> filters(8);
+    for (uint_t f : range(filters)) {
+        double l0 = 0.2*pow(2.0, f);
+        filters[f].lam = rgen(l0, 1.5*l0, 37 + 3*f);
+        filters[f].res = 1.0 + 0.5*randomu(seed, filters[f].lam.size());
+        filters[f].res /= integrate(filters[f].lam, filters[f].res);
+        filters[f].rlam = 1.25*l0;
+    }
+
+    filters[6].lam = rgen(150.0, 300.0, 20);
+    filters[6].res = replicate(1.0/150.0, 20);
+    filters[7].lam = rgen(0.05, 0.3, 20);
+    filters[7].res = replicate(1.0/0.25, 20);
+
+    // Analytic case: unit grid, sed = lam^2 and a flat filter over [2.5, 5.5]
+    {
+        vec1d ulam = dindgen(11);
+        vec1d used = sqr(ulam);
+        astro::filter_t f;
+        f.lam = {2.5, 5.5};
+        f.res = {1.0/3.0, 1.0/3.0};
+
+        // 0.5*0.5*(6.5 + 9) + 0.5*(9 + 16) + 0.5*(16 + 25) + 0.5*0.5*(25 + 30.5)
+        double expected = 50.75/3.0;
+        check(abs(astro::sed2flux(f, ulam, used) - expected) < 1e-12, true);
+        check(abs(astro::sed2flux(astro::make_filter_operator(vec<1,astro::filter_t>{f}, ulam),
+            used)[0] - expected) < 1e-12, true);
+    }
+
+    // Random filters: same result as the reference integral
+    {
+        bool same = true;
+        for (uint_t f : range(6)) {
+            double r = sed2flux_ref(filters[f], lam, lib.sed(2,_));
+            same = same && abs(astro::sed2flux(filters[f], lam, lib.sed(2,_)) - r) < 1e-12*abs(r);
+        }
+
+        check(same, true);
+    }
+
+    // Observer frame: same result as sed2flux() for each filter
+    {
+        vec2d ref(nsed, filters.size());
+        for (uint_t f : range(filters)) {
+            ref(_,f) = astro::sed2flux(filters[f], lib.lam, lib.sed);
+        }
+
+        check(count(is_nan(ref(_,6))), nsed);
+        check(count(is_nan(ref(_,7))), nsed);
+
+        astro::filter_operator op = astro::make_filter_operator(filters, lam);
+        check(op.nz(), 1u);
+        check(max_rel_diff(ref, astro::sed2flux(op, lib.sed)) < 1e-12, true);
+
+        vec2f fsed = lib.sed;
+        check(max_rel_diff(ref, astro::sed2flux(op, fsed)) < 1e-6, true);
+        check(max_rel_diff(ref(3,_).concretise(), astro::sed2flux(op, lib.sed(3,_))) < 1e-12,
+            true);
+
+        // Filter starting on the first wavelength of the grid
+        astro::filter_t f0;
+        f0.lam = rgen(lam[0], 2*lam[0], 10);
+        f0.res = replicate(1.0/lam[0], 10);
+        double r0 = astro::sed2flux(f0, lam, lib.sed(0,_));
+        check(abs(r0 - sed2flux_ref(f0, lam, lib.sed(0,_))) < 1e-12*r0, true);
+        check(abs(astro::sed2flux(astro::make_filter_operator(vec<1,astro::filter_t>{f0}, lam),
+            lib.sed(0,_))[0] - r0) < 1e-12*r0, true);
+
+        // Sparse: only the wavelengths covered by each filter are stored
+        check(op.weight.size() < nlam*filters.size()/4, true);
+    }
+
+    // Grid of redshifts: same result as moving the library to the observer frame
+    {
+        vec1d z = {0.0, 0.3, 1.0, 2.5};
+        vec1d d = lumdist(z, cosmo_wmap());
+        d[0] = 1e-5;
+
+        astro::filter_operator op = astro::make_filter_operator(filters, lam, z, d);
+        check(op.nz(), 4u);
+
+        bool same = true;
+        for (uint_t iz : range(z)) {
+            library_t tlib = lib;
+            tlib.sed = lsun2uJy(z[iz], d[iz], tlib.lam, tlib.sed);
+            tlib.lam *= 1.0 + z[iz];
+
+            vec2d ref(nsed, filters.size());
+            for (uint_t f : range(filters)) {
+                ref(_,f) = astro::sed2flux(filters[f], tlib.lam, tlib.sed);
+            }
+
+            same = same && max_rel_diff(ref, astro::sed2flux(op, lib.sed, iz)) < 1e-12 &&
+                max_rel_diff(ref, astro::template_observed(lib, z[iz], d[iz], filters)) < 1e-12;
+        }
+
+        check(same, true);
+    }
+
+    // Libraries with one grid per SED use sed2flux() directly
+    {
+        library_t tlib = lib;
+        tlib.lam(0,_) *= 1.01;
+        check(impl::template_fit_impl::shared_lam_grid(lib.lam), true);
+        check(impl::template_fit_impl::shared_lam_grid(tlib.lam), false);
+
+        vec2d ref(nsed, filters.size());
+        for (uint_t f : range(filters)) {
+            ref(_,f) = astro::sed2flux(filters[f], tlib.lam, tlib.sed);
+        }
+
+        check(max_rel_diff(ref, astro::template_observed(tlib, filters)), 0.0);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
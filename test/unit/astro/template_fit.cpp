@@ -0,0 +1,118 @@
+#include <phypp.hpp>
+#include <phypp/astro/template_fit.hpp>
+#include <phypp/test/unit_test.hpp>
+
+struct library_t {
+    vec2d lam, sed;
+};
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    // Gaussian templates and box filters
+    const uint_t nsed = 20, nlam = 300, nfilter = 6;
+    library_t lib;
+    lib.lam.resize(nsed, nlam);
+    lib.sed.resize(nsed, nlam);
+    for (uint_t t : range(nsed)) {
+        lib.lam(t,_) = rgen_log(0.1, 100.0, nlam);
+        lib.sed(t,_) = 1e10*exp(-sqr(log10(lib.lam(t,_)) - 0.05*t)/0.5);
+    }
+
+    vec<1,astro::filter_t> filters(nfilter);
+    for (uint_t f : range(filters)) {
+        filters[f].lam = rgen(0.3 + 0.5*f, 0.6 + 0.5*f, 50);
+        filters[f].res = replicate(1.0/0.3, 50);
+        filters[f].rlam = 0.45 + 0.5*f;
+    }
+
+    // Sources at a few redshifts
+    auto seed = make_seed(42);
+    const uint_t nsrc = 40;
+    vec1d z = 0.5 + 0.25*(uindgen(nsrc) % 5);
+    vec1d d = lumdist(z, cosmo_wmap());
+    vec2d flux(nsrc, nfilter), err(nsrc, nfilter);
+    for (uint_t i : range(nsrc)) {
+        vec2d tf = astro::template_observed(lib, z[i], d[i], filters);
+        flux(i,_) = (1.0 + 0.1*randomn(seed))*tf(i % nsed,_);
+        err(i,_) = 0.1*flux(i,_) + 0.01*max(flux(i,_));
+        flux(i,_) += err(i,_)*randomn(seed, nfilter);
+    }
+
+    for (bool ulim : {false, true}) {
+        astro::template_fit_params p;
+        p.nsim = 50;
+        p.renorm = true;
+        p.ulim = ulim;
+
+        vec2d terr = err;
+        if (ulim) terr(_,0) *= -1.0;
+
+        // Same best fit as fitting the sources one by one
+        parallel::set_threads(4);
+        auto bseed = make_seed(7);
+        auto res = astro::template_fit_batch(lib, bseed, z, d, flux, terr, filters, p);
+        check(res.size(), nsrc);
+
+        bool same = true;
+        for (uint_t i : range(nsrc)) {
+            auto r = astro::template_fit(lib, seed, z[i], d[i], flux(i,_).concretise(),
+                terr(i,_).concretise(), filters, p);
+            same = same && r.bfit == res[i].bfit && res[i].amp_sim.size() == p.nsim &&
+                max(abs(r.chi2 - res[i].chi2)/(1.0 + abs(r.chi2))) < 1e-6 &&
+                max(abs(r.flux - res[i].flux)/abs(r.flux)) < 1e-6;
+        }
+
+        check(same, true);
+
+        // Random realizations do not depend on the number of threads
+        parallel::set_threads(1);
+        bseed = make_seed(7);
+        auto res1 = astro::template_fit_batch(lib, bseed, z, d, flux, terr, filters, p);
+        same = true;
+        for (uint_t i : range(nsrc)) {
+            same = same && count(res1[i].amp_sim != res[i].amp_sim) == 0 &&
+                count(res1[i].sed_sim != res[i].sed_sim) == 0;
+        }
+
+        check(same, true);
+    }
+
+    // Odd number of filters: same realizations as drawing one simulation at a time
+    {
+        vec<1,astro::filter_t> ofilters = filters[uindgen(5)];
+        astro::template_fit_params p;
+        p.nsim = 20;
+        p.renorm = true;
+
+        vec1d of = flux(3,_-4).concretise(), oe = err(3,_-4).concretise();
+        auto oseed = make_seed(11);
+        auto r = astro::template_fit(lib, oseed, z[3], d[3], of, oe, ofilters, p);
+
+        vec2d tf = astro::template_observed(lib, z[3], d[3], ofilters);
+        vec1d w = 1.0/sqr(oe);
+        oseed = make_seed(11);
+        bool same = r.amp_sim.size() == p.nsim;
+        for (uint_t i = 0; i < p.nsim && same; ++i) {
+            vec1d fsim = of + randomn(oseed, of.size())*oe;
+            vec1d amp(nsed), chi2(nsed);
+            for (uint_t t : range(nsed)) {
+                amp[t] = total(w*fsim*tf(t,_))/total(w*sqr(tf(t,_)));
+                chi2[t] = total(w*sqr(fsim - amp[t]*tf(t,_)));
+            }
+
+            uint_t ised = min_id(chi2);
+            same = r.sed_sim[i] == ised && abs(r.amp_sim[i] - amp[ised]) < 1e-10*abs(amp[ised]);
+        }
+
+        check(same, true);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
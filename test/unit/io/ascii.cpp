@@ -0,0 +1,142 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    file::mkdir("out");
+
+    // Header, blank lines, placeholders and groups of columns
+    {
+        std::ofstream f("out/ascii_simple.txt");
+        f << "# header\n# id1 id2\n  0    0\n  1    1\n2    3   \n  3  \t5\n  \n  4\t   9";
+    }
+
+    {
+        check(ascii::find_skip("out/ascii_simple.txt"), 2u);
+
+        vec1i i1, i2;
+        ascii::read_table("out/ascii_simple.txt", 2, i1, i2);
+        check(i1, (vec1i{0, 1, 2, 3, 4}));
+        check(i2, (vec1i{0, 1, 3, 5, 9}));
+
+        vec1i i2b;
+        ascii::read_table("out/ascii_simple.txt", 2, _, i2b);
+        check(i2b, i2);
+
+        vec2i ids;
+        ascii::read_table("out/ascii_simple.txt", 2, ascii::columns(2, ids));
+        check(ids(_,0), i1);
+        check(ids(_,1), i2);
+
+        vec2i i2d;
+        ascii::read_table("out/ascii_simple.txt", 2, ascii::columns(1, _, i2d));
+        check(i2d(_,0), i2);
+
+        // Skipping all the lines leaves the columns empty
+        vec1i i3 = {1, 2};
+        ascii::read_table("out/ascii_simple.txt", 8, i3);
+        check(i3.empty(), true);
+    }
+
+    // Number formats
+    {
+        std::ofstream f("out/ascii_numbers.txt");
+        f << "1.5 -2 nan str\n+3e2 4 INF- a\n.5 +5 NULL b\n5. -0 -inf c\n"
+             "0.1 -7 123456789012345678901234567890 d\n";
+    }
+
+    {
+        vec1d d;
+        vec1i i;
+        vec1f f;
+        vec1s s;
+        ascii::read_table("out/ascii_numbers.txt", 0, d, i, f, s);
+        check(d, (vec1d{1.5, 300.0, 0.5, 5.0, 0.1}));
+        check(i, (vec1i{-2, 4, 5, 0, -7}));
+        check(is_nan(f[0]) && is_nan(f[2]), true);
+        check(f[1] == -finf && f[3] == -finf, true);
+        check(f[4], 1.23456789012345678901234567890e29f);
+        check(s, (vec1s{"str", "a", "b", "c", "d"}));
+    }
+
+    // Large file, read in several chunks, compared to strtod()
+    {
+        const uint_t n = 300000;
+        auto seed = make_seed(42);
+        vec1d v = randomn(seed, n)*e10(randomu(seed, n)*20 - 10);
+        vec1s sv(n);
+        {
+            std::ofstream f("out/ascii_large.txt");
+            f << "# value id\n";
+            for (uint_t k : range(n)) {
+                char buf[64];
+                std::snprintf(buf, 64, (k % 2 == 0 ? "%.17g" : "%.6e"), v[k]);
+                sv[k] = buf;
+                f << buf << " " << k << "\n";
+                if (k % 1000 == 0) f << "\n";
+            }
+        }
+
+        vec1d rv;
+        vec1u rid;
+        ascii::read_table("out/ascii_large.txt", 1, rv, rid);
+        check(rid, uindgen(n));
+
+        bool same = rv.size() == n;
+        for (uint_t k = 0; same && k < n; ++k) {
+            same = rv[k] == std::strtod(sv[k].c_str(), nullptr);
+        }
+
+        check(same, true);
+    }
+
+    // Writing: same text as strn(), aligned on the header
+    {
+        vec1d d = {1.5, -2.0, dnan, 1e12, 0.1, -0.0};
+        vec1f f = {0.1f, 3e6f, -finf, 1.0f/3.0f, 123456.0f, 1e-10f};
+        vec1i i = {0, -1, 2147483647, -2147483647-1, 10, 5};
+        vec1s s = {"a", "bb", "ccc", "", "e", "f"};
+        vec2u c = {{1,2}, {3,4}, {5,6}, {7,8}, {9,10}, {11,12}};
+        ascii::write_table_hdr("out/ascii_write.txt", 12, {"d","f","i","s","c1","c2"},
+            d, f, i, s, c);
+
+        std::ifstream in("out/ascii_write.txt");
+        std::string line;
+        bool same = true;
+        std::getline(in, line);
+        same = same && line == "#          d           f           i           s          c1          c2";
+        std::getline(in, line);
+        same = same && line == "#";
+        for (uint_t k : range(d)) {
+            std::string ref;
+            for (std::string v : {strn(d[k]), strn(f[k]), strn(i[k]), s[k], strn(c(k,0)), strn(c(k,1))}) {
+                ref += std::string(12 - v.size(), ' ') + v;
+            }
+
+            std::getline(in, line);
+            same = same && line == ref;
+        }
+
+        check(same, true);
+
+        // Many rows, written by blocks, read back
+        const uint_t n = 100000;
+        auto seed = make_seed(42);
+        vec1d v = randomn(seed, n);
+        ascii::write_table("out/ascii_write_large.txt", 20, v, uindgen(n));
+        vec1d rv;
+        vec1u rid;
+        ascii::read_table("out/ascii_write_large.txt", 0, rv, rid);
+        check(rid, uindgen(n));
+        check(max(abs(rv - v)) < 1e-10, true);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
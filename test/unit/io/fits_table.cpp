@@ -0,0 +1,135 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+// Write a row-oriented table (one row per element), as produced by other software
+void write_row_table(const std::string& filename, const vec1u& id, const vec1d& x,
+    const vec2f& y, const vec1s& name, const vec1b& flag, const vec<1,short>& n) {
+
+    int status = 0;
+    fitsfile* fptr;
+    fits_create_file(&fptr, ("!"+filename).c_str(), &status);
+
+    const char* ttype[] = {"ID", "X", "Y", "NAME", "FLAG", "N"};
+    const char* tform[] = {"K", "D", "3E", "8A", "L", "I"};
+    fits_create_tbl(fptr, BINARY_TBL, id.size(), 6, const_cast<char**>(ttype),
+        const_cast<char**>(tform), nullptr, "TEST", &status);
+
+    vec<1,long long> tid = id;
+    fits_write_col(fptr, TLONGLONG, 1, 1, 1, id.size(), tid.data.data(), &status);
+    fits_write_col(fptr, TDOUBLE, 2, 1, 1, x.size(), const_cast<double*>(x.data.data()), &status);
+    fits_write_col(fptr, TFLOAT, 3, 1, 1, y.size(), const_cast<float*>(y.data.data()), &status);
+
+    std::vector<char*> tname(name.size());
+    for (uint_t i : range(name)) {
+        tname[i] = const_cast<char*>(name[i].c_str());
+    }
+    fits_write_col(fptr, TSTRING, 4, 1, 1, name.size(), tname.data(), &status);
+
+    fits_write_col(fptr, TLOGICAL, 5, 1, 1, flag.size(), const_cast<char*>(flag.data.data()), &status);
+    fits_write_col(fptr, TSHORT, 6, 1, 1, n.size(), const_cast<short*>(n.data.data()), &status);
+
+    fits_close_file(fptr, &status);
+    phypp_check(status == 0, "could not write ", filename);
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    file::mkdir("out");
+
+    const uint_t n = 50000;
+    auto seed = make_seed(42);
+    vec1u id = uindgen(n);
+    vec1d x = randomn(seed, n);
+    vec2f y = randomn(seed, n, 3);
+    vec1s name = "src"+strna(id % 1000);
+    name[2] = "";
+    vec1b flag = randomu(seed, n) > 0.5;
+    vec<1,short> num = -100 + id % 200;
+    write_row_table("out/rtable.fits", id, x, y, name, flag, num);
+
+    // Reading all the columns at once, from blocks of rows
+    {
+        vec1u rid;
+        vec1d rx;
+        vec2f ry;
+        vec1s rname;
+        vec1b rflag;
+        vec1i rnum;
+        fits::read_table("out/rtable.fits", ftable(rid, rx, ry, rname, rflag, rnum));
+        check(rid, id);
+        check(rx, x);
+        check(ry, y);
+        check(rname, name);
+        check(rflag, flag);
+        check(rnum, vec1i{num});
+
+        // Same as reading the columns one by one
+        fits::input_table tbl("out/rtable.fits");
+        vec1d sx;
+        vec1s sname;
+        tbl.read_column("x", sx);
+        tbl.read_column("name", sname);
+        check(sx, rx);
+        check(sname, rname);
+
+        // A range of rows
+        tbl.read_columns(fits::rows(100, 250), "id", rid, "y", ry);
+        check(rid, id[100-_-249]);
+        check(ry, y(100-_-249,_));
+
+        // An empty range of rows
+        tbl.read_columns(fits::rows(5, 5), "id", rid, "y", ry, "name", rname);
+        check(rid.empty(), true);
+        check(ry.empty(), true);
+        check(rname.empty(), true);
+    }
+
+    // Streaming by chunks, for row-oriented and column-oriented tables
+    {
+        fits::write_table("out/ctable.fits", "id", id, "x", x);
+
+        for (std::string fname : {"out/rtable.fits", "out/ctable.fits"}) {
+            fits::input_table tbl(fname);
+            vec1u cid;
+            vec1d cx;
+            uint_t nchunk = 0, nread = 0;
+            bool same = true;
+            tbl.for_each_chunk(7000, [&](uint_t i0) {
+                same = same && i0 == 7000*nchunk && cid.size() == cx.size() &&
+                    cid.size() == std::min(uint_t(7000), n - i0) &&
+                    count(cid != id[i0+uindgen(cid.size())]) == 0 &&
+                    count(cx != x[i0+uindgen(cx.size())]) == 0;
+                nread += cid.size();
+                ++nchunk;
+            }, "id", cid, "x", cx);
+
+            check(same, true);
+            check(nchunk, 8u);
+            check(nread, n);
+        }
+    }
+
+    // Column information from the header only
+    {
+        fits::write_table("out/btable.fits", ftable(flag, id));
+        vec<1,fits::column_info> ci = fits::read_table_columns("out/btable.fits");
+        check(ci.size(), 2u);
+        check(ci[0].type == fits::column_info::boolean, true);
+        check(ci[1].type == fits::column_info::integer, true);
+
+        ci = fits::read_table_columns("out/rtable.fits");
+        check(ci.size(), 6u);
+        check(ci[4].type == fits::column_info::boolean, true);
+        check(ci[3].type == fits::column_info::string, true);
+        check(ci[3].length, 8u);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
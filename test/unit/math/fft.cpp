@@ -1,18 +1,86 @@
 #include <phypp.hpp>
-#include <phypp/unit_test.hpp>
+#include <phypp/test/unit_test.hpp>
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
 
-int main(int argc, char* argv[]) {
     vec2d v = gaussian_profile({{41,41}}, 4.0) + 0.1*gaussian_profile({{41,41}}, 10.0);
     vec2cd cv = fft(v);
-    vec2d iv = ifft(cv)/v.size();
+    check(cv.dims[1], 21u);
+    vec2d iv = ifft(cv, 41)/v.size();
+    check(iv, v);
 
-    for (uint_t i : range(v)) {
-        check(v[i], iv[i]);
-    }
+    // The input of ifft() must not be modified
+    vec2cd cv2 = cv;
+    ifft(cv, 41);
+    check(cv == cv2, true);
 
     auto seed = make_seed(42);
-    vec2d img = randomn(seed, 1000, 1000);
-    vec2d psf = v;
+
+    // 1D and 3D transforms, odd and even sizes
+    for (uint_t n : {16, 17}) {
+        vec1d v1 = randomn(seed, n);
+        vec1cd c1 = fft(v1);
+        check(c1.dims[0], n/2 + 1);
+
+        bool good = true;
+        for (uint_t k : range(c1)) {
+            complex<double> s = 0;
+            for (uint_t i : range(v1)) {
+                s += v1[i]*std::polar(1.0, -2*dpi*k*i/double(n));
+            }
+
+            good = good && std::abs(s - c1[k]) < 1e-10;
+        }
+
+        check(good, true);
+        check(max(abs(ifft(c1, n)/n - v1)) < 1e-10, true);
+    }
+
+    vec1d v1 = randomn(seed, 12);
+    check(max(abs(ifft(fft(v1))/12.0 - v1)) < 1e-10, true);
+
+    vec3d v3 = randomn(seed, 4, 5, 6);
+    vec3cd c3 = fft(v3);
+    check(c3.dims[2], 4u);
+    check(max(abs(ifft(c3, 6)/v3.size() - v3)) < 1e-10, true);
+
+    // Batched transforms
+    vec3d cube = randomn(seed, 3, 6, 7);
+    vec3cd cc = fft_batch(cube);
+    check(cc.dims[2], 4u);
+    bool same = true;
+    for (uint_t i : range(cube.dims[0])) {
+        vec2d slice = cube(i,_,_);
+        same = same && max(abs(fft(slice) - cc(i,_,_))) < 1e-10;
+    }
+
+    check(same, true);
+    check(max(abs(ifft_batch(cc, 7)/42.0 - cube)) < 1e-10, true);
+
+    // In place transforms
+    vec2d v2 = randomn(seed, 6, 9);
+    vec2cd p2 = fft_pack(v2);
+    check(p2.dims[1], 5u);
+    check(fft_unpack(p2, 9), v2);
+    inplace_fft(p2, 9);
+    check(max(abs(p2 - fft(v2))) < 1e-10, true);
+    inplace_ifft(p2, 9);
+    check(max(abs(fft_unpack(p2, 9)/v2.size() - v2)) < 1e-10, true);
+
+    vec3cd pc = fft_pack(cube);
+    inplace_fft_batch(pc, 7);
+    check(max(abs(pc - cc)) < 1e-10, true);
+    inplace_ifft_batch(pc, 7);
+    check(max(abs(fft_unpack(pc, 7)/42.0 - cube)) < 1e-10, true);
+    vec2d img = randomn(seed, 60, 50);
+    vec2d psf = gaussian_profile({{11,11}}, 2.0);
+    psf(10,_) = 1.0;
+    psf(_,0) = -1.0;
 
     double st = now();
     vec2d cimg1 = convolve2d(img, psf);
@@ -21,13 +89,34 @@ int main(int argc, char* argv[]) {
     vec2d cimg2 = convolve2d_naive(img, psf);
     double slow = now() - st;
 
-    // TODO: investigate expected numerical precision of the FFT convolution algorithm
-    for (uint_t i : range(v)) {
-        check(cimg1[i], cimg2[i]);
+    check(max(abs(cimg1 - cimg2)) < 1e-10, true);
+
+    // Same kernel, several images (and sizes)
+    convolver conv(psf);
+    for (uint_t i = 0; i < 3; ++i) {
+        check(max(abs(conv(img) - cimg2)) < 1e-10, true);
+        img *= 2.0;
+        cimg2 *= 2.0;
     }
 
+    vec2f fimg = randomn(seed, 30, 40);
+    check(max(abs(conv(fimg) - convolve2d_naive(fimg, psf))) < 1e-5, true);
+
+    // Planning modes and wisdom
+    fft_set_planner(fft_planner::measure);
+    fft_set_threads(2);
+    check(max(abs(convolve2d(img, psf) - cimg2)) < 1e-10, true);
+    fft_set_planner(fft_planner::estimate);
+    fft_set_threads(1);
+    check(fft_save_wisdom("/tmp/phypp_fft_wisdom.txt"), true);
+    check(fft_load_wisdom("/tmp/phypp_fft_wisdom.txt"), true);
+    fft_clear_plans();
+    check(max(abs(conv(img) - cimg2)) < 1e-10, true);
+
     print("fast version: ", fast);
     print("slow version: ", slow);
 
-    return 0;
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
 }
@@ -0,0 +1,116 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+// Reference: first bin containing each value
+template<typename T, typename TB>
+vec1u bin_ref(const vec<1,T>& v, const vec<2,TB>& bins) {
+    vec1u r(v.size());
+    for (uint_t i : range(v)) {
+        r[i] = npos;
+        for (uint_t b : range(bins.dims[1])) {
+            if (in_bin(v[i], bins, b)) {
+                r[i] = b;
+                break;
+            }
+        }
+    }
+
+    return r;
+}
+
+template<typename T, typename TB>
+vec1u histogram_ref(const vec<1,T>& v, const vec<2,TB>& bins) {
+    vec1u bid = bin_ref(v, bins);
+    vec1u r(bins.dims[1]);
+    for (uint_t b : bid) {
+        if (b != npos) ++r[b];
+    }
+
+    return r;
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    auto seed = make_seed(42);
+    const uint_t n = 100000;
+    vec1d v = 12*randomu(seed, n) - 1;
+    v[uindgen(100)*7] = dnan;
+    v[uindgen(100)*11] = floor(v[uindgen(100)*11]);
+
+    // Uniform, irregular, with gaps and overlapping bins
+    vec2d ubins = make_bins(0.0, 10.0, 37);
+    vec2d ibins = make_bins(vec1d{0.0, 0.1, 0.5, 2.0, 2.1, 7.0, 10.0});
+    vec2d gbins = {{0.0, 1.0, 1.5, 4.0, 4.0}, {0.5, 1.5, 3.0, 4.0, 9.0}};
+    vec2d obins = {{5.0, 0.0, 2.0, 1.0}, {6.0, 3.0, 8.0, 1.5}};
+
+    for (uint_t t : {1u, 4u}) {
+        parallel::set_threads(t);
+
+        for (auto& bins : {ubins, ibins, gbins, obins}) {
+            vec1u ref = histogram_ref(v, bins);
+            check(histogram(v, bins), ref);
+            check(histogram(par, v, bins), ref);
+
+            // Weights
+            vec1d w = randomu(seed, n);
+            vec1u bid = bin_ref(v, bins);
+            vec1d wref(bins.dims[1]);
+            for (uint_t i : range(v)) {
+                if (bid[i] != npos) wref[bid[i]] += w[i];
+            }
+
+            check(max(abs(histogram(v, w, bins) - wref)) < 1e-8, true);
+
+            // Groups of values, in increasing order
+            bool same = true;
+            uint_t ncall = 0;
+            histogram(v, bins, [&](uint_t b, vec1u ids) {
+                same = same && ids.size() == ref[b] && count(bid[ids] != b) == 0 &&
+                    (ids.empty() || is_sorted(ids));
+                ++ncall;
+            });
+
+            check(same, true);
+            check(ncall, bins.dims[1]);
+        }
+    }
+
+    parallel::set_threads(1);
+
+    // Integer values in integer bins
+    {
+        vec1i k = randomi(seed, -2, 12, 1000);
+        vec2i bins = {{0,2,5,8,10}, {2,5,8,10,12}};
+        check(histogram(k, bins), histogram_ref(k, bins));
+        check(histogram(k, make_bins(-0.5, 9.5, 10)), histogram_ref(k, make_bins(-0.5, 9.5, 10)));
+    }
+
+    // 2D histograms
+    {
+        vec1d x = v, y = 10*randomu(seed, n);
+        vec2u counts = histogram2d(x, y, ubins, ibins);
+        vec1u bx = bin_ref(x, ubins), by = bin_ref(y, ibins);
+        vec2u ref(ubins.dims[1], ibins.dims[1]);
+        for (uint_t i : range(x)) {
+            if (bx[i] != npos && by[i] != npos) ++ref(bx[i], by[i]);
+        }
+
+        check(counts, ref);
+
+        bool same = true;
+        histogram2d(x, y, ubins, ibins, [&](uint_t i, uint_t j, vec1u ids) {
+            same = same && ids.size() == ref(i,j) && count(bx[ids] != i || by[ids] != j) == 0;
+        });
+
+        check(same, true);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+// Reference: naive triple loop, in double precision
+template<typename TA, typename TB>
+vec2d product_ref(const vec<2,TA>& a, const vec<2,TB>& b) {
+    vec2d r(a.dims[0], b.dims[1]);
+    for (uint_t i : range(a.dims[0]))
+    for (uint_t j : range(b.dims[1]))
+    for (uint_t k : range(a.dims[1])) {
+        r.safe(i,j) += double(a.safe(i,k))*double(b.safe(k,j));
+    }
+
+    return r;
+}
+
+template<typename TA, typename TB>
+bool same_matrix(const vec<2,TA>& a, const vec<2,TB>& b, double tol) {
+    return a.dims[0] == b.dims[0] && a.dims[1] == b.dims[1] &&
+        (a.empty() || max(abs(a - b)) <= tol);
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    auto seed = make_seed(42);
+
+    // Matrix products of various shapes, covering the simple loops, the blocked kernel
+    // (with partial tiles and blocks) and BLAS
+    vec2u shapes = {{1, 3, 1}, {2, 5, 7}, {13, 9, 17}, {37, 300, 21}, {70, 65, 130},
+        {130, 260, 70}, {0, 4, 3}, {4, 0, 3}};
+    for (uint_t s : range(shapes.dims[0])) {
+        uint_t n = shapes(s,0), o = shapes(s,1), m = shapes(s,2);
+        vec2d a = randomn(seed, n, o), b = randomn(seed, o, m);
+        vec2d ref = product_ref(a, b);
+        double tol = 1e-12*max(o, 1u);
+
+        check(same_matrix(matrix::product(a, b), ref, tol), true);
+        check(same_matrix(matrix::product_transpose(a, transpose(b)), ref, tol), true);
+        check(same_matrix(matrix::product(transpose(transpose(a)), b), ref, tol), true);
+
+        vec2f af = a, bf = b;
+        vec2f rf = matrix::product(af, bf);
+        check(same_matrix(rf, ref, 1e-5*max(o, 1u)), true);
+
+        // Mixed and integer types
+        vec2i ai = a*10, bi = b*10;
+        check(same_matrix(matrix::product(ai, bi), product_ref(ai, bi), 0.5), true);
+        check(same_matrix(matrix::product(af, b), product_ref(af, b), tol), true);
+
+        // Symmetric products
+        vec2d ata = matrix::product_transpose(a);
+        check(same_matrix(ata, product_ref(a, transpose(a)), tol), true);
+        check(same_matrix(ata, transpose(ata), 0.0), true);
+
+        // Matrix-vector products
+        vec1d x = randomn(seed, o), y = randomn(seed, n);
+        vec2d xm = reform(x, o, 1), ym = reform(y, 1, n);
+        check(same_matrix(reform(matrix::product(a, x), n, 1), product_ref(a, xm), tol), true);
+        check(same_matrix(reform(matrix::product(y, a), 1, o), product_ref(ym, a), tol), true);
+        vec1f xf = x;
+        check(same_matrix(reform(matrix::product(af, xf), n, 1), product_ref(a, xm),
+            1e-5*max(o, 1u)), true);
+    }
+
+    // Large matrix-vector products
+    {
+        vec2d a = randomn(seed, 300, 400);
+        vec1d x = randomn(seed, 400), y = randomn(seed, 300);
+        vec2d xm = reform(x, 400, 1), ym = reform(y, 1, 300);
+        check(same_matrix(reform(matrix::product(a, x), 300, 1), product_ref(a, xm), 1e-10), true);
+        check(same_matrix(reform(matrix::product(y, a), 1, 400), product_ref(ym, a), 1e-10), true);
+    }
+
+    // Non-square vector-matrix products
+    {
+        vec2d a = {{1, 2, 3}, {4, 5, 6}};
+        check(matrix::product(vec1d{1, 1}, a), (vec1d{5, 7, 9}));
+        check(matrix::product(a, vec1d{1, 0, 1}), (vec1d{4, 10}));
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include <phypp.hpp>
+#include <phypp/math/mpfit.hpp>
+#include <phypp/test/unit_test.hpp>
+
+// Gaussian profile on top of a constant background
+struct gauss_model {
+    vec1d x, y, ye;
+
+    void deviate(const vec1d& p, vec1d& d) const {
+        for (uint_t k : range(x)) {
+            double m = p[0]*exp(-sqr(x[k] - p[1])/(2.0*sqr(p[2]))) + p[3];
+            d[k] = (y[k] - m)/ye[k];
+        }
+    }
+
+    vec1d deviate(const vec1d& p) const {
+        vec1d d(x.size());
+        deviate(p, d);
+        return d;
+    }
+
+    void jacobian(const vec1d& p, vec2d& j) const {
+        for (uint_t k : range(x)) {
+            double dx = x[k] - p[1];
+            double g = exp(-sqr(dx)/(2.0*sqr(p[2])));
+            j(0,k) = -g/ye[k];
+            j(1,k) = -p[0]*g*dx/sqr(p[2])/ye[k];
+            j(2,k) = -p[0]*g*sqr(dx)/(p[2]*sqr(p[2]))/ye[k];
+            j(3,k) = -1.0/ye[k];
+        }
+    }
+};
+
+gauss_model make_model(std::mt19937& seed, uint_t n) {
+    gauss_model g;
+    g.x = rgen(-5.0, 5.0, n);
+    g.ye = replicate(0.05, n);
+    g.y = 2.0*exp(-sqr(g.x - 0.3)/(2.0*sqr(0.8))) + 0.5 + g.ye*randomn(seed, n);
+    return g;
+}
+
+bool same_result(const mpfit_result& r1, const mpfit_result& r2) {
+    return r1.success == r2.success && r1.reason == r2.reason && r1.iter == r2.iter &&
+        r1.chi2 == r2.chi2 && count(r1.params != r2.params) == 0 &&
+        count(r1.errors != r2.errors) == 0;
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    auto seed = make_seed(42);
+    gauss_model g = make_model(seed, 200);
+    vec1d p0 = {1.0, 0.0, 1.0, 0.0};
+
+    auto dev = [&](const vec1d& p) { return g.deviate(p); };
+    auto idev = [&](const vec1d& p, vec1d& d) { g.deviate(p, d); };
+    auto jac = [&](const vec1d& p, vec2d& j) { g.jacobian(p, j); };
+
+    // Finite differences and analytic derivatives converge to the same solution
+    mpfit_result rfd = mpfit(dev, p0);
+    mpfit_result rj = mpfit(dev, jac, p0);
+    check(rfd.success, true);
+    check(rj.success, true);
+    check(max(abs(rfd.params - rj.params)) < 1e-6, true);
+    check(max(abs(rfd.errors - rj.errors)/rj.errors) < 1e-4, true);
+    check(abs(rfd.chi2 - rj.chi2) < 1e-6*rj.chi2, true);
+    check(abs(rj.params[1] - 0.3) < 5*rj.errors[1], true);
+    check(rj.dof, 196u);
+
+    // The workspace gives the same result as a standalone fit, and can be reused
+    {
+        mpfit_workspace ws(200, 4);
+        check(same_result(mpfit(ws, idev, p0), rfd), true);
+        check(same_result(mpfit(ws, idev, jac, p0), rj), true);
+        check(same_result(mpfit(ws, dev, jac, p0), rj), true);
+        check(same_result(mpfit(ws, dev, p0), rfd), true);
+
+        // Different problem size
+        gauss_model g2 = make_model(seed, 50);
+        auto dev2 = [&](const vec1d& p) { return g2.deviate(p); };
+        check(same_result(mpfit(ws, dev2, p0), mpfit(dev2, p0)), true);
+        check(ws.npt, 50u);
+        check(same_result(mpfit(ws, dev, p0), rfd), true);
+    }
+
+    // Frozen parameters and limits
+    {
+        mpfit_options opts(4);
+        opts.frozen[3] = true;
+        opts.upper_limit[2] = 0.6;
+        vec1d p1 = {1.0, 0.0, 0.5, 0.5};
+        mpfit_result r1 = mpfit(dev, p1, opts);
+        mpfit_result r2 = mpfit(dev, jac, p1, opts);
+        check(r1.params[3], 0.5);
+        check(r2.params[3], 0.5);
+        check(r1.params[2] <= 0.6, true);
+        check(r2.params[2] <= 0.6, true);
+        check(max(abs(r1.params - r2.params)) < 1e-6, true);
+        check(r1.errors[3], 0.0);
+        check(r2.dof, 197u);
+    }
+
+    // Batch of fits: same results as sequential fits, whatever the number of threads
+    {
+        const uint_t nfit = 100;
+        std::vector<gauss_model> gs;
+        for (uint_t i = 0; i < nfit; ++i) {
+            gs.push_back(make_model(seed, 30 + i%7));
+        }
+
+        auto fit = [&](uint_t i, mpfit_workspace& ws) {
+            return mpfit(ws, [&](const vec1d& p) { return gs[i].deviate(p); },
+                [&](const vec1d& p, vec2d& j) { gs[i].jacobian(p, j); }, p0);
+        };
+
+        std::vector<mpfit_result> ref;
+        for (uint_t i = 0; i < nfit; ++i) {
+            mpfit_workspace ws;
+            ref.push_back(fit(i, ws));
+        }
+
+        for (uint_t t : {1u, 4u}) {
+            parallel::set_threads(t);
+            std::vector<mpfit_result> res = mpfit_batch(nfit, fit);
+            bool same = res.size() == nfit;
+            for (uint_t i = 0; i < nfit && same; ++i) {
+                same = same_result(res[i], ref[i]);
+            }
+
+            check(same, true);
+        }
+
+        parallel::set_threads(1);
+    }
+
+    // Wrapper for standard deviates
+    {
+        mpfit_result r = mpfitfun(g.y, g.ye, g.x, [](const vec1d& x, const vec1d& p) {
+            return p[0]*exp(-sqr(x - p[1])/(2.0*sqr(p[2]))) + p[3];
+        }, p0);
+        check(same_result(r, rfd), true);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+// Reference implementations, using a full sort
+template<typename T>
+T sorted_rank(vec<1,T> v, double u) {
+    v = v[where(is_finite(v))];
+    inplace_sort(v);
+    return v[std::min(uint_t(v.size()*u), v.size()-1)];
+}
+
+template<typename T>
+T sorted_median(vec<1,T> v) {
+    v = v[where(!is_nan(v))];
+    inplace_sort(v);
+    return v[v.size()/2];
+}
+
+double sorted_weighted_median(const vec1d& v, const vec1d& w) {
+    vec1u ids = sort(v);
+    double totw = total(w), tot = 0;
+    for (uint_t i : range(ids)) {
+        tot += w[ids[i]];
+        if (tot > totw/2.0) {
+            return v[ids[i == 0 ? 0 : i-1]];
+        }
+    }
+
+    return dnan;
+}
+
+template<typename T>
+void test_select(vec<1,T> v) {
+    check(median(v), sorted_median(v));
+    check(percentile(v, 0.3), sorted_rank(v, 0.3));
+    vec<1,T> p = percentiles(v, 0.9, 0.1, 0.5, 0.1, 1.0, 0.0);
+    vec<1,T> rp = {sorted_rank(v, 0.9), sorted_rank(v, 0.1), sorted_rank(v, 0.5),
+                   sorted_rank(v, 0.1), sorted_rank(v, 1.0), sorted_rank(v, 0.0)};
+    check(p, rp);
+
+    // In place version, on a copy
+    vec<1,T> t = v;
+    check(inplace_median(t), sorted_median(v));
+
+    // Views
+    vec1u ids = uindgen(v.size()/2)*2;
+    check(median(v[ids]), sorted_median(vec<1,T>(v[ids])));
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    auto seed = make_seed(42);
+
+    // Small and large arrays (the latter use radix selection), with NaN values, ties,
+    // negative values, and values spanning a narrow range
+    for (uint_t n : {3, 10, 101, 5000, 70001, 200000}) {
+        vec1d v = randomn(seed, n);
+        v[uindgen(n/10)*10] = dnan;
+        test_select(v);
+        test_select(vec1d(round(v*3)));
+        test_select(vec1f(v*1e3));
+        test_select(vec1d(1.0 + 1e-12*randomu(seed, n)));
+        test_select(vec1i(round(v*100)));
+    }
+
+    // Infinities are used by the median, not by the percentiles
+    vec1d vi = {1.0, 2.0, dinf, dinf, dinf};
+    check(median(vi), dinf);
+    check(percentile(vi, 0.5), 2.0);
+
+    vec1d vn = {dnan, dnan};
+    check(is_nan(median(vn)), true);
+    check(percentile(vn, 0.5), 0.0);
+    check(percentiles(vn, 0.5).empty(), true);
+
+    // Weighted median
+    for (uint_t n : {1, 2, 7, 1000, 20000}) {
+        vec1d v = round(randomn(seed, n)*10);
+        vec1d w = randomu(seed, n);
+        check(weighted_median(v, w), sorted_weighted_median(v, w));
+        check(weighted_median(v, replicate(1.0, n)), sorted_weighted_median(v, replicate(1.0, n)));
+    }
+
+    vec1d wv = {1.0, dnan, 3.0, 2.0};
+    vec1d ww = {1.0, 1.0, dnan, 1.5};
+    check(weighted_median(wv, ww), 1.0);
+
+    // Sigma clipping
+    vec1d sv = randomn(seed, 10000);
+    sv[uindgen(100)] = 1e3;
+    vec1d sv2 = sv;
+    sv2[5] = dnan;
+    check(sigma_clip(sv, 3.0), abs(sv - median(sv)) < 3.0*mad(sv));
+    check(sigma_clip(sv2, 3.0), abs(sv2 - median(sv2)) < 3.0*mad(sv2));
+
+    vec1b m = sigma_clip(sv, 3.0);
+    vec1b m2 = sigma_clip(sv, 3.0, 10);
+    for (uint_t i = 0; i < 10; ++i) {
+        vec1d tv = sv[where(m)];
+        m = abs(sv - median(tv)) < 3.0*mad(tv);
+    }
+
+    check(m2, m);
+    check(count(sigma_clip(sv, 3.0, 10)) < count(sigma_clip(sv, 3.0)), true);
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
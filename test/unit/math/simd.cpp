@@ -0,0 +1,173 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+namespace simd = phypp::impl::simd;
+
+// Reference implementations
+template<typename T>
+long double ref_sum(const vec<1,T>& v, bool skip_nan, bool sqr) {
+    long double s = 0;
+    for (T t : v) {
+        if (skip_nan && std::isnan(t)) continue;
+        s += sqr ? (long double)t*t : (long double)t;
+    }
+    return s;
+}
+
+// Bound on the rounding error of a sum of n double values
+template<typename T>
+double sum_tolerance(const vec<1,T>& v, bool sqr) {
+    long double a = 0;
+    for (T t : v) {
+        if (std::isnan(t)) continue;
+        a += sqr ? (long double)t*t : std::abs((long double)t);
+    }
+    return 2*v.size()*std::numeric_limits<double>::epsilon()*a;
+}
+
+template<typename T>
+bool same_bits(T t1, T t2) {
+    return (std::isnan(t1) && std::isnan(t2)) || std::memcmp(&t1, &t2, sizeof(T)) == 0;
+}
+
+template<typename T>
+void test_float_kernels(uint_t n, bool with_nan) {
+    auto seed = make_seed(42 + n);
+    vec<1,T> v = randomn(seed, n)*100;
+    if (with_nan && n != 0) {
+        v[n/2] = std::numeric_limits<T>::quiet_NaN();
+        v[n-1] = std::numeric_limits<T>::quiet_NaN();
+    }
+
+    // Sums: rounding errors differ from a sequential sum, but must stay within bounds
+    double s = simd::sum<false>(v.data.data(), n);
+    double rs = ref_sum(v, false, false);
+    if (with_nan && n != 0) {
+        check(std::isnan(s), true);
+    } else {
+        check(std::abs(s - rs) <= sum_tolerance(v, false), true);
+    }
+
+    s = simd::sum<true>(v.data.data(), n);
+    rs = ref_sum(v, true, false);
+    check(std::abs(s - rs) <= sum_tolerance(v, false), true);
+
+    s = simd::sum_sqr<true>(v.data.data(), n);
+    rs = ref_sum(v, true, true);
+    check(std::abs(s - rs) <= sum_tolerance(v, true), true);
+
+    // Extrema: exact
+    T mi, ma;
+    simd::minmax<true>(v.data.data(), n, mi, ma);
+    T rmi = std::numeric_limits<T>::infinity(), rma = -rmi;
+    for (T t : v) {
+        if (std::isnan(t)) continue;
+        if (t < rmi) rmi = t;
+        if (t > rma) rma = t;
+    }
+    check(same_bits(mi, rmi), true);
+    check(same_bits(ma, rma), true);
+
+    simd::minmax<false>(v.data.data(), n, mi, ma);
+    if (with_nan && n != 0) {
+        check(std::isnan(mi) && std::isnan(ma), true);
+    } else {
+        check(same_bits(mi, rmi), true);
+        check(same_bits(ma, rma), true);
+    }
+
+    // Square root: correctly rounded, hence bitwise identical
+    vec<1,T> a = abs(v);
+    vec<1,T> r(n);
+    simd::sqrt(a.data.data(), r.data.data(), n);
+    bool same = true;
+    for (uint_t i = 0; i < n; ++i) {
+        same = same && same_bits(r.safe[i], T(std::sqrt(a.safe[i])));
+    }
+    check(same, true);
+}
+
+void test_other_kernels(uint_t n) {
+    auto seed = make_seed(42 + n);
+    vec1b b = randomu(seed, n) > 0.3;
+    uint_t rc = 0;
+    for (bool t : b) rc += t;
+    check(simd::count(b.data.data(), n), rc);
+
+    vec<1,int_t> i = round(randomn(seed, n)*1e18);
+    int_t ri = 0;
+    for (int_t t : i) ri = int_t(uint_t(ri) + uint_t(t));
+    check(simd::sum<false>(i.data.data(), n), ri);
+}
+
+void test_reductions() {
+    // Public functions must agree between the SIMD path (contiguous data) and the
+    // generic path (indirect view)
+    auto seed = make_seed(42);
+    vec1d v = randomn(seed, 1001);
+    v[500] = dnan;
+    v[10] = v[20] = -10.0;
+    v[30] = v[40] = 10.0;
+    vec1u ids = uindgen(v.size());
+    auto iv = v[ids];
+    check(iv.data.is_indirect(), true);
+
+    check(min(v), min(iv));
+    check(max(v), max(iv));
+    check(min_id(v), min_id(iv));
+    check(max_id(v), max_id(iv));
+    check(minmax_ids(v).first, minmax_ids(iv).first);
+    check(minmax_ids(v).second, minmax_ids(iv).second);
+    check(min_id(v), 10u);
+    check(max_id(v), 30u);
+    check(minmax_ids(v).second, 40u);
+
+    vec1d w = v[where(is_finite(v))];
+    auto iw = w[uindgen(w.size())];
+    check(std::abs(total(w) - total(iw)) < 1e-12, true);
+    check(std::abs(mean(w) - mean(iw)) < 1e-12, true);
+    check(std::abs(rms(w) - rms(iw)) < 1e-12, true);
+    check(std::abs(stddev(w) - stddev(iw)) < 1e-12, true);
+    check(count(v > 0), count((v > 0)[ids]));
+
+    vec1f f = {dnan, dnan};
+    check(min_id(f), 0u);
+    check(max_id(f), 0u);
+    check(std::isnan(min(f)), true);
+
+    vec1u u = {1, 2, 3, 4, 5};
+    check(total(u), 15u);
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    for (simd::isa i : {simd::isa::scalar, simd::isa::sse2, simd::isa::avx2, simd::isa::avx512}) {
+        if (simd::set_isa(i) != i) continue;
+
+        print("testing instruction set ", int(i), "...");
+        uint_t old_tested = tested;
+        uint_t old_failed = failed;
+
+        for (uint_t n : {0, 1, 2, 3, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1000}) {
+            test_float_kernels<float>(n, false);
+            test_float_kernels<float>(n, true);
+            test_float_kernels<double>(n, false);
+            test_float_kernels<double>(n, true);
+            test_other_kernels(n);
+        }
+
+        test_reductions();
+
+        print("> ", tested - failed - (old_tested - old_failed), "/", tested - old_tested," passed");
+    }
+
+    print("total:");
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    // Random points in 2D, coupled to their neighbors, plus one element coupled to all the
+    // others (like the background in a PSF fit)
+    const uint_t n = 400;
+    auto seed = make_seed(42);
+    vec1d x = 100*randomu(seed, n), y = 100*randomu(seed, n);
+
+    matrix::sparse_symmetric a(n+1);
+    for (uint_t i : range(n)) {
+        a.add(i, i, 1.0 + randomu(seed));
+        a.add(i, n, 0.01*randomu(seed));
+        for (uint_t j : range(i+1, n)) {
+            double d2 = sqr(x[i] - x[j]) + sqr(y[i] - y[j]);
+            if (d2 < 36.0) {
+                a.add(i, j, 0.3*exp(-d2/10.0));
+            }
+        }
+    }
+
+    a.add(n, n, 10.0);
+
+    check(a(3,n), a(n,3));
+    check(a.dense()(n,3), a(3,n));
+
+    vec1d b = randomn(seed, n+1);
+
+    // Natural order, and order by position
+    vec1u order = sort(x);
+    order.push_back(n);
+
+    for (bool natural : {true, false}) {
+        matrix::sparse_cholesky c;
+        check(c.factorize(a, natural ? vec1u{} : order), true);
+
+        vec1d s = c.solve(b);
+        check(max(abs(a.product(s) - b)) < 1e-10, true);
+
+        // Diagonal of the inverse, compared to solving for each column of the identity
+        vec1d id = c.inverse_diagonal();
+        bool same = true;
+        for (uint_t i : range(n+1)) {
+            vec1d e(n+1);
+            e[i] = 1.0;
+            same = same && abs(c.solve(e)[i] - id[i]) < 1e-10*id[i];
+        }
+
+        check(same, true);
+    }
+
+    // Not positive definite
+    {
+        matrix::sparse_symmetric m(2);
+        m.add(0, 0, 1.0);
+        m.add(1, 1, 1.0);
+        m.add(0, 1, 2.0);
+        matrix::sparse_cholesky c;
+        check(c.factorize(m), false);
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
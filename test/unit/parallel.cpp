@@ -0,0 +1,140 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+void test_reductions(uint_t n) {
+    auto seed = make_seed(42 + n);
+    vec1d v = randomn(seed, n)*100;
+    v[n/3] = v[2*n/3] = -1000.0;
+    v[n/4] = v[3*n/4] = 1000.0;
+    v[n/2] = dnan;
+    vec1d w = v[where(is_finite(v))];
+    vec1u ids = uindgen(w.size());
+    vec<1,int_t> i = round(randomn(seed, n)*1e6);
+
+    // Same results as the sequential versions, on contiguous data and indirect views
+    check(std::abs(total(par, w) - total(w)) < 1e-9*n, true);
+    check(std::abs(total(par, w[ids]) - total(par, w)) < 1e-9*n, true);
+    check(std::abs(mean(par, w) - mean(w)) < 1e-9, true);
+    check(total(par, i), total(i));
+    check(min(par, v), min(v));
+    check(max(par, v), max(v));
+    check(min(par, v[uindgen(n)]), -1000.0);
+    check(count(par, v > 0), count(v > 0));
+    check(where(par, v > 0), where(v > 0));
+    check(sort(par, w), sort(w));
+    check(sort(par, i, [](int_t a, int_t b) { return a%7 < b%7; }),
+          sort(i, [](int_t a, int_t b) { return a%7 < b%7; }));
+
+    vec2d b = make_bins(-100.0, 100.0, 20);
+    check(histogram(par, v, b), histogram(v, b));
+
+    // Results must not depend on the number of threads
+    parallel::set_threads(1);
+    double t1 = total(par, w);
+    parallel::set_threads(4);
+    double t4 = total(par, w);
+    check(t1 == t4, true);
+
+    // Global setting
+    parallel::set_enabled(true);
+    check(total(w) == t4, true);
+    check(min_id(v), min_id(v[uindgen(n)]));
+    vec1d e = 2*v + 1;
+    parallel::set_enabled(false);
+    check(e, 2*v + 1);
+}
+
+void test_partial() {
+    auto seed = make_seed(42);
+    vec3d cube = randomn(seed, 200, 30, 40);
+    cube(10,_,_) = dnan;
+
+    check(partial_median(par, 0, cube), partial_median(0, cube));
+    check(partial_mean(par, 1, cube), partial_mean(1, cube));
+    check(partial_max(par, 2, cube), partial_max(2, cube));
+}
+
+uint_t fib(uint_t n) {
+    // Nested tasks, each waiting for its children
+    if (n < 10) return n < 2 ? n : fib(n-1) + fib(n-2);
+    auto f = parallel::async([n]() { return fib(n-1); });
+    uint_t r = fib(n-2);
+    return r + f.get();
+}
+
+void test_tasks() {
+    // Futures
+    auto f1 = parallel::async([]() { return 42; });
+    auto f2 = parallel::async([]() {});
+    f2.get();
+    check(f1.get(), 42);
+    check(fib(25), 75025u);
+
+    auto f3 = parallel::async([]() -> int { throw std::runtime_error("error"); });
+    bool thrown = false;
+    try { f3.get(); } catch (std::runtime_error&) { thrown = true; }
+    check(thrown, true);
+
+    // Task groups
+    std::atomic<uint_t> n(0);
+    {
+        parallel::task_group g;
+        for (uint_t i = 0; i < 100; ++i) {
+            g.run([&n]() { ++n; });
+        }
+        g.wait();
+    }
+    check(n.load(), 100u);
+
+    {
+        parallel::task_group g;
+        g.run([]() { thread::sleep_for(0.05); });
+        check(g.wait_for(0.0), false);
+        while (!g.wait_for(0.01)) {}
+    }
+
+    // parallel_for
+    vec1u v(1000);
+    parallel_for(range(v), 7, [&](uint_t i) {
+        // Nested
+        vec1u w(10);
+        parallel_for(range(w), 1, [&](uint_t j) { w[j] = j; });
+        v[i] = i + total(w);
+    });
+    check(v, uindgen(1000) + 45);
+
+    // Worker: jobs executed in order
+    vec1u order;
+    {
+        thread::worker w;
+        for (uint_t i = 0; i < 10; ++i) {
+            w.push([&order, i]() { order.push_back(i); });
+        }
+        w.wait();
+    }
+    check(order, uindgen(10));
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    parallel::set_threads(4);
+
+    for (uint_t n : {10, 16385, 100000}) {
+        test_reductions(n);
+    }
+
+    test_partial();
+
+    test_tasks();
+    parallel::set_threads(1);
+    test_tasks();
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#include <phypp.hpp>
+#include <phypp/test/unit_test.hpp>
+
+// Reference: stable sort of the indices
+template<std::size_t D, typename T>
+vec1u sort_ref(const vec<D,T>& v) {
+    vec1u r = uindgen(v.size());
+    std::stable_sort(r.begin(), r.end(), [&v](uint_t i, uint_t j) {
+        return v.safe[i] < v.safe[j];
+    });
+    return r;
+}
+
+// Reference: nested loop, comparing values in their common key type like match()
+template<std::size_t D1, std::size_t D2, typename T1, typename T2>
+void match_ref(const vec<D1,T1>& v1, const vec<D2,T2>& v2, vec1u& id1, vec1u& id2) {
+    using key_t = typename impl::match_hash_key<meta::rtype_t<T1>, meta::rtype_t<T2>>::type;
+    for (uint_t i : range(v1))
+    for (uint_t j : range(v2)) {
+        if (key_t(v1.safe[i]) == key_t(v2.safe[j])) {
+            id1.push_back(i);
+            id2.push_back(j);
+            break;
+        }
+    }
+}
+
+int phypp_main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "line") {
+            check_show_line = true;
+        }
+    }
+
+    auto seed = make_seed(42);
+
+    // Radix sort: same result as a stable sort, for small and large vectors, sequential
+    // and parallel
+    for (uint_t n : {10u, 1000u, 100000u}) {
+        vec1d d = randomn(seed, n);
+        d[uindgen(n/5)*4] = 0.0;
+        d[uindgen(n/10)*7] = -0.0;
+        vec1f f = d;
+        vec1i i = randomi(seed, -50, 50, n);
+        vec<1,long long> l = randomi(seed, -5000000, 5000000, n)*100000ll;
+        vec1u u = randomi(seed, 0, 1000, n);
+
+        for (uint_t t : {1u, 4u}) {
+            parallel::set_threads(t);
+            check(sort(d), sort_ref(d));
+            check(sort(f), sort_ref(f));
+            check(sort(i), sort_ref(i));
+            check(sort(l), sort_ref(l));
+            check(sort(u), sort_ref(u));
+            check(sort(par, d), sort_ref(d));
+
+            vec1d sd = d;
+            inplace_sort(sd);
+            check(sd, d[sort_ref(d)]);
+        }
+
+        parallel::set_threads(1);
+    }
+
+    // NaN values are sorted last
+    {
+        vec1d d = {3.0, dnan, -1.0, dinf, -dinf, dnan, 0.0};
+        vec1d t;
+        for (uint_t k = 0; k < 100; ++k) {
+            append(t, d);
+        }
+
+        vec1u s = sort(t);
+        check(t[s[0]], -dinf);
+        check(is_nan(t[s[s.size()-1]]), true);
+        check(count(is_nan(t[s[uindgen(500)]])), 0u);
+    }
+
+    // Unique values
+    {
+        vec1u v = randomi(seed, 0, 100, 10000);
+        vec1u u = uniq(v, sort(v));
+        check(u.size(), 101u);
+        check(v[u], uindgen(101));
+    }
+
+    // Matching: all strategies give the same result as the nested loop
+    for (uint_t n1 : {5u, 2000u, 30000u})
+    for (uint_t n2 : {3u, 3000u, 40000u}) {
+        vec1u a = randomi(seed, 0, 2*n2, n1);
+        vec1u b = randomi(seed, 0, 2*n2, n2);
+
+        vec1u e1, e2;
+        match_ref(a, b, e1, e2);
+
+        vec1u id1, id2;
+        match(a, b, id1, id2);
+        check(id1, e1);
+        check(id2, e2);
+
+        vec1i ai = a;
+        vec1d bd = b;
+        id1.clear(); id2.clear();
+        match(ai, bd, id1, id2);
+        check(id1, e1);
+        check(id2, e2);
+
+        vec1s as = strna(a), bs = strna(b);
+        id1.clear(); id2.clear();
+        match(as, bs, id1, id2);
+        check(id1, e1);
+        check(id2, e2);
+
+        std::vector<uint_t> best(n1, npos), hbest(n1, npos), sbest(n1, npos);
+        impl::match_nested_(a, b, best);
+        impl::match_hash_(a, b, hbest);
+        impl::match_sorted_(a, b, sbest);
+        check(hbest == best, true);
+        check(sbest == best, true);
+    }
+
+    // Mixing signed and unsigned values, and NaN
+    {
+        vec1i a = {-1, 2, 5, 3, -1};
+        vec1u b = {3, 2, uint_t(-1)};
+        vec1u id1, id2;
+        match(a, b, id1, id2);
+        vec1u e1, e2;
+        match_ref(a, b, e1, e2);
+        check(id1, e1);
+        check(id2, e2);
+
+        vec1d c = replicate(dnan, 2000);
+        c[1500] = 1.0;
+        vec1d d = flatten(replicate(vec1d{dnan, 1.0, 2.0}, 1000));
+        id1.clear(); id2.clear();
+        match(c, d, id1, id2);
+        check(id1, (vec1u{1500}));
+        check(id2, (vec1u{1}));
+    }
+
+    print("> ", tested - failed, "/", tested," passed");
+
+    return failed == 0u ? 0 : 1;
+}
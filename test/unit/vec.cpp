@@ -1000,7 +1000,138 @@ void test_vec_operator() {
 
     const generator<T> gen;
 
-    // TODO
+    {
+        // Arithmetic operators return lazy expressions
+        vec<1,T> v1 = {gen[0], gen[1], gen[2], gen[3]};
+        vec<1,T> v2 = {gen[4], gen[5], gen[6], gen[7]};
+
+        using rtype = meta::concrete_t<decltype(v1 + v2)>;
+
+        rtype r1 = v1 + v2 + v1;
+        check(r1.size(), 4u);
+        for (uint_t i = 0; i < 4; ++i) {
+            check(r1[i], v1[i] + v2[i] + v1[i]);
+        }
+
+        auto e = v1 + v2;
+        check(e.dims[0], 4u);
+        check(e.size(), 4u);
+        check(e.view_same(v1[_]), true);
+        check(e.view_same(v2(_)), true);
+        check(e.view_same(r1[_]), false);
+        for (uint_t i = 0; i < 4; ++i) {
+            check(e[i], v1[i] + v2[i]);
+            check(e.safe[i], v1[i] + v2[i]);
+        }
+
+        rtype s = (v1 + v2)[vec1u{3,0}];
+        check(s.size(), 2u);
+        check(s[0], v1[3] + v2[3]);
+        check(s[1], v1[0] + v2[0]);
+        check((v1 + v2).concretise(), rtype(e));
+
+        // Operands that are also the destination are handled
+        rtype r2 = r1;
+        r2 = r2[vec1u{3,2,1,0}] + r2;
+        for (uint_t i = 0; i < 4; ++i) {
+            check(r2[i], r1[3-i] + r1[i]);
+        }
+
+        r2 = r1;
+        r2[vec1u{3,2,1,0}] = r2 + r2[0];
+        for (uint_t i = 0; i < 4; ++i) {
+            check(r2[3-i], r1[i] + r1[0]);
+        }
+    }
+
+    print("> ", tested - failed - (old_tested - old_failed), "/", tested - old_tested," passed");
+}
+
+template<typename T>
+void test_vec_view() {
+    print("test_vec_view...");
+
+    uint_t old_tested = tested;
+    uint_t old_failed = failed;
+
+    const generator<T> gen;
+
+    vec<3,T> v(2,3,4);
+    for (uint_t i = 0; i < v.size(); ++i) {
+        v[i] = gen[i%12];
+    }
+
+    {
+        // Regular slices are stored as strides, not as one pointer per element
+        check(v(1,_,_).data.is_indirect(),       false);
+        check(v(_,2,_).data.is_indirect(),       false);
+        check(v(_,_,3).data.is_indirect(),       false);
+        check(v(_,1-_-2,1-_-2).data.is_indirect(), false);
+        check(v[_].data.is_indirect(),           false);
+        check(v(_,vec1u{0,2},1).data.is_indirect(), true);
+
+        for (uint_t j = 0; j < 3; ++j)
+        for (uint_t k = 0; k < 4; ++k) {
+            check(v(1,_,_)(j,k), v(1,j,k));
+        }
+
+        for (uint_t i = 0; i < 2; ++i)
+        for (uint_t k = 0; k < 4; ++k) {
+            check(v(_,2,_)(i,k), v(i,2,k));
+        }
+
+        for (uint_t i = 0; i < 2; ++i)
+        for (uint_t j = 0; j < 3; ++j) {
+            check(v(_,_,3)(i,j), v(i,j,3));
+        }
+
+        auto sv = v(_,1-_-2,1-_-2);
+        check(sv.dims[0], 2u);
+        check(sv.dims[1], 2u);
+        check(sv.dims[2], 2u);
+        for (uint_t i = 0; i < 2; ++i)
+        for (uint_t j = 0; j < 2; ++j)
+        for (uint_t k = 0; k < 2; ++k) {
+            check(sv(i,j,k), v(i,j+1,k+1));
+        }
+
+        uint_t n = 0;
+        for (auto& t : sv) {
+            check(t, sv[n]);
+            ++n;
+        }
+        check(n, sv.size());
+    }
+
+    {
+        // View of a view
+        vec<3,T> v1 = v;
+        auto sv = v1(1,_,_);
+        check(sv(_,2).data.is_indirect(), false);
+        check(sv(1,_).data.is_indirect(), false);
+        for (uint_t j = 0; j < 3; ++j) {
+            check(sv(j,_), v1(1,j,_));
+        }
+        for (uint_t k = 0; k < 4; ++k) {
+            check(sv(_,k), v1(1,_,k));
+        }
+
+        sv(_,2) = gen[11];
+        for (uint_t j = 0; j < 3; ++j) {
+            check(v1(1,j,2), gen[11]);
+        }
+    }
+
+    {
+        // Modifying the view itself falls back to a list of pointers
+        vec<3,T> v1 = v;
+        auto sv = v1(_,1,_);
+        vec<1,T> tmp = sv[_];
+        std::reverse(sv.data.begin(), sv.data.end());
+        check(sv.data.is_indirect(), true);
+        check(sv[0], tmp[tmp.size()-1]);
+        check(v1, v);
+    }
 
     print("> ", tested - failed - (old_tested - old_failed), "/", tested - old_tested," passed");
 }
@@ -1019,6 +1150,7 @@ void test() {
     test_vec_convert<T>();
     test_vec_iterator<T>();
     test_vec_operator<T>();
+    test_vec_view<T>();
     print(" ");
 }
 
@@ -309,6 +309,49 @@ int phypp_main(int argc, char* argv[]) {
         vec2d nv;
         fits::read("out/image_saved.fits", nv);
         check(count(nv != v) == 0, "1");
+
+        print("FITS mapped image");
+        fits::mapped_image<2,double> mimg("data/image.fits");
+        check(mimg.is_mapped(), "1");
+        check(mimg.dims, "{161, 161}");
+        check(mimg(80,79) == v(80,79), "1");
+        vec1u p0 = {10, 20}, p1 = {59, 29};
+        mimg.prefetch(p0, p1);
+        vec2d sv;
+        mimg.read_subset(p0, p1, sv);
+        check(count(sv != v(10-_-59,20-_-29)) == 0, "1");
+        check(count(mimg.view(p0, p1) != sv) == 0, "1");
+        mimg.read(nv);
+        check(count(nv != v) == 0, "1");
+
+        fits::mapped_image<2,float> fimg("data/image.fits");
+        check(fimg.is_mapped(), "0");
+        check(fimg(80,79) == float(v(80,79)), "1");
+
+        print("FITS tiled image processing");
+        fits::tile_params tp;
+        tp.width = 50; tp.height = 40; tp.halo = 5;
+        fits::tile_reader<double> tin("data/image.fits", tp);
+        check(tin.size(), "20");
+        fits::tile<double> t = tin.read(5);
+        check(t.c0, "{40, 50}");
+        check(t.p0, "{35, 45}");
+        check(t.data.dims, "{50, 60}");
+        check(count(t.core() != v(40-_-79,50-_-99)) == 0, "1");
+
+        uint_t ntile = 0;
+        while (tin.next(t)) ++ntile;
+        check(ntile, "20");
+
+        {
+            fits::tile_writer<double> tout("out/image_tiled.fits", tin.dims());
+            fits::for_each_tile(tin, tout, [](fits::tile<double>& tt) {
+                tt.data *= 2.0;
+            });
+        }
+
+        fits::read("out/image_tiled.fits", nv);
+        check(count(nv != 2.0*v) == 0, "1");
     }
 
     {
@@ -2,6 +2,44 @@
 
 void print_help();
 
+void make_regions(uint_t n, const vec1d& rra, const vec1d& rdec, const vec1d& ra,
+    const vec1d& dec, vec1u& rreg, vec1u& reg) {
+
+    // Boundaries of the Dec strips
+    vec1d sdec = rdec[sort(rdec)];
+    vec1d dec_edges(n-1);
+    for (uint_t i : range(dec_edges)) {
+        dec_edges[i] = sdec[(i+1)*sdec.size()/n];
+    }
+
+    auto find_bin = [](const vec1d& edges, double v) -> uint_t {
+        return std::upper_bound(edges.begin(), edges.end(), v) - edges.begin();
+    };
+
+    vec1u rstrip(rra.size()), strip(ra.size());
+    for (uint_t i : range(rra)) rstrip[i] = find_bin(dec_edges, rdec[i]);
+    for (uint_t i : range(ra))  strip[i]  = find_bin(dec_edges, dec[i]);
+
+    // Boundaries along RA in each strip
+    rreg.resize(rra.size());
+    reg.resize(ra.size());
+    for (uint_t s : range(n)) {
+        vec1u rid = where(rstrip == s);
+        vec1u id = where(strip == s);
+        if (rid.empty()) continue;
+
+        vec1d sra = rra[rid];
+        sra = sra[sort(sra)];
+        vec1d ra_edges(n-1);
+        for (uint_t i : range(ra_edges)) {
+            ra_edges[i] = sra[(i+1)*sra.size()/n];
+        }
+
+        for (uint_t i : rid) rreg[i] = s*n + find_bin(ra_edges, rra[i]);
+        for (uint_t i : id)  reg[i]  = s*n + find_bin(ra_edges, ra[i]);
+    }
+}
+
 int phypp_main(int argc, char* argv[]) {
     if (argc <= 2) {
         print_help();
@@ -22,8 +60,14 @@ int phypp_main(int argc, char* argv[]) {
     uint_t nbin = 10;
     std::string out_file = "angcorrel.fits";
     uint_t tseed = 42;
+    uint_t nrand = 0;
+    uint_t jackknife = 0;
+    uint_t thread = 1;
+
+    read_args(argc-2, argv+2, arg_list(range, nbin, name(out_file, "out"), name(tseed, "seed"),
+        nrand, jackknife, thread));
 
-    read_args(argc-2, argv+2, arg_list(range, nbin, name(out_file, "out"), name(tseed, "seed")));
+    parallel::set_threads(thread);
 
     vec2d bins = e10(make_bins(log10(range[0]), log10(range[1]), nbin));
     vec1d ang = 0.5*(bins(0,_) + bins(1,_));
@@ -36,6 +80,7 @@ int phypp_main(int argc, char* argv[]) {
     vec1d rra, rdec;
     uint_t nsrc = cat.ra.size();
     if (nsrc < 1000) nsrc = 1000;
+    if (nrand != 0) nsrc = nrand;
     auto seed = make_seed(tseed);
 
     auto status = randpos_uniform_box(seed, nsrc,
@@ -50,9 +95,24 @@ int phypp_main(int argc, char* argv[]) {
         return 1;
     }
 
-    vec1d w = angcorrel(cat.ra, cat.dec, rra, rdec, bins);
+    if (jackknife == 0) {
+        vec1d w = angcorrel(cat.ra, cat.dec, rra, rdec, bins);
+        fits::write_table(out_file, ftable(bins, w, ang));
+    } else {
+        // Split the field in regions of equal area: first in strips of constant Dec
+        // containing the same number of random positions, then each strip along RA
+        vec1u reg, rreg;
+        make_regions(jackknife, rra, rdec, cat.ra, cat.dec, rreg, reg);
+
+        vec2d wjk;
+        vec1d w = angcorrel(cat.ra, cat.dec, rra, rdec, bins, reg, rreg, wjk);
 
-    fits::write_table(out_file, ftable(bins, w, ang));
+        uint_t nreg = wjk.dims[0];
+        vec1d w_err = sqrt((nreg - 1.0)/nreg*partial_total(0,
+            sqr(wjk - replicate(partial_mean(0, wjk), nreg))));
+
+        fits::write_table(out_file, ftable(bins, w, w_err, ang));
+    }
 
     return 0;
 }
@@ -61,12 +121,14 @@ void print_help() {
     using namespace format;
 
     print("angcorrel v1.0");
-    paragraph("usage: angcorrel cat.fits refcat.fits [range,nbin,out,seed]");
+    paragraph("usage: angcorrel cat.fits refcat.fits [range,nbin,out,seed,nrand,jackknife,thread]");
     paragraph("Compute the angular two point correlation function of a given catalog "
         "'cat.fits'. The correlation is calculated using the Landy-Szalay estimator, by "
         "comparing against a random uniform distribution of points generated within the "
         "boundaries of the catalog 'refcat.fits'. The correlation function is written in "
-        "a FITS file as column 'W', in units of counts per arcsec.");
+        "a FITS file as column 'W', in units of counts per arcsec. If requested, the "
+        "uncertainty on the correlation function is estimated by jackknife resampling and "
+        "written in column 'W_ERR'.");
 
     header("List of available command line options:");
     bullet("range", "[float,float] angular range within which to compute the correlation "
@@ -75,4 +137,11 @@ void print_help() {
     bullet("out", "[string] output file name (default: angcorrel.fits)");
     bullet("seed", "[unsigned integer] random seed for the generation of the random "
         "uniform positions (default: 42)");
+    bullet("nrand", "[unsigned integer] number of random positions (default: same as the "
+        "number of sources in 'cat.fits', or 1000 if there are fewer)");
+    bullet("jackknife", "[unsigned integer] split the field in NxN regions of equal area "
+        "to estimate the uncertainty on the correlation function by jackknife resampling "
+        "(default: 0, no uncertainty)");
+    bullet("thread", "[unsigned integer] number of concurrent threads used to count pairs "
+        "(default: 1)");
 }
@@ -64,16 +64,41 @@ bool convolve(int argc, char* argv[]) {
         return true;
     }
 
-    vec2d map = fits::read(argv[1]);
     vec2d kernel = fits::read(argv[2]);
     if (normalize) {
         kernel /= total(kernel);
     }
 
-    map = convolve2d(map, kernel);
+    // Process the map by tiles, each with enough margin to convolve its pixels exactly
+    fits::tile_params tp;
+    tp.halo = std::max(kernel.dims[0], kernel.dims[1])/2;
+    fits::tile_reader<double> map(argv[1], tp);
+
+    // Convolvers are not thread safe, so each tile borrows one from this pool. At most one
+    // convolver is created per thread, and the transformed kernel, the FFT plans and the
+    // buffers are reused for all the tiles of the same dimensions.
+    std::mutex pool_mutex;
+    std::vector<std::unique_ptr<convolver>> pool;
 
     file::mkdir(file::get_directory(argv[3]));
-    fits::write(argv[3], map);
+    fits::tile_writer<double> out(argv[3], map.dims());
+    fits::for_each_tile(map, out, [&](fits::tile<double>& t) {
+        std::unique_ptr<convolver> conv;
+        {
+            std::lock_guard<std::mutex> l(pool_mutex);
+            if (!pool.empty()) {
+                conv = std::move(pool.back());
+                pool.pop_back();
+            }
+        }
+
+        if (!conv) conv.reset(new convolver(kernel));
+
+        t.data = (*conv)(t.data);
+
+        std::lock_guard<std::mutex> l(pool_mutex);
+        pool.push_back(std::move(conv));
+    });
 
     return true;
 }
@@ -102,17 +127,19 @@ bool multiply(int argc, char* argv[]) {
         return true;
     }
 
-    vec2d map = fits::read(argv[1]);
     double value;
     if (!from_string(argv[2], value)) {
         error("could not parse multiply value '", argv[2], "'");
         return false;
     }
 
-    map *= value;
+    fits::tile_reader<double> map(argv[1]);
 
     file::mkdir(file::get_directory(argv[3]));
-    fits::write(argv[3], map);
+    fits::tile_writer<double> out(argv[3], map.dims());
+    fits::for_each_tile(map, out, [&](fits::tile<double>& t) {
+        t.data *= value;
+    });
 
     return true;
 }
@@ -3,6 +3,32 @@
 
 void print_help();
 
+// Elimination order of the sources for the sparse normal matrix (nested dissection). Sources
+// are split recursively in two spatial groups whose PSFs do not overlap, and the sources that
+// separate these groups are eliminated last. This limits the fill-in of the factorization.
+void nested_dissection(const vec1i& ix, const vec1i& iy, int_t hsize, const vec1u& ids,
+    vec1u& order) {
+
+    if (ids.size() <= 32) {
+        append(order, ids);
+        return;
+    }
+
+    vec1i tx = ix[ids], ty = iy[ids];
+    const vec1i& c = (max(tx) - min(tx) > max(ty) - min(ty) ? tx : ty);
+    int_t m = median(c);
+
+    vec1u ids_sep = where(abs(c - m) <= hsize);
+    if (ids_sep.size() == ids.size()) {
+        append(order, ids);
+        return;
+    }
+
+    nested_dissection(ix, iy, hsize, ids[where(c < m - hsize)], order);
+    nested_dissection(ix, iy, hsize, ids[where(c > m + hsize)], order);
+    append(order, ids[ids_sep]);
+}
+
 int phypp_main(int argc, char* argv[]) {
     std::string cat_file; // Name of the catalog from which to take the sources
     std::string map_file; // Name of the file listing the observed maps
@@ -27,7 +53,7 @@ int phypp_main(int argc, char* argv[]) {
     double beam_size = dnan;
     // Save the covariance matrix
     bool save_covariance = false;
-    // Do not compute the whole covariance matrix, just invert some sub-matrices
+    // Obsolete: the errors are now always computed exactly from the sparse normal matrix
     bool cell_approx = false;
     // Use a flux prior
     bool flux_prior = false;
@@ -63,9 +89,7 @@ int phypp_main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (cell_approx && save_covariance) {
-        cell_approx = false;
-    }
+    parallel::set_threads(nthread);
 
     if (cat_file.empty()) {
         error("missing input catalog name (cat=...)");
@@ -576,18 +600,20 @@ int phypp_main(int argc, char* argv[]) {
 
         uint_t nelem = nobs + (free_bg ? 1 : 0);
 
-        vec2d alpha(nelem, nelem);
+        matrix::sparse_symmetric alpha(nelem);
         vec1d beta(nelem);
 
         // Alpha is symmetric, so only compute one side
         // This matrix measures the overlap between the different fit components
         // Beta measures the product of each component with the actual data
+        // Each source only overlaps with its neighbors, so alpha is sparse
 
         // Source terms
         vec1f local_error(nsrc);
 
-        auto pg = progress_start(nobs*(nobs-1)/2);
-        for (uint_t i : range(nobs)) {
+        // Weighted PSF of each source, computed once
+        std::vector<vec2d> wpsf(nobs);
+        parallel::run(nobs, [&](uint_t i) {
             // TODO: for groups, build a combined PSF instead of just using a PSF at the center
 
             // Get the weighted PSF of source 'i'
@@ -609,46 +635,64 @@ int phypp_main(int argc, char* argv[]) {
 
             // Alpha terms
             // The source with itself: alpha(i,i) = (x[i]/err)^2
-            alpha(i,i) = total(sqr(tpsf));
+            alpha.add(i, i, total(sqr(tpsf)));
 
             if (flux_prior) {
                 // If requested, add a prior on the flux of each source
                 beta[i] += fprior[i]/sqr(fprior_err[i]);
-                alpha(i,i) += 1.0/sqr(fprior_err[i]);
+                alpha.add(i, i, 1.0/sqr(fprior_err[i]));
             }
 
             if (free_bg) {
                 // Source x Background: alpha(i,bg) = x[i]/err^2
-                alpha(i,nobs) = alpha(nobs,i) = total(tpsf/terr);
+                alpha.add(i, nobs, total(tpsf/terr));
             }
 
-            // Source x Source: alpha(j,i) = x[i]*x[j]/err^2
-            for (uint_t j : range(i+1, nobs)) {
-                int_t idx = ix[i]-ix[j], idy = iy[i]-iy[j];
-
-                if (abs(idx) <= 2*hsize && abs(idy) <= 2*hsize) {
-                    vec1u pidi, pidj;
-                    subregion(psf, {idy, idx, idy+2*hsize, idx+2*hsize}, pidj, pidi);
-                    if (!pidi.empty()) {
-                        // Get the weighted PSF of source 'j'
-                        vec2d tpsf2_j; {
-                            tpsf2_j = translate(psf, dy[j], dx[j]);
-                            vec1u idi_j, idp_j;
-                            subregion(snr, {iy[j]-hsize, ix[j]-hsize, iy[j]+hsize, ix[j]+hsize},
-                                idi_j, idp_j);
-
-                            vec1u idpc_j = complement(tpsf2_j, idp_j);
-                            tpsf2_j[idp_j] /= err[idi_j];
-                            tpsf2_j[idpc_j] = 0;
-                        }
+            wpsf[i] = std::move(tpsf2);
+        });
+
+        // Find overlapping sources on a grid of cells as large as the PSF
+        const int_t csize = 2*hsize+1;
+        int_t cx0 = min(ix), cy0 = min(iy);
+        vec1u cx = (ix - cx0)/csize, cy = (iy - cy0)/csize;
+        uint_t ncx = max(cx)+1, ncy = max(cy)+1;
+        vec1u cid = cx + ncx*cy;
+        vec1u cell_src = sort(cid);
+        vec1u cell_start(ncx*ncy+1); {
+            for (uint_t i : range(nobs)) {
+                ++cell_start[cid[i]+1];
+            }
 
-                        alpha(j,i) = alpha(i,j) = total(tpsf2_j[pidj]*tpsf2[pidi]);
+            for (uint_t c : range(ncx*ncy)) {
+                cell_start[c+1] += cell_start[c];
+            }
+        }
+
+        // Source x Source: alpha(j,i) = x[i]*x[j]/err^2
+        auto pg = progress_start(nobs);
+        parallel::run(nobs, [&](uint_t i) {
+            for (uint_t tcy = (cy[i] == 0 ? 0 : cy[i]-1); tcy <= std::min(cy[i]+1, ncy-1); ++tcy)
+            for (uint_t tcx = (cx[i] == 0 ? 0 : cx[i]-1); tcx <= std::min(cx[i]+1, ncx-1); ++tcx) {
+                uint_t c = tcx + ncx*tcy;
+                for (uint_t k : range(cell_start[c], cell_start[c+1])) {
+                    uint_t j = cell_src[k];
+                    if (j <= i) continue;
+
+                    int_t idx = ix[i]-ix[j], idy = iy[i]-iy[j];
+                    if (abs(idx) <= 2*hsize && abs(idy) <= 2*hsize) {
+                        vec1u pidi, pidj;
+                        subregion(psf, {idy, idx, idy+2*hsize, idx+2*hsize}, pidj, pidi);
+                        if (!pidi.empty()) {
+                            alpha.add(i, j, total(wpsf[j][pidj]*wpsf[i][pidi]));
+                        }
                     }
                 }
-
-                if (verbose) progress(pg, 1123);
             }
-        }
+
+            if (verbose && nthread <= 1) progress(pg, 131);
+        });
+
+        wpsf.clear();
 
         // Pure Background terms
         if (free_bg) {
@@ -656,7 +700,7 @@ int phypp_main(int argc, char* argv[]) {
             beta[nobs] = total(snr/err);
 
             // Background x Background: alpha(bg,bg) = 1/err^2
-            alpha(nobs, nobs) = total(1.0/sqr(err));
+            alpha.add(nobs, nobs, total(1.0/sqr(err)));
         }
 
         // Solve the system
@@ -692,98 +736,32 @@ int phypp_main(int argc, char* argv[]) {
             ));
         };
 
-        vec2d covar;
-        if (has_groups) {
-            covar = alpha;
-            matrix::symmetrize(covar);
-        }
-
-        if (cell_approx) {
-            if (verbose) {
-                print("compute approximated covariance errors...");
-            }
-
-            // Estimate the error for each source
-            vec1u idn; idn.reserve(nobs);
-            best_fit_err.resize(nelem);
-            for (uint i : range(nobs)) {
-                idn.clear();
-
-                uint_t ii = npos;
-                for (uint_t j : range(nobs)) {
-                    if (alpha(i,j) > 1e-3*sqrt(alpha(i,i)*alpha(j,j))) {
-                        if (j == i) ii = idn.size();
-                        idn.push_back(j);
-                    }
-                }
-
-                uint_t neib = idn.size();
-                uint_t ntelem = neib + (free_bg ? 1 : 0);
-                vec2d talpha(ntelem, ntelem);
-                for (uint_t ti : range(neib)) {
-                    if (free_bg) {
-                        talpha(ti,neib) = talpha(neib,ti) = alpha(nobs,idn[ti]);
-                    }
-
-                    for (uint_t tj : range(ti, neib)) {
-                        talpha(tj,ti) = alpha(idn[tj],idn[ti]);
-                        if (tj != ti) {
-                            talpha(ti,tj) = talpha(tj,ti);
-                        }
-                    }
-                }
-
-                if (free_bg) {
-                    talpha(neib,neib) += alpha(nobs,nobs);
-                }
-
-                if (!matrix::inplace_invert_symmetric(talpha)) {
-                    error("could not invert sub-matrix for source ", idin[i]);
-                    note("there are probably some prior source positions which are too "
-                        "close and cannot be deblended");
-                    return 1;
-                } else {
-                    double terr = sqrt(talpha(ii,ii));
-                    best_fit_err[i] = terr;
-                    flux_err[idin[i]] = terr;
-                }
-            }
-
-            // Now solve the system to get the fluxes
-            if (verbose) {
-                print("solve system...");
-            }
-
-            if (!matrix::inplace_solve_symmetric(alpha, beta)) {
-                error("could not solve the linear problem");
-                note("there are probably some prior source positions which are too close and "
-                    "cannot be deblended");
-                return 1;
-            }
-
-            // The best fit values are now stored in beta
-            best_fit = beta;
-
+        auto save_fit_errors = [&]() {
             // Extract the background value if needed
             if (free_bg) {
                 background = best_fit[nobs]/map.fconv;
+                background_err = best_fit_err[nobs]/map.fconv;
             } else {
                 background = fixed_bg;
+                background_err = 0.0;
             }
 
-            background_err = 0.0;
-
-            // Extract the fluxes
+            // Extract the fluxes and associated errors
             flux[idin] = best_fit[_-(nobs-1)];
+            flux_err[idin] = best_fit_err[_-(nobs-1)];
 
             // Save to disk
             save_fit_basics();
-        } else {
+        };
+
+        if (save_covariance) {
             if (verbose) {
                 print("invert matrix...");
             }
 
-            if (!matrix::inplace_invert_symmetric(alpha)) {
+            // The full covariance matrix is needed, so invert the whole matrix
+            vec2d covar = alpha.dense();
+            if (!matrix::inplace_invert_symmetric(covar)) {
                 error("could not invert covariance matrix, it is singular");
                 note("there are probably some prior source positions which are too close and "
                     "cannot be deblended");
@@ -791,41 +769,55 @@ int phypp_main(int argc, char* argv[]) {
             }
 
             // Compute covariance matrix to get the errors
-            matrix::symmetrize(alpha);
+            matrix::symmetrize(covar);
 
             // Multiply the inverted alpha with beta to get the best fit values
-            best_fit = matrix::product(alpha, beta);
-            best_fit_err = sqrt(matrix::diagonal(alpha));
+            best_fit = matrix::product(covar, beta);
+            best_fit_err = sqrt(matrix::diagonal(covar));
 
-            // Extract the background value if needed
-            if (free_bg) {
-                background = best_fit[nobs]/map.fconv;
-                background_err = best_fit_err[nobs]/map.fconv;
-            } else {
-                background = fixed_bg;
-                background_err = 0.0;
-            }
+            save_fit_errors();
 
-            // Extract the fluxes and associated errors
-            flux[idin] = best_fit[_-(nobs-1)];
-            flux_err[idin] = best_fit_err[_-(nobs-1)];
+            vec2d covariance(nsrc, nsrc);
+            covariance(idin,idin) = covar(_-(nobs-1), _-(nobs-1));
 
-            // Save to disk
-            save_fit_basics();
+            if (make_groups && !id_new.empty()) {
+                // Ungroup grouped sources
+                covariance = covariance(id_new,id_new);
 
-            if (save_covariance) {
-                vec2d covariance(nsrc, nsrc);
-                covariance(idin,idin) = alpha(_-(nobs-1), _-(nobs-1));
+                // TODO: what to do of grouped sources?
+            }
 
-                if (make_groups && !id_new.empty()) {
-                    // Ungroup grouped sources
-                    covariance = covariance(id_new,id_new);
+            fits::update_table(out_file, ftable(covariance));
+        } else {
+            if (verbose) {
+                print("factorize matrix (", alpha.nonzeros(), " non-zero elements)...");
+            }
 
-                    // TODO: what to do of grouped sources?
-                }
+            // Eliminate the sources by nested dissection, and the background last
+            vec1u order;
+            nested_dissection(ix, iy, hsize, uindgen(nobs), order);
+            if (free_bg) {
+                order.push_back(nobs);
+            }
 
-                fits::update_table(out_file, ftable(covariance));
+            matrix::sparse_cholesky chol;
+            if (!chol.factorize(alpha, order)) {
+                error("could not factorize covariance matrix, it is singular");
+                note("there are probably some prior source positions which are too close and "
+                    "cannot be deblended");
+                return 1;
             }
+
+            // Solve the system to get the best fit values, and get the errors from the
+            // diagonal of the inverse
+            if (verbose) {
+                print("solve system...");
+            }
+
+            best_fit = chol.solve(beta);
+            best_fit_err = sqrt(chol.inverse_diagonal());
+
+            save_fit_errors();
         }
 
         if (has_groups) {
@@ -845,7 +837,7 @@ int phypp_main(int argc, char* argv[]) {
 
                     double bcov = group_cov_threshold;
                     for (uint_t j : range(nobs)) {
-                        double tcov = covar(i,j)/sqrt(covar(i,i)*covar(j,j));
+                        double tcov = alpha(i,j)/sqrt(alpha(i,i)*alpha(j,j));
                         if (tcov > bcov && is_grouped[j]) {
                             // We found one, but keep on going to make sure we pick the group
                             // that has the highest covariance
@@ -869,7 +861,7 @@ int phypp_main(int argc, char* argv[]) {
                     // Notify sources of their new group
                     vec1u nidg;
                     for (uint_t j : range(nobs)) {
-                        if (covar(i,j)/sqrt(covar(i,i)*covar(j,j)) > group_cov_threshold && !is_grouped[j]) {
+                        if (alpha(i,j)/sqrt(alpha(i,i)*alpha(j,j)) > group_cov_threshold && !is_grouped[j]) {
                             if (group_fit_id[j] != npos) {
                                 vec1u idg = where(old_cat.group_fit_id == group_fit_id[j]);
                                 old_cat.group_aper_id[idg] = gid;
@@ -1160,7 +1152,8 @@ void print_help() {
     bullet("fixed_bg", "[float] fix the background to a given value (default: not fixed)");
     bullet("save_covariance", "[flag] also save the full covariance matrix in the output "
         "catalog (default: no)");
-    bullet("cell_approx", "[flag] use a fitting approximation for non blended sources "
-        "to make the fit significantly faster (default: no)");
+    bullet("cell_approx", "[flag] obsolete: the uncertainties are now always computed from "
+        "the sparse normal matrix, which is fast and exact (default: no)");
+    bullet("threads", "[uint] number of threads used to build the normal matrix (default: 1)");
     print("");
 }
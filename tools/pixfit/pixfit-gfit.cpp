@@ -506,7 +506,7 @@ int phypp_main(int argc, char* argv[]) {
         vec2d alpha(np,np);
         vec1d beta(np);
 
-        auto tmp = f.measures/f.errors;
+        vec1f tmp = f.measures/f.errors;
         for (uint_t i : range(tnfit))
         for (uint_t j : range(i, tnfit)) {
             for (uint_t b : range(nband)) {
@@ -42,6 +42,12 @@ void print_help() {
     bullet("sbstrap", "[unsigned integer, optional] size of a boostraping realisation");
     bullet("randomize", "[flag] when stacking from a catalog, randomize the positions inside the "
         "area that is covered by the selected sources");
+    bullet("thread", "[unsigned integer] number of concurrent threads used to extract the "
+        "cutouts (default: 1)");
+    bullet("stream", "[flag] when stacking from a catalog, stack the cutouts as they are "
+        "extracted instead of keeping them all in memory. Median stacking is then approximate, "
+        "and each bootstrap realisation draws every source a Poisson-distributed number of "
+        "times, with a mean of sbstrap divided by the number of sources in the catalog");
     bullet("verbose", "[flag] print some information about the stacking process");
     print("");
 
@@ -107,12 +113,14 @@ int phypp_main(int argc, char* argv[]) {
     uint_t nbstrap = 200;
     uint_t sbstrap = 0;
     uint_t tseed = 42;
+    uint_t thread = 1;
+    bool stream = false;
     vec1s cids;
 
     read_args(argc, argv, arg_list(
         out, cat, img, wht, err, pos, hsize, median, mean, bstrap, nbstrap, sbstrap,
         randomize, name(tseed, "seed"), name(tcube, "cube"), subpixel, verbose, keepnan,
-        name(cids, "ids")
+        name(cids, "ids"), thread, stream
     ));
 
     auto seed = make_seed(tseed);
@@ -233,8 +241,64 @@ int phypp_main(int argc, char* argv[]) {
     params.keep_nan = keepnan;
     params.verbose = verbose;
     params.save_offsets = subpixel;
+    params.thread = thread;
 
-    if ((wht.empty() && err.empty()) || median) {
+    if (stream) {
+        if (cat.empty()) {
+            error("'stream' can only be used when stacking from a catalog");
+            return 1;
+        }
+
+        if (tcube) {
+            error("'stream' cannot be used to output the cube");
+            return 1;
+        }
+
+        if (img.size() != 1) {
+            error("catalog stacking needs a single image");
+            return 1;
+        }
+
+        const bool weighted = !wht.empty() || !err.empty();
+        if (median && weighted) {
+            error("cannot use weights when doing median stacking");
+            return 1;
+        }
+
+        double fraction = (sbstrap == 0 ? 0.5 : sbstrap/double(fcat.ra.size()));
+        qstack_accumulator acc(hsize, median ? vec1d{0.5} : vec1d());
+        qstack_bootstrap_accumulator<> bacc(hsize, bstrap ? nbstrap : 0, fraction, seed,
+            median ? vec1d{0.5} : vec1d());
+
+        auto accumulate = [&](const qstack_cutout<float>& c) {
+            vec2f flux = (subpixel ? vec2f(translate(c.flux, c.dy, c.dx)) : c.flux);
+            if (!weighted) {
+                acc.add(flux);
+            } else if (!wht.empty()) {
+                acc.add(flux, c.weight);
+            } else {
+                acc.add(flux, invsqr(c.weight));
+            }
+
+            // Bootstrap realisations are not weighted, as in the non-streaming case.
+            // The draws are seeded by source, so they do not depend on the thread scheduling.
+            bacc.add(c.id, flux);
+        };
+
+        if (!weighted) {
+            qstack_stream<float>(fcat.ra, fcat.dec, img[0], hsize, accumulate, params);
+        } else {
+            qstack_stream<float>(fcat.ra, fcat.dec, img[0], wht.empty() ? err[0] : wht[0],
+                hsize, accumulate, params);
+        }
+
+        if (verbose) print("stacked ", acc.count(), "/", fcat.ra.size(), " sources");
+
+        stack = (median ? acc.median() : acc.mean());
+        if (bstrap) {
+            bs = (median ? bacc.median() : bacc.mean());
+        }
+    } else if ((wht.empty() && err.empty()) || median) {
         if (cat.empty()) {
             fits::read(img[0], cube);
 
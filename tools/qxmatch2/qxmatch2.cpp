@@ -42,6 +42,10 @@ void print_help() {
         "catalogs (default: \"\")");
     bullet("thread", "[number]: set this value to the number of concurrent threads you want to run "
         "(default: 1).");
+    bullet("index", "[string]: name of a file in which to store the index of the second catalog. "
+        "If this file already exists, the index is read from it instead of being built again, "
+        "which saves time when the same catalog is used for many cross matches. The file "
+        "must be deleted if the catalog changes.");
     print("");
 
     paragraph("Copyright (c) 2013 C. Schreiber (corentin.schreiber@cea.fr)");
@@ -67,6 +71,7 @@ void print_help() {
 int phypp_main(int argc, char* argv[]) {
     vec1s cats;
     std::string output;
+    std::string index;
     vec1s pos;
 
     uint_t nth = 1;
@@ -75,7 +80,7 @@ int phypp_main(int argc, char* argv[]) {
     bool   quiet = false;
     bool   brute = false;
 
-    read_args(argc, argv, arg_list(cats, output, nth, thread, verbose, quiet, pos, brute));
+    read_args(argc, argv, arg_list(cats, output, nth, thread, verbose, quiet, pos, brute, index));
 
     if (quiet) verbose = false;
 
@@ -115,7 +120,23 @@ int phypp_main(int argc, char* argv[]) {
 
         qxmatch_params p; p.nth = nth; p.thread = thread; p.verbose = verbose;
         p.brute_force = brute;
-        res = qxmatch(cat1, cat2, p);
+        if (!index.empty() && !brute) {
+            sky_index idx;
+            if (file::exists(index)) {
+                idx = sky_index_restore(index);
+                if (idx.size() != cat2.ra.size()) {
+                    error("qxmatch: the index in '", index, "' does not match the second catalog");
+                    return 1;
+                }
+            } else {
+                idx = sky_index(cat2.ra, cat2.dec);
+                sky_index_save(index, idx);
+            }
+
+            res = qxmatch(cat1.ra, cat1.dec, idx, p);
+        } else {
+            res = qxmatch(cat1, cat2, p);
+        }
     } else if (cats.size() == 1) {
         if (pos.empty()) pos = {""};
         if (!pos[0].empty()) pos += ".";